@@ -24,15 +24,25 @@ import org.zeromq.ZMQContext;
 import org.zeromq.ZMQException;
 import org.zeromq.ZMQPoller;
 import org.zeromq.ZMQSocket;
+import org.zeromq.ZMQStats;
 import org.zeromq.ZMQDevice;
+import org.zeromq.remoting.ZMQBinaryCodec;
 import org.zeromq.remoting.ZMQConnection;
+import org.zeromq.remoting.ZMQRemotingCodec;
+import org.zeromq.remoting.ZMQRemotingServer;
 import org.zeromq.remoting.ZMQSocketProtocol;
+import org.zeromq.remoting.ZMQTextCodec;
 import org.zeromq.ZContext;
 import org.zeromq.ZSocket;
 import org.zeromq.ZFrame;
 import org.zeromq.ZMsg;
 import org.zeromq.ZLoop;
+import org.zeromq.ZOutbox;
+import org.zeromq.ZMailbox;
+import org.zeromq.ZJournal;
+import org.zeromq.ZSubscriptionCache;
 import org.zeromq.ZThread;
+import org.zeromq.ZThreadPool;
 
 #if php
 import org.zeromq.externals.phpzmq.ZMQException;
@@ -39,6 +39,8 @@ import org.zeromq.ZMQSocket;
  * 2. Automatically configures sockets with a ZMQ_LINGER timeout you can define, and which defaults to zero. The default behaviour of ZContext is therefore like 0MQ/2.0, immediate termination with loss of any pending messages. You can set any linger timeout you like by calling the zctx_set_linger() method.<br />
  * 3. Moves the iothreads configuration to a separate method, so that default usage is 1 I/O thread. Lets you configure this value.<br />
  * 4. Sets up signal (SIGINT and SIGTERM) handling so that blocking calls such as zmq_recv() and zmq_poll() will return when the user presses Ctrl-C.<br />
+ * 5. Applies context tuning (maximum sockets, I/O thread scheduling and CPU pinning) when the context is created,
+ * and maps socket types to I/O threads with ZMQ_AFFINITY as sockets are created.<br />
  * 
  * </p>
  */
@@ -60,6 +62,21 @@ class ZContext
     /** Indicates if context object owned by main thread */
     public var main(default, default):Bool;
     
+    /** Maximum number of sockets, or -1 for the 0MQ default. Set before the first socket is created */
+    public var maxSockets(default, default):Int;
+    
+    /** Scheduling priority of the I/O threads, or -1 for the OS default. Set before the first socket is created */
+    public var threadPriority(default, default):Int;
+    
+    /** Scheduling policy of the I/O threads, e.g. SCHED_FIFO, or -1 for the OS default. Set before the first socket is created */
+    public var threadSchedPolicy(default, default):Int;
+    
+    /** CPUs the I/O threads are pinned to, or null for no pinning. Set before the first socket is created */
+    public var ioThreadCpus(default, default):Array<Int>;
+    
+    /** ZMQ_AFFINITY bitmask of I/O threads, keyed by socket type enum index */
+    private var affinities:IntHash<Int>;
+    
     /**
      * Constructor
      */
@@ -70,6 +87,11 @@ class ZContext
         ioThreads = 1;
         linger = 0;
         main = true;
+        maxSockets = -1;
+        threadPriority = -1;
+        threadSchedPolicy = -1;
+        ioThreadCpus = null;
+        affinities = new IntHash<Int>();
         
         // Set up signal handling
 #if !php        
@@ -99,22 +121,61 @@ class ZContext
      * Creates a new managed socket within this ZContext context.
        * Use this to get automatic management of the socket at shutdown
      * @param	type
+     * @param	?affinity   ZMQ_AFFINITY bitmask of the I/O threads to handle the socket's connections,
+     *                      overriding any set for the socket type with setSocketAffinity
      * @return
      */
-    public function createSocket(type:SocketType):ZMQSocket {
+    public function createSocket(type:SocketType, ?affinity:Null<Int>):ZMQSocket {
         if (context == null) {
             context = new ZMQContext(ioThreads);
+            configure();
         }
         if (!context.closed) {
             // Create and register socket
             var socket:ZMQSocket = context.socket(type);
             sockets.add(socket);
+            if (affinity == null)
+                affinity = affinities.get(Type.enumIndex(type));
+            if (affinity != null) {
+#if php
+                socket.setsockopt(ZMQ_AFFINITY, affinity);
+#else
+                socket.setsockopt(ZMQ_AFFINITY, { hi:0, lo:affinity } );
+#end
+            }
             return socket;
         } else {
             throw new ZMQException(ENOTSUP);
         }
     }
     
+    /**
+     * Sets the I/O threads that handle connections of sockets of a type, created after this call.
+     * Used with ioThreads and ioThreadCpus, lets traffic for a socket type be kept on I/O threads
+     * pinned near the haXe threads that consume it.
+     * @param	type
+     * @param	ioThreads   ZMQ_AFFINITY bitmask: bit n set allows I/O thread n; 0 allows any
+     */
+    public function setSocketAffinity(type:SocketType, ioThreads:Int) {
+        affinities.set(Type.enumIndex(type), ioThreads);
+    }
+    
+    /**
+     * Applies context tuning options to a newly created context
+     */
+    private function configure() {
+        if (maxSockets >= 0)
+            context.setOption(ZMQ_MAX_SOCKETS, maxSockets);
+        if (threadSchedPolicy >= 0)
+            context.setOption(ZMQ_THREAD_SCHED_POLICY, threadSchedPolicy);
+        if (threadPriority >= 0)
+            context.setOption(ZMQ_THREAD_PRIORITY, threadPriority);
+        if (ioThreadCpus != null) {
+            for (cpu in ioThreadCpus)
+                context.setOption(ZMQ_THREAD_AFFINITY_CPU_ADD, cpu);
+        }
+    }
+    
     /**
      * Destroys managed socket within this context.
      * @param	s   Socket to remove
@@ -142,6 +203,7 @@ class ZContext
         
         var shadow:ZContext = new ZContext();
         shadow.context = ctx.context;
+        shadow.affinities = ctx.affinities;
         return shadow;
     }
     
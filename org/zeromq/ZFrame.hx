@@ -21,6 +21,9 @@ package org.zeromq;
 
 import haxe.io.Bytes;
 import neko.Lib;
+#if (neko || cpp)
+import neko.vm.Tls;
+#end
 import org.zeromq.ZMQ;
 
 
@@ -33,6 +36,20 @@ import org.zeromq.ZMQ;
  * the same frame many times. Frames are binary, and this class has no special support for text data.
  * </p>
  * <p>
+ * On neko and cpp, a received frame keeps its content in the underlying native 0MQ message.
+ * The content is only copied into a haXe Bytes object when the data property is first read,
+ * so frames that are received and then sent on unread (e.g. by a forwarding proxy) are never copied.
+ * </p>
+ * <p>
+ * Frames made by duplicate() share their content with the original rather than copying it, so
+ * frame data should be treated as read-only: use reset() to give a frame new content.
+ * </p>
+ * <p>
+ * Destroyed frames can be kept for reuse by newFrame() and the receive methods, by setting a
+ * pool size with setPoolSize(). Each thread has its own pool. Once pooling is enabled, a frame
+ * must not be used after it is destroyed (or sent).
+ * </p>
+ * <p>
  * Based on <a href="http://github.com/zeromq/czmq/blob/master/src/zframe.c">zframe.c</a> in czmq
  * </p>
  */
@@ -45,8 +62,26 @@ class ZFrame
     /** More flag, from last frame read */
     public var more(default, null):Bool;
     
-    /** Message blob for frame */
-    public var data(default,null):Bytes;
+    /** Message blob for frame. Reading this copies any native message content into a Bytes object */
+    public var data(getData,null):Bytes;
+    
+    /** Frame content, once held in a haXe Bytes object */
+    private var _data:Bytes;
+    
+    /** Opaque native 0MQ message handle holding the frame content, if not yet copied into _data */
+    private var _msgHandle:Dynamic;
+    
+    /** True while the frame is held in the pool */
+    private var pooled:Bool;
+    
+    /** Most destroyed frames kept for reuse by each thread, or 0 if pooling is disabled (the default) */
+    public static var poolSize(default, null):Int = 0;
+    
+#if (neko || cpp)
+    private static var pool:Tls<Array<ZFrame>> = new Tls<Array<ZFrame>>();
+#else
+    private static var pool:Array<ZFrame>;
+#end
     
     /**
      * Constructor.
@@ -56,52 +91,88 @@ class ZFrame
     public function new(?data:Bytes) 
     {
         if (data != null) {
-            this.data = Bytes.alloc(data.length);
-            this.data.blit(0, data, 0, data.length);
+            _data = Bytes.alloc(data.length);
+            _data.blit(0, data, 0, data.length);
         } 
     }
     
     /**
-     * Destructor
+     * Destructor.
+     * Returns the frame to this thread's pool, if pooling is enabled and the pool is not full.
      */
     public function destroy() {
-        if (hasData()) {
-            data = null;
+        clear();
+        if (poolSize > 0 && !pooled) {
+            var p = threadPool();
+            if (p.length < poolSize) {
+                pooled = true;
+                p.push(this);
+            }
         }
     }
     
-    private function recv(socket:ZMQSocket):Bytes {
-        if (socket == null) {
-            throw new ZMQException(EINVAL);
+    private function clear() {
+        closeHandle();
+        _data = null;
+        more = false;
+    }
+    
+    private function getData():Bytes {
+#if (neko || cpp)
+        if (_data == null && _msgHandle != null) {
+            // Copy native message content into haXe memory, then release the native message
+            _data = Bytes.ofData(_hx_zmq_msg_data(_msgHandle));
+            closeHandle();
         }
-        try {
-            data = socket.recvMsg();  
-        } catch (e:ZMQException) {
-            if (ZMQ.isInterrupted()) {
-                destroy();
-                return null;
-            }
-            Lib.rethrow(e);  // Propagate other exception
+#end
+        return _data;
+    }
+    
+    private function closeHandle() {
+#if (neko || cpp)
+        if (_msgHandle != null) {
+            _hx_zmq_msg_close(_msgHandle);
+            _msgHandle = null;
         }
-        more = socket.hasReceiveMore();
-        return data;
+#end
     }
     
-    private function recvNoWait(socket:ZMQSocket):Bytes {
+    /**
+     * Receives frame content from socket.
+     * Returns true if a frame was received, false if interrupted or (with DONTWAIT) no frame was waiting
+     */
+    private function recvWithFlags(socket:ZMQSocket, flags:SendReceiveFlagType):Bool {
         if (socket == null) {
             throw new ZMQException(EINVAL);
         }
+        clear();
         try {
-            data = socket.recvMsg(DONTWAIT);  
+#if (neko || cpp)
+            if (socket._socketHandle == null || socket.closed)
+                throw new ZMQException(ENOTSUP);
+            try {
+                _msgHandle = _hx_zmq_msg_recv(socket._socketHandle, ZMQ.sendReceiveFlagNo(flags));
+            } catch (e:Int) {
+                throw new ZMQException(ZMQ.errNoToErrorType(e));
+            }
+            if (_msgHandle == null) {
+                more = false;
+                return false;
+            }
+            more = _hx_zmq_msg_more(_msgHandle);
+            return true;
+#else
+            _data = socket.recvMsg(flags);  
+#end
         } catch (e:ZMQException) {
             if (ZMQ.isInterrupted()) {
-                destroy();
-                return null;
+                clear();
+                return false;
             }
             Lib.rethrow(e);  // Propagate other exception
         }
         more = socket.hasReceiveMore();
-        return data;
+        return hasData();
     }
     
     /**
@@ -113,7 +184,25 @@ class ZFrame
         if (socket == null || !hasData()) {
             throw new ZMQException(EINVAL);
         }
-        socket.sendMsg(data, { if ((flags & ZFRAME_MORE)>0) SNDMORE else null; } );
+        var sendFlags = { if ((flags & ZFRAME_MORE)>0) SNDMORE else null; };
+#if (neko || cpp)
+        if (_msgHandle != null) {
+            // Hand native message straight back to 0MQ, without copying its content
+            if (socket._socketHandle == null || socket.closed)
+                throw new ZMQException(ENOTSUP);
+            var h:Dynamic = { if ((flags & ZFRAME_REUSE) == 0) _msgHandle else _hx_zmq_msg_copy(_msgHandle); };
+            try {
+                _hx_zmq_msg_send(socket._socketHandle, h, ZMQ.sendReceiveFlagNo(sendFlags));
+            } catch (e:Int) {
+                throw new ZMQException(ZMQ.errNoToErrorType(e));
+            }
+            if ((flags & ZFRAME_REUSE) == 0) {
+                destroy();
+            }
+            return;
+        }
+#end
+        socket.sendMsg(_data, sendFlags);
        
         if ((flags & ZFRAME_REUSE) == 0) {
             destroy();
@@ -124,18 +213,71 @@ class ZFrame
      * Returns byte size of frame, if set, else 0
      * @return
      */
-    public inline function size():Int {
+    public function size():Int {
+#if (neko || cpp)
+        if (_data == null && _msgHandle != null)
+            return _hx_zmq_msg_size(_msgHandle);
+#end
         return {
-            if (hasData()) data.length else 0;
+            if (_data != null) _data.length else 0;
+        }
+    }
+    
+    /**
+     * Returns the byte at position pos in the frame, without copying native frame content
+     * @param	pos
+     * @return
+     */
+    public function getByte(pos:Int):Int {
+#if (neko || cpp)
+        if (_data == null && _msgHandle != null) {
+            try {
+                return _hx_zmq_msg_get(_msgHandle, pos);
+            } catch (e:Int) {
+                throw new ZMQException(ZMQ.errNoToErrorType(e));
+            }
         }
+#end
+        if (_data == null || pos < 0 || pos >= _data.length)
+            throw new ZMQException(EINVAL);
+        return _data.get(pos);
     }
     
     /**
-     * Creates a new frame that duplicates an existing frame
+     * Returns a copy of len bytes from the frame, starting at pos.
+     * Only the requested bytes are copied out of native frame content.
+     * @param	pos
+     * @param	len
+     * @return
+     */
+    public function sub(pos:Int, len:Int):Bytes {
+#if (neko || cpp)
+        if (_data == null && _msgHandle != null) {
+            try {
+                return Bytes.ofData(_hx_zmq_msg_slice(_msgHandle, pos, len));
+            } catch (e:Int) {
+                throw new ZMQException(ZMQ.errNoToErrorType(e));
+            }
+        }
+#end
+        if (_data == null)
+            throw new ZMQException(EINVAL);
+        return _data.sub(pos, len);
+    }
+    
+    /**
+     * Creates a new frame that duplicates an existing frame.
+     * The content is shared, not copied: native content is reference-counted by 0MQ.
      * @return  A duplicates ZFrame object
      */
     public function duplicate():ZFrame {
-        return new ZFrame(this.data);
+        var f = newFrame(_data);
+#if (neko || cpp)
+        if (_data == null && _msgHandle != null)
+            f._msgHandle = _hx_zmq_msg_copy(_msgHandle);
+#end
+        f.more = more;
+        return f;
     }
     
     /**
@@ -147,7 +289,7 @@ class ZFrame
         if (other == null) return false;
         
         if (size() == other.size()) {
-            if (hasData() && other.data != null) {
+            if (hasData() && other.hasData()) {
                 return data.compare(other.data) == 0;    
             }
             
@@ -163,7 +305,8 @@ class ZFrame
         if (data == null) {
             throw new ZMQException(EINVAL);          
         }
-        this.data = data;
+        closeHandle();
+        _data = data;
     }
     
     /**
@@ -173,6 +316,7 @@ class ZFrame
     public function strhex():String {
         
         var hex_char:String = "0123456789ABCDEF";
+        var data = getData();
         
         var hexStr:StringBuf = new StringBuf();
         for (nbr in 0 ... data.length) {
@@ -198,7 +342,7 @@ class ZFrame
      * @return
      */
     public function hasData():Bool {
-        var ret:Bool = data != null;
+        var ret:Bool = _data != null || _msgHandle != null;
         return ret;
     }
     
@@ -209,6 +353,7 @@ class ZFrame
     public function toString():String {
         if (!hasData()) return null;
 		// Dump message as text or binary
+		var data = getData();
 		var isText = true;
 		for (i in 0...data.length) {
 			if (data.get(i) < 32 || data.get(i) > 127) isText = false; 
@@ -228,13 +373,11 @@ class ZFrame
      * @return  received frame, else null
      */
     public static function recvFrame(socket:ZMQSocket):ZFrame {
-        var f:ZFrame = new ZFrame();
-        return {
-			if (f.recv(socket) != null) 
-				f;
-			else
-				null;
-		}
+        var f:ZFrame = newFrame();
+        if (f.recvWithFlags(socket, null))
+            return f;
+        f.destroy();
+        return null;
     }
     
     /**
@@ -244,11 +387,95 @@ class ZFrame
      * @return  received frame, else null
      */
     public static function recvFrameNoWait(socket:ZMQSocket):ZFrame {
-        var f:ZFrame = new ZFrame();
-        f.recvNoWait(socket);
+        var f:ZFrame = newFrame();
+        f.recvWithFlags(socket, DONTWAIT);
         return f;
     }
 	
+    /**
+     * Sends frames to socket as one multipart message, then destroys them.
+     * On neko and cpp all frames are handed to 0MQ in a single native call, without
+     * copying the content of frames that were received from a socket.
+     * @param	socket  Socket to send to
+     * @param	frames  Frames making up the message, in order
+     * @param	?flags  DONTWAIT
+     * @return  true if sent, false if DONTWAIT was used and the message could not be queued
+     */
+    public static function sendFrames(socket:ZMQSocket, frames:Iterable<ZFrame>, ?flags:SendReceiveFlagType):Bool {
+        if (socket == null || frames == null) {
+            throw new ZMQException(EINVAL);
+        }
+        for (f in frames) {
+            if (!f.hasData())
+                throw new ZMQException(EINVAL);
+        }
+#if (neko || cpp)
+        if (socket._socketHandle == null || socket.closed)
+            throw new ZMQException(ENOTSUP);
+        var parts = nativeParts(frames);
+        var sent:Int = 0;
+        try {
+            sent = _hx_zmq_send_multipart(socket._socketHandle, parts, ZMQ.sendReceiveFlagNo(flags));
+        } catch (e:Int) {
+            for (f in frames) f.destroy();
+            throw new ZMQException(ZMQ.errNoToErrorType(e));
+        }
+        for (f in frames) f.destroy();
+        return sent > 0;
+#else
+        var iter:Iterator<ZFrame> = frames.iterator();
+        while (iter.hasNext()) {
+            var f:ZFrame = iter.next();
+            f.send(socket, { if (iter.hasNext()) ZFRAME_MORE else 0; } );
+        }
+        return true;
+#end
+    }
+    
+    /**
+     * Receives all frames of the next multipart message on socket.
+     * On neko and cpp the whole message is read in a single native call.
+     * @param	socket  Socket to read from
+     * @param	?flags  DONTWAIT
+     * @return  received frames, else null if interrupted or (with DONTWAIT) no message was waiting
+     */
+    public static function recvFrames(socket:ZMQSocket, ?flags:SendReceiveFlagType):Array<ZFrame> {
+        if (socket == null) {
+            throw new ZMQException(EINVAL);
+        }
+        var frames = new Array<ZFrame>();
+#if (neko || cpp)
+        if (socket._socketHandle == null || socket.closed)
+            throw new ZMQException(ENOTSUP);
+        var handles:Dynamic = null;
+        try {
+            handles = _hx_zmq_recv_multipart(socket._socketHandle, ZMQ.sendReceiveFlagNo(flags));
+        } catch (e:Int) {
+            if (ZMQ.isInterrupted())
+                return null;
+            throw new ZMQException(ZMQ.errNoToErrorType(e));
+        }
+        if (handles == null)
+            return null;
+        for (h in ZMQ.nativeToArray(handles)) {
+            frames.push(ofMsgHandle(h));
+        }
+#else
+        while (true) {
+            var f = newFrame();
+            if (!f.recvWithFlags(socket, { if (frames.length == 0) flags else null; } )) {
+                f.destroy();
+                for (g in frames) g.destroy();
+                return null;
+            }
+            frames.push(f);
+            if (!f.more)
+                break;
+        }
+#end
+        return frames;
+    }
+    
 	/**
 	 * Creates a new ZFrame object from a given string.
 	 * 
@@ -263,6 +490,96 @@ class ZFrame
 	 * </pre>
 	 */
 	public static function newStringFrame(str:String):ZFrame {
-		return new ZFrame(Bytes.ofString(str));
+		return newFrame(Bytes.ofString(str));
 	}
+	
+    /**
+     * Returns a frame holding data, taken from this thread's pool if one is available.
+     * Unlike the constructor, does not copy data: the frame takes ownership of it.
+     * @param	?data
+     */
+    public static function newFrame(?data:Bytes):ZFrame {
+        var f:ZFrame = null;
+        if (poolSize > 0)
+            f = threadPool().pop();
+        if (f == null) {
+            f = new ZFrame();
+        } else {
+            f.pooled = false;
+        }
+        f._data = data;
+        return f;
+    }
+    
+#if (neko || cpp)
+    /**
+     * Returns a frame holding the content of a native message handle, taking ownership of it.
+     * Used by the hxzmq driver.
+     * @param	h
+     */
+    public static function ofMsgHandle(h:Dynamic):ZFrame {
+        var f = newFrame();
+        f._msgHandle = h;
+        f.more = _hx_zmq_msg_more(h);
+        return f;
+    }
+    
+    /**
+     * Returns the native content of each frame, as taken by hxzmq driver functions:
+     * the native message handle where content has not been copied out, else the Bytes data.
+     * Frames keep their content.
+     * @param	frames
+     */
+    public static function nativeParts(frames:Iterable<ZFrame>):Array<Dynamic> {
+        var parts = new Array<Dynamic>();
+        for (f in frames) {
+            parts.push( { if (f._data == null) f._msgHandle else f._data.getData(); } );
+        }
+        return parts;
+    }
+#end
+    
+    /**
+     * Sets the most destroyed frames kept for reuse by each thread.
+     * 0 disables pooling, and releases the frames held in the calling thread's pool.
+     * @param	size
+     */
+    public static function setPoolSize(size:Int) {
+        if (size < 0) {
+            throw new ZMQException(EINVAL);
+        }
+        poolSize = size;
+        var p = threadPool();
+        while (p.length > size)
+            p.pop().pooled = false;
+    }
+    
+    private static function threadPool():Array<ZFrame> {
+#if (neko || cpp)
+        var p = pool.value;
+        if (p == null) {
+            p = new Array<ZFrame>();
+            pool.value = p;
+        }
+        return p;
+#else
+        if (pool == null)
+            pool = new Array<ZFrame>();
+        return pool;
+#end
+    }
+
+#if (neko || cpp)
+	private static var _hx_zmq_msg_recv = Lib.load("hxzmq", "hx_zmq_msg_recv", 2);
+	private static var _hx_zmq_msg_send = Lib.load("hxzmq", "hx_zmq_msg_send", 3);
+	private static var _hx_zmq_msg_more = Lib.load("hxzmq", "hx_zmq_msg_more", 1);
+	private static var _hx_zmq_msg_size = Lib.load("hxzmq", "hx_zmq_msg_size", 1);
+	private static var _hx_zmq_msg_get = Lib.load("hxzmq", "hx_zmq_msg_get", 2);
+	private static var _hx_zmq_msg_slice = Lib.load("hxzmq", "hx_zmq_msg_slice", 3);
+	private static var _hx_zmq_msg_data = Lib.load("hxzmq", "hx_zmq_msg_data", 1);
+	private static var _hx_zmq_msg_copy = Lib.load("hxzmq", "hx_zmq_msg_copy", 1);
+	private static var _hx_zmq_msg_close = Lib.load("hxzmq", "hx_zmq_msg_close", 1);
+	private static var _hx_zmq_send_multipart = Lib.load("hxzmq", "hx_zmq_send_multipart", 3);
+	private static var _hx_zmq_recv_multipart = Lib.load("hxzmq", "hx_zmq_recv_multipart", 2);
+#end
 }
\ No newline at end of file
@@ -0,0 +1,240 @@
+/**
+ * (c) 2011 Richard J Smith
+ *
+ * This file is part of hxzmq
+ *
+ * hxzmq is free software; you can redistribute it and/or modify it under
+ * the terms of the Lesser GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hxzmq is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * Lesser GNU General Public License for more details.
+ *
+ * You should have received a copy of the Lesser GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+package org.zeromq;
+
+import neko.Lib;
+import org.zeromq.ZFrame;
+import org.zeromq.ZMQ;
+import org.zeromq.ZMsg;
+
+/**
+ * Append-only message journal, for recording messages to disk and replaying them later,
+ * e.g. for a durable queue or a late-joining subscriber.
+ * 
+ * Messages are numbered in the order they are appended, from 0. Sequence numbers are Floats,
+ * as they can outgrow a haXe Int; they are exact up to 2^53. Messages are held in a directory of
+ * fixed-size, memory-mapped segment files, so appending a message copies it once, straight
+ * into the page cache, and replayed frames refer to the mapped file rather than copies of it.
+ * Each message is checksummed, and a damaged one ends its segment when the journal is reopened.
+ * 
+ * By default it is left to the operating system to write appended messages to disk. Use
+ * setSyncPolicy() to group commit, or sync() to write everything appended so far.
+ * 
+ * A journal must only be used by one thread at a time. Only available on neko and cpp.
+ */
+class ZJournal 
+{
+	/** Default segment file size */
+	public static inline var DEFAULT_SEGMENT_SIZE:Int = 64 * 1024 * 1024;
+	
+#if (neko || cpp)
+	/** Opaque data used by hxzmq driver: native journal */
+	public var journalHandle(default,null):Dynamic;
+#end
+
+	/**
+	 * Constructor. Opens the journal in a directory, creating it if need be.
+	 * @param	path			Directory holding the journal's segment files
+	 * @param	?segmentSize	Size of new segment files, in bytes. A message larger than this gets a segment of its own.
+	 */
+	public function new(path:String, ?segmentSize:Int = DEFAULT_SEGMENT_SIZE) 
+	{
+		if (path == null) {
+			throw new ZMQException(EINVAL);
+		}
+#if (neko || cpp)
+		try {
+			journalHandle = _hx_zmq_journal_open(Lib.haxeToNeko(path), segmentSize);
+		} catch (e:Int) {
+			throw new ZMQException(ZMQ.errNoToErrorType(e));
+		}
+#else
+		throw new ZMQException(ENOTSUP);
+#end
+	}
+	
+	/**
+	 * Appends a message. The message is left unchanged.
+	 * @param	msg
+	 * @return	Sequence number of the message
+	 */
+	public function append(msg:ZMsg):Float {
+		if (msg == null) {
+			throw new ZMQException(EINVAL);
+		}
+		return appendBatch([msg]);
+	}
+	
+	/**
+	 * Appends several messages in one native call, which is cheaper than appending
+	 * them one by one and counts once towards the group commit policy's interval.
+	 * Nothing is appended if any of the messages is invalid. The messages are left unchanged.
+	 * @param	msgs
+	 * @return	Sequence number of the first message
+	 */
+	public function appendBatch(msgs:Array<ZMsg>):Float {
+		if (msgs == null) {
+			throw new ZMQException(EINVAL);
+		}
+#if (neko || cpp)
+		var batch = new Array<Dynamic>();
+		for (msg in msgs) {
+			if (msg == null) {
+				throw new ZMQException(EINVAL);
+			}
+			batch.push(ZFrame.nativeParts(msg));
+		}
+		try {
+			return _hx_zmq_journal_append(journalHandle, batch);
+		} catch (e:Int) {
+			throw new ZMQException(ZMQ.errNoToErrorType(e));
+		}
+#end
+		return -1;
+	}
+	
+	/**
+	 * Reads messages back, in sequence order.
+	 * Frames refer to the journal's mapped data until their content is read, so replaying
+	 * messages to a socket copies nothing.
+	 * A damaged message is dropped when the journal is opened, with any after it in the same
+	 * segment file, leaving a gap in the sequence. Reading stops short at a gap, and a read
+	 * starting inside one starts after it instead; use readable() to find where. A replayer
+	 * can so advance by the number of messages read, as long as it starts each read at readable(seq).
+	 * @param	seq		Sequence number of the first message to read
+	 * @param	?max	Most messages to read
+	 * @return	Messages, empty if there are none from seq onwards
+	 */
+	public function read(seq:Float, ?max:Int = 1):Array<ZMsg> {
+		var msgs = new Array<ZMsg>();
+#if (neko || cpp)
+		var records:Dynamic = null;
+		try {
+			records = _hx_zmq_journal_read(journalHandle, seq, max);
+		} catch (e:Int) {
+			throw new ZMQException(ZMQ.errNoToErrorType(e));
+		}
+		for (r in ZMQ.nativeToArray(records)) {
+			var msg = ZMsg.newMsg();
+			for (h in ZMQ.nativeToArray(r)) {
+				msg.add(ZFrame.ofMsgHandle(h));
+			}
+			msgs.push(msg);
+		}
+#end
+		return msgs;
+	}
+	
+	/**
+	 * Returns the sequence number of the first message read(seq) would return: seq itself,
+	 * unless it is before first() or in a gap left by damaged messages.
+	 * @param	seq
+	 */
+	public function readable(seq:Float):Float {
+#if (neko || cpp)
+		try {
+			return _hx_zmq_journal_readable(journalHandle, seq);
+		} catch (e:Int) {
+			throw new ZMQException(ZMQ.errNoToErrorType(e));
+		}
+#end
+		return seq;
+	}
+	
+	/**
+	 * Returns the sequence number the next message appended will have
+	 */
+	public function next():Float {
+#if (neko || cpp)
+		try {
+			return _hx_zmq_journal_next(journalHandle);
+		} catch (e:Int) {
+			throw new ZMQException(ZMQ.errNoToErrorType(e));
+		}
+#end
+		return 0;
+	}
+	
+	/**
+	 * Returns the sequence number of the oldest message held
+	 */
+	public function first():Float {
+#if (neko || cpp)
+		try {
+			return _hx_zmq_journal_first(journalHandle);
+		} catch (e:Int) {
+			throw new ZMQException(ZMQ.errNoToErrorType(e));
+		}
+#end
+		return 0;
+	}
+	
+	/**
+	 * Sets the group commit policy: appended messages are written to disk once everyMessages
+	 * have been appended, or intervalMsecs after the last write, whichever comes first.
+	 * The check is made on every call to the journal, not just as batches are appended, so
+	 * messages appended before a pause are written once the journal is next used. 0 disables either trigger.
+	 * @param	everyMessages
+	 * @param	intervalMsecs
+	 */
+	public function setSyncPolicy(everyMessages:Int, intervalMsecs:Int) {
+#if (neko || cpp)
+		try {
+			_hx_zmq_journal_set_sync(journalHandle, everyMessages, intervalMsecs);
+		} catch (e:Int) {
+			throw new ZMQException(ZMQ.errNoToErrorType(e));
+		}
+#end
+	}
+	
+	/**
+	 * Writes all messages appended so far to disk, returning once they are durable
+	 */
+	public function sync() {
+#if (neko || cpp)
+		try {
+			_hx_zmq_journal_sync(journalHandle);
+		} catch (e:Int) {
+			throw new ZMQException(ZMQ.errNoToErrorType(e));
+		}
+#end
+	}
+	
+	/**
+	 * Closes the journal. Frames already read remain valid.
+	 */
+	public function close() {
+#if (neko || cpp)
+		_hx_zmq_journal_close(journalHandle);
+#end
+	}
+	
+#if (neko || cpp)
+	private static var _hx_zmq_journal_open = Lib.load("hxzmq", "hx_zmq_journal_open", 2);
+	private static var _hx_zmq_journal_append = Lib.load("hxzmq", "hx_zmq_journal_append", 2);
+	private static var _hx_zmq_journal_read = Lib.load("hxzmq", "hx_zmq_journal_read", 3);
+	private static var _hx_zmq_journal_readable = Lib.load("hxzmq", "hx_zmq_journal_readable", 2);
+	private static var _hx_zmq_journal_next = Lib.load("hxzmq", "hx_zmq_journal_next", 1);
+	private static var _hx_zmq_journal_first = Lib.load("hxzmq", "hx_zmq_journal_first", 1);
+	private static var _hx_zmq_journal_set_sync = Lib.load("hxzmq", "hx_zmq_journal_set_sync", 3);
+	private static var _hx_zmq_journal_sync = Lib.load("hxzmq", "hx_zmq_journal_sync", 1);
+	private static var _hx_zmq_journal_close = Lib.load("hxzmq", "hx_zmq_journal_close", 1);
+#end
+}
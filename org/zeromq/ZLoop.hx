@@ -19,12 +19,15 @@
 
 package org.zeromq;
 
+import haxe.io.Bytes;
 import haxe.Log;
 import neko.Lib;
 import neko.Sys;
 import org.zeromq.ZMQ;
 import org.zeromq.ZMQSocket;
 import org.zeromq.ZMQPoller;
+import org.zeromq.ZMailbox;
+import org.zeromq.ZOutbox;
 
 typedef PollItemT = {
     socket:ZMQSocket,
@@ -32,26 +35,47 @@ typedef PollItemT = {
 };
 
 private typedef PollerT = {
-    pollItem:PollItemT,
-    handler: ZLoop -> ZMQSocket -> Int
+    pollItem:PollItemT,     // null for a native file descriptor
+    handler: ZLoop -> ZMQSocket -> Int,
+    fd:Int,
+    fdHandler: ZLoop -> Int -> Int,
+    writer:WriterT          // Set for the POLLOUT item of a socket with queued messages
+};
+
+private typedef WriterT = {
+    socket:ZMQSocket,
+    outbox:ZOutbox,         // Messages sent through the reactor that the socket could not yet take
+    handler:ZLoop -> ZMQSocket -> Int,  // Called when the outbox empties, or null
+    waiting:Bool            // True while a POLLOUT item is registered for the socket
 };
 
 private typedef TimerT = {
+    id:Int,         // Key of timer in timers hash and timer queue
     delay:Float,    // Number of milliseconds to delay before triggering timed event
     times:Int,      // Number of times to repeat timed event, separated by delay
     handler:ZLoop ->Dynamic->Int,
 	args:Dynamic,
-    when:Float     // Number of milliseconds since 1 Jan 1970 to trigger timer event
+    when:Float     // Time to trigger timer event, in msecs on the ZTimers.now() clock
 };
 
 /**
  * <p>
- * The ZLoop class provides an event-driven reactor pattern. The reactor handles socket readers not writers,
+ * The ZLoop class provides an event-driven reactor pattern. The reactor handles socket readers,
  * and once-off or repeated timers.  its resolution is 1 msec. It uses a tickless timer to reduce CPU interrupts in
  * inactive processes.
  * </p>
  * <p>
- * Note that at present, it only supports 0MQ sockets; polling of haXe Socket objects is not supported. 
+ * Messages sent with send() never block the reactor: those a socket cannot take yet (e.g. at its high
+ * water mark) are queued, and flushed in a batch when the socket next polls as writable. This only applies
+ * to socket types that block at the high water mark; PUB and XPUB sockets silently drop messages there
+ * instead, as they always do, and never queue.
+ * A writer handler, registered with registerWriter, is called each time such a backlog has been flushed,
+ * so a publisher can stop producing while send() reports queued messages, and resume from the handler.
+ * </p>
+ * <p>
+ * On neko and cpp, native file descriptors (plain TCP sockets, pipes, timerfds etc.) can be registered
+ * with registerFd, and are waited on in the same poll as 0MQ sockets. Values posted to a ZMailbox
+ * by other threads are handled in the same way, with registerMailbox.
  * </p>
  * <p>
  * Based on <a href="http://github.com/zeromq/czmq/blob/master/src/zloop.c">zloop.c</a> in czmq
@@ -63,20 +87,26 @@ class ZLoop
     /** Turns on verbose trace logging */
     public var verbose:Bool;
     
-    /** List of registered pollers */
-    private var pollers:List<PollerT>;
+    /** Registered pollers, in the same order as the pollset held within the poller object */
+    private var pollers:Array<PollerT>;
+    
+    /** Sockets sent on through the reactor, with their outbound queues, keyed by socket id */
+    private var writers:IntHash<WriterT>;
+    
+    /** Registered timers, keyed by timer id */
+    private var timers:IntHash<TimerT>;
     
-    /** List of registered timers */
-    private var timers:List<TimerT>;
+    /** Deadlines of registered timers, in expiry order */
+    private var timerQueue:ZTimers;
     
-    /** List of timer argument objects to kill */
-    private var zombies:List<Dynamic>;
+    /** Id given to the last registered timer */
+    private var lastTimerId:Int;
     
     /** Internal ZMQPoller object that holds the actual pollset used when querying socket state */
     private var poller:ZMQPoller;
     
-    /** True if list of pollers and timers are different to pollset held within the poller object */
-    private var dirty:Bool;
+    /** Most mailbox values handled per wakeup, so a busy mailbox cannot starve other pollers */
+    private static inline var MAILBOX_BATCH:Int = 256;
     
     /** Logger function used in verbose mode. Set during ZLoop construction */
     private var log:Dynamic->Void;
@@ -88,9 +118,11 @@ class ZLoop
      */
     public function new(?logger:Dynamic->Void) 
     {
-        pollers = new List<PollerT>();
-        timers = new List<TimerT>();
-        zombies = new List<Dynamic>();
+        pollers = new Array<PollerT>();
+        writers = new IntHash<WriterT>();
+        timers = new IntHash<TimerT>();
+        timerQueue = new ZTimers();
+        lastTimerId = 0;
         poller = new ZMQPoller();
         verbose = false;
         if (logger != null) {
@@ -105,11 +137,16 @@ class ZLoop
      */
     public function destroy() {
         // Destroy list of pollers
-        pollers.clear();
+        pollers = new Array<PollerT>();
+        
+        // Discard messages still queued for sending
+        for (w in writers)
+            w.outbox.clear();
+        writers = new IntHash<WriterT>();
         
         // Destroy list of timers
-        timers.clear();
-        zombies.clear();
+        timers = new IntHash<TimerT>();
+        timerQueue = new ZTimers();
         poller.unregisterAllSockets();
         poller = null;
     }
@@ -124,7 +161,10 @@ class ZLoop
      * @return  true if OK, else false
      */
     public function registerTimer(delay:Float, times:Int, handler:ZLoop->Dynamic->Int, ?args:Dynamic):Bool {
-        timers.push(ZLoop.newTimer(delay, times, handler, args));
+        var t = ZLoop.newTimer(++lastTimerId, delay, times, handler, args);
+        t.when = ZTimers.now() + delay;
+        timers.set(t.id, t);
+        timerQueue.add(t.id, t.when);
         if (verbose)
             log("I: zloop: register timer delay=" + delay + " times=" + times);
         return true;    
@@ -135,10 +175,17 @@ class ZLoop
 	 * @param	args
 	 */
 	public function unregisterTimer(args:Dynamic) {
-		// We cannot touch timers because we may be executing that
-		// from inside the poll loop. So, we hold the arg on the zombie
-		// list, and process that list when we're done executing timers.
-		zombies.add(args);
+		// Timers already taken off the timer queue for this pass are skipped
+		// by the reactor once they are no longer in the timers hash
+		var killed = new List<Int>();
+		for (t in timers) {
+			if (t.args == args)
+				killed.add(t.id);
+		}
+		for (id in killed) {
+			timers.remove(id);
+			timerQueue.cancel(id);
+		}
 		if (verbose) {
 			log("I: zloop: cancel timer");
 		}
@@ -157,8 +204,8 @@ class ZLoop
         if (item == null || handler == null) {
             throw new ZMQException(EINVAL);
         }
-        pollers.push(newPoller(item, handler));
-        dirty = true;
+        poller.registerSocket(item.socket, item.event);
+        pollers.push(newPoller(item, handler, -1, null, null));
         if (verbose) 
             log("I: zloop: register socket poller " + item.socket.type);
         return true;    
@@ -173,51 +220,193 @@ class ZLoop
 		if (item == null || (item != null && item.socket == null)) {
 			throw new ZMQException(EINVAL);
 		}
-		var i = 0;
-		for (p in pollers) {
-			i++;
-			if (p.pollItem.socket != null && p.pollItem.socket.equals(item.socket))
-			{
-				if (pollers.remove(p))
-					dirty = true;
-			}
-		}
+		removePollers(function(p) {
+			return p.writer == null && p.pollItem != null && p.pollItem.socket != null && p.pollItem.socket.equals(item.socket);
+		});
 		if (verbose) {
 			log("I: zloop: unregister socket poller " + item.socket.type);
 		}
 	}
 	
+    /**
+     * Register a native file descriptor with the reactor. When it is ready for
+     * any of the given events, or has an error, will call the handler.
+     * Not supported on php.
+     * @param	fd          File descriptor (a SOCKET on Windows)
+     * @param	event       Bitmasked Int for polled events (ZMQ_POLLIN, ZMQ_POLLOUT)
+     * @param	handler     Handler function, receives the file descriptor
+     * @return  true if OK, else false
+     */
+    public function registerFd(fd:Int, event:Int, handler:ZLoop->Int->Int):Bool {
+        if (handler == null) {
+            throw new ZMQException(EINVAL);
+        }
+        poller.registerFd(fd, event);
+        pollers.push(newPoller(null, null, fd, handler, null));
+        if (verbose) 
+            log("I: zloop: register fd poller " + fd);
+        return true;    
+    }
+    
+	/**
+	 * Removes all pollers for a file descriptor previously registered with registerFd
+	 * @param	fd
+	 */
+	public function unregisterFd(fd:Int) {
+		removePollers(function(p) { return p.pollItem == null && p.fd == fd; } );
+		if (verbose) {
+			log("I: zloop: unregister fd poller " + fd);
+		}
+	}
+	
+    /**
+     * Register a mailbox with the reactor. For each value posted to it, will call the handler,
+     * in the order posted. Not supported on php.
+     * @param	mailbox
+     * @param	handler     Handler function, receives the value
+     * @return  true if OK, else false
+     */
+    public function registerMailbox(mailbox:ZMailbox, handler:ZLoop->Dynamic->Int):Bool {
+        if (mailbox == null || handler == null) {
+            throw new ZMQException(EINVAL);
+        }
+        // The descriptor stays readable while values remain, so any left over are handled on the next pass
+        registerFd(mailbox.fd, ZMQ.ZMQ_POLLIN(), function(loop:ZLoop, fd:Int):Int {
+            for (i in 0 ... MAILBOX_BATCH) {
+                var v = mailbox.recv();
+                if (v == null)
+                    break;
+                if (handler(loop, v) == -1)
+                    return -1;
+            }
+            return 0;
+        });
+        if (verbose)
+            log("I: zloop: register mailbox " + mailbox.fd);
+        return true;
+    }
+    
+	/**
+	 * Removes a mailbox previously registered with registerMailbox.
+	 * Values still in the mailbox are kept.
+	 * @param	mailbox
+	 */
+	public function unregisterMailbox(mailbox:ZMailbox) {
+		if (mailbox == null) {
+			throw new ZMQException(EINVAL);
+		}
+		unregisterFd(mailbox.fd);
+	}
+	
+	/**
+	 * Sends a message part on a socket without blocking the reactor.
+	 * If the socket cannot take it now, or earlier messages are still queued, it is queued
+	 * and sent when the socket next becomes writable, in order and without being dropped.
+	 * (PUB and XPUB sockets never block, so drop messages at their high water mark as usual.)
+	 * @param	socket
+	 * @param	data        The content of the message part
+	 * @param	?more       True if more parts of this message follow
+	 * @return  Number of message parts queued for the socket, so 0 if everything has been sent
+	 */
+	public function send(socket:ZMQSocket, data:Bytes, ?more:Bool = false):Int {
+		if (socket == null || data == null) {
+			throw new ZMQException(EINVAL);
+		}
+		var w = writerFor(socket, true);
+		var queued = w.outbox.send(data, more);
+		if (queued > 0 && !w.waiting) {
+			// Socket is backed up; flush when it polls as writable
+			poller.registerSocket(socket, ZMQ.ZMQ_POLLOUT());
+			pollers.push(newPoller( { socket:socket, event:ZMQ.ZMQ_POLLOUT() }, null, -1, null, w));
+			w.waiting = true;
+			if (verbose)
+				log("I: zloop: socket backed up, " + queued + " queued " + socket.type);
+		}
+		return queued;
+	}
+	
+	/**
+	 * Returns the number of message parts queued by send() for a socket
+	 * @param	socket
+	 */
+	public function queued(socket:ZMQSocket):Int {
+		var w = writerFor(socket, false);
+		return { if (w == null) 0 else w.outbox.size(); };
+	}
+	
+	/**
+	 * Register a writer handler for a socket. Each time messages queued by send() for
+	 * the socket have all been sent, will call the handler.
+	 * @param	socket
+	 * @param	handler     Handler function, receives the socket
+	 * @return  true if OK, else false
+	 */
+	public function registerWriter(socket:ZMQSocket, handler:ZLoop->ZMQSocket->Int):Bool {
+		if (socket == null || handler == null) {
+			throw new ZMQException(EINVAL);
+		}
+		writerFor(socket, true).handler = handler;
+		if (verbose)
+			log("I: zloop: register socket writer " + socket.type);
+		return true;
+	}
+	
+	/**
+	 * Removes a socket's writer handler, and discards any messages still queued for it
+	 * @param	socket
+	 */
+	public function unregisterWriter(socket:ZMQSocket) {
+		var w = writerFor(socket, false);
+		if (w == null)
+			return;
+		w.outbox.clear();
+		if (w.waiting)
+			removePollers(function(p) { return p.writer == w; } );
+		writers.remove(socket.id);
+		if (verbose)
+			log("I: zloop: unregister socket writer " + socket.type);
+	}
+	
     /**
      * Start the reactor. Takes control of the thread and returns when the 0MQ
      * context is terminated or the process is interrupted, or any event handler returns -1.
      * Event handlers may register new sockets and timers, and cancel sockets.
+     * 
+     * On neko and cpp the wait loop runs in the hxzmq native library, which calls back
+     * into haXe only for sockets that are ready and timers that have expired.
      * @return Returns 0 if interrupted, -1 if cancelled by a handler
      */
     public function start():Int {
         var rc:Int = 0;
         
         // Re-calculate all timers now
-        var now:Float = Sys.time();
+        var now:Float = ZTimers.now();
         for ( t in timers) {
             t.when = now + t.delay;
+            timerQueue.add(t.id, t.when);
         }
         
+#if (neko || cpp)
+        try {
+            rc = _hx_zmq_reactor_start(poller.pollsetHandle, timerQueue.timersHandle, socketEvent, timerEvent);
+        } catch (e:Int) {
+            if (ZMQ.isInterrupted()) {
+                if (verbose)
+                    log("I: zloop: main loop interrupted");
+                return 0;
+            }
+            if (verbose)
+                log("E: zloop: " + ZMQ.strError(e));
+            throw new ZMQException(ZMQ.errNoToErrorType(e));
+        }
+        if (rc == 0 && verbose)
+            log("I: zloop: interrupted");
+#else
         // Main reactor loop
         while (true) {
-            if (dirty) {
-               rebuildPollset();
-            }
             try {
                 rc = poller.poll(ticklessTimer() * ZMQ.ZMQ_POLL_MSEC());
             } catch (e:ZMQException) {
-#if !php                
-                if (ZMQ.isInterrupted()) {
-                    if (verbose)
-                        log("I: zloop: main loop interrupted");
-                    rc = 0;
-                    break;
-                }
-#end                
                 if (verbose)
                     log("E: zloop: " + e.toString());
                 Lib.rethrow (e);
@@ -227,118 +416,201 @@ class ZLoop
                     log("E: zloop: " + e);
                 Lib.rethrow(e);
             }
-            if (rc == -1 #if !php ||  ZMQ.isInterrupted() #end ) {
+            if (rc == -1) {
                if (verbose)
                    log("I: zloop: interrupted");
                rc = 0;
                break;
             }
-            // Handle any timers that have now expired
-            for ( t in timers) {
-                now = Date.now().getTime();
-                if (now >= t.when && t.when != -1) {
-                    if (verbose)
-                        log("I: zloop: call timer handler");
-                    rc = t.handler(this, t.args);
-                    if (rc == -1)
-                        break;  // Timer handler signalled break
-                    if (--t.times == 0) {
-                        timers.remove(t);
-                    } else
-                        t.when = t.delay + now;
+            // Handle any timers that have now expired, taken off the timer queue in deadline order
+            var expired:Array<Int> = timerQueue.expired(ZTimers.now());
+            for (i in 0...expired.length) {
+                rc = timerEvent(expired[i]);
+                if (rc == -1) {
+                    // Put back timers not yet handled
+                    for (j in i + 1...expired.length) {
+                        var u = timers.get(expired[j]);
+                        if (u != null)
+                            timerQueue.add(u.id, u.when);
+                    }
+                    break;
                 }
             }
-            // Handle any pollers that are ready
-            var item_nbr:Int = 0;
-            for (p in pollers) {
-                if (poller.pollin(++item_nbr)) {
-                    if (verbose)
-                        log("I: zloop: call socket handler");
-                    rc = p.handler(this, p.pollItem.socket);
-                    if (rc == -1) 
-                        break;  // Poller handler signalled break
-                }
+            if (rc == -1)
+                break;
+            // Handle any pollers that are ready, visiting only those that signalled
+            var ready = pollers;
+            for (k in 0...poller.readyCount()) {
+                rc = socketEvent(poller.readyIndex(k) - 1, poller.readyEvents(k));
+                if (rc == -1 || ready != pollers) 
+                    break;  // Poller handler signalled break, or changed the pollset
             }
-            
-			// Now handle any timer zombies
-			for (z in zombies) {
-				for (t in timers) {
-					if (t.args == z) {
-						timers.remove(t);
-					}
-				}
-			}
-			
             if (rc == -1)
                 break;
-                    
         }
+#end
         
         return rc;
     }
     
+    /**
+     * Calls the handler for a ready pollset item
+     * @param	index       Index of item in pollset
+     * @param	revents     Events signalled on item
+     * @return  Handler return value
+     */
+    private function socketEvent(index:Int, revents:Int):Int {
+        var p = pollers[index];
+        if (p.writer != null)
+            return writerEvent(p.writer, revents);
+        if (p.pollItem == null) {
+            // Errors are passed on too, else a failed descriptor would wake every poll
+            if (verbose)
+                log("I: zloop: call fd handler");
+            return p.fdHandler(this, p.fd);
+        }
+        if ((revents & ZMQ.ZMQ_POLLIN()) == 0)
+            return 0;
+        if (verbose)
+            log("I: zloop: call socket handler");
+        return p.handler(this, p.pollItem.socket);
+    }
     
     /**
-     * Rebuilds pollset held within the poller object from list of registered pollers
+     * Flushes a writable socket's outbox; once it is empty, stops polling for POLLOUT
+     * and calls the writer handler
+     * @param	w           Writer
+     * @param	revents     Events signalled on its POLLOUT item
+     * @return  Handler return value
      */
-    private function rebuildPollset() {
-        poller.unregisterAllSockets();
-        for (p in pollers) {
-            poller.registerSocket(p.pollItem.socket, p.pollItem.event);
+    private function writerEvent(w:WriterT, revents:Int):Int {
+        if ((revents & ZMQ.ZMQ_POLLOUT()) == 0)
+            return 0;
+        if (w.outbox.flush() > 0)
+            return 0;
+        removePollers(function(p) { return p.writer == w; } );
+        w.waiting = false;
+        if (w.handler == null)
+            return 0;
+        if (verbose)
+            log("I: zloop: call socket writer");
+        return w.handler(this, w.socket);
+    }
+    
+    /**
+     * Calls the handler for an expired timer, then reschedules or removes it
+     * @param	id          Timer id
+     * @return  Handler return value
+     */
+    private function timerEvent(id:Int):Int {
+        var t:TimerT = timers.get(id);
+        if (t == null)
+            return 0;   // Cancelled
+        if (verbose)
+            log("I: zloop: call timer handler");
+        var rc = t.handler(this, t.args);
+        if (rc == -1) {
+            timerQueue.add(t.id, t.when);   // Not handled; leave it due
+            return rc;
+        }
+        if (--t.times == 0) {
+            timers.remove(t.id);
+        } else {
+            t.when = t.delay + ZTimers.now();
+            timerQueue.add(t.id, t.when);
         }
-        dirty = false;
+        return rc;
     }
     
+#if !(neko || cpp)
     /**
      * Calculate timeout between now and next timed event
      * @return  Number of milliseconds between now and next timed event
      */
     private function ticklessTimer():Int {
         // Calculate next timer event time, up to 1 hour from now
-        var now:Float = Sys.time();
+        var now:Float = ZTimers.now();
         var tickless:Float = now + (1000 * 3600);
-        for (t in timers) {
-            if (t.when == null) {
-                t.when = t.delay + now;
-            }
-            if (tickless > t.when) tickless = t.when;
-        }
+        var next:Null<Float> = timerQueue.next();
+        if (next != null && tickless > next) tickless = next;
         var timeout:Int = Std.int(tickless - now);
         if (timeout < 0) timeout = 0;
         if (verbose) log("I: ZLoop: polling for " + timeout + " msec");
         
         return timeout;
     }
+#end
+    
+    /**
+     * Removes matching pollers, and their items in the pollset.
+     * Replaces the pollers array, so a reactor pass in progress sees that the pollset changed.
+     * @param	match
+     */
+    private function removePollers(match:PollerT->Bool) {
+        var remaining = new Array<PollerT>();
+        for (p in pollers) {
+            if (match(p))
+                poller.unregisterIndex(remaining.length + 1);   // Pollset position, after earlier removals
+            else
+                remaining.push(p);
+        }
+        pollers = remaining;
+    }
+    
+    /**
+     * Finds the writer for a socket
+     * @param	socket
+     * @param	create      Create the writer if the socket has none
+     * @return  Writer, or null if none
+     */
+    private function writerFor(socket:ZMQSocket, create:Bool):WriterT {
+        var w = writers.get(socket.id);
+        if (w != null || !create)
+            return w;
+        w = { socket:socket, outbox:new ZOutbox(socket), handler:null, waiting:false };
+        writers.set(socket.id, w);
+        return w;
+    }
     
     /**
      * Creates a new Poller T anonymous object
-     * @param	item
+     * @param	item        Socket poll item, or null for a file descriptor
      * @param	handler
+     * @param	fd
+     * @param	fdHandler
+     * @param	writer      Writer flushed on POLLOUT, or null
      * @return
      */
-    private static function newPoller(item:PollItemT, handler:ZLoop->ZMQSocket->Int):PollerT {
+    private static function newPoller(item:PollItemT, handler:ZLoop->ZMQSocket->Int, fd:Int, fdHandler:ZLoop->Int->Int, writer:WriterT):PollerT {
         return {
             pollItem:item,
             handler:handler,
+            fd:fd,
+            fdHandler:fdHandler,
+            writer:writer
         }
     }
     
     /**
      * Creates a new TimerT anonymous object
+     * @param	id
      * @param	delay
      * @param	times
      * @param	handler
      * @return
      */
-    private static function newTimer(delay:Float, times:Int, handler:ZLoop->Dynamic->Int, args:Dynamic):TimerT {
+    private static function newTimer(id:Int, delay:Float, times:Int, handler:ZLoop->Dynamic->Int, args:Dynamic):TimerT {
         return {
+            id:id,
             delay:delay,
             times:times,
             handler:handler,
 			args:args,
-            when:null     // Indicates a new timer
+            when:0.0
         }
     }
     
-    
-}
\ No newline at end of file
+#if (neko || cpp)
+	private static var _hx_zmq_reactor_start = Lib.load("hxzmq", "hx_zmq_reactor_start", 4);
+#end
+}
@@ -104,6 +104,21 @@ enum SocketOptionsType {
 
 }
 
+/**
+ * Enumeration of 0MQ context options
+ * See: http://api.zeromq.org/master:zmq-ctx-set
+ */
+enum ContextOptionType {
+
+	ZMQ_IO_THREADS;			// Number of I/O threads
+	ZMQ_MAX_SOCKETS;		// Maximum number of sockets
+	ZMQ_THREAD_PRIORITY;	// Scheduling priority of the I/O threads (libzmq 4.1+)
+	ZMQ_THREAD_SCHED_POLICY;	// Scheduling policy of the I/O threads (libzmq 4.1+)
+	ZMQ_THREAD_AFFINITY_CPU_ADD;	// Add a CPU to those the I/O threads may run on (libzmq 4.3+)
+	ZMQ_THREAD_AFFINITY_CPU_REMOVE;	// Remove a CPU from those the I/O threads may run on (libzmq 4.3+)
+
+}
+
 /**
  * Used to pass 64 bit ints to setlongsockopt
  */
@@ -151,22 +166,45 @@ class ZMQ {
 	
    
 		
+	/** socketOptionKind value for options that take an Int */
+	public static inline var OPTION_INT:Int = 1;
+	/** socketOptionKind value for options that take a ZMQInt64Type */
+	public static inline var OPTION_INT64:Int = 2;
+	/** socketOptionKind value for options that take Bytes */
+	public static inline var OPTION_BYTES:Int = 3;
+	
 	// Bitmask flags for ZMQ_EVENTS socket event option query
 
 	public static inline function ZMQ_POLLIN():Int {
+#if (neko || cpp)
+		return _POLLIN;
+#else
 		return _hx_zmq_ZMQ_POLLIN();
+#end
 	}
 	public static inline function ZMQ_POLLOUT():Int {
+#if (neko || cpp)
+		return _POLLOUT;
+#else
 		return _hx_zmq_ZMQ_POLLOUT();
+#end
 	}
 	public static inline function ZMQ_POLLERR():Int {
+#if (neko || cpp)
+		return _POLLERR;
+#else
 		return _hx_zmq_ZMQ_POLLERR();
+#end
 	}
 	
 	// Multiplying factor for Poller.poll() method calls to handle 
 	// units change in ZMQ3 from microsecs to millisecs
 	public static inline function ZMQ_POLL_MSEC():Int {
+#if (neko || cpp)
+		return _POLL_MSEC;
+#else
 		return _hx_zmq_ZMQ_POLL_MSEC();
+#end
 	}
 	
 	/**
@@ -232,12 +270,34 @@ class ZMQ {
 #end        
 	}
 
+	/**
+	 * Wraps an array returned by the hxzmq native library as a haXe Array,
+	 * leaving its elements (opaque handles or BytesData) unconverted.
+	 * @param	v	Native array
+	 * @return		haXe Array
+	 */
+	public static function nativeToArray(v:Dynamic):Array<Dynamic> {
+#if neko
+		if (untyped __dollar__typeof(v) == __dollar__tarray)
+			return untyped Array.new1(v, __dollar__asize(v));
+#end
+		return v;
+	}
+
 	/**
 	 * Converts a SocketType enum into a ZMQ socket type integer value
 	 * @param	type
 	 * @return
 	 */
 	public static function socketTypeNo(type:SocketType):Int {
+#if (neko || cpp)
+		return { if (type == null) null else _socketTypeNos[Type.enumIndex(type)]; };
+#else
+		return lookupSocketTypeNo(type);
+#end
+	}
+	
+	private static function lookupSocketTypeNo(type:SocketType):Int {
 		return {
 			switch(type) {
 				case ZMQ_PUB:
@@ -274,6 +334,73 @@ class ZMQ {
 	 * @return
 	 */
 	public static function socketOptionTypeNo(option:SocketOptionsType):Int {
+#if (neko || cpp)
+		return { if (option == null) null else _socketOptionTypeNos[Type.enumIndex(option)]; };
+#else
+		return lookupSocketOptionTypeNo(option);
+#end
+	}
+	
+	/**
+	 * Converts a ContextOptionType enum into a ZMQ int
+	 * @param	option
+	 * @return	ZMQ int, or -1 if the option is not supported by the 0MQ library
+	 */
+	public static function contextOptionNo(option:ContextOptionType):Int {
+#if (neko || cpp)
+		return { if (option == null) null else _contextOptionNos[Type.enumIndex(option)]; };
+#else
+		return lookupContextOptionNo(option);
+#end
+	}
+	
+	private static function lookupContextOptionNo(option:ContextOptionType):Int {
+#if (neko || cpp)
+		return {
+			switch(option) {
+				case ZMQ_IO_THREADS:
+					_hx_zmq_ZMQ_IO_THREADS();
+				case ZMQ_MAX_SOCKETS:
+					_hx_zmq_ZMQ_MAX_SOCKETS();
+				case ZMQ_THREAD_PRIORITY:
+					_hx_zmq_ZMQ_THREAD_PRIORITY();
+				case ZMQ_THREAD_SCHED_POLICY:
+					_hx_zmq_ZMQ_THREAD_SCHED_POLICY();
+				case ZMQ_THREAD_AFFINITY_CPU_ADD:
+					_hx_zmq_ZMQ_THREAD_AFFINITY_CPU_ADD();
+				case ZMQ_THREAD_AFFINITY_CPU_REMOVE:
+					_hx_zmq_ZMQ_THREAD_AFFINITY_CPU_REMOVE();
+				default:
+					-1;
+			}
+		}
+#else
+		// Not supported in php-zmq 0.7.0
+		return -1;
+#end
+	}
+	
+	/**
+	 * Returns the kind of value taken by a socket option
+	 * @param	option
+	 * @return	OPTION_INT, OPTION_INT64 or OPTION_BYTES, else 0 if the option is not supported
+	 */
+	public static function socketOptionKind(option:SocketOptionsType):Int {
+		if (option == null) return 0;
+		if (_socketOptionKinds == null) {
+			// Built on first use from the public option type lists
+			_socketOptionKinds = new Array<Int>();
+			for (o in Type.allEnums(SocketOptionsType)) {
+				_socketOptionKinds.push(0);
+			}
+			for (o in intSocketOptionTypes) _socketOptionKinds[Type.enumIndex(o)] = OPTION_INT;
+			for (o in int64SocketOptionTypes) _socketOptionKinds[Type.enumIndex(o)] = OPTION_INT64;
+			for (o in bytesSocketOptionTypes) _socketOptionKinds[Type.enumIndex(o)] = OPTION_BYTES;
+		}
+		return _socketOptionKinds[Type.enumIndex(option)];
+	}
+	
+	private static function lookupSocketOptionTypeNo(option:SocketOptionsType):Int {
 		return {
 			switch(option) {
 				case ZMQ_SNDHWM:
@@ -333,6 +460,14 @@ class ZMQ {
 	 */
 	public static function sendReceiveFlagNo(type:SendReceiveFlagType):Int {
 		if (type == null) return null;
+#if (neko || cpp)
+		return _sendReceiveFlagNos[Type.enumIndex(type)];
+#else
+		return lookupSendReceiveFlagNo(type);
+#end
+	}
+	
+	private static function lookupSendReceiveFlagNo(type:SendReceiveFlagType):Int {
 		return {
 			switch(type) {
 				case DONTWAIT:
@@ -351,6 +486,14 @@ class ZMQ {
 	 * @return
 	 */
 	public static function errorTypeToErrNo(e:ErrorType):Int {
+#if (neko || cpp)
+		return { if (e == null) 0 else _errNos[Type.enumIndex(e)]; };
+#else
+		return lookupErrNo(e);
+#end
+	}
+	
+	private static function lookupErrNo(e:ErrorType):Int {
 		return {
 			switch(e) {
 				case EINVAL:
@@ -397,6 +540,15 @@ class ZMQ {
 	 * @return
 	 */
 	public static function errNoToErrorType(e:Int):ErrorType {
+#if (neko || cpp)
+		var t = _errorTypes.get(e);
+		return { if (t == null) ENOTSUP else t; };
+#else
+		return lookupErrorType(e);
+#end
+	}
+	
+	private static function lookupErrorType(e:Int):ErrorType {
 		return {
 			switch (e) {
 				case _hx_zmq_EINVAL():
@@ -514,6 +666,13 @@ class ZMQ {
 	private static var _hx_zmq_ZMQ_EVENTS = Lib.load("hxzmq", "hx_zmq_ZMQ_EVENTS", 0);
 	private static var _hx_zmq_ZMQ_TYPE = Lib.load("hxzmq", "hx_zmq_ZMQ_TYPE", 0);
 
+	private static var _hx_zmq_ZMQ_IO_THREADS = Lib.load("hxzmq", "hx_zmq_ZMQ_IO_THREADS", 0);
+	private static var _hx_zmq_ZMQ_MAX_SOCKETS = Lib.load("hxzmq", "hx_zmq_ZMQ_MAX_SOCKETS", 0);
+	private static var _hx_zmq_ZMQ_THREAD_PRIORITY = Lib.load("hxzmq", "hx_zmq_ZMQ_THREAD_PRIORITY", 0);
+	private static var _hx_zmq_ZMQ_THREAD_SCHED_POLICY = Lib.load("hxzmq", "hx_zmq_ZMQ_THREAD_SCHED_POLICY", 0);
+	private static var _hx_zmq_ZMQ_THREAD_AFFINITY_CPU_ADD = Lib.load("hxzmq", "hx_zmq_ZMQ_THREAD_AFFINITY_CPU_ADD", 0);
+	private static var _hx_zmq_ZMQ_THREAD_AFFINITY_CPU_REMOVE = Lib.load("hxzmq", "hx_zmq_ZMQ_THREAD_AFFINITY_CPU_REMOVE", 0);
+
 	private static var _hx_zmq_ZMQ_POLLIN = Lib.load("hxzmq", "hx_zmq_ZMQ_POLLIN", 0);
 	private static var _hx_zmq_ZMQ_POLLOUT = Lib.load("hxzmq", "hx_zmq_ZMQ_POLLOUT", 0);
 	private static var _hx_zmq_ZMQ_POLLERR = Lib.load("hxzmq", "hx_zmq_ZMQ_POLLERR", 0);
@@ -537,7 +696,40 @@ class ZMQ {
 	private static var _hx_zmq_EFSM = Lib.load("hxzmq", "hx_zmq_EFSM", 0);
 	private static var _hx_zmq_ENOCOMPATPROTO = Lib.load("hxzmq", "hx_zmq_ENOCOMPATPROTO", 0);
 	private static var _hx_zmq_ETERM = Lib.load("hxzmq", "hx_zmq_ETERM", 0);
+	
+	// 0MQ constants are fixed when hxzmq.ndll is built against zmq.h,
+	// so are read from it just once, into tables indexed by haXe enum index
+	private static var _POLLIN:Int = _hx_zmq_ZMQ_POLLIN();
+	private static var _POLLOUT:Int = _hx_zmq_ZMQ_POLLOUT();
+	private static var _POLLERR:Int = _hx_zmq_ZMQ_POLLERR();
+	private static var _POLL_MSEC:Int = _hx_zmq_ZMQ_POLL_MSEC();
+	private static var _socketTypeNos:Array<Int> = enumTable(SocketType, lookupSocketTypeNo);
+	private static var _socketOptionTypeNos:Array<Int> = enumTable(SocketOptionsType, lookupSocketOptionTypeNo);
+	private static var _contextOptionNos:Array<Int> = enumTable(ContextOptionType, lookupContextOptionNo);
+	private static var _sendReceiveFlagNos:Array<Int> = enumTable(SendReceiveFlagType, lookupSendReceiveFlagNo);
+	private static var _errNos:Array<Int> = enumTable(ErrorType, lookupErrNo);
+	private static var _errorTypes:IntHash<ErrorType> = errorTypeTable();
+	
+	private static function enumTable<T>(e:Enum<T>, lookup:T->Int):Array<Int> {
+		var table = new Array<Int>();
+		for (v in Type.allEnums(e)) {
+			table.push(lookup(v));
+		}
+		return table;
+	}
+	
+	private static function errorTypeTable():IntHash<ErrorType> {
+		var table = new IntHash<ErrorType>();
+		for (t in Type.allEnums(ErrorType)) {
+			var n = lookupErrNo(t);
+			if (!table.exists(n))
+				table.set(n, t);
+		}
+		return table;
+	}
 #end
+	
+	private static var _socketOptionKinds:Array<Int>;
 
 
 #if php
@@ -76,6 +76,51 @@ class ZMQContext  {
 		}
 	}
 	
+	/**
+	 * Sets a context option.
+	 * Options configuring the I/O threads (ZMQ_IO_THREADS, ZMQ_THREAD_*) only take effect
+	 * if set before the first socket is created in the context.
+	 * 
+	 * Raises a ENOTSUP ZMQException if the option is not supported by the 0MQ library (or on php)
+	 * 
+	 * See: http://api.zeromq.org/master:zmq-ctx-set
+	 * @param	option
+	 * @param	optval
+	 */
+	public function setOption(option:ContextOptionType, optval:Int):Void {
+		if (closed)
+			throw new ZMQException(ENOTSUP);
+#if (neko || cpp)
+		try {
+			_hx_zmq_ctx_set(contextHandle, ZMQ.contextOptionNo(option), optval);
+		} catch (e:Int) {
+			throw new ZMQException(ZMQ.errNoToErrorType(e));
+		}
+#else
+		throw new ZMQException(ENOTSUP);
+#end
+	}
+	
+	/**
+	 * Returns the value of a context option.
+	 * Raises a ENOTSUP ZMQException if the option is not supported by the 0MQ library (or on php)
+	 * @param	option
+	 * @return
+	 */
+	public function getOption(option:ContextOptionType):Int {
+		if (closed)
+			throw new ZMQException(ENOTSUP);
+#if (neko || cpp)
+		try {
+			return _hx_zmq_ctx_get(contextHandle, ZMQ.contextOptionNo(option));
+		} catch (e:Int) {
+			throw new ZMQException(ZMQ.errNoToErrorType(e));
+		}
+#end
+		throw new ZMQException(ENOTSUP);
+		return null;
+	}
+	
 	/**
 	 * Create a Socket associated with this Context
 	 * @param	socketType	The socket type which can be any of the ZMQ socket types
@@ -119,6 +164,8 @@ class ZMQContext  {
 #if (cpp || neko)	
 	private static var _hx_zmq_construct = neko.Lib.load("hxzmq", "hx_zmq_construct", 1);
 	private static var _hx_zmq_term = neko.Lib.load("hxzmq", "hx_zmq_term", 1);
+	private static var _hx_zmq_ctx_set = neko.Lib.load("hxzmq", "hx_zmq_ctx_set", 3);
+	private static var _hx_zmq_ctx_get = neko.Lib.load("hxzmq", "hx_zmq_ctx_get", 2);
 #elseif php
     private static function _hx_zmq_construct(ioThreads:Int):Dynamic {
         // Implement this test explicitly as php-zmq doesnt seem to detect / trap it.
@@ -22,12 +22,13 @@ package org.zeromq;
 import neko.Lib;
 import neko.Sys;
 import org.zeromq.ZMQ;
+import org.zeromq.ZSubscriptionCache;
 
 /**
  * Wraps ZMQ zmq_device method call.
  * Creates in-built ZMQ devices that run in the current thread of execution.
  * 
- * DEPRECATED in 3.1.x branch
+ * DEPRECATED in 3.1.x branch; use ZMQDevice.proxy instead
  */
 
 class ZMQDevice 
@@ -36,4 +37,46 @@ class ZMQDevice
 		throw new ZMQException(ENOTSUP);
 	}
 
+	/**
+	 * Runs a proxy between a frontend and a backend socket in the current thread,
+	 * in the same way as zmq_proxy. Messages are forwarded in both directions without
+	 * entering the haXe VM, so queue, forwarder and streamer brokers run at libzmq speed.
+	 * 
+	 * Returns when the 0MQ context is terminated.
+	 * Use ZMQ.isInterrupted() to test for a system interrupt after an exception.
+	 * 
+	 * With a ZSubscriptionCache, an XSUB frontend and an XPUB backend, the proxy also tracks
+	 * subscriptions and caches the last message on each topic, replaying cached messages to
+	 * new subscribers natively (neko and cpp only).
+	 * 
+	 * @param	frontend	Frontend socket, e.g. ROUTER, SUB or PULL
+	 * @param	backend		Backend socket, e.g. DEALER, PUB or PUSH
+	 * @param	?capture	If set, every message part forwarded is also sent to this socket
+	 * @param	?cache		If set, subscription trie and last value cache to maintain
+	 */
+	public static function proxy(frontend:ZMQSocket, backend:ZMQSocket, ?capture:ZMQSocket, ?cache:ZSubscriptionCache) {
+		if (frontend == null || backend == null)
+			throw new ZMQException(EINVAL);
+		if (frontend.closed || backend.closed || (capture != null && capture.closed))
+			throw new ZMQException(ENOTSUP);
+#if (neko || cpp)
+		try {
+			_hx_zmq_proxy(frontend._socketHandle, backend._socketHandle, { if (capture == null) null else capture._socketHandle; },
+				{ if (cache == null) null else cache.cacheHandle; } );
+		} catch (e:Int) {
+			throw new ZMQException(ZMQ.errNoToErrorType(e));
+		}
+#elseif php
+		if (cache != null)
+			throw new ZMQException(ENOTSUP);
+		var f = frontend._socketHandle;
+		var b = backend._socketHandle;
+		var c = { if (capture == null) null else capture._socketHandle; };
+		untyped __php__('$d = ($c === null) ? new ZMQDevice($f, $b) : new ZMQDevice($f, $b, $c); $d->run()');
+#end
+	}
+
+#if (neko || cpp)
+	private static var _hx_zmq_proxy = Lib.load("hxzmq", "hx_zmq_proxy", 4);
+#end
 }
\ No newline at end of file
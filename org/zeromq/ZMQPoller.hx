@@ -29,16 +29,40 @@ import org.zeromq.ZMQSocket;
 /**
  * Encapsulates ZMQ Poller functions.
  * 
- * Statefull class, maintaining a set of sockets to poll, events to poll for
+ * Statefull class, maintaining a set of sockets to poll, events to poll for.
+ * On neko and cpp, native file descriptors can be polled in the same set as 0MQ sockets.
+ * Items are numbered in the order they were registered, whether sockets or file descriptors.
+ * On cpp with -D hxzmq_static, poll calls the typed entry points in src/prime.h directly.
  */
+#if (cpp && hxzmq_static)
+@:cppFileCode('extern "C" {
+	struct hx_zmq_pollset;
+	int hx_zmq_prime_poll(hx_zmq_pollset *ps, long timeout);
+	int hx_zmq_prime_ready(hx_zmq_pollset *ps, int k, int *revents);
+	hx_zmq_pollset *hx_zmq_prime_pollset(void *handle);
+}')
+#end
 class ZMQPoller 
 {
     /**
-     * Provides the last-polled set of rececived events
+     * Provides the last-polled set of rececived events, one entry per registered socket.
+     * Built on first access after each poll; use readyCount, readyIndex and readyEvents
+     * to visit only the sockets that signalled.
      */
-	public var revents(default,null):Array<Int>;
+	public var revents(getRevents,null):Array<Int>;
+	
+	/** Last-polled events, once built */
+	private var _revents:Array<Int>;
+	
+	/** Flat (index, revents) pairs for the sockets that signalled on the last poll */
+	private var ready:Array<Int>;
 
 	private var pollItems:List<PollSocketEventTuple>;
+	
+#if (neko || cpp)
+	/** Opaque data used by hxzmq driver: native pollset, kept in step with pollItems and reused across polls */
+	public var pollsetHandle(default,null):Dynamic;
+#end
 		
 	/**
 	 * Constructor
@@ -46,7 +70,11 @@ class ZMQPoller
 	public function new() {
 		
 		pollItems = new List<PollSocketEventTuple>();
-		revents = new Array<Int>();
+		_revents = new Array<Int>();
+		ready = new Array<Int>();
+#if (neko || cpp)
+		pollsetHandle = _hx_zmq_pollset_construct();
+#end
 		
 	}
 	
@@ -67,10 +95,44 @@ class ZMQPoller
 			return;
 		}
 		
-		pollItems.add( { _socket:socket, _event:event } );
+#if (neko || cpp)
+		try {
+			_hx_zmq_pollset_add(pollsetHandle, socket._socketHandle, event);
+		} catch (e:Int) {
+			throw new ZMQException(ZMQ.errNoToErrorType(e));
+		}
+#end
+		pollItems.add( { _socket:socket, _event:event, _fd:-1 } );
 					
 	}
 	
+	/**
+	 * Adds a native file descriptor (e.g. a TCP socket, pipe or timerfd; a SOCKET on Windows)
+	 * to the internal list of polled items, to be polled alongside 0MQ sockets.
+	 * Not supported on php.
+	 * @param	fd		File descriptor
+	 * @param	event	Bitmasked Int for polled events (ZMQ_POLLIN, ZMQ_POLLOUT)
+	 */
+	public function registerFd(fd:Int, event:Int)
+	{
+		
+		if (fd == null || fd < 0 || event == null) {
+			throw new ZMQException(EINVAL);
+			return;
+		}
+		
+#if (neko || cpp)
+		try {
+			_hx_zmq_pollset_add_fd(pollsetHandle, fd, event);
+		} catch (e:Int) {
+			throw new ZMQException(ZMQ.errNoToErrorType(e));
+		}
+#else
+		throw new ZMQException(ENOTSUP);
+#end
+		pollItems.add( { _socket:null, _event:event, _fd:fd } );
+	}
+	
 	/**
 	 * Removes a previously registered socket
 	 * @param	socket
@@ -84,21 +146,75 @@ class ZMQPoller
 		}
 		
 		// Find first matching socket object, then remove it
+		var i = 0;
 		for (pi in pollItems) {
-			if (pi._socket.equals(socket)) {
+			if (pi._socket != null && pi._socket.equals(socket)) {
 				pollItems.remove(pi);
+#if (neko || cpp)
+				_hx_zmq_pollset_remove(pollsetHandle, i);
+#end
 				return true;
 			}
+			i++;
 		}
 		
 		return false;
 	}
 	
 	/**
-	 * Removes all current registered sockets
+	 * Removes a previously registered file descriptor
+	 * @param	fd
+	 * @return
+	 */
+	public function unregisterFd(fd:Int):Bool {
+		
+		// Find first matching file descriptor, then remove it
+		var i = 0;
+		for (pi in pollItems) {
+			if (pi._socket == null && pi._fd == fd) {
+				pollItems.remove(pi);
+#if (neko || cpp)
+				_hx_zmq_pollset_remove(pollsetHandle, i);
+#end
+				return true;
+			}
+			i++;
+		}
+		
+		return false;
+	}
+	
+	/**
+	 * Removes the s'th registered item, whether a socket or file descriptor.
+	 * Later items move down by one.
+	 * @param	s	Valid s parameter range from 1 to getSize()
+	 * @return
+	 */
+	public function unregisterIndex(s:Int):Bool {
+
+		var i = 1;
+		for (pi in pollItems) {
+			if (i == s) {
+				pollItems.remove(pi);
+#if (neko || cpp)
+				_hx_zmq_pollset_remove(pollsetHandle, i - 1);
+#end
+				return true;
+			}
+			i++;
+		}
+
+		return false;
+	}
+
+	/**
+	 * Removes all current registered sockets and file descriptors
 	 */
 	public function unregisterAllSockets() {
 		pollItems.clear();
+#if (neko || cpp)
+		_hx_zmq_pollset_clear(pollsetHandle);
+#end
 	}
 	
 	/**
@@ -108,26 +224,32 @@ class ZMQPoller
 	 */
 	public function poll(?timeout:Int = -1):Int 
 	{
-		revents = null;		// Clear out revents array ready for next set of results
-		revents = new Array<Int>();
-#if (neko || cpp)
-		// Split pollItems array into 2 separate arrays to pass to the native layer
-		var sArray:Array<Dynamic> = new Array<Dynamic>();   // ZMQ Sockets
-		var eArray:Array<Int> = new Array<Int>();           // Polled Event Types
-
-		for (p in pollItems) {
-			sArray.push(p._socket._socketHandle);
-			eArray.push(p._event);
-			revents.push(0);		// initialise revents array
+		_revents = null;		// Clear out previous results
+		ready.splice(0, ready.length);	// Reused, rather than allocated on every poll
+#if (cpp && hxzmq_static)
+		var ps:Dynamic = pollsetHandle;
+		if (ps == null)
+			throw new ZMQException(ENOTSUP);
+		// Resolve the native pollset once, for the poll and all its ready items
+		untyped __cpp__("hx_zmq_pollset *nps = hx_zmq_prime_pollset(ps.mPtr)");
+		var n:Int = untyped __cpp__("hx_zmq_prime_poll(nps, timeout)");
+		if (n < 0)
+			throw new ZMQException(ZMQ.errNoToErrorType(-n));
+		// Native pollset holds the indexes of signalled items only
+		for (k in 0 ... n) {
+			var ev:Int = 0;
+			var index:Int = untyped __cpp__("hx_zmq_prime_ready(nps, k, &ev)");
+			if (index < 0)
+				throw new ZMQException(EINVAL);
+			ready.push(index);
+			ready.push(ev);
 		}
-		
-		try {			
-			var r:PollResult = _hx_zmq_poll(sArray, eArray, timeout);
-			if (r == null) {
-				return -1;
-			}
-			revents = Lib.nekoToHaxe(r._revents).copy();
-			return r._ret;
+		return n;
+#elseif (neko || cpp)
+		try {
+			// Native pollset returns (index, revents) pairs for signalled items only
+			ready = cast ZMQ.nativeToArray(_hx_zmq_pollset_poll(pollsetHandle, timeout));
+			return readyCount();
 		} catch (e:Int) {
 			throw new ZMQException(ZMQ.errNoToErrorType(e));
 			return -1;
@@ -155,6 +277,7 @@ class ZMQPoller
         // Iterate over registered sockets to build up revents array
         var item = 0;
         var numEvents = 0;
+        var revents = new Array<Int>();
         for (p in pollItems) {
             revents[item] = 0;
             // Is this socket in the readableArr returned from the php poll?
@@ -171,14 +294,48 @@ class ZMQPoller
                     break;
                 }
             }
-            if (revents[item] != 0) numEvents++;
+            if (revents[item] != 0) {
+                ready.push(item);
+                ready.push(revents[item]);
+                numEvents++;
+            }
             item++;
         }
+        _revents = revents;
         return numEvents;
 
 #end
 	}
 	
+	/**
+	 * Number of registered sockets that signalled on the last poll
+	 * @return
+	 */
+	public function readyCount():Int {
+		return ready.length >> 1;
+	}
+	
+	/**
+	 * Returns the position of the k'th socket that signalled on the last poll,
+	 * in the same 1-based form taken by pollin and pollout.
+	 * 
+	 * @param	k	Valid k parameter range from 0 to readyCount() - 1
+	 * @return
+	 */
+	public function readyIndex(k:Int):Int {
+		return ready[k << 1] + 1;
+	}
+	
+	/**
+	 * Returns the events received by the k'th socket that signalled on the last poll
+	 * 
+	 * @param	k	Valid k parameter range from 0 to readyCount() - 1
+	 * @return
+	 */
+	public function readyEvents(k:Int):Int {
+		return ready[(k << 1) + 1];
+	}
+	
 	/**
 	 * Test if the s'th registered socket has a registered POLLIN event.
 	 * Call this after a poll() method call to test the results.
@@ -187,10 +344,7 @@ class ZMQPoller
 	 * @return		True if specified registered socket has a current POLLIN event, else False
 	 */
 	public function pollin(s: Int):Bool {
-		if (revents == null || revents.length == 0) return false;
-		if (s > revents.length) return false;	
-	
-		return (revents[s - 1] & ZMQ.ZMQ_POLLIN()) == ZMQ.ZMQ_POLLIN();
+		return (events(s) & ZMQ.ZMQ_POLLIN()) == ZMQ.ZMQ_POLLIN();
 	}
 	
 	/**
@@ -201,10 +355,7 @@ class ZMQPoller
 	 * @return		True if specified registered socket has a current POLLOUT event, else False
 	 */
 	public function pollout(s: Int):Bool {
-		if (revents == null || revents.length == 0) return false;
-		if (s > revents.length) return false;	
-	
-		return (revents[s - 1] & ZMQ.ZMQ_POLLOUT()) == ZMQ.ZMQ_POLLOUT();
+		return (events(s) & ZMQ.ZMQ_POLLOUT()) == ZMQ.ZMQ_POLLOUT();
 	}
 	
 	/**
@@ -216,16 +367,48 @@ class ZMQPoller
 		return (!pollin(s) && !pollout(s));
 	}
 	
+	/**
+	 * Returns events received by the s'th registered socket on the last poll, else 0
+	 */
+	private function events(s:Int):Int {
+		if (_revents != null) {
+			return { if (s < 1 || s > _revents.length) 0 else _revents[s - 1]; };
+		}
+		// Look up in ready list, without building the full revents array
+		var k = 0;
+		while (k < ready.length) {
+			if (ready[k] == s - 1) return ready[k + 1];
+			k += 2;
+		}
+		return 0;
+	}
+	
+	private function getRevents():Array<Int> {
+		if (_revents == null) {
+			_revents = new Array<Int>();
+			for (p in pollItems) {
+				_revents.push(0);
+			}
+			var k = 0;
+			while (k < ready.length) {
+				_revents[ready[k]] = ready[k + 1];
+				k += 2;
+			}
+		}
+		return _revents;
+	}
+	
 #if (neko || cpp)    
-	private static var _hx_zmq_poll = Lib.load("hxzmq", "hx_zmq_poll", 3);
+	private static var _hx_zmq_pollset_construct = Lib.load("hxzmq", "hx_zmq_pollset_construct", 0);
+	private static var _hx_zmq_pollset_add = Lib.load("hxzmq", "hx_zmq_pollset_add", 3);
+	private static var _hx_zmq_pollset_add_fd = Lib.load("hxzmq", "hx_zmq_pollset_add_fd", 3);
+	private static var _hx_zmq_pollset_remove = Lib.load("hxzmq", "hx_zmq_pollset_remove", 2);
+	private static var _hx_zmq_pollset_clear = Lib.load("hxzmq", "hx_zmq_pollset_clear", 1);
+	private static var _hx_zmq_pollset_poll = Lib.load("hxzmq", "hx_zmq_pollset_poll", 2);
 #end
 }
 
 typedef PollSocketEventTuple = {
-	_socket:ZMQSocket,
-	_event:Int };
-	
-typedef PollResult = {
-	_revents:Array<Int>,
-	_ret:Int
-};
\ No newline at end of file
+	_socket:ZMQSocket,	// null for a native file descriptor
+	_event:Int,
+	_fd:Int };
@@ -27,6 +27,8 @@ import neko.Sys;
 import org.zeromq.ZMQ;
 #if php
 import org.zeromq.externals.phpzmq.ZMQSocketException;
+#elseif (neko || cpp)
+import neko.vm.Mutex;
 #end
 
 /**
@@ -36,7 +38,21 @@ import org.zeromq.externals.phpzmq.ZMQSocketException;
  * 
  * Class based on code from pyzmq project
  * See: https://github.com/zeromq/pyzmq/blob/master/zmq/core/socket.pyx
+ * 
+ * On cpp, compiling with -D hxzmq_static and linking the hxzmq-static library (see build.xml)
+ * makes sendMsg, recvInto and int socket options call the typed entry points in src/prime.h
+ * directly, instead of the boxed CFFI primitives.
  */
+#if (cpp && hxzmq_static)
+@:cppFileCode('#include <errno.h>
+extern "C" {
+	int hx_zmq_prime_send(void *socket, const unsigned char *data, size_t size, int flags);
+	int hx_zmq_prime_recv(void *socket, unsigned char *data, size_t size, int flags);
+	int hx_zmq_prime_setsockopt_int(void *socket, int option, int optval);
+	int hx_zmq_prime_getsockopt_int(void *socket, int option, int *optval);
+	void *hx_zmq_prime_socket(void *handle);
+}')
+#end
 class ZMQSocket 
 {
 
@@ -55,6 +71,9 @@ class ZMQSocket
      * Holds type of socket
      */
     public var type(default, null):SocketType;
+
+	/** Number unique to this socket within the process, e.g. to key an IntHash by socket */
+	public var id(default,null):Int;
     
 	/**
 	 * Constructor.
@@ -67,6 +86,7 @@ class ZMQSocket
 	{
 		closed = true;
 		this.context = context;
+		id = newId();
 		try {
 			_socketHandle = _hx_zmq_construct_socket(context.contextHandle, ZMQ.socketTypeNo(type));
 			
@@ -185,16 +205,23 @@ class ZMQSocket
 			throw new ZMQException(ENOTSUP);
                     
         var _opt = ZMQ.socketOptionTypeNo(option);
+		var _kind = ZMQ.socketOptionKind(option);
            
 		// Handle 32 bit int options
-		if (Lambda.exists(ZMQ.intSocketOptionTypes,
-			  function(so) { return so == option; } ))
+		if (_kind == ZMQ.OPTION_INT)
 		{
 			if (!Std.is(optval,Int))
 				throw new String("Expected Int, got " + optval);
 		
 			try {	
-#if (neko || cpp)                
+#if (cpp && hxzmq_static)
+				var sock:Dynamic = _socketHandle;
+				var iv:Int = optval;
+				primeResult(untyped __cpp__("hx_zmq_prime_setsockopt_int(hx_zmq_prime_socket(sock.mPtr), _opt, iv)"));
+			} catch (e:Int) {
+				throw new ZMQException(ZMQ.errNoToErrorType(e));
+			}
+#elseif (neko || cpp)                
 				_hx_zmq_setintsockopt(_socketHandle, _opt, optval);
 			} catch (e:Int) {
 				throw new ZMQException(ZMQ.errNoToErrorType(e));
@@ -207,8 +234,7 @@ class ZMQSocket
 #end  
 			
 		// Handle 64 bit int options	
-		} else if (Lambda.exists(ZMQ.int64SocketOptionTypes,
-			  function(so) { return so == option; } ))
+		} else if (_kind == ZMQ.OPTION_INT64)
 		{
 #if (neko || cpp)            
 			var _hi = Reflect.field(optval, "hi");
@@ -238,8 +264,7 @@ class ZMQSocket
 #end
 			
 		// Handle bytes  options	
-		} else if (Lambda.exists(ZMQ.bytesSocketOptionTypes,
-			  function(so) { return so == option; } ))
+		} else if (_kind == ZMQ.OPTION_BYTES)
 		{
 			if (!Std.is(optval, Bytes)) {
 				throw new String("Expected Bytes, got " + optval);
@@ -274,18 +299,27 @@ class ZMQSocket
 	{
 		var _optval:Dynamic = null;
         var _opt = ZMQ.socketOptionTypeNo(option);
+		var _kind = ZMQ.socketOptionKind(option);
 		
 		if (_socketHandle == null || closed) {
 			throw new ZMQException(ENOTSUP);
 			return null;
 		}
 
-		if (Lambda.exists(ZMQ.intSocketOptionTypes,
-			  function(so) { return so == option; } ))
+		if (_kind == ZMQ.OPTION_INT)
 		{
 		
 			try {	
-#if (neko || cpp)        
+#if (cpp && hxzmq_static)
+				var sock:Dynamic = _socketHandle;
+				var iv:Int = 0;
+				primeResult(untyped __cpp__("hx_zmq_prime_getsockopt_int(hx_zmq_prime_socket(sock.mPtr), _opt, &iv)"));
+				return iv;
+			} catch (e:Int) {
+				throw new ZMQException(ZMQ.errNoToErrorType(e));
+				return null;
+			}
+#elseif (neko || cpp)        
 				_optval = Lib.nekoToHaxe(_hx_zmq_getintsockopt(_socketHandle, _opt));
 			} catch (e:Int) {
 				throw new ZMQException(ZMQ.errNoToErrorType(e));
@@ -305,8 +339,7 @@ class ZMQSocket
             }
 #end
 
-		} else if (Lambda.exists(ZMQ.int64SocketOptionTypes,
-			  function(so) { return so == option; } ))
+		} else if (_kind == ZMQ.OPTION_INT64)
 		{
 		
 #if php
@@ -333,8 +366,7 @@ class ZMQSocket
 			}
  #end
                 
-		}else if (Lambda.exists(ZMQ.bytesSocketOptionTypes,
-			  function(so) { return so == option; } ))
+		}else if (_kind == ZMQ.OPTION_BYTES)
 		{
 		
 			try {	
@@ -375,7 +407,15 @@ class ZMQSocket
 		}
 
 		try {
-#if (neko || cpp)            
+#if (cpp && hxzmq_static)
+			var sock:Dynamic = _socketHandle;
+			var buf:BytesData = data.getData();
+			var fl:Int = ZMQ.sendReceiveFlagNo(flags);
+			var rc:Int = untyped __cpp__("hx_zmq_prime_send(hx_zmq_prime_socket(sock.mPtr), (const unsigned char *)buf->GetBase(), buf->length, fl)");
+			// If DONTWAIT, but cant send message now, quietly return
+			if (rc != untyped __cpp__("-EAGAIN"))
+				primeResult(rc);
+#elseif (neko || cpp)            
 			_hx_zmq_send(_socketHandle, data.getData(), ZMQ.sendReceiveFlagNo(flags));
 #elseif php
 
@@ -392,6 +432,52 @@ class ZMQSocket
 			
 	}
 
+	/**
+	 * Send a message on this socket without copying its data
+	 * 
+	 * The bytes are handed directly to the 0MQ IO thread, rather than being copied into
+	 * a new 0MQ message first.  Use this for large messages, where the copy made by sendMsg
+	 * is significant.  The data object is kept alive until 0MQ has finished with it, so
+	 * the caller MUST NOT modify the contents of data after calling this method.
+	 * Call releaseZeroCopyBuffers() to test if 0MQ still holds any sent buffers.
+	 * 
+	 * On php, this is the same as calling sendMsg.
+	 * 
+	 * @param	data	The content of the message
+	 * @param	?flags	Any supported SocketFlag DONTWAIT, SNDMORE
+	 */
+	public function sendMsgZeroCopy(data:Bytes, ?flags:SendReceiveFlagType):Void {
+#if (neko || cpp)
+		if (_socketHandle == null || closed) {
+			throw new ZMQException(ENOTSUP);
+		}
+
+		try {
+			_hx_zmq_send_zerocopy(_socketHandle, data.getData(), ZMQ.sendReceiveFlagNo(flags));
+		} catch (e:Int) {
+			throw new ZMQException(ZMQ.errNoToErrorType(e));
+		} 
+#elseif php
+		sendMsg(data, flags);
+#end
+	}
+	
+	/**
+	 * Releases any buffers sent with sendMsgZeroCopy that 0MQ has now finished with,
+	 * so they can be garbage collected.
+	 * 
+	 * Buffers are also released automatically on each sendMsgZeroCopy call.
+	 * 
+	 * @return	Number of zero-copy buffers still in use by 0MQ
+	 */
+	public static function releaseZeroCopyBuffers():Int {
+#if (neko || cpp)
+		return _hx_zmq_release_zerocopy();
+#else
+		return 0;
+#end
+	}
+	
 	/**
 	 * Receive a message on this socket
 	 * 
@@ -436,6 +522,250 @@ class ZMQSocket
 			
 	}
 	
+	/**
+	 * Receive a message on this socket into an existing Bytes object
+	 * 
+	 * Writes the message content into bytes, starting at offset, instead of allocating
+	 * a new Bytes object for every message.  Reusing the same buffers lets a steady-state
+	 * consumer receive without creating garbage.
+	 * 
+	 * As with zmq_recv, the returned size is the full size of the received message.  If it is
+	 * larger than (bytes.length - offset), the message was truncated to fit.
+	 * 
+	 * @param	bytes	Buffer to receive message content into
+	 * @param	offset	Position in bytes to write message content from
+	 * @param	?flags	DONTWAIT
+	 * @return	Size of the received message, or -1 if DONTWAIT was used and no message was available
+	 */
+	public function recvInto(bytes:Bytes, offset:Int, ?flags:SendReceiveFlagType):Int {
+
+		if (_socketHandle == null || closed)
+			throw new ZMQException(ENOTSUP);
+		if (bytes == null || offset < 0 || offset > bytes.length)
+			throw new ZMQException(EINVAL);
+			
+#if (cpp && hxzmq_static)
+		var sock:Dynamic = _socketHandle;
+		var buf:BytesData = bytes.getData();
+		var fl:Int = ZMQ.sendReceiveFlagNo(flags);
+		var rc:Int = untyped __cpp__("hx_zmq_prime_recv(hx_zmq_prime_socket(sock.mPtr), (unsigned char *)buf->GetBase() + offset, buf->length - offset, fl)");
+		if (rc == untyped __cpp__("-EAGAIN"))
+			return -1;
+		try {
+			return primeResult(rc);
+		} catch (e:Int) {
+			throw new ZMQException(ZMQ.errNoToErrorType(e));
+		}
+		return -1;
+#elseif (neko || cpp)
+		try {
+			return _hx_zmq_recv_into(_socketHandle, bytes.getData(), offset, ZMQ.sendReceiveFlagNo(flags));
+		} catch (e:Int) {
+			throw new ZMQException(ZMQ.errNoToErrorType(e));
+		}
+		return -1;
+#else
+		var msg:Bytes = recvMsg(flags);
+		if (msg == null)
+			return -1;
+		var len = msg.length;
+		if (len > bytes.length - offset)
+			len = bytes.length - offset;
+		bytes.blit(offset, msg, 0, len);
+		return msg.length;
+#end
+	}
+	
+	/**
+	 * Receive a batch of waiting messages on this socket
+	 * 
+	 * Only the first receive uses flags, so may block; further messages are taken only while
+	 * they are already waiting.  On neko and cpp the whole batch is read in a single native call,
+	 * letting a handler drain a socket once per poll wakeup.
+	 * Each part of a multipart message is returned as a separate entry; pass a more array to
+	 * tell where messages end. A multipart message is never split between batches, so the last
+	 * message may take the batch past max.
+	 * 
+	 * @param	max		Maximum number of message parts to receive
+	 * @param	?flags	DONTWAIT
+	 * @param	?more	If set, cleared and filled with the RCVMORE flag of each entry returned
+	 * @return	Received message parts, or null if DONTWAIT was used and no message was available
+	 */
+	public function recvBatch(max:Int, ?flags:SendReceiveFlagType, ?more:Array<Bool>):Array<Bytes> {
+
+		if (_socketHandle == null || closed)
+			throw new ZMQException(ENOTSUP);
+		if (max <= 0)
+			throw new ZMQException(EINVAL);
+			
+#if (neko || cpp)
+		var r:Dynamic = null;
+		try {
+			r = _hx_zmq_recv_batch(_socketHandle, max, ZMQ.sendReceiveFlagNo(flags));
+		} catch (e:Int) {
+			throw new ZMQException(ZMQ.errNoToErrorType(e));
+		}
+		if (more != null)
+			more.splice(0, more.length);
+		if (r == null)
+			return null;
+		// Native batch is flat (data, more flag) pairs
+		var a = ZMQ.nativeToArray(r);
+		var msgs = new Array<Bytes>();
+		var i = 0;
+		while (i < a.length) {
+			msgs.push(Bytes.ofData(a[i]));
+			if (more != null)
+				more.push(a[i + 1]);
+			i += 2;
+		}
+		return msgs;
+#else
+		if (more != null)
+			more.splice(0, more.length);
+		var msg:Bytes = recvMsg(flags);
+		if (msg == null)
+			return null;
+		var msgs = new Array<Bytes>();
+		var partMore = true;
+		while (msg != null) {
+			msgs.push(msg);
+			partMore = hasReceiveMore();
+			if (more != null)
+				more.push(partMore);
+			msg = { if (msgs.length < max || partMore) recvMsg(DONTWAIT) else null; };
+		}
+		return msgs;
+#end
+	}
+	
+	/**
+	 * Send a batch of messages on this socket
+	 * 
+	 * Each element is sent as a separate message.  On neko and cpp the whole batch is sent
+	 * in a single native call.
+	 * 
+	 * @param	msgs	Messages to send, in order
+	 * @param	?flags	DONTWAIT
+	 * @return	Number of messages sent; with DONTWAIT, sending stops at the first message that could not be queued
+	 */
+	public function sendBatch(msgs:Array<Bytes>, ?flags:SendReceiveFlagType):Int {
+
+		if (_socketHandle == null || closed)
+			throw new ZMQException(ENOTSUP);
+		if (msgs == null)
+			throw new ZMQException(EINVAL);
+			
+#if (neko || cpp)
+		var data = new Array<Dynamic>();
+		for (m in msgs) {
+			if (m == null)
+				throw new ZMQException(EINVAL);
+			data.push(m.getData());
+		}
+		try {
+			return _hx_zmq_send_batch(_socketHandle, data, ZMQ.sendReceiveFlagNo(flags));
+		} catch (e:Int) {
+			throw new ZMQException(ZMQ.errNoToErrorType(e));
+		}
+		return 0;
+#else
+		for (m in msgs) {
+			sendMsg(m, flags);
+		}
+		return msgs.length;
+#end
+	}
+	
+	/**
+	 * Send a multipart message on this socket
+	 * 
+	 * On neko and cpp, all parts are sent in a single native call.
+	 * 
+	 * @param	parts	Message parts, in order
+	 * @param	?flags	DONTWAIT
+	 * @return	true if sent, false if DONTWAIT was used and the message could not be queued
+	 */
+	public function sendMultipart(parts:Array<Bytes>, ?flags:SendReceiveFlagType):Bool {
+
+		if (_socketHandle == null || closed)
+			throw new ZMQException(ENOTSUP);
+		if (parts == null)
+			throw new ZMQException(EINVAL);
+			
+#if (neko || cpp)
+		var data = new Array<Dynamic>();
+		for (p in parts) {
+			if (p == null)
+				throw new ZMQException(EINVAL);
+			data.push(p.getData());
+		}
+		try {
+			return _hx_zmq_send_multipart(_socketHandle, data, ZMQ.sendReceiveFlagNo(flags)) > 0;
+		} catch (e:Int) {
+			throw new ZMQException(ZMQ.errNoToErrorType(e));
+		}
+		return false;
+#else
+		for (i in 0...parts.length) {
+			sendMsg(parts[i], { if (i < parts.length - 1) SNDMORE else flags; } );
+		}
+		return true;
+#end
+	}
+	
+	/**
+	 * Receive all parts of a multipart message on this socket
+	 * 
+	 * On neko and cpp, the whole message is read in a single native call.
+	 * 
+	 * @param	?flags	DONTWAIT
+	 * @return	Message parts, or null if DONTWAIT was used and no message was available
+	 */
+	public function recvMultipart(?flags:SendReceiveFlagType):Array<Bytes> {
+
+		if (_socketHandle == null || closed)
+			throw new ZMQException(ENOTSUP);
+			
+		var parts = new Array<Bytes>();
+#if (neko || cpp)
+		var handles:Dynamic = null;
+		try {
+			handles = _hx_zmq_recv_multipart(_socketHandle, ZMQ.sendReceiveFlagNo(flags));
+		} catch (e:Int) {
+			throw new ZMQException(ZMQ.errNoToErrorType(e));
+		}
+		if (handles == null)
+			return null;
+		for (h in ZMQ.nativeToArray(handles)) {
+			parts.push(Bytes.ofData(_hx_zmq_msg_data(h)));
+			_hx_zmq_msg_close(h);
+		}
+#else
+		var msg:Bytes = recvMsg(flags);
+		if (msg == null)
+			return null;
+		parts.push(msg);
+		while (hasReceiveMore()) {
+			parts.push(recvMsg());
+		}
+#end
+		return parts;
+	}
+	
+	/**
+	 * Returns a snapshot of the traffic counters and blocking time histogram kept for this socket
+	 * @return	Stats, or null if hxzmq.ndll was built without HXZMQ_STATS, on php, or once the socket is closed
+	 */
+	public function stats():ZMQStats {
+		if (_socketHandle == null || closed) return null;
+#if (neko || cpp)
+		return ZMQStats.fromNative(_hx_zmq_stats_socket(_socketHandle));
+#else
+		return null;
+#end
+	}
+	
 	/**
 	 * Convenience method to test if socket has more parts of a multipart message to read
 	 * @return
@@ -448,6 +778,23 @@ class ZMQSocket
 
 	}
 	
+	// Sockets may be created on any thread
+	private static function newId():Int {
+#if (neko || cpp)
+		idLock.acquire();
+#end
+		var ret = nextId++;
+#if (neko || cpp)
+		idLock.release();
+#end
+		return ret;
+	}
+	
+	private static var nextId:Int = 0;
+#if (neko || cpp)
+	private static var idLock:Mutex = new Mutex();
+#end
+	
 	/**
 	 * Performs a target-specific equality test to another ZMQSocket instance
 	 * @param	other
@@ -463,18 +810,39 @@ class ZMQSocket
 	}
 	
 #if (neko || cpp)    
+#if (cpp && hxzmq_static)
+	/**
+	 * Throws the errno of a failed typed entry point call, as the boxed primitives do, else returns rc
+	 */
+	private static function primeResult(rc:Int):Int {
+		if (rc < 0)
+			throw -rc;
+		return rc;
+	}
+#end
+	
 	private static var _hx_zmq_construct_socket = neko.Lib.load("hxzmq", "hx_zmq_construct_socket", 2);
 	private static var _hx_zmq_close = neko.Lib.load("hxzmq", "hx_zmq_close", 1);
 	private static var _hx_zmq_bind = neko.Lib.load("hxzmq", "hx_zmq_bind", 2);
 	private static var _hx_zmq_connect = neko.Lib.load("hxzmq", "hx_zmq_connect", 2);
 	private static var _hx_zmq_send = neko.Lib.load("hxzmq", "hx_zmq_send", 3);
+	private static var _hx_zmq_send_zerocopy = neko.Lib.load("hxzmq", "hx_zmq_send_zerocopy", 3);
+	private static var _hx_zmq_release_zerocopy = neko.Lib.load("hxzmq", "hx_zmq_release_zerocopy", 0);
 	private static var _hx_zmq_rcv = neko.Lib.load("hxzmq", "hx_zmq_rcv", 2);
+	private static var _hx_zmq_recv_into = neko.Lib.load("hxzmq", "hx_zmq_recv_into", 4);
+	private static var _hx_zmq_send_batch = neko.Lib.load("hxzmq", "hx_zmq_send_batch", 3);
+	private static var _hx_zmq_recv_batch = neko.Lib.load("hxzmq", "hx_zmq_recv_batch", 3);
+	private static var _hx_zmq_send_multipart = neko.Lib.load("hxzmq", "hx_zmq_send_multipart", 3);
+	private static var _hx_zmq_recv_multipart = neko.Lib.load("hxzmq", "hx_zmq_recv_multipart", 2);
+	private static var _hx_zmq_msg_data = neko.Lib.load("hxzmq", "hx_zmq_msg_data", 1);
+	private static var _hx_zmq_msg_close = neko.Lib.load("hxzmq", "hx_zmq_msg_close", 1);
 	private static var _hx_zmq_setintsockopt = neko.Lib.load("hxzmq", "hx_zmq_setintsockopt", 3);
 	private static var _hx_zmq_setint64sockopt = neko.Lib.load("hxzmq", "hx_zmq_setint64sockopt", 4);
 	private static var _hx_zmq_setbytessockopt = neko.Lib.load("hxzmq", "hx_zmq_setbytessockopt", 3);
 	private static var _hx_zmq_getintsockopt = neko.Lib.load("hxzmq", "hx_zmq_getintsockopt", 2);
 	private static var _hx_zmq_getint64sockopt = neko.Lib.load("hxzmq", "hx_zmq_getint64sockopt", 2);
 	private static var _hx_zmq_getbytessockopt = neko.Lib.load("hxzmq", "hx_zmq_getbytessockopt", 2);
+	private static var _hx_zmq_stats_socket = neko.Lib.load("hxzmq", "hx_zmq_stats_socket", 1);
 #elseif php
     private static  function _hx_zmq_construct_socket(context:Dynamic, type:Int):Dynamic {
         return untyped __php__('new ZMQSocket($context, $type)');
@@ -0,0 +1,161 @@
+/**
+ * (c) 2011 Richard J Smith
+ *
+ * This file is part of hxzmq
+ *
+ * hxzmq is free software; you can redistribute it and/or modify it under
+ * the terms of the Lesser GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hxzmq is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * Lesser GNU General Public License for more details.
+ *
+ * You should have received a copy of the Lesser GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+package org.zeromq;
+
+import neko.Lib;
+
+/**
+ * Snapshot of the traffic counters and blocking time histogram kept by the hxzmq native library,
+ * for one socket (ZMQSocket.stats()), all sockets (ZMQStats.process()) or poll calls (ZMQStats.polls()).
+ *
+ * Stats are only kept when hxzmq.ndll is built with HXZMQ_STATS defined (see build.xml);
+ * otherwise, and on php, no snapshots are available.
+ *
+ * Counts are Floats, as they can exceed the range of a neko Int.
+ * Blocking times are the time spent inside libzmq with the GC released, in nanoseconds.
+ */
+class ZMQStats
+{
+	/** Number of histogram buckets per power of two */
+	private static inline var SUB_BUCKETS:Int = 4;
+
+	/** Number of counters preceding the histogram in a native snapshot */
+	private static inline var COUNTERS:Int = 9;
+
+	/** Messages (or message parts) sent */
+	public var messagesSent(default,null):Float;
+	/** Bytes sent */
+	public var bytesSent(default,null):Float;
+	/** Messages (or message parts) received */
+	public var messagesReceived(default,null):Float;
+	/** Bytes received */
+	public var bytesReceived(default,null):Float;
+	/** DONTWAIT sends that could not be queued */
+	public var sendsDropped(default,null):Float;
+	/** DONTWAIT receives that found no message waiting */
+	public var receivesEmpty(default,null):Float;
+	/** Send and receive calls that failed with an error other than EAGAIN */
+	public var errors(default,null):Float;
+	/** Number of calls timed */
+	public var calls(default,null):Float;
+	/** Total blocking time of all timed calls, in nanoseconds */
+	public var blockedNsec(default,null):Float;
+	/** Count of timed calls per blocking time bucket. See bucketLow() */
+	public var histogram(default,null):Array<Float>;
+
+	/**
+	 * Returns the totals for all sockets opened by this process, including those since closed,
+	 * or null if stats are not available
+	 */
+	public static function process():ZMQStats {
+#if (neko || cpp)
+		return fromNative(_hx_zmq_stats_process());
+#else
+		return null;
+#end
+	}
+
+	/**
+	 * Returns the number and blocking time histogram of ZMQPoller and ZLoop polls,
+	 * or null if stats are not available
+	 */
+	public static function polls():ZMQStats {
+#if (neko || cpp)
+		return fromNative(_hx_zmq_stats_polls());
+#else
+		return null;
+#end
+	}
+
+	/**
+	 * Returns true if hxzmq.ndll was built with stats enabled
+	 */
+	public static function isEnabled():Bool {
+		return polls() != null;
+	}
+
+	/**
+	 * Converts a native snapshot array, returns null if v is null
+	 */
+	public static function fromNative(v:Dynamic):ZMQStats {
+		if (v == null) return null;
+		var a:Array<Float> = cast ZMQ.nativeToArray(v);
+		var s = new ZMQStats();
+		s.messagesSent = a[0];
+		s.bytesSent = a[1];
+		s.messagesReceived = a[2];
+		s.bytesReceived = a[3];
+		s.sendsDropped = a[4];
+		s.receivesEmpty = a[5];
+		s.errors = a[6];
+		s.calls = a[7];
+		s.blockedNsec = a[8];
+		s.histogram = a.slice(COUNTERS);
+		return s;
+	}
+
+	/**
+	 * Returns the smallest blocking time, in nanoseconds, counted in a histogram bucket
+	 */
+	public static function bucketLow(bucket:Int):Float {
+		if (bucket < SUB_BUCKETS) return bucket;
+		var magnitude = Std.int(bucket / SUB_BUCKETS) + 1;
+		return (SUB_BUCKETS + bucket % SUB_BUCKETS) * Math.pow(2, magnitude - 2);
+	}
+
+	private function new() {
+	}
+
+	/**
+	 * Estimates a blocking time percentile from the histogram
+	 * @param	p	Percentile, from 0 to 100
+	 * @return	Lower bound, in nanoseconds, of the bucket holding the percentile; within 25% of the exact value
+	 */
+	public function percentile(p:Float):Float {
+		if (calls == 0) return 0;
+		var target = calls * p / 100;
+		var seen = 0.0;
+		for (i in 0 ... histogram.length) {
+			seen += histogram[i];
+			if (seen >= target && histogram[i] > 0)
+				return bucketLow(i);
+		}
+		return bucketLow(histogram.length - 1);
+	}
+
+	/**
+	 * Mean blocking time per timed call, in nanoseconds
+	 */
+	public function meanNsec():Float {
+		return { if (calls == 0) 0 else blockedNsec / calls; };
+	}
+
+	public function toString():String {
+		return "sent=" + messagesSent + "/" + bytesSent + "B" +
+			" received=" + messagesReceived + "/" + bytesReceived + "B" +
+			" dropped=" + sendsDropped + " empty=" + receivesEmpty + " errors=" + errors +
+			" calls=" + calls + " p50=" + percentile(50) + "ns p99=" + percentile(99) + "ns";
+	}
+
+#if (neko || cpp)
+	private static var _hx_zmq_stats_process = Lib.load("hxzmq", "hx_zmq_stats_process", 0);
+	private static var _hx_zmq_stats_polls = Lib.load("hxzmq", "hx_zmq_stats_polls", 0);
+#end
+}
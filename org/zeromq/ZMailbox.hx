@@ -0,0 +1,135 @@
+/**
+ * (c) 2011 Richard J Smith
+ *
+ * This file is part of hxzmq
+ *
+ * hxzmq is free software; you can redistribute it and/or modify it under
+ * the terms of the Lesser GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hxzmq is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * Lesser GNU General Public License for more details.
+ *
+ * You should have received a copy of the Lesser GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+package org.zeromq;
+
+import neko.Lib;
+import org.zeromq.ZMQ;
+
+/**
+ * Lightweight mailbox for passing values (including Bytes) from any number of threads
+ * to one receiving thread, usually running a ZLoop (see ZLoop.registerMailbox).
+ * 
+ * Unlike a ZThread.attach pipe, posting a value makes no 0MQ message and copies nothing:
+ * the value itself is queued in the hxzmq native library, and the receiver is woken through
+ * a native file descriptor that can be polled alongside 0MQ sockets.
+ * A posted value is shared with the receiving thread, so it must not be modified after posting.
+ * 
+ * Only available on neko and cpp.
+ */
+class ZMailbox 
+{
+	/** Native file descriptor that polls as readable (ZMQ_POLLIN) while the mailbox holds values */
+	public var fd(default,null):Int;
+	
+#if (neko || cpp)
+	/** Opaque data used by hxzmq driver: native mailbox */
+	public var mailboxHandle(default,null):Dynamic;
+#end
+
+	/**
+	 * Constructor
+	 */
+	public function new() 
+	{
+#if (neko || cpp)
+		try {
+			mailboxHandle = _hx_zmq_mailbox_construct();
+			fd = _hx_zmq_mailbox_fd(mailboxHandle);
+		} catch (e:Int) {
+			throw new ZMQException(ZMQ.errNoToErrorType(e));
+		}
+#else
+		throw new ZMQException(ENOTSUP);
+#end
+	}
+	
+	/**
+	 * Posts a value to the mailbox, from any thread
+	 * @param	v	Value, not null
+	 */
+	public function post(v:Dynamic) {
+#if (neko || cpp)
+		try {
+			_hx_zmq_mailbox_post(mailboxHandle, v);
+		} catch (e:Int) {
+			throw new ZMQException(ZMQ.errNoToErrorType(e));
+		}
+#end
+	}
+	
+	/**
+	 * Receives the oldest value posted, without waiting.
+	 * Only one thread may receive from a mailbox.
+	 * @return	Value, or null if the mailbox is empty
+	 */
+	public function recv():Dynamic {
+#if (neko || cpp)
+		return _hx_zmq_mailbox_recv(mailboxHandle);
+#else
+		return null;
+#end
+	}
+	
+	/**
+	 * Receives up to max values, oldest first, without waiting
+	 * @param	max
+	 * @return	Values received, empty if the mailbox is empty
+	 */
+	public function recvBatch(max:Int):Array<Dynamic> {
+#if (neko || cpp)
+		try {
+			return ZMQ.nativeToArray(_hx_zmq_mailbox_recv_batch(mailboxHandle, max));
+		} catch (e:Int) {
+			throw new ZMQException(ZMQ.errNoToErrorType(e));
+		}
+#end
+		return new Array<Dynamic>();
+	}
+	
+	/**
+	 * Returns the number of values posted and not yet received
+	 */
+	public function size():Int {
+#if (neko || cpp)
+		return _hx_zmq_mailbox_size(mailboxHandle);
+#else
+		return 0;
+#end
+	}
+	
+	/**
+	 * Closes the mailbox: values not yet received are discarded, and later posts throw ETERM
+	 */
+	public function destroy() {
+#if (neko || cpp)
+		_hx_zmq_mailbox_close(mailboxHandle);
+#end
+	}
+	
+#if (neko || cpp)
+	private static var _hx_zmq_mailbox_construct = Lib.load("hxzmq", "hx_zmq_mailbox_construct", 0);
+	private static var _hx_zmq_mailbox_post = Lib.load("hxzmq", "hx_zmq_mailbox_post", 2);
+	private static var _hx_zmq_mailbox_recv = Lib.load("hxzmq", "hx_zmq_mailbox_recv", 1);
+	private static var _hx_zmq_mailbox_recv_batch = Lib.load("hxzmq", "hx_zmq_mailbox_recv_batch", 2);
+	private static var _hx_zmq_mailbox_fd = Lib.load("hxzmq", "hx_zmq_mailbox_fd", 1);
+	private static var _hx_zmq_mailbox_size = Lib.load("hxzmq", "hx_zmq_mailbox_size", 1);
+	private static var _hx_zmq_mailbox_close = Lib.load("hxzmq", "hx_zmq_mailbox_close", 1);
+#end
+}
@@ -22,6 +22,9 @@ package org.zeromq;
 import haxe.io.Bytes;
 import neko.io.FileInput;
 import neko.io.FileOutput;
+#if (neko || cpp)
+import neko.vm.Tls;
+#end
 import org.zeromq.ZMQ;
 import org.zeromq.ZFrame;
 
@@ -51,40 +54,75 @@ import org.zeromq.ZFrame;
  * </pre>
  * </p>
  * <p>
+ * Frames are held in an array, so pushing and popping frames (e.g. wrapping and unwrapping
+ * envelopes) allocates nothing in the common case. Destroyed messages can be kept for reuse
+ * by newMsg() and recvMsg(), by setting a pool size with setPoolSize(); see also
+ * ZFrame.setPoolSize(). Each thread has its own pool. Once pooling is enabled, a message must
+ * not be used after it is destroyed (or sent).
+ * </p>
+ * <p>
  * Based on <a href="http://github.com/zeromq/czmq/blob/master/src/zmsg.c">zmsg.c</a> in czmq
  * </p>
  */
 class ZMsg 
 {
 
-    // Hold internal list of ZFrame objects
-    private var frames:List<ZFrame>;
+    // Hold internal array of ZFrame objects, from index head on. Null once destroyed
+    private var frames:Array<ZFrame>;
+    private var head:Int;
+    
+    /** Emptied frame array kept by a pooled message, for reuse */
+    private var spare:Array<ZFrame>;
+    
+    /** True while the message is held in the pool */
+    private var pooled:Bool;
+    
+    /** Most destroyed messages kept for reuse by each thread, or 0 if pooling is disabled (the default) */
+    public static var poolSize(default, null):Int = 0;
+    
+#if (neko || cpp)
+    private static var pool:Tls<Array<ZMsg>> = new Tls<Array<ZMsg>>();
+#else
+    private static var pool:Array<ZMsg>;
+#end
         
     /**
      * Constructor
      */
     public function new() {
-        frames = new List<ZFrame>();
+        frames = new Array<ZFrame>();
+        head = 0;
     }
     
     /**
      * Destructor.
-     * Destroys all ZFrames stored in ZMsg
+     * Destroys all ZFrames stored in ZMsg, then returns the message to this thread's pool,
+     * if pooling is enabled and the pool is not full.
      */
     public function destroy() {
 		if (frames == null)		// Handle usecase if destroy() is called repeatedly on same ZMsg object
 			return;
-        while (frames.length > 0) {
-            var f:ZFrame = frames.pop();
-            f.destroy();
+        for (i in head ... frames.length) {
+            frames[i].destroy();
         }
+        var a = frames;
         frames = null;
+        head = 0;
+        if (poolSize > 0 && !pooled) {
+            var p = threadPool();
+            if (p.length < poolSize) {
+                a.splice(0, a.length);
+                spare = a;
+                pooled = true;
+                p.push(this);
+            }
+        }
     }
     
     /** Return number of frames in message */
     public function size():Int {
         if (frames != null) {
-            return frames.length;
+            return frames.length - head;
         } else {
             return 0;
         }
@@ -97,8 +135,8 @@ class ZMsg
     public function contentSize():Int {
         var size:Int = 0;
         if (frames != null) {
-            for (f in frames) {
-                size += f.size();
+            for (i in head ... frames.length) {
+                size += frames[i].size();
             }
         }
         return size;
@@ -112,7 +150,7 @@ class ZMsg
         if (frame == null) {
             throw new ZMQException(EINVAL);
         }
-        frames.add(frame);
+        frames.push(frame);
     }
     
 	/**
@@ -121,7 +159,7 @@ class ZMsg
 	 */
 	public function wrap(frame:ZFrame) {
 		if (frame != null) {
-			push(new ZFrame(Bytes.ofString("")));
+			push(ZFrame.newFrame(Bytes.alloc(0)));
 			push(frame);
 		}
 	}
@@ -138,7 +176,7 @@ class ZMsg
 		} else {
 			var f = pop();
 			var empty:ZFrame = first();
-			if (empty.hasData() && empty.size() == 0) {
+			if (empty != null && empty.hasData() && empty.size() == 0) {
 				empty = pop();
 				empty.destroy();
 			}
@@ -156,7 +194,19 @@ class ZMsg
         if (frame == null) {
             throw new ZMQException(EINVAL);
         }
-        return frames.remove(frame);
+        if (frames != null) {
+            for (i in head ... frames.length) {
+                if (frames[i] == frame) {
+                    if (i == head) {
+                        pop();
+                    } else {
+                        frames.splice(i, 1);
+                    }
+                    return true;
+                }
+            }
+        }
+        return false;
     }
     
     /**
@@ -165,23 +215,25 @@ class ZMsg
      */
     public function iterator():Iterator<ZFrame> {
         if (frames != null) {
+            compact();
             return frames.iterator();
         } else
             return null;
     }
     
     /**
-     * Returns a new ZMsg object containing only those ZFrames from this message
-     * where f(x) is true
+     * Returns a new ZMsg object containing duplicates of those ZFrames from this message
+     * where f(x) is true. Duplicates share their content with the originals, so this is cheap,
+     * and either message may then be destroyed without affecting the other.
      * @param	f
      * @return  Filtered ZMsg object, else null if this message contains no frame list (ie has been destroyed)
      */
     public function filter(f: ZFrame -> Bool):ZMsg {
         if (frames != null) {
-            var filteredFrames:List<ZFrame> = frames.filter(f);
-            var filteredMsg:ZMsg = new ZMsg();
-            for (frame in filteredFrames) {
-                filteredMsg.add(frame);
+            var filteredMsg:ZMsg = newMsg();
+            for (i in head ... frames.length) {
+                if (f(frames[i]))
+                    filteredMsg.add(frames[i].duplicate());
             }
             return filteredMsg;
         } else
@@ -193,8 +245,8 @@ class ZMsg
      * @return
      */
     public function first():ZFrame {
-        if (frames != null) {
-            return frames.first();
+        if (frames != null && head < frames.length) {
+            return frames[head];
         } else
             return null;
     }
@@ -212,8 +264,8 @@ class ZMsg
      * @return
      */
     public function last():ZFrame {
-       if (frames != null) {
-            return frames.last();
+       if (frames != null && head < frames.length) {
+            return frames[frames.length - 1];
         } else
             return null;
     }
@@ -224,8 +276,14 @@ class ZMsg
      * @return
      */
     public function pop():ZFrame {
-        if (frames != null) {
-            return frames.pop();
+        if (frames != null && head < frames.length) {
+            var f = frames[head];
+            frames[head++] = null;
+            if (head == frames.length) {
+                frames.splice(0, head);
+                head = 0;
+            }
+            return f;
         } else
             return null;
     }
@@ -240,7 +298,12 @@ class ZMsg
             throw new ZMQException(EINVAL);
         }
         if (frames != null) {
-            frames.push(frame);
+            // Reuse the slot left by an earlier pop, if any
+            if (head > 0) {
+                frames[--head] = frame;
+            } else {
+                frames.unshift(frame);
+            }
         }
     }
     
@@ -250,9 +313,10 @@ class ZMsg
      */
     public function pushString(str:String) {
         if (frames == null) {
-            frames = new List<ZFrame>();
+            frames = new Array<ZFrame>();
+            head = 0;
         }
-        frames.push(new ZFrame(Bytes.ofString(str)));
+        push(ZFrame.newFrame(Bytes.ofString(str)));
     }
     
     /**
@@ -261,9 +325,10 @@ class ZMsg
      */
     public function addString(str:String) {
         if (frames == null) {
-            frames = new List<ZFrame>();
+            frames = new Array<ZFrame>();
+            head = 0;
         }
-        frames.add(new ZFrame(Bytes.ofString(str)));
+        frames.push(ZFrame.newFrame(Bytes.ofString(str)));
     }
    
     /**
@@ -273,7 +338,7 @@ class ZMsg
      */
     public function popString():String {
         if (frames != null) {
-            var f:ZFrame = frames.pop();
+            var f:ZFrame = pop();
             if (f != null && f.hasData()) {
                 var s = f.data.toString();
                 f.destroy();
@@ -284,14 +349,15 @@ class ZMsg
     }
     
     /**
-     * Creates copy of this message, also copying all contained frames & their data
+     * Creates copy of this message, duplicating all contained frames.
+     * Frame data is shared with this message, not copied (see ZFrame.duplicate).
      * @return  Copied ZMsg object, or null if this message contains an invalid (destroyed) frame list.
      */
     public function duplicate():ZMsg {
         if (frames != null) {
-            var msg:ZMsg = new ZMsg();
-            for (f in frames) {
-                msg.add(f.duplicate());
+            var msg:ZMsg = newMsg();
+            for (i in head ... frames.length) {
+                msg.frames.push(frames[i].duplicate());
             }
             return msg;
         } else
@@ -311,12 +377,8 @@ class ZMsg
         if (frames == null) {
             return;
         }
-        var iter:Iterator<ZFrame> = iterator();
-        var f:ZFrame = iter.next();
-        while (f != null) {
-            f.send(socket, { if (iter.hasNext()) ZFrame.ZFRAME_MORE else null; });
-            f = iter.next();
-        }
+        compact();
+        ZFrame.sendFrames(socket, frames);
         destroy();
         return;
     }
@@ -332,9 +394,9 @@ class ZMsg
 		} else {
 			buf.add("#frames:" + size());
 			var frame_nbr = 0;
-			for (f in frames) {
+			for (i in head ... frames.length) {
 				buf.add(",#" + ++frame_nbr + ":[");
-				buf.add(f.toString());
+				buf.add(frames[i].toString());
 				buf.add("]");
 			}
 		}
@@ -353,22 +415,16 @@ class ZMsg
             throw new ZMQException(EINVAL);
             return null;
         }
-        var msg:ZMsg = null;
-        
-        while (true) {
-            var f:ZFrame = ZFrame.recvFrame(socket);
-            if (f == null) {
-                // If receive failed or was interrupted
-                if (msg != null) msg.destroy();
-                break;
-            }
-			if (msg == null) msg = new ZMsg();
-            msg.add(f);
-            if (!f.more) {
-                break;
-            }
+        // Read all frames of the message at once
+        var received:Array<ZFrame> = ZFrame.recvFrames(socket);
+        if (received == null) {
+            // If receive failed or was interrupted
+            return null;
+        }
+        var msg:ZMsg = newMsg();
+        for (f in received) {
+            msg.frames.push(f);
         }
-        
         return msg;
     }
     
@@ -378,7 +434,7 @@ class ZMsg
      * @return
      */
     public static function newStringMsg(data:String):ZMsg {
-        var msg:ZMsg = new ZMsg();
+        var msg:ZMsg = newMsg();
         msg.addString(data);
         return msg;
     }
@@ -405,7 +461,7 @@ class ZMsg
             // Write number of frames
             file.writeInt31(msg.size());
             if (msg.size() > 0) {
-                for (f in msg.frames) {
+                for (f in msg) {
                     // Write byte size of frame
                     file.writeInt31(f.size());
                     // Write frame byte data
@@ -434,7 +490,7 @@ class ZMsg
         }
         var rcvMsg:ZMsg = {
             if (msg == null) 
-                new ZMsg() 
+                newMsg() 
             else
                 msg;
         }
@@ -444,7 +500,7 @@ class ZMsg
             var msg_nbr = 0;
             while (++msg_nbr <= msgSize) {
                 var frameSize = file.readInt31();
-                var f:ZFrame = new ZFrame(file.read(frameSize));
+                var f:ZFrame = ZFrame.newFrame(file.read(frameSize));
                 rcvMsg.add(f);
                 
             }
@@ -453,4 +509,66 @@ class ZMsg
         
     }
     
+    /**
+     * Returns an empty message, taken from this thread's pool if one is available
+     * @return
+     */
+    public static function newMsg():ZMsg {
+        if (poolSize > 0) {
+            var msg:ZMsg = threadPool().pop();
+            if (msg != null) {
+                msg.pooled = false;
+                msg.frames = msg.spare;
+                msg.spare = null;
+                msg.head = 0;
+                return msg;
+            }
+        }
+        return new ZMsg();
+    }
+    
+    /**
+     * Sets the most destroyed messages kept for reuse by each thread.
+     * 0 disables pooling, and releases the messages held in the calling thread's pool.
+     * Frames are pooled separately, see ZFrame.setPoolSize.
+     * @param	size
+     */
+    public static function setPoolSize(size:Int) {
+        if (size < 0) {
+            throw new ZMQException(EINVAL);
+        }
+        poolSize = size;
+        var p = threadPool();
+        while (p.length > size) {
+            var msg = p.pop();
+            msg.pooled = false;
+            msg.spare = null;
+        }
+    }
+    
+    /**
+     * Moves frames down to the start of the frame array, after frames were popped
+     */
+    private function compact() {
+        if (head > 0) {
+            frames.splice(0, head);
+            head = 0;
+        }
+    }
+    
+    private static function threadPool():Array<ZMsg> {
+#if (neko || cpp)
+        var p = pool.value;
+        if (p == null) {
+            p = new Array<ZMsg>();
+            pool.value = p;
+        }
+        return p;
+#else
+        if (pool == null)
+            pool = new Array<ZMsg>();
+        return pool;
+#end
+    }
+    
 }
\ No newline at end of file
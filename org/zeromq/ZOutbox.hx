@@ -0,0 +1,136 @@
+/**
+ * (c) 2011 Richard J Smith
+ *
+ * This file is part of hxzmq
+ *
+ * hxzmq is free software; you can redistribute it and/or modify it under
+ * the terms of the Lesser GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hxzmq is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * Lesser GNU General Public License for more details.
+ *
+ * You should have received a copy of the Lesser GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+package org.zeromq;
+
+import haxe.io.Bytes;
+import neko.Lib;
+import org.zeromq.ZMQ;
+import org.zeromq.ZMQSocket;
+
+/**
+ * Outbound message queue for a socket.
+ * 
+ * Messages are sent without blocking where possible. A message the socket cannot take now
+ * (e.g. because it is at its high water mark) is queued, instead of being dropped as with a
+ * DONTWAIT sendMsg, and later messages queue behind it so order is kept. This only applies to
+ * socket types that block at the high water mark: PUB and XPUB sockets drop messages there
+ * without an error, so nothing is ever queued for them.
+ * Call flush() when the socket is writable again (ZLoop does this on POLLOUT).
+ * 
+ * On neko and cpp the queue is held in the hxzmq native library.
+ * On php, messages are sent immediately, blocking if necessary, and are never queued.
+ */
+class ZOutbox 
+{
+	/** Socket messages are sent on */
+	public var socket(default,null):ZMQSocket;
+	
+#if (neko || cpp)
+	/** Opaque data used by hxzmq driver: native message queue */
+	public var outboxHandle(default,null):Dynamic;
+#end
+
+	/**
+	 * Constructor
+	 * @param	socket	Socket to send on
+	 */
+	public function new(socket:ZMQSocket) 
+	{
+		if (socket == null) {
+			throw new ZMQException(EINVAL);
+		}
+		this.socket = socket;
+#if (neko || cpp)
+		outboxHandle = _hx_zmq_outbox_construct();
+#end
+	}
+	
+	/**
+	 * Sends a message part, or queues it if it cannot be sent without blocking
+	 * or earlier messages are still queued
+	 * @param	data	The content of the message part
+	 * @param	?more	True if more parts of this message follow
+	 * @return	Number of message parts now queued, so 0 if everything has been sent
+	 */
+	public function send(data:Bytes, ?more:Bool = false):Int {
+		checkSocket();
+#if (neko || cpp)
+		try {
+			return _hx_zmq_outbox_send(outboxHandle, socket._socketHandle, data.getData(), more);
+		} catch (e:Int) {
+			throw new ZMQException(ZMQ.errNoToErrorType(e));
+		}
+		return 0;
+#else
+		socket.sendMsg(data, { if (more) SNDMORE else null; } );
+		return 0;
+#end
+	}
+	
+	/**
+	 * Sends as many queued message parts as the socket will now take without blocking
+	 * @return	Number of message parts still queued
+	 */
+	public function flush():Int {
+		checkSocket();
+#if (neko || cpp)
+		try {
+			return _hx_zmq_outbox_flush(outboxHandle, socket._socketHandle);
+		} catch (e:Int) {
+			throw new ZMQException(ZMQ.errNoToErrorType(e));
+		}
+#end
+		return 0;
+	}
+	
+	/**
+	 * Returns the number of message parts queued
+	 */
+	public function size():Int {
+#if (neko || cpp)
+		return _hx_zmq_outbox_size(outboxHandle);
+#else
+		return 0;
+#end
+	}
+	
+	/**
+	 * Discards all queued message parts
+	 */
+	public function clear() {
+#if (neko || cpp)
+		_hx_zmq_outbox_clear(outboxHandle);
+#end
+	}
+	
+	private function checkSocket() {
+		if (socket._socketHandle == null || socket.closed) {
+			throw new ZMQException(ENOTSUP);
+		}
+	}
+	
+#if (neko || cpp)
+	private static var _hx_zmq_outbox_construct = Lib.load("hxzmq", "hx_zmq_outbox_construct", 0);
+	private static var _hx_zmq_outbox_send = Lib.load("hxzmq", "hx_zmq_outbox_send", 4);
+	private static var _hx_zmq_outbox_flush = Lib.load("hxzmq", "hx_zmq_outbox_flush", 2);
+	private static var _hx_zmq_outbox_size = Lib.load("hxzmq", "hx_zmq_outbox_size", 1);
+	private static var _hx_zmq_outbox_clear = Lib.load("hxzmq", "hx_zmq_outbox_clear", 1);
+#end
+}
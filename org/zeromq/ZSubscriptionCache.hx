@@ -0,0 +1,159 @@
+/**
+ * (c) 2011 Richard J Smith
+ *
+ * This file is part of hxzmq
+ *
+ * hxzmq is free software; you can redistribute it and/or modify it under
+ * the terms of the Lesser GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hxzmq is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * Lesser GNU General Public License for more details.
+ *
+ * You should have received a copy of the Lesser GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+package org.zeromq;
+
+import haxe.io.Bytes;
+import neko.Lib;
+import org.zeromq.ZFrame;
+import org.zeromq.ZMQ;
+import org.zeromq.ZMsg;
+
+/**
+ * Subscription trie and last value cache for an XSUB/XPUB proxy (see ZMQDevice.proxy).
+ * 
+ * While the proxy runs, the cache holds a count of subscribe requests for each subscribed
+ * prefix, and the last message published on each topic (the message's first frame). The proxy
+ * sends publishers each subscription only once, and replays the cached messages for every
+ * topic under a prefix as soon as it is subscribed to, so late joiners need not wait for the
+ * next publication. The replay reaches all matching subscribers, as any publication does.
+ * 
+ * By default only topics under a subscribed prefix reach the proxy, and so the cache. Construct
+ * the cache with cacheAll set to have the proxy subscribe to every topic itself for as long
+ * as it runs, whatever its subscribers do.
+ * 
+ * Cached messages share their content with the messages forwarded, so caching copies nothing.
+ * The cache may be inspected from any thread while the proxy runs.
+ * Only available on neko and cpp.
+ */
+class ZSubscriptionCache 
+{
+#if (neko || cpp)
+	/** Opaque data used by hxzmq driver: native trie and cache */
+	public var cacheHandle(default,null):Dynamic;
+#end
+
+	/**
+	 * Constructor
+	 * @param	?cacheAll	If true, cache every topic published, not just those subscribed to
+	 */
+	public function new(?cacheAll:Bool = false) 
+	{
+#if (neko || cpp)
+		cacheHandle = _hx_zmq_subs_construct(cacheAll);
+#else
+		throw new ZMQException(ENOTSUP);
+#end
+	}
+	
+	/**
+	 * Returns the number of subscribe requests held for a prefix, or 0 if it is not subscribed.
+	 * Requests are only counted individually with libzmq 3.2 or later (XPUB_VERBOSE).
+	 * @param	prefix
+	 */
+	public function subscribers(prefix:Bytes):Int {
+		if (prefix == null) {
+			throw new ZMQException(EINVAL);
+		}
+#if (neko || cpp)
+		return _hx_zmq_subs_count(cacheHandle, prefix.getData());
+#else
+		return 0;
+#end
+	}
+	
+	/**
+	 * Returns true if a message with this topic would reach a subscriber
+	 * @param	topic
+	 */
+	public function matches(topic:Bytes):Bool {
+		if (topic == null) {
+			throw new ZMQException(EINVAL);
+		}
+#if (neko || cpp)
+		return _hx_zmq_subs_matches(cacheHandle, topic.getData());
+#else
+		return false;
+#end
+	}
+	
+	/**
+	 * Returns the number of prefixes subscribed to
+	 */
+	public function prefixes():Int {
+#if (neko || cpp)
+		return _hx_zmq_subs_prefixes(cacheHandle);
+#else
+		return 0;
+#end
+	}
+	
+	/**
+	 * Returns the number of topics with a cached message
+	 */
+	public function topics():Int {
+#if (neko || cpp)
+		return _hx_zmq_subs_topics(cacheHandle);
+#else
+		return 0;
+#end
+	}
+	
+	/**
+	 * Returns the last message published on a topic
+	 * @param	topic
+	 * @return	Copy of the cached message, or null if none is cached
+	 */
+	public function lastValue(topic:Bytes):ZMsg {
+		if (topic == null) {
+			throw new ZMQException(EINVAL);
+		}
+#if (neko || cpp)
+		var handles:Dynamic = _hx_zmq_subs_last(cacheHandle, topic.getData());
+		if (handles == null)
+			return null;
+		var msg = ZMsg.newMsg();
+		for (h in ZMQ.nativeToArray(handles)) {
+			msg.add(ZFrame.ofMsgHandle(h));
+		}
+		return msg;
+#else
+		return null;
+#end
+	}
+	
+	/**
+	 * Discards all cached messages. Subscriptions are kept.
+	 */
+	public function clear() {
+#if (neko || cpp)
+		_hx_zmq_subs_clear(cacheHandle);
+#end
+	}
+	
+#if (neko || cpp)
+	private static var _hx_zmq_subs_construct = Lib.load("hxzmq", "hx_zmq_subs_construct", 1);
+	private static var _hx_zmq_subs_count = Lib.load("hxzmq", "hx_zmq_subs_count", 2);
+	private static var _hx_zmq_subs_matches = Lib.load("hxzmq", "hx_zmq_subs_matches", 2);
+	private static var _hx_zmq_subs_prefixes = Lib.load("hxzmq", "hx_zmq_subs_prefixes", 1);
+	private static var _hx_zmq_subs_topics = Lib.load("hxzmq", "hx_zmq_subs_topics", 1);
+	private static var _hx_zmq_subs_last = Lib.load("hxzmq", "hx_zmq_subs_last", 2);
+	private static var _hx_zmq_subs_clear = Lib.load("hxzmq", "hx_zmq_subs_clear", 1);
+#end
+}
@@ -0,0 +1,255 @@
+/**
+ * (c) 2011 Richard J Smith
+ *
+ * This file is part of hxzmq
+ *
+ * hxzmq is free software; you can redistribute it and/or modify it under
+ * the terms of the Lesser GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hxzmq is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * Lesser GNU General Public License for more details.
+ *
+ * You should have received a copy of the Lesser GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+package org.zeromq;
+
+import haxe.io.Bytes;
+import org.zeromq.ZContext;
+import org.zeromq.ZFrame;
+import org.zeromq.ZLoop;
+import org.zeromq.ZMQ;
+import org.zeromq.ZMQPoller;
+import org.zeromq.ZMQSocket;
+import org.zeromq.ZThread;
+
+/**
+ * Fixed-size pool of worker threads (forked processes, on php) for running CPU-heavy
+ * message handling off a ZLoop.
+ *
+ * Each worker is started with ZThread.attach, so has its own shadow ZContext and a pipe
+ * used to stop it. Workers connect REQ sockets to the pool's ROUTER socket, and announce
+ * themselves with READY; after that each result they send back also asks for the next task.
+ *
+ * Tasks are only ever sent to a worker that is idle, one at a time, in the order workers became
+ * free (as in the zguide's load balancing broker, and ZMQRemotingServer). Tasks submitted while
+ * every worker is busy wait in the pool's queue, so a slow task never holds up queued work that
+ * an idle worker could take.
+ */
+class ZThreadPool
+{
+	/** Most results passed to the result handler per wakeup */
+	private static inline var RESULT_BATCH:Int = 256;
+
+	/** Number of workers */
+	public var size(default,null):Int;
+
+	/** Number of tasks submitted whose results have not yet been received */
+	public var pending(default,null):Int;
+
+	private var ctx:ZContext;
+	private var workers:ZMQSocket;
+	private var pipes:Array<ZMQSocket>;
+	private var loop:ZLoop;
+
+	/** Identities of idle workers, least recently used first */
+	private var idle:Array<Bytes>;
+
+	/** Tasks waiting for an idle worker */
+	private var queue:List<Bytes>;
+
+	/** Results read but not yet passed on */
+	private var results:Array<Bytes>;
+
+	/**
+	 * Constructor. Starts the workers.
+	 * @param	ctx		Context for the pool's socket, shadowed by each worker
+	 * @param	size	Number of workers
+	 * @param	worker	Task function, run in the worker threads. Receives the worker's context and a task,
+	 * 					returns the task's result, or null for an empty result. Must not throw.
+	 */
+	public function new(ctx:ZContext, size:Int, worker:ZContext->Bytes->Bytes)
+	{
+		if (ctx == null || size < 1 || worker == null) {
+			throw new ZMQException(EINVAL);
+		}
+		this.ctx = ctx;
+		this.size = size;
+		pending = 0;
+		loop = null;
+		idle = new Array<Bytes>();
+		queue = new List<Bytes>();
+		results = new Array<Bytes>();
+
+		var id = nextId++ + "-" + Std.random(0x7fffffff);
+#if php
+		var endpoint = "ipc:///tmp/zthreadpool-" + id;
+#else
+		var endpoint = "inproc://zthreadpool-" + id;
+#end
+
+		// Bind before the workers connect, as inproc requires
+		workers = ctx.createSocket(ZMQ_ROUTER);
+		workers.bind(endpoint);
+
+		pipes = new Array<ZMQSocket>();
+		for (i in 0 ... size) {
+			pipes.push(ZThread.attach(ctx, workerLoop, {
+				fn:worker,
+				identity:"W" + i,
+				endpoint:endpoint } ));
+		}
+	}
+
+	/**
+	 * Registers the pool with a reactor, which then receives results and hands queued tasks
+	 * to workers as they become free, without blocking.
+	 * @param	loop
+	 * @param	handler		Result handler, receives the results waiting, in the order they arrived
+	 * @return	true if OK, else false
+	 */
+	public function attach(loop:ZLoop, handler:ZLoop->Array<Bytes>->Int):Bool {
+		if (loop == null || handler == null) {
+			throw new ZMQException(EINVAL);
+		}
+		this.loop = loop;
+		var pool = this;
+		return loop.registerPoller( { socket:workers, event:ZMQ.ZMQ_POLLIN() }, function(loop:ZLoop, socket:ZMQSocket):Int {
+			var more = true;
+			while (more && pool.results.length < RESULT_BATCH) {
+				more = pool.workerMessage(DONTWAIT);
+			}
+			pool.dispatch();
+			var batch = pool.results;
+			if (batch.length == 0)
+				return 0;
+			pool.results = new Array<Bytes>();
+			pool.pending -= batch.length;
+			return handler(loop, batch);
+		});
+	}
+
+	/**
+	 * Submits a task to the next free worker.
+	 * Once attached to a reactor, never blocks: if all workers are busy the task is queued.
+	 * Otherwise blocks until a worker can take the task, or the wait is interrupted.
+	 * @param	task
+	 * @return	Number of tasks queued waiting for a free worker
+	 */
+	public function submit(task:Bytes):Int {
+		if (task == null) {
+			throw new ZMQException(EINVAL);
+		}
+		pending++;
+		queue.add(task);
+		dispatch();
+		if (loop != null)
+			return queue.length;
+		while (!queue.isEmpty()) {
+			if (!workerMessage(null))
+				return queue.length;
+			dispatch();
+		}
+		return 0;
+	}
+
+	/**
+	 * Receives one result, for use when the pool is not attached to a reactor
+	 * @param	?flags	DONTWAIT
+	 * @return	Result, or null if DONTWAIT was used and no result was waiting
+	 */
+	public function recvResult(?flags:SendReceiveFlagType):Bytes {
+		while (results.length == 0) {
+			if (!workerMessage(flags))
+				return null;
+			dispatch();
+		}
+		pending--;
+		return results.shift();
+	}
+
+	/**
+	 * Stops the workers, and closes the pool's socket.
+	 * Queued tasks and unreceived results are discarded. The workers' pipes are left for the
+	 * context to close, so that a worker still busy with a task receives its stop message.
+	 */
+	public function destroy() {
+		if (loop != null) {
+			loop.unregisterPoller( { socket:workers, event:ZMQ.ZMQ_POLLIN() } );
+			loop = null;
+		}
+		for (pipe in pipes)
+			pipe.sendMsg(Bytes.ofString("STOP"));
+		pipes = new Array<ZMQSocket>();
+		queue.clear();
+		results = new Array<Bytes>();
+		ctx.destroySocket(workers);
+	}
+
+	/**
+	 * Reads one message from a worker: [identity, empty, "READY"] when it starts, else
+	 * [identity, empty, "R", result]. Keeps any result, and marks the worker idle.
+	 * @return	false if DONTWAIT was used and no message was waiting, or the receive was interrupted
+	 */
+	private function workerMessage(flags:SendReceiveFlagType):Bool {
+		var frames = ZFrame.recvFrames(workers, flags);
+		if (frames == null)
+			return false;
+		idle.push(frames[0].data);
+		if (frames.length > 3)
+			results.push(frames[3].data);
+		for (f in frames) f.destroy();
+		return true;
+	}
+
+	/**
+	 * Sends queued tasks to idle workers
+	 */
+	private function dispatch() {
+		while (idle.length > 0 && !queue.isEmpty()) {
+			var frames = [ZFrame.newFrame(idle.shift()), ZFrame.newFrame(Bytes.alloc(0)), ZFrame.newFrame(queue.pop())];
+			ZFrame.sendFrames(workers, frames);
+		}
+	}
+
+	/**
+	 * Worker thread: runs tasks until told to stop on its pipe, or the context is terminated
+	 */
+	private static function workerLoop(ctx:ZContext, pipe:ZMQSocket, args:Dynamic) {
+		var fn:ZContext->Bytes->Bytes = args.fn;
+		var socket = ctx.createSocket(ZMQ_REQ);
+		socket.setsockopt(ZMQ_IDENTITY, Bytes.ofString(args.identity));
+		socket.connect(args.endpoint);
+		socket.sendMsg(Bytes.ofString("READY"));
+
+		var poller = new ZMQPoller();
+		poller.registerSocket(pipe, ZMQ.ZMQ_POLLIN());
+		poller.registerSocket(socket, ZMQ.ZMQ_POLLIN());
+		var empty = Bytes.alloc(0);
+		var tag = Bytes.ofString("R");
+		var running = true;
+		while (running) {
+			// Stops when interrupted, told to by the pool, or the context is terminated
+			try {
+				if (poller.poll(-1) == -1 || poller.pollin(1)) {
+					running = false;
+				} else if (poller.pollin(2)) {
+					var task = socket.recvMsg(DONTWAIT);
+					if (task != null) {
+						var result = fn(ctx, task);
+						socket.sendMultipart([tag, { if (result == null) empty else result; } ]);
+					}
+				}
+			} catch (e:ZMQException) {
+				running = false;
+			}
+		}
+	}
+
+	private static var nextId:Int = 0;
+}
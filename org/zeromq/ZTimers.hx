@@ -0,0 +1,217 @@
+/**
+ * (c) 2011 Richard J Smith
+ *
+ * This file is part of hxzmq
+ *
+ * hxzmq is free software; you can redistribute it and/or modify it under
+ * the terms of the Lesser GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hxzmq is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * Lesser GNU General Public License for more details.
+ *
+ * You should have received a copy of the Lesser GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+package org.zeromq;
+
+import neko.Lib;
+import neko.Sys;
+import org.zeromq.ZMQ;
+
+/**
+ * Priority queue of timer deadlines, keyed by caller-assigned integer timer ids.
+ * 
+ * Used by ZLoop to find the next deadline and the expired timers without scanning every
+ * registered timer. Adding, rescheduling and cancelling a timer are O(log n), and finding
+ * the next deadline is O(1).
+ * Timers with equal deadlines expire in the order they were added.
+ * 
+ * On neko and cpp, the queue is a binary heap held in the hxzmq native library.
+ */
+class ZTimers 
+{
+#if (neko || cpp)
+	/** Opaque data used by hxzmq driver: native timer queue */
+	public var timersHandle(default,null):Dynamic;
+#else
+	private var whens:Array<Float>;
+	private var seqs:Array<Int>;
+	private var ids:Array<Int>;
+	private var positions:IntHash<Int>;
+	private var seq:Int;
+#end
+
+	/**
+	 * Constructor
+	 */
+	public function new() 
+	{
+#if (neko || cpp)
+		timersHandle = _hx_zmq_timers_construct();
+#else
+		whens = new Array<Float>();
+		seqs = new Array<Int>();
+		ids = new Array<Int>();
+		positions = new IntHash<Int>();
+		seq = 0;
+#end
+	}
+	
+	/**
+	 * Schedules a timer, replacing any existing deadline for the same id
+	 * @param	id		Timer id
+	 * @param	when	Deadline, in milliseconds
+	 */
+	public function add(id:Int, when:Float) {
+#if (neko || cpp)
+		_hx_zmq_timers_add(timersHandle, id, when);
+#else
+		if (positions.exists(id))
+			removeAt(positions.get(id));
+		whens.push(when);
+		seqs.push(seq++);
+		ids.push(id);
+		siftUp(ids.length - 1);
+#end
+	}
+	
+	/**
+	 * Cancels a timer
+	 * @param	id		Timer id
+	 * @return	true if the timer was scheduled, else false
+	 */
+	public function cancel(id:Int):Bool {
+#if (neko || cpp)
+		return _hx_zmq_timers_cancel(timersHandle, id);
+#else
+		if (!positions.exists(id))
+			return false;
+		removeAt(positions.get(id));
+		return true;
+#end
+	}
+	
+	/**
+	 * Returns the earliest deadline, in milliseconds, or null if no timers are scheduled
+	 */
+	public function next():Null<Float> {
+#if (neko || cpp)
+		return _hx_zmq_timers_next(timersHandle);
+#else
+		return { if (ids.length == 0) null else whens[0]; };
+#end
+	}
+	
+	/**
+	 * Removes all timers due at or before now
+	 * @param	now		Current time, in milliseconds
+	 * @return	Ids of the expired timers, in deadline order
+	 */
+	public function expired(now:Float):Array<Int> {
+#if (neko || cpp)
+		return cast ZMQ.nativeToArray(_hx_zmq_timers_expired(timersHandle, now));
+#else
+		var ret = new Array<Int>();
+		while (ids.length > 0 && whens[0] <= now) {
+			ret.push(ids[0]);
+			removeAt(0);
+		}
+		return ret;
+#end
+	}
+	
+	/**
+	 * Returns the current time, in milliseconds, on the clock used for timer deadlines
+	 */
+	public static function now():Float {
+#if (neko || cpp)
+		return _hx_zmq_timers_now();
+#else
+		return Sys.time() * 1000;
+#end
+	}
+	
+	/**
+	 * Returns the number of scheduled timers
+	 */
+	public function size():Int {
+#if (neko || cpp)
+		return _hx_zmq_timers_size(timersHandle);
+#else
+		return ids.length;
+#end
+	}
+	
+#if !(neko || cpp)
+	private function before(a:Int, b:Int):Bool {
+		return whens[a] < whens[b] || (whens[a] == whens[b] && seqs[a] < seqs[b]);
+	}
+	
+	private function swap(a:Int, b:Int) {
+		var w = whens[a]; whens[a] = whens[b]; whens[b] = w;
+		var s = seqs[a]; seqs[a] = seqs[b]; seqs[b] = s;
+		var i = ids[a]; ids[a] = ids[b]; ids[b] = i;
+		positions.set(ids[a], a);
+		positions.set(ids[b], b);
+	}
+	
+	private function siftUp(pos:Int) {
+		positions.set(ids[pos], pos);
+		while (pos > 0) {
+			var parent = (pos - 1) >> 1;
+			if (!before(pos, parent))
+				break;
+			swap(pos, parent);
+			pos = parent;
+		}
+	}
+	
+	private function siftDown(pos:Int) {
+		var n = ids.length;
+		while (true) {
+			var child = pos * 2 + 1;
+			if (child >= n)
+				break;
+			if (child + 1 < n && before(child + 1, child))
+				child++;
+			if (!before(child, pos))
+				break;
+			swap(pos, child);
+			pos = child;
+		}
+	}
+	
+	private function removeAt(pos:Int) {
+		positions.remove(ids[pos]);
+		var last = ids.length - 1;
+		if (pos < last) {
+			whens[pos] = whens[last];
+			seqs[pos] = seqs[last];
+			ids[pos] = ids[last];
+		}
+		whens.pop();
+		seqs.pop();
+		ids.pop();
+		if (pos < last) {
+			var moved = ids[pos];
+			siftUp(pos);
+			siftDown(positions.get(moved));
+		}
+	}
+#end
+
+#if (neko || cpp)
+	private static var _hx_zmq_timers_construct = Lib.load("hxzmq", "hx_zmq_timers_construct", 0);
+	private static var _hx_zmq_timers_add = Lib.load("hxzmq", "hx_zmq_timers_add", 3);
+	private static var _hx_zmq_timers_cancel = Lib.load("hxzmq", "hx_zmq_timers_cancel", 2);
+	private static var _hx_zmq_timers_next = Lib.load("hxzmq", "hx_zmq_timers_next", 1);
+	private static var _hx_zmq_timers_expired = Lib.load("hxzmq", "hx_zmq_timers_expired", 2);
+	private static var _hx_zmq_timers_size = Lib.load("hxzmq", "hx_zmq_timers_size", 1);
+	private static var _hx_zmq_timers_now = Lib.load("hxzmq", "hx_zmq_timers_now", 0);
+#end
+}
@@ -0,0 +1,57 @@
+/**
+ * (c) 2011 Richard J Smith
+ *
+ * This file is part of hxzmq
+ *
+ * hxzmq is free software; you can redistribute it and/or modify it under
+ * the terms of the Lesser GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hxzmq is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * Lesser GNU General Public License for more details.
+ *
+ * You should have received a copy of the Lesser GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+package org.zeromq.bench;
+
+import neko.Sys;
+
+/**
+ * Main program for the hxzmq benchmarks.
+ * 
+ * Runs every benchmark, or just those named on the command line, e.g.
+ * <pre>
+ * ./BenchAll zerocopy timers calls perf
+ * </pre>
+ * or one of the libzmq perf tools ported in BenchPerf, e.g.
+ * <pre>
+ * ./BenchAll local_lat tcp://127.0.0.1:5555 1 10000
+ * </pre>
+ * Results are printed as comma-separated lines, each set preceded by a "#" header line.
+ */
+class BenchAll 
+{
+
+	public static function main() {
+		var args:Array<String> = Sys.args();
+		if (args.length > 0 && Lambda.has(BenchPerf.TOOLS, args[0])) {
+			BenchPerf.tool(args);
+			return;
+		}
+		var all = (args.length == 0);
+		
+		if (all || Lambda.has(args, "zerocopy"))
+			BenchZeroCopy.run();
+		if (all || Lambda.has(args, "timers"))
+			BenchTimers.run();
+		if (all || Lambda.has(args, "calls"))
+			BenchCalls.run();
+		if (all || Lambda.has(args, "perf"))
+			BenchPerf.run();
+	}
+}
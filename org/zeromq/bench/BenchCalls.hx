@@ -0,0 +1,103 @@
+/**
+ * (c) 2011 Richard J Smith
+ *
+ * This file is part of hxzmq
+ *
+ * hxzmq is free software; you can redistribute it and/or modify it under
+ * the terms of the Lesser GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hxzmq is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * Lesser GNU General Public License for more details.
+ *
+ * You should have received a copy of the Lesser GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+package org.zeromq.bench;
+
+import haxe.io.Bytes;
+import neko.Lib;
+import neko.Sys;
+
+import org.zeromq.ZContext;
+import org.zeromq.ZMQ;
+import org.zeromq.ZMQPoller;
+import org.zeromq.ZMQSocket;
+
+/**
+ * Measures the per-call overhead of the hot socket primitives.
+ *
+ * Each call is made on an inproc PAIR socket so that libzmq does little work and the time
+ * is dominated by the haXe wrapper, argument boxing and the native call itself.
+ *
+ * Every call is timed twice: through the boxed CFFI primitives directly ("boxed"), and through
+ * the ZMQSocket and ZMQPoller methods, which call the typed entry points in src/prime.h on cpp
+ * builds compiled with -D hxzmq_static ("typed"), else the same boxed primitives ("wrapper").
+ * Compare runs against different builds of hxzmq.ndll, and between the neko and cpp targets.
+ */
+class BenchCalls
+{
+	/** Number of calls timed for each primitive */
+	private static inline var CALLS:Int = 200000;
+
+	public static function run() {
+		Lib.println("# calls: call,api,nsec_per_call");
+
+		var ctx:ZContext = new ZContext();
+		var a:ZMQSocket = ctx.createSocket(ZMQ_PAIR);
+		var b:ZMQSocket = ctx.createSocket(ZMQ_PAIR);
+		a.bind("inproc://bench-calls");
+		b.connect("inproc://bench-calls");
+		var payload:Bytes = Bytes.alloc(8);
+		var buffer:Bytes = Bytes.alloc(8);
+		var poller:ZMQPoller = new ZMQPoller();
+		poller.registerSocket(b, ZMQ.ZMQ_POLLIN());
+
+#if (cpp && hxzmq_static)
+		var api = "typed";
+#else
+		var api = "wrapper";
+#end
+		var type = ZMQ.socketOptionTypeNo(ZMQ_TYPE);
+		var linger = ZMQ.socketOptionTypeNo(ZMQ_LINGER);
+		var dontwait = ZMQ.sendReceiveFlagNo(DONTWAIT);
+		var data = payload.getData();
+		var into = buffer.getData();
+
+		report("getsockopt", api, function() { a.getsockopt(ZMQ_TYPE); } );
+		report("getsockopt", "boxed", function() { _hx_zmq_getintsockopt(a._socketHandle, type); } );
+		report("setsockopt", api, function() { a.setsockopt(ZMQ_LINGER, 0); } );
+		report("setsockopt", "boxed", function() { _hx_zmq_setintsockopt(a._socketHandle, linger, 0); } );
+		report("recv_eagain", api, function() { b.recvInto(buffer, 0, DONTWAIT); } );
+		report("recv_eagain", "boxed", function() { _hx_zmq_recv_into(b._socketHandle, into, 0, dontwait); } );
+		report("poll_idle", api, function() { poller.poll(0); } );
+		report("poll_idle", "boxed", function() { _hx_zmq_pollset_poll(poller.pollsetHandle, 0); } );
+		// Sends and receives in turn, so the pipe never reaches its high water mark
+		report("send_recv", api, function() { a.sendMsg(payload); b.recvInto(buffer, 0); } );
+		report("send_recv", "boxed", function() {
+			_hx_zmq_send(a._socketHandle, data, 0);
+			_hx_zmq_recv_into(b._socketHandle, into, 0, 0);
+		} );
+
+		ctx.destroy();
+	}
+
+	private static function report(name:String, api:String, call:Void->Void) {
+		var start = Sys.time();
+		for (i in 0 ... CALLS) {
+			call();
+		}
+		var elapsed = Sys.time() - start;
+		Lib.println(name + "," + api + "," + Std.int(elapsed * 1000000000 / CALLS));
+	}
+
+	private static var _hx_zmq_send = Lib.load("hxzmq", "hx_zmq_send", 3);
+	private static var _hx_zmq_recv_into = Lib.load("hxzmq", "hx_zmq_recv_into", 4);
+	private static var _hx_zmq_setintsockopt = Lib.load("hxzmq", "hx_zmq_setintsockopt", 3);
+	private static var _hx_zmq_getintsockopt = Lib.load("hxzmq", "hx_zmq_getintsockopt", 2);
+	private static var _hx_zmq_pollset_poll = Lib.load("hxzmq", "hx_zmq_pollset_poll", 2);
+}
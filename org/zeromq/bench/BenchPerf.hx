@@ -0,0 +1,275 @@
+/**
+ * (c) 2011 Richard J Smith
+ *
+ * This file is part of hxzmq
+ *
+ * hxzmq is free software; you can redistribute it and/or modify it under
+ * the terms of the Lesser GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hxzmq is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * Lesser GNU General Public License for more details.
+ *
+ * You should have received a copy of the Lesser GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+package org.zeromq.bench;
+
+import haxe.io.Bytes;
+import neko.Lib;
+import neko.Sys;
+
+import org.zeromq.ZContext;
+import org.zeromq.ZFrame;
+import org.zeromq.ZMQ;
+import org.zeromq.ZMQSocket;
+import org.zeromq.ZMsg;
+import org.zeromq.ZThread;
+
+/**
+ * haXe ports of the libzmq perf tools (local_thr, remote_thr, local_lat, remote_lat),
+ * so that throughput and latency through the binding can be compared with the C numbers.
+ *
+ * The tools take the same arguments as their libzmq counterparts, plus an optional API
+ * ("raw" for ZMQSocket.sendMsg/recvMsg, "zmsg" for ZMsg), and are run through BenchAll, e.g.
+ * <pre>
+ * ./BenchAll local_thr tcp://127.0.0.1:5555 64 1000000
+ * ./BenchAll remote_thr tcp://127.0.0.1:5555 64 1000000
+ * </pre>
+ * The "perf" benchmark runs both sides in one process, sweeping message size,
+ * transport, socket pattern and API.
+ */
+class BenchPerf
+{
+	private static var SIZES:Array<Int> = [1, 64, 1024, 16 * 1024, 256 * 1024];
+
+	/** Total number of payload bytes sent for each throughput run, up to MAX_COUNT messages */
+	private static inline var BYTES_PER_RUN:Int = 64 * 1024 * 1024;
+	private static inline var MAX_COUNT:Int = 100000;
+	private static inline var MIN_COUNT:Int = 1000;
+
+	/** Round trips timed for each latency run */
+	private static inline var ROUNDTRIPS:Int = 10000;
+	private static inline var ROUNDTRIPS_LARGE:Int = 1000;
+
+	public static var TOOLS:Array<String> = ["local_thr", "remote_thr", "local_lat", "remote_lat"];
+
+	/**
+	 * Runs one of the perf tools
+	 * @param	args	Tool name, then endpoint, message size, message count (or round trips) and optional API
+	 */
+	public static function tool(args:Array<String>) {
+		if (args.length < 4) {
+			var countName = { if (args[0].indexOf("thr") >= 0) "message-count" else "roundtrip-count"; };
+			Lib.println("usage: " + args[0] + " <endpoint> <message-size> <" + countName + "> [raw|zmsg]");
+			return;
+		}
+		var endpoint = args[1];
+		var size = Std.parseInt(args[2]);
+		var count = Std.parseInt(args[3]);
+		var zmsg = (args.length > 4 && args[4] == "zmsg");
+
+		var ctx:ZContext = new ZContext();
+		switch (args[0]) {
+			case "local_thr":
+				var s = ctx.createSocket(ZMQ_PULL);
+				s.bind(endpoint);
+				var elapsed = receive(s, size, count, zmsg);
+				Lib.println("# local_thr: size,count,msgs_per_sec,mbit_per_sec");
+				Lib.println(size + "," + count + "," + throughput(size, count, elapsed));
+			case "remote_thr":
+				// Let all messages be delivered before the context is destroyed
+				ctx.linger = -1;
+				var s = ctx.createSocket(ZMQ_PUSH);
+				s.connect(endpoint);
+				send(s, size, count, zmsg);
+			case "local_lat":
+				var s = ctx.createSocket(ZMQ_REP);
+				s.bind(endpoint);
+				echo(s, size, count, zmsg);
+			case "remote_lat":
+				var s = ctx.createSocket(ZMQ_REQ);
+				s.connect(endpoint);
+				var elapsed = roundtrips(s, size, count, zmsg);
+				Lib.println("# remote_lat: size,roundtrips,latency_usec");
+				Lib.println(size + "," + count + "," + latency(count, elapsed));
+		}
+		ctx.destroy();
+	}
+
+	/**
+	 * Runs throughput and latency sweeps with both sides in this process
+	 */
+	public static function run() {
+		var transports = ["inproc://bench-perf", "tcp://127.0.0.1:5590"];
+		if (Sys.systemName() != "Windows")
+			transports.insert(1, "ipc:///tmp/hxzmq-bench-perf");
+		var apis = ["raw", "zmsg"];
+
+		Lib.println("# thr: pattern,transport,api,size,count,msgs_per_sec,mbit_per_sec");
+		for (pattern in [[ZMQ_PUSH, ZMQ_PULL], [ZMQ_PAIR, ZMQ_PAIR]]) {
+			for (endpoint in transports) {
+				for (api in apis) {
+					for (size in SIZES) {
+						var count = Std.int(BYTES_PER_RUN / size);
+						if (count > MAX_COUNT) count = MAX_COUNT;
+						if (count < MIN_COUNT) count = MIN_COUNT;
+						var elapsed = runThr(pattern[0], pattern[1], endpoint, size, count, api == "zmsg");
+						Lib.println(patternName(pattern) + "," + transportName(endpoint) + "," + api + "," +
+							size + "," + count + "," + throughput(size, count, elapsed));
+					}
+				}
+			}
+		}
+
+		Lib.println("# lat: pattern,transport,api,size,roundtrips,latency_usec");
+		for (pattern in [[ZMQ_REQ, ZMQ_REP], [ZMQ_PAIR, ZMQ_PAIR]]) {
+			for (endpoint in transports) {
+				for (api in apis) {
+					for (size in SIZES) {
+						var count = { if (size <= 1024) ROUNDTRIPS else ROUNDTRIPS_LARGE; };
+						var elapsed = runLat(pattern[0], pattern[1], endpoint, size, count, api == "zmsg");
+						Lib.println(patternName(pattern) + "," + transportName(endpoint) + "," + api + "," +
+							size + "," + count + "," + latency(count, elapsed));
+					}
+				}
+			}
+		}
+	}
+
+	/**
+	 * Receives count messages in this thread from a sender in an attached thread,
+	 * returns elapsed time in seconds
+	 */
+	private static function runThr(sender:SocketType, receiver:SocketType, endpoint:String, size:Int, count:Int, zmsg:Bool):Float {
+		var ctx:ZContext = new ZContext();
+		var s:ZMQSocket = ctx.createSocket(receiver);
+		s.bind(endpoint);
+		var pipe:ZMQSocket = ZThread.attach(ctx, function(ctx:ZContext, pipe:ZMQSocket, args:Dynamic) {
+			var s:ZMQSocket = ctx.createSocket(sender);
+			s.connect(endpoint);
+			send(s, size, count, zmsg);
+			pipe.recvMsg();
+		}, null);
+		var elapsed = receive(s, size, count, zmsg);
+		pipe.sendMsg(Bytes.ofString("DONE"));
+		ctx.destroy();
+		return elapsed;
+	}
+
+	/**
+	 * Times count round trips from this thread to an echo in an attached thread,
+	 * returns elapsed time in seconds
+	 */
+	private static function runLat(requester:SocketType, replier:SocketType, endpoint:String, size:Int, count:Int, zmsg:Bool):Float {
+		var ctx:ZContext = new ZContext();
+		var s:ZMQSocket = ctx.createSocket(requester);
+		s.bind(endpoint);
+		var pipe:ZMQSocket = ZThread.attach(ctx, function(ctx:ZContext, pipe:ZMQSocket, args:Dynamic) {
+			var s:ZMQSocket = ctx.createSocket(replier);
+			s.connect(endpoint);
+			echo(s, size, count + 1, zmsg);
+			pipe.recvMsg();
+		}, null);
+		// One untimed round trip, so connection setup is not measured
+		roundtrips(s, size, 1, zmsg);
+		var elapsed = roundtrips(s, size, count, zmsg);
+		pipe.sendMsg(Bytes.ofString("DONE"));
+		ctx.destroy();
+		return elapsed;
+	}
+
+	/**
+	 * Receives count messages. As in local_thr, timing starts from the first message
+	 */
+	private static function receive(s:ZMQSocket, size:Int, count:Int, zmsg:Bool):Float {
+		recvOne(s, size, zmsg);
+		var start = Sys.time();
+		for (i in 1 ... count) {
+			recvOne(s, size, zmsg);
+		}
+		return Sys.time() - start;
+	}
+
+	private static function send(s:ZMQSocket, size:Int, count:Int, zmsg:Bool) {
+		var payload:Bytes = Bytes.alloc(size);
+		for (i in 0 ... count) {
+			sendOne(s, payload, zmsg);
+		}
+	}
+
+	private static function echo(s:ZMQSocket, size:Int, count:Int, zmsg:Bool) {
+		for (i in 0 ... count) {
+			if (zmsg) {
+				ZMsg.recvMsg(s).send(s);
+			} else {
+				s.sendMsg(s.recvMsg());
+			}
+		}
+	}
+
+	private static function roundtrips(s:ZMQSocket, size:Int, count:Int, zmsg:Bool):Float {
+		var payload:Bytes = Bytes.alloc(size);
+		var start = Sys.time();
+		for (i in 0 ... count) {
+			sendOne(s, payload, zmsg);
+			recvOne(s, size, zmsg);
+		}
+		return Sys.time() - start;
+	}
+
+	private static function sendOne(s:ZMQSocket, payload:Bytes, zmsg:Bool) {
+		if (zmsg) {
+			var msg = new ZMsg();
+			msg.add(new ZFrame(payload));
+			msg.send(s);
+		} else {
+			s.sendMsg(payload);
+		}
+	}
+
+	private static function recvOne(s:ZMQSocket, size:Int, zmsg:Bool) {
+		var received = 0;
+		if (zmsg) {
+			var msg = ZMsg.recvMsg(s);
+			received = msg.contentSize();
+			msg.destroy();
+		} else {
+			received = s.recvMsg().length;
+		}
+		if (received != size)
+			throw "message of incorrect size received: " + received;
+	}
+
+	/**
+	 * Returns "msgs_per_sec,mbit_per_sec", calculated as by local_thr
+	 */
+	private static function throughput(size:Int, count:Int, elapsed:Float):String {
+		// The first message is not timed
+		var msgs = (count - 1) / elapsed;
+		return Std.int(msgs) + "," + Std.int(msgs * size * 8 / 10000) / 100;
+	}
+
+	/**
+	 * Returns one-way latency in microseconds, calculated as by remote_lat
+	 */
+	private static function latency(count:Int, elapsed:Float):String {
+		return Std.string(Std.int(elapsed * 1000000 / (count * 2) * 100) / 100);
+	}
+
+	private static function patternName(pattern:Array<SocketType>):String {
+		return { if (pattern[0] == pattern[1]) "pair" else (socketName(pattern[0]) + "_" + socketName(pattern[1])); };
+	}
+
+	private static function socketName(type:SocketType):String {
+		return Std.string(type).substr(4).toLowerCase();
+	}
+
+	private static function transportName(endpoint:String):String {
+		return endpoint.substr(0, endpoint.indexOf(":"));
+	}
+}
@@ -0,0 +1,67 @@
+/**
+ * (c) 2011 Richard J Smith
+ *
+ * This file is part of hxzmq
+ *
+ * hxzmq is free software; you can redistribute it and/or modify it under
+ * the terms of the Lesser GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hxzmq is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * Lesser GNU General Public License for more details.
+ *
+ * You should have received a copy of the Lesser GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+package org.zeromq.bench;
+
+import neko.Lib;
+import neko.Sys;
+
+import org.zeromq.ZLoop;
+
+/**
+ * Measures ZLoop timer overhead as the number of registered timers grows.
+ * 
+ * Registers a number of idle timers that never expire during the run, plus one
+ * zero-delay timer that fires on every pass of the reactor until it has ticked
+ * TICKS times, so each pass measures the cost of a wakeup with that many timers.
+ */
+class BenchTimers 
+{
+	private static var COUNTS:Array<Int> = [10, 100, 1000, 10000, 100000];
+	
+	/** Number of reactor passes timed for each timer count */
+	private static inline var TICKS:Int = 10000;
+	
+	public static function run() {
+		Lib.println("# timers: timers,register_usec_per_timer,wakeup_usec");
+		for (count in COUNTS) {
+			var loop:ZLoop = new ZLoop();
+			var idle = function(loop:ZLoop, args:Dynamic):Int { return 0; };
+			
+			var start = Sys.time();
+			for (i in 0 ... count) {
+				loop.registerTimer(3600 * 1000, 1, idle, i);
+			}
+			var register = Sys.time() - start;
+			
+			var ticks = 0;
+			loop.registerTimer(0, 0, function(loop:ZLoop, args:Dynamic):Int {
+				return { if (++ticks == TICKS) -1 else 0; };
+			});
+			start = Sys.time();
+			loop.start();
+			var elapsed = Sys.time() - start;
+			loop.destroy();
+			
+			Lib.println(count + "," +
+				Std.int(register * 1000000 / count * 100) / 100 + "," +
+				Std.int(elapsed * 1000000 / TICKS * 100) / 100);
+		}
+	}
+}
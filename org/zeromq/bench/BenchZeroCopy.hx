@@ -0,0 +1,96 @@
+/**
+ * (c) 2011 Richard J Smith
+ *
+ * This file is part of hxzmq
+ *
+ * hxzmq is free software; you can redistribute it and/or modify it under
+ * the terms of the Lesser GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hxzmq is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * Lesser GNU General Public License for more details.
+ *
+ * You should have received a copy of the Lesser GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+package org.zeromq.bench;
+
+import haxe.io.Bytes;
+import neko.Lib;
+import neko.Sys;
+
+import org.zeromq.ZContext;
+import org.zeromq.ZMQ;
+import org.zeromq.ZMQSocket;
+import org.zeromq.ZThread;
+
+/**
+ * Compares ZMQSocket.sendMsg (copying) with ZMQSocket.sendMsgZeroCopy
+ * across a range of payload sizes.
+ * 
+ * A PUSH socket in the main thread sends to a PULL socket in an attached thread,
+ * which signals back over its pipe once it has received every message.
+ */
+class BenchZeroCopy 
+{
+	private static var SIZES:Array<Int> = [64, 1024, 16 * 1024, 256 * 1024, 1024 * 1024, 4 * 1024 * 1024];
+	
+	/** Total number of payload bytes sent for each message size */
+	private static inline var BYTES_PER_RUN:Int = 256 * 1024 * 1024;
+	
+	public static function run() {
+		Lib.println("# zerocopy: size,copy_msgs_per_sec,copy_mb_per_sec,zerocopy_msgs_per_sec,zerocopy_mb_per_sec");
+		for (size in SIZES) {
+			var count = Std.int(BYTES_PER_RUN / size);
+			if (count > 100000) count = 100000;
+			var copy = runOnce(size, count, false);
+			var zeroCopy = runOnce(size, count, true);
+			Lib.println(size + "," +
+				Std.int(count / copy) + "," + Std.int((count * size) / (copy * 1048576)) + "," +
+				Std.int(count / zeroCopy) + "," + Std.int((count * size) / (zeroCopy * 1048576)));
+		}
+	}
+	
+	/**
+	 * Sends count messages of the given size, returns elapsed time in seconds
+	 */
+	private static function runOnce(size:Int, count:Int, zeroCopy:Bool):Float {
+		var ctx:ZContext = new ZContext();
+		var endpoint = "inproc://bench-zerocopy";
+		var push:ZMQSocket = ctx.createSocket(ZMQ_PUSH);
+		push.bind(endpoint);
+		var pipe:ZMQSocket = ZThread.attach(ctx, receiver, { endpoint:endpoint, count:count } );
+		
+		// Wait for receiver to be connected
+		pipe.recvMsg();
+		
+		var payload:Bytes = Bytes.alloc(size);
+		var start = Sys.time();
+		for (i in 0 ... count) {
+			if (zeroCopy)
+				push.sendMsgZeroCopy(payload);
+			else
+				push.sendMsg(payload);
+		}
+		pipe.recvMsg();
+		var elapsed = Sys.time() - start;
+		
+		ZMQSocket.releaseZeroCopyBuffers();
+		ctx.destroy();
+		return elapsed;
+	}
+	
+	private static function receiver(ctx:ZContext, pipe:ZMQSocket, args:Dynamic) {
+		var pull:ZMQSocket = ctx.createSocket(ZMQ_PULL);
+		pull.connect(args.endpoint);
+		pipe.sendMsg(Bytes.ofString("READY"));
+		for (i in 0 ... args.count) {
+			pull.recvMsg();
+		}
+		pipe.sendMsg(Bytes.ofString("DONE"));
+	}
+}
@@ -0,0 +1,296 @@
+/**
+ * (c) 2011 Richard J Smith
+ *
+ * This file is part of hxzmq
+ *
+ * hxzmq is free software; you can redistribute it and/or modify it under
+ * the terms of the Lesser GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hxzmq is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * Lesser GNU General Public License for more details.
+ *
+ * You should have received a copy of the Lesser GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+package org.zeromq.remoting;
+
+import haxe.io.Bytes;
+import haxe.io.BytesInput;
+import haxe.io.BytesOutput;
+import org.zeromq.remoting.ZMQRemotingCodec;
+
+/**
+ * Compact binary haXe remoting message format.
+ * <p>
+ * Each message starts with a byte giving its kind: 1 for a request, 2 for an answer, or 3 for
+ * an answer holding an exception. A request then holds the method path, as a length-prefixed
+ * string of the path elements joined by ".", then an array of parameters. An answer then holds
+ * the result, or the exception.
+ * </p>
+ * <p>
+ * Values are written as a one-byte type tag, followed by:<br />
+ *	- n, t, f: nothing (null, true, false)<br />
+ *	- i: an Int >= 0, as a varint; j: a negative Int i, as the varint -(i + 1)<br />
+ *	- d: a Float, as 8 bytes little-endian IEEE 754<br />
+ *	- s: a String, as a varint byte length then its UTF-8 bytes<br />
+ *	- b: a Bytes object, as a varint length then its bytes<br />
+ *	- a: an Array, as a varint length then each element<br />
+ *	- o: an anonymous object, as a varint field count then each field name (as a String) and value<br />
+ *	- x: any other value (e.g. class instances, enums, Hash, Date), as a String holding
+ *	  the value serialized with haxe.Serializer<br />
+ * </p>
+ * <p>
+ * Decoded method paths are interned, so requests for the same method share one path array
+ * (which must not be modified). A codec object must not be used by more than one thread at once.
+ * </p>
+ */
+class ZMQBinaryCodec implements ZMQRemotingCodec
+{
+	private static inline var REQUEST:Int = 1;
+	private static inline var ANSWER:Int = 2;
+	private static inline var EXCEPTION:Int = 3;
+	
+	private static inline var TAG_NULL:Int = 0x6E;		// n
+	private static inline var TAG_TRUE:Int = 0x74;		// t
+	private static inline var TAG_FALSE:Int = 0x66;		// f
+	private static inline var TAG_INT:Int = 0x69;		// i
+	private static inline var TAG_NEGINT:Int = 0x6A;	// j
+	private static inline var TAG_FLOAT:Int = 0x64;		// d
+	private static inline var TAG_STRING:Int = 0x73;	// s
+	private static inline var TAG_BYTES:Int = 0x62;		// b
+	private static inline var TAG_ARRAY:Int = 0x61;		// a
+	private static inline var TAG_OBJECT:Int = 0x6F;	// o
+	private static inline var TAG_SERIALIZED:Int = 0x78;	// x
+	
+	/** Most distinct method paths kept interned */
+	private static inline var MAX_PATHS:Int = 1024;
+	
+	private var paths:Hash<Array<String>>;
+	private var pathCount:Int;
+	
+	/** Message being decoded, and read position in it */
+	private var buf:Bytes;
+	private var pos:Int;
+	
+	public function new() {
+		paths = new Hash<Array<String>>();
+		pathCount = 0;
+	}
+	
+	public function accepts(data:Bytes):Bool {
+		return data != null && data.length > 0 && data.get(0) >= REQUEST && data.get(0) <= EXCEPTION;
+	}
+	
+	public function encodeRequest(path:Array<String>, params:Array<Dynamic>):Bytes {
+		var o = new BytesOutput();
+		o.writeByte(REQUEST);
+		writeString(o, path.join("."));
+		writeValue(o, params);
+		return o.getBytes();
+	}
+	
+	public function encodeAnswer(answer:Dynamic, isException:Bool):Bytes {
+		var o = new BytesOutput();
+		o.writeByte({ if (isException) EXCEPTION else ANSWER; });
+		writeValue(o, answer);
+		return o.getBytes();
+	}
+	
+	public function isRequest(data:Bytes):Bool {
+		if (!accepts(data))
+			throw "Invalid data";
+		return data.get(0) == REQUEST;
+	}
+	
+	public function decodeRequest(data:Bytes):ZMQRemotingRequest {
+		if (data == null || data.length == 0 || data.get(0) != REQUEST)
+			throw "Not a request";
+		buf = data;
+		pos = 1;
+		var key = readString();
+		var path = paths.get(key);
+		if (path == null) {
+			path = key.split(".");
+			if (pathCount < MAX_PATHS) {
+				paths.set(key, path);
+				pathCount++;
+			}
+		}
+		var params:Array<Dynamic> = readValue();
+		buf = null;
+		if (!Std.is(params, Array))
+			throw "Invalid data";
+		return { path:path, params:params };
+	}
+	
+	public function decodeAnswer(data:Bytes):Dynamic {
+		var kind = { if (data == null || data.length == 0) 0 else data.get(0); };
+		if (kind != ANSWER && kind != EXCEPTION)
+			throw "Not an answer";
+		buf = data;
+		pos = 1;
+		var v = readValue();
+		buf = null;
+		if (kind == EXCEPTION)
+			throw v;
+		return v;
+	}
+	
+	private static function writeValue(o:BytesOutput, v:Dynamic) {
+		switch (Type.typeof(v)) {
+			case TNull:
+				o.writeByte(TAG_NULL);
+			case TBool:
+				o.writeByte({ if (v) TAG_TRUE else TAG_FALSE; });
+			case TInt:
+				var i:Int = v;
+				if (i >= 0) {
+					o.writeByte(TAG_INT);
+					writeVarint(o, i);
+				} else {
+					// -(i + 1) cannot overflow, even for the smallest Int
+					o.writeByte(TAG_NEGINT);
+					writeVarint(o, -(i + 1));
+				}
+			case TFloat:
+				o.writeByte(TAG_FLOAT);
+				o.writeDouble(v);
+			case TObject:
+				var fields = Reflect.fields(v);
+				o.writeByte(TAG_OBJECT);
+				writeVarint(o, fields.length);
+				for (f in fields) {
+					writeString(o, f);
+					writeValue(o, Reflect.field(v, f));
+				}
+			case TClass(c):
+				if (Std.is(v, String)) {
+					o.writeByte(TAG_STRING);
+					writeString(o, v);
+				} else if (Std.is(v, Array)) {
+					var a:Array<Dynamic> = v;
+					o.writeByte(TAG_ARRAY);
+					writeVarint(o, a.length);
+					for (e in a) {
+						writeValue(o, e);
+					}
+				} else if (Std.is(v, Bytes)) {
+					var b:Bytes = v;
+					o.writeByte(TAG_BYTES);
+					writeVarint(o, b.length);
+					o.write(b);
+				} else {
+					writeSerialized(o, v);
+				}
+			default:
+				writeSerialized(o, v);
+		}
+	}
+	
+	private static function writeSerialized(o:BytesOutput, v:Dynamic) {
+		o.writeByte(TAG_SERIALIZED);
+		writeString(o, haxe.Serializer.run(v));
+	}
+	
+	private static function writeString(o:BytesOutput, s:String) {
+		var b = Bytes.ofString(s);
+		writeVarint(o, b.length);
+		o.write(b);
+	}
+	
+	/**
+	 * Writes a non-negative Int, 7 bits per byte, least significant first.
+	 * The top bit of each byte is set if more bytes follow.
+	 */
+	private static function writeVarint(o:BytesOutput, v:Int) {
+		while (v >= 0x80) {
+			o.writeByte((v & 0x7F) | 0x80);
+			v >>>= 7;
+		}
+		o.writeByte(v);
+	}
+	
+	private function readValue():Dynamic {
+		var tag = readByte();
+		if (tag == TAG_STRING) {
+			return readString();
+		} else if (tag == TAG_INT) {
+			return readVarint();
+		} else if (tag == TAG_NEGINT) {
+			return -readVarint() - 1;
+		} else if (tag == TAG_NULL) {
+			return null;
+		} else if (tag == TAG_TRUE) {
+			return true;
+		} else if (tag == TAG_FALSE) {
+			return false;
+		} else if (tag == TAG_FLOAT) {
+			need(8);
+			var d = new BytesInput(buf, pos, 8).readDouble();
+			pos += 8;
+			return d;
+		} else if (tag == TAG_ARRAY) {
+			var n = readVarint();
+			var a = new Array<Dynamic>();
+			for (i in 0 ... n) {
+				a.push(readValue());
+			}
+			return a;
+		} else if (tag == TAG_OBJECT) {
+			var n = readVarint();
+			var obj = { };
+			for (i in 0 ... n) {
+				var f = readString();
+				Reflect.setField(obj, f, readValue());
+			}
+			return obj;
+		} else if (tag == TAG_BYTES) {
+			var n = readVarint();
+			need(n);
+			var b = buf.sub(pos, n);
+			pos += n;
+			return b;
+		} else if (tag == TAG_SERIALIZED) {
+			return haxe.Unserializer.run(readString());
+		}
+		throw "Invalid data";
+		return null;
+	}
+	
+	private function readString():String {
+		var n = readVarint();
+		need(n);
+		var s = buf.readString(pos, n);
+		pos += n;
+		return s;
+	}
+	
+	private function readVarint():Int {
+		var v = 0;
+		var shift = 0;
+		var b = readByte();
+		while (b >= 0x80) {
+			v |= (b & 0x7F) << shift;
+			shift += 7;
+			if (shift > 28)
+				throw "Invalid data";
+			b = readByte();
+		}
+		return v | (b << shift);
+	}
+	
+	private function readByte():Int {
+		need(1);
+		return buf.get(pos++);
+	}
+	
+	private function need(n:Int) {
+		if (n < 0 || pos + n > buf.length)
+			throw "Truncated data";
+	}
+}
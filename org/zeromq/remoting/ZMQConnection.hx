@@ -43,6 +43,13 @@
 
 package org.zeromq.remoting;
 
+import haxe.io.Bytes;
+import org.zeromq.ZFrame;
+import org.zeromq.ZLoop;
+import org.zeromq.ZMQ;
+import org.zeromq.ZMQException;
+import org.zeromq.ZMQSocket;
+import org.zeromq.remoting.ZMQRemotingCodec;
 import org.zeromq.remoting.ZMQSocketProtocol;
 import haxe.remoting.AsyncConnection;
 import haxe.remoting.Context;
@@ -51,8 +58,24 @@ import haxe.remoting.Context;
  * This class provides a haXe remoting adapter using the zeroMQ message 
  * library (via hxzmq) as the transport layer.
  * 
+ * <p>
+ * Connections made with create() exchange single-part messages over REQ and REP sockets,
+ * so have one call in flight at a time, answered in order.
+ * </p>
+ * <p>
+ * Connections made with createAsync() pipeline calls over a DEALER socket to a ROUTER socket
+ * (also served by an async connection). Each request carries a correlation ID, so any number of
+ * calls can be outstanding, and answers are matched to their callbacks in whatever order they arrive.
+ * Messages are received by attaching the connection to a ZLoop, or by calling dispatch().
+ * Each async message is [envelope, empty delimiter frame, correlation ID frame, payload];
+ * a server echoes everything before the payload back with its answer.
+ * </p>
  * <pre>
- * 
+ * var cnx = ZMQConnection.createAsync(dealer);
+ * cnx.attach(loop);
+ * for (i in 0 ... 100)
+ *     cnx.Api.square.call([i], function(r) trace(r));
+ * loop.start();
  * </pre>
  */
 class ZMQConnection implements AsyncConnection, implements Dynamic<AsyncConnection>
@@ -64,8 +87,16 @@ class ZMQConnection implements AsyncConnection, implements Dynamic<AsyncConnecti
 		results : List<{ onResult : Dynamic -> Void, onError : Dynamic -> Void }>,
 		log : Array<String> -> Array<Dynamic> -> Dynamic -> Void,
 		error : Dynamic -> Void,
+		async : Bool,
+		pending : IntHash<{ onResult : Dynamic -> Void, onError : Dynamic -> Void }>,
+		pendingCount : Int,
+		nextId : Int,
+		loop : ZLoop,
 	};
 
+	/** Most messages handled per dispatch by an attached connection */
+	static inline var DISPATCH_BATCH : Int = 256;
+
 	function new(data,path) {
 		__data = data;
 		__path = path;
@@ -78,6 +109,10 @@ class ZMQConnection implements AsyncConnection, implements Dynamic<AsyncConnecti
 	}
 
 	public function call( params : Array<Dynamic>, ?onResult : Dynamic -> Void ) {
+		if( __data.async ) {
+			callAsync(params, onResult);
+			return;
+		}
 		try {
 			__data.protocol.sendRequest(__path,params);
 			__data.results.add({ onResult : onResult, onError : __data.error });
@@ -103,34 +138,205 @@ class ZMQConnection implements AsyncConnection, implements Dynamic<AsyncConnecti
 	}
 
 	public function close() {
+		detach();
 		try __data.protocol.socket.close() catch( e : Dynamic ) { };
+		if( __data.async ) {
+			// Fail any calls still waiting for an answer
+			var waiting = __data.pending;
+			__data.pending = new IntHash();
+			__data.pendingCount = 0;
+			for( f in waiting )
+				f.onError("Connection closed");
+		}
+	}
+
+	/**
+	 * Returns the number of async calls waiting for an answer
+	 */
+	public function pendingCalls() : Int {
+		return __data.pendingCount;
+	}
+
+	/**
+	 * Registers an async connection with a reactor, which then receives and handles its
+	 * answers (or requests), and queues outgoing messages rather than blocking.
+	 * @return	true if OK, else false
+	 */
+	public function attach( loop : ZLoop ) : Bool {
+		if( loop == null || !__data.async )
+			throw new ZMQException(EINVAL);
+		__data.loop = loop;
+		var me = this;
+		return loop.registerPoller({ socket : __data.protocol.socket, event : ZMQ.ZMQ_POLLIN() }, function(l : ZLoop, s : ZMQSocket) : Int {
+			me.dispatch(DISPATCH_BATCH);
+			return 0;
+		});
+	}
+
+	/**
+	 * Unregisters an attached connection from its reactor. Messages queued for sending are discarded.
+	 */
+	public function detach() {
+		if( __data.loop != null ) {
+			__data.loop.unregisterWriter(__data.protocol.socket);
+			__data.loop.unregisterPoller({ socket : __data.protocol.socket, event : ZMQ.ZMQ_POLLIN() });
+			__data.loop = null;
+		}
+	}
+
+	/**
+	 * Receives and handles the messages waiting on an async connection's socket, without blocking:
+	 * answers are passed to their callbacks, and requests are called and answered.
+	 * A bad message is passed to the error handler; if that throws, as the default one does,
+	 * the exception is dropped so that the other messages are still handled.
+	 * @param	?max	Most messages to handle, default all that are waiting
+	 * @return	Number of messages handled
+	 */
+	public function dispatch( ?max : Int = -1 ) : Int {
+		var socket = __data.protocol.socket;
+		var n = 0;
+		while( max < 0 || n < max ) {
+			var frames = ZFrame.recvFrames(socket, DONTWAIT);
+			if( frames == null || frames.length == 0 )
+				break;
+			n++;
+			try processFrames(frames) catch( e : Dynamic ) { };
+		}
+		return n;
+	}
+
+	function callAsync( params : Array<Dynamic>, ?onResult : Dynamic -> Void ) {
+		var id = __data.nextId;
+		__data.nextId = (id + 1) & 0x3FFFFFFF;
+		try {
+			var request = __data.protocol.codec.encodeRequest(__path, params);
+			__data.pending.set(id, { onResult : onResult, onError : __data.error });
+			__data.pendingCount++;
+			sendParts([Bytes.alloc(0), idToBytes(id), request]);
+		} catch( e : Dynamic ) {
+			if( __data.pending.remove(id) )
+				__data.pendingCount--;
+			__data.error(e);
+		}
+	}
+
+	function processFrames( frames : Array<ZFrame> ) {
+		var last = frames.pop();
+		var data = last.data;
+		last.destroy();
+		var envelope = new Array<Bytes>();
+		for( f in frames ) {
+			envelope.push(f.data);
+			f.destroy();
+		}
+		var proto = __data.protocol;
+		var request;
+		try {
+			request = proto.isRequestBytes(data);
+		} catch( e : Dynamic ) {
+			__data.error(Std.string(e) + " (in "+StringTools.urlEncode(data.toString())+")"); // protocol error
+			return;
+		}
+		if( request ) {
+			// Answer with the envelope and correlation ID the request came with
+			var me = this;
+			var answered = false;
+			try proto.answerRequest(data, function(answer) {
+				answered = true;
+				envelope.push(answer);
+				me.sendParts(envelope);
+			}, __data.log) catch( e : Dynamic ) {
+				if( answered )
+					throw e;
+				// The request could not be decoded: answer with the error, so the caller is not left waiting
+				try {
+					envelope.push(proto.decoderFor(data).encodeAnswer(Std.string(e), true));
+					sendParts(envelope);
+				} catch( e2 : Dynamic ) { };
+				__data.error(e);
+			}
+			return;
+		}
+		// answer: the correlation ID is in the frame before the payload
+		var id = { if( envelope.length == 0 ) -1 else bytesToId(envelope[envelope.length - 1]); };
+		var f = __data.pending.get(id);
+		if( f == null ) {
+			__data.error("No response excepted (correlation ID "+id+")");
+			return;
+		}
+		__data.pending.remove(id);
+		__data.pendingCount--;
+		var ret;
+		try {
+			ret = proto.processAnswerBytes(data);
+		} catch( e : Dynamic ) {
+			f.onError(e);
+			return;
+		}
+		if( f.onResult != null ) f.onResult(ret);
+	}
+
+	/**
+	 * Sends a multipart message, through the reactor's outbound queue if attached, so never blocking
+	 */
+	function sendParts( parts : Array<Bytes> ) {
+		var socket = __data.protocol.socket;
+		for( i in 0 ... parts.length ) {
+			var more = i < parts.length - 1;
+			if( __data.loop != null )
+				__data.loop.send(socket, parts[i], more);
+			else
+				socket.sendMsg(parts[i], { if( more ) SNDMORE else null; });
+		}
+	}
+
+	static function idToBytes( id : Int ) : Bytes {
+		var b = Bytes.alloc(4);
+		b.set(0, id & 0xFF);
+		b.set(1, (id >> 8) & 0xFF);
+		b.set(2, (id >> 16) & 0xFF);
+		b.set(3, (id >> 24) & 0xFF);
+		return b;
+	}
+
+	static function bytesToId( b : Bytes ) : Int {
+		if( b == null || b.length != 4 )
+			return -1;
+		return b.get(0) | (b.get(1) << 8) | (b.get(2) << 16) | (b.get(3) << 24);
 	}
 
 	public function processMessage( data : String ) {
+		processBytes(Bytes.ofString(__data.protocol.decodeData(data)));
+	}
+
+	/**
+	 * Processes a received request or answer, straight from the received message bytes
+	 * (e.g. as returned by ZMQSocketProtocol.readBytes).
+	 */
+	public function processBytes( data : Bytes ) {
 		var request;
 		var proto = __data.protocol;
-		data = proto.decodeData(data);
 		try {
-			request = proto.isRequest(data);
+			request = proto.isRequestBytes(data);
 		} catch( e : Dynamic ) {
-			var msg = Std.string(e) + " (in "+StringTools.urlEncode(data)+")";
+			var msg = Std.string(e) + " (in "+StringTools.urlEncode(data.toString())+")";
 			__data.error(msg); // protocol error
 			return;
 		}
 		// request
 		if( request ) {
-			try proto.processRequest(data,__data.log) catch( e : Dynamic ) __data.error(e);
+			try proto.processRequestBytes(data,__data.log) catch( e : Dynamic ) __data.error(e);
 			return;
 		}
 		// answer
 		var f = __data.results.pop();
 		if( f == null ) {
-			__data.error("No response excepted ("+data+")");
+			__data.error("No response excepted ("+data.toString()+")");
 			return;
 		}
 		var ret;
 		try {
-			ret = proto.processAnswer(data);
+			ret = proto.processAnswerBytes(data);
 		} catch( e : Dynamic ) {
 			f.onError(e);
 			return;
@@ -147,17 +353,39 @@ class ZMQConnection implements AsyncConnection, implements Dynamic<AsyncConnecti
 		__data.error(header + estr);
 	}
 
-	public static function create( s : ZMQSocket, ?ctx : Context ) {
+	/**
+	 * Creates a connection over socket s, serving calls to ctx if given.
+	 * Messages are sent in codec's format, by default the original text format (ZMQTextCodec);
+	 * pass a ZMQBinaryCodec for compact binary messages.
+	 */
+	public static function create( s : ZMQSocket, ?ctx : Context, ?codec : ZMQRemotingCodec ) {
 		var data = {
-			protocol : new ZMQSocketProtocol(s,ctx),
+			protocol : new ZMQSocketProtocol(s,ctx,codec),
 			results : new List(),
 			error : function(e) throw e,
 			log : null,
+			async : false,
+			pending : null,
+			pendingCount : 0,
+			nextId : 0,
+			loop : null,
 		};
 		var sc = new ZMQConnection(data,[]);
 		data.log = sc.defaultLog;
 		return sc;
 	}
 
+	/**
+	 * Creates an async connection over socket s: a DEALER socket to make pipelined calls,
+	 * or a ROUTER socket to serve them from ctx.
+	 * Messages are sent in codec's format, by default the original text format (ZMQTextCodec).
+	 */
+	public static function createAsync( s : ZMQSocket, ?ctx : Context, ?codec : ZMQRemotingCodec ) {
+		var sc = create(s, ctx, codec);
+		sc.__data.async = true;
+		sc.__data.pending = new IntHash();
+		return sc;
+	}
+
 
 }
\ No newline at end of file
@@ -0,0 +1,66 @@
+/**
+ * (c) 2011 Richard J Smith
+ *
+ * This file is part of hxzmq
+ *
+ * hxzmq is free software; you can redistribute it and/or modify it under
+ * the terms of the Lesser GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hxzmq is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * Lesser GNU General Public License for more details.
+ *
+ * You should have received a copy of the Lesser GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+package org.zeromq.remoting;
+
+import haxe.io.Bytes;
+
+/**
+ * Encodes and decodes the requests and answers exchanged by ZMQSocketProtocol.
+ * 
+ * Two codecs are provided: ZMQTextCodec, the original haxe.Serializer string format, and
+ * ZMQBinaryCodec, a compact type-tagged binary format. Messages are encoded straight into,
+ * and decoded straight from, the Bytes sent and received on the socket.
+ */
+interface ZMQRemotingCodec 
+{
+	/**
+	 * Returns true if data is in this codec's format
+	 */
+	function accepts(data:Bytes):Bool;
+	
+	/**
+	 * Encodes a call of the method at path, with parameters params
+	 */
+	function encodeRequest(path:Array<String>, params:Array<Dynamic>):Bytes;
+	
+	/**
+	 * Encodes the result of a call, or the exception it threw if isException is true
+	 */
+	function encodeAnswer(answer:Dynamic, isException:Bool):Bytes;
+	
+	/**
+	 * Returns true if data holds a request, false if it holds an answer.
+	 * Throws if data is not valid.
+	 */
+	function isRequest(data:Bytes):Bool;
+	
+	/**
+	 * Decodes a request. Throws if data does not hold a request.
+	 */
+	function decodeRequest(data:Bytes):ZMQRemotingRequest;
+	
+	/**
+	 * Decodes an answer, returning the result of the call, or throwing the exception it threw.
+	 * Throws if data does not hold an answer.
+	 */
+	function decodeAnswer(data:Bytes):Dynamic;
+}
+
+typedef ZMQRemotingRequest = { path:Array<String>, params:Array<Dynamic> };
@@ -0,0 +1,428 @@
+/**
+ * (c) 2011 Richard J Smith
+ *
+ * This file is part of hxzmq
+ *
+ * hxzmq is free software; you can redistribute it and/or modify it under
+ * the terms of the Lesser GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hxzmq is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * Lesser GNU General Public License for more details.
+ *
+ * You should have received a copy of the Lesser GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+package org.zeromq.remoting;
+
+import haxe.io.Bytes;
+import haxe.remoting.Context;
+import neko.Sys;
+import org.zeromq.ZContext;
+import org.zeromq.ZFrame;
+import org.zeromq.ZLoop;
+import org.zeromq.ZMQ;
+import org.zeromq.ZMQException;
+import org.zeromq.ZMQPoller;
+import org.zeromq.ZMQSocket;
+import org.zeromq.ZThread;
+import org.zeromq.remoting.ZMQSocketProtocol;
+
+/**
+ * Call statistics for one remote method
+ */
+typedef ZMQRemotingMethodStats = {
+	/** Number of calls answered */
+	calls:Int,
+	/** Number of those calls that threw an exception */
+	errors:Int,
+	/** Total and longest time, in seconds, from receiving a call to sending its answer, including time queued */
+	totalLatency:Float,
+	maxLatency:Float,
+	/** Total time, in seconds, spent by the workers decoding, calling and answering */
+	totalServiceTime:Float
+};
+
+/**
+ * Multi-threaded haXe remoting server.
+ * <p>
+ * Binds a ROUTER socket that clients connect to, with ZMQConnection.create over a REQ socket,
+ * or ZMQConnection.createAsync over a DEALER socket. Requests are passed over inproc to a fixed
+ * number of worker threads (forked processes, on php), each with its own haxe.remoting.Context.
+ * A request goes to a worker only when the worker is free, so one slow call never holds up
+ * requests that another worker could answer. Answers are routed back by client identity.
+ * </p>
+ * <p>
+ * Requests that arrive while every worker is busy are queued, up to maxQueue requests. While the
+ * queue is full, no more requests are read from clients, so they wait in 0MQ's queues instead.
+ * </p>
+ * <p>
+ * The server runs in a ZLoop, see attach() and start(). Statistics are available from the thread
+ * running the loop.
+ * </p>
+ * Based on the load balancing broker in the zguide.
+ */
+class ZMQRemotingServer
+{
+	/** Most messages read from a socket per wakeup */
+	private static inline var BATCH:Int = 256;
+
+	/** Most methods that failed calls get statistics of their own, as clients choose their paths */
+	private static inline var MAX_FAILED_METHODS:Int = 256;
+
+	/** Statistics key for calls that could not be decoded, and failed calls beyond MAX_FAILED_METHODS */
+	public static inline var OTHER_METHODS:String = "?";
+
+	/** Number of workers */
+	public var size(default,null):Int;
+
+	/** Most requests queued waiting for a free worker */
+	public var maxQueue:Int;
+
+	/** Number of requests answered */
+	public var answered(default,null):Int;
+
+	private var ctx:ZContext;
+	private var frontend:ZMQSocket;
+	private var backend:ZMQSocket;
+	private var pipes:Array<ZMQSocket>;
+	private var loop:ZLoop;
+	private var frontendPolled:Bool;
+
+	/** Identities of free workers */
+	private var free:Array<Bytes>;
+
+	/** Requests waiting for a free worker */
+	private var queue:List<{ frames:Array<ZFrame>, received:Float }>;
+
+	/** Time each busy worker's request was received, by worker identity */
+	private var busy:Hash<Float>;
+	private var busyCount:Int;
+
+	private var stats:Hash<ZMQRemotingMethodStats>;
+	private var failedMethods:Int;
+
+	/**
+	 * Constructor. Binds the server socket and starts the workers.
+	 * @param	ctx				Context for the server's sockets, shadowed by each worker
+	 * @param	endpoint		Endpoint to bind for clients
+	 * @param	size			Number of workers
+	 * @param	contextFactory	Run once in each worker thread, returns the worker's remoting context
+	 */
+	public function new(ctx:ZContext, endpoint:String, size:Int, contextFactory:Void->Context)
+	{
+		if (ctx == null || endpoint == null || size < 1 || contextFactory == null) {
+			throw new ZMQException(EINVAL);
+		}
+		this.ctx = ctx;
+		this.size = size;
+		maxQueue = 1000;
+		answered = 0;
+		loop = null;
+		frontendPolled = false;
+		free = new Array<Bytes>();
+		queue = new List<{ frames:Array<ZFrame>, received:Float }>();
+		busy = new Hash<Float>();
+		busyCount = 0;
+		stats = new Hash<ZMQRemotingMethodStats>();
+		failedMethods = 0;
+
+		var id = nextId++ + "-" + Std.random(0x7fffffff);
+#if php
+		var workersEndpoint = "ipc:///tmp/zremoting-workers-" + id;
+#else
+		var workersEndpoint = "inproc://zremoting-workers-" + id;
+#end
+		frontend = ctx.createSocket(ZMQ_ROUTER);
+		frontend.bind(endpoint);
+		// Bind before the workers connect, as inproc requires
+		backend = ctx.createSocket(ZMQ_ROUTER);
+		backend.bind(workersEndpoint);
+
+		pipes = new Array<ZMQSocket>();
+		for (i in 0 ... size) {
+			pipes.push(ZThread.attach(ctx, workerLoop, {
+				factory:contextFactory,
+				endpoint:workersEndpoint,
+				identity:"W" + i } ));
+		}
+	}
+
+	/**
+	 * Registers the server with a reactor, which then serves requests while it runs
+	 * @param	loop
+	 * @return	true if OK, else false
+	 */
+	public function attach(loop:ZLoop):Bool {
+		if (loop == null) {
+			throw new ZMQException(EINVAL);
+		}
+		this.loop = loop;
+		var server = this;
+		frontendPolled = false;
+		updateFrontend();
+		return loop.registerPoller( { socket:backend, event:ZMQ.ZMQ_POLLIN() }, function(loop:ZLoop, socket:ZMQSocket):Int {
+			return server.backendEvent();
+		});
+	}
+
+	/**
+	 * Unregisters the server from its reactor
+	 */
+	public function detach() {
+		if (loop != null) {
+			loop.unregisterPoller( { socket:frontend, event:ZMQ.ZMQ_POLLIN() } );
+			loop.unregisterPoller( { socket:backend, event:ZMQ.ZMQ_POLLIN() } );
+			loop = null;
+			frontendPolled = false;
+		}
+	}
+
+	/**
+	 * Serves requests in a reactor of its own, until the process is interrupted or the context is terminated
+	 * @return	Reactor return value
+	 */
+	public function start():Int {
+		var loop = new ZLoop();
+		attach(loop);
+		var rc = loop.start();
+		detach();
+		loop.destroy();
+		return rc;
+	}
+
+	/**
+	 * Stops the workers, and closes the server's sockets. Queued requests are discarded.
+	 */
+	public function destroy() {
+		detach();
+		for (pipe in pipes)
+			pipe.sendMsg(Bytes.ofString("STOP"));
+		pipes = new Array<ZMQSocket>();
+		for (r in queue)
+			for (f in r.frames) f.destroy();
+		queue.clear();
+		ctx.destroySocket(frontend);
+		ctx.destroySocket(backend);
+	}
+
+	/**
+	 * Number of requests waiting for a free worker
+	 */
+	public function queueDepth():Int {
+		return queue.length;
+	}
+
+	/**
+	 * Number of workers busy with a request
+	 */
+	public function busyWorkers():Int {
+		return busyCount;
+	}
+
+	/**
+	 * Call statistics, by method path (e.g. "api.hello"). Requests that could not be decoded
+	 * are counted under OTHER_METHODS, as are failed calls to methods beyond the first
+	 * MAX_FAILED_METHODS that failed before ever succeeding.
+	 */
+	public function methodStats():Hash<ZMQRemotingMethodStats> {
+		return stats;
+	}
+
+	/**
+	 * Reads requests from clients, and passes them to free workers
+	 */
+	private function frontendEvent():Int {
+		var n = 0;
+		while (n < BATCH && queue.length < maxQueue) {
+			var frames = ZFrame.recvFrames(frontend, DONTWAIT);
+			if (frames == null)
+				break;
+			n++;
+			if (frames.length < 2) {
+				// No client identity
+				for (f in frames) f.destroy();
+			} else {
+				queue.add( { frames:frames, received:Sys.time() } );
+				dispatchQueued();
+			}
+		}
+		updateFrontend();
+		return 0;
+	}
+
+	/**
+	 * Reads workers' answers, sends them on to clients, and passes queued requests to the freed workers
+	 */
+	private function backendEvent():Int {
+		var n = 0;
+		var more = true;
+		while (more && n < BATCH) {
+			var frames = ZFrame.recvFrames(backend, DONTWAIT);
+			if (frames == null) {
+				more = false;
+			} else {
+				n++;
+				workerMessage(frames);
+			}
+		}
+		dispatchQueued();
+		updateFrontend();
+		return 0;
+	}
+
+	/**
+	 * Handles a message from a worker: [identity, empty, "READY"] when it starts, else
+	 * [identity, empty, method, service time, "1" if failed, client envelope..., answer]
+	 */
+	private function workerMessage(frames:Array<ZFrame>) {
+		var identity = frames[0].data;
+		var key = identity.toString();
+		if (frames.length > 5) {
+			var received = busy.get(key);
+			record(frames[2].data.toString(), { if (received == null) 0.0 else Sys.time() - received; },
+				Std.parseFloat(frames[3].data.toString()), frames[4].data.toString() == "1");
+			answered++;
+			for (i in 0 ... 5)
+				frames[i].destroy();
+			ZFrame.sendFrames(frontend, frames.slice(5));
+		} else {
+			for (f in frames) f.destroy();
+		}
+		if (busy.remove(key))
+			busyCount--;
+		free.push(identity);
+	}
+
+	private function dispatchQueued() {
+		while (free.length > 0 && !queue.isEmpty()) {
+			var request = queue.pop();
+			var identity = free.pop();
+			busy.set(identity.toString(), request.received);
+			busyCount++;
+			var frames = request.frames;
+			frames.unshift(ZFrame.newFrame(Bytes.alloc(0)));
+			frames.unshift(ZFrame.newFrame(identity));
+			ZFrame.sendFrames(backend, frames);
+		}
+	}
+
+	/**
+	 * Polls for client requests only while there is room in the queue
+	 */
+	private function updateFrontend() {
+		var poll = queue.length < maxQueue;
+		if (loop == null || poll == frontendPolled)
+			return;
+		frontendPolled = poll;
+		var item = { socket:frontend, event:ZMQ.ZMQ_POLLIN() };
+		if (poll) {
+			var server = this;
+			loop.registerPoller(item, function(loop:ZLoop, socket:ZMQSocket):Int {
+				return server.frontendEvent();
+			});
+		} else {
+			loop.unregisterPoller(item);
+		}
+	}
+
+	private function record(method:String, latency:Float, serviceTime:Float, failed:Bool) {
+		var s = stats.get(method);
+		if (s == null) {
+			// A call that failed may name a method that does not exist, so only so many get an entry
+			if (failed) {
+				if (failedMethods < MAX_FAILED_METHODS)
+					failedMethods++;
+				else
+					method = OTHER_METHODS;
+				s = stats.get(method);
+			}
+		}
+		if (s == null) {
+			s = { calls:0, errors:0, totalLatency:0.0, maxLatency:0.0, totalServiceTime:0.0 };
+			stats.set(method, s);
+		}
+		s.calls++;
+		if (failed)
+			s.errors++;
+		s.totalLatency += latency;
+		if (latency > s.maxLatency)
+			s.maxLatency = latency;
+		s.totalServiceTime += serviceTime;
+	}
+
+	/**
+	 * Worker thread: answers requests until told to stop on its pipe, or the context is terminated
+	 */
+	private static function workerLoop(ctx:ZContext, pipe:ZMQSocket, args:Dynamic) {
+		var factory:Void->Context = args.factory;
+		var proto = new ZMQSocketProtocol(null, factory());
+		var socket = ctx.createSocket(ZMQ_REQ);
+		socket.setsockopt(ZMQ_IDENTITY, Bytes.ofString(args.identity));
+		socket.connect(args.endpoint);
+		socket.sendMsg(Bytes.ofString("READY"));
+
+		var poller = new ZMQPoller();
+		poller.registerSocket(pipe, ZMQ.ZMQ_POLLIN());
+		poller.registerSocket(socket, ZMQ.ZMQ_POLLIN());
+		var running = true;
+		while (running) {
+			// Stops when interrupted, told to by the server, or the context is terminated
+			try {
+				if (poller.poll(-1) == -1 || poller.pollin(1)) {
+					running = false;
+				} else if (poller.pollin(2)) {
+					var frames = ZFrame.recvFrames(socket, DONTWAIT);
+					if (frames != null)
+						ZFrame.sendFrames(socket, answer(proto, frames));
+				}
+			} catch (e:ZMQException) {
+				running = false;
+			}
+		}
+	}
+
+	/**
+	 * Makes the call requested by the last of frames, and returns the reply: a report of
+	 * three frames (method, service time, "1" if failed), the client's envelope, then the answer.
+	 * The method is a frame of its own, as its path comes from the client and may hold anything
+	 */
+	private static function answer(proto:ZMQSocketProtocol, frames:Array<ZFrame>):Array<ZFrame> {
+		var last = frames.pop();
+		var data = last.data;
+		last.destroy();
+		var start = Sys.time();
+		var method = OTHER_METHODS;
+		var isException = false;
+		var codec = proto.decoderFor(data);
+		var result:Bytes = null;
+		try {
+			var request = codec.decodeRequest(data);
+			method = request.path.join(".");
+			var value:Dynamic = null;
+			try {
+				if (proto.context == null) throw "No context is shared";
+				value = proto.context.call(request.path, request.params);
+			} catch (e:Dynamic) {
+				value = e;
+				isException = true;
+			}
+			result = codec.encodeAnswer(value, isException);
+		} catch (e:Dynamic) {
+			// Request could not be decoded, or result could not be encoded
+			isException = true;
+			result = codec.encodeAnswer(Std.string(e), true);
+		}
+		frames.unshift(ZFrame.newFrame(Bytes.ofString({ if (isException) "1" else "0"; })));
+		frames.unshift(ZFrame.newFrame(Bytes.ofString(Std.string(Sys.time() - start))));
+		frames.unshift(ZFrame.newFrame(Bytes.ofString(method)));
+		frames.push(ZFrame.newFrame(result));
+		return frames;
+	}
+
+	private static var nextId:Int = 0;
+}
@@ -45,6 +45,9 @@ package org.zeromq.remoting;
 import haxe.io.Bytes;
 import haxe.remoting.Context;
 import org.zeromq.ZMQSocket;
+import org.zeromq.remoting.ZMQBinaryCodec;
+import org.zeromq.remoting.ZMQRemotingCodec;
+import org.zeromq.remoting.ZMQTextCodec;
 
 /**
     <p>
@@ -52,23 +55,14 @@ import org.zeromq.ZMQSocket;
     Heavily based on the haxe.remoting.SocketProtocol class implementation.
     </p>
     <p>
-	The 0MQ haXe Remoting Socket Protocol is composed of serialized strings converted into byte data exchanges.
-    Each message (request or answer) is sent as a single-part zeroMQ message.
+	Each message (request or answer) is sent as a single-part zeroMQ message, encoded by
+	a ZMQRemotingCodec. By default this is ZMQTextCodec, the serialized string format of
+	haxe.remoting.SocketProtocol. ZMQBinaryCodec is a faster, more compact alternative.
     </p>
     <p>
-	A request string is composed of the following serialized values :<br />
-		- the boolean true for a request<br />
-		- an array of strings representing the object+method path<br />
-		- an array of parameters<br />
-    </p>
-    <p>
-	A response string is composed of the following serialized values :<br />
-		- the boolean false for a response<br />
-		- a serialized value representing the result<br />
-    </p>
-    <p>
-	Exceptions are serialized with [serializeException] so they will be thrown immediately
-	when they are unserialized.
+	Messages in either built-in format are always accepted, whichever codec is used for sending,
+	and each request is answered in the format it was received in. So a server using the binary
+	codec still serves clients using the text format.
     </p>
 **/
 class ZMQSocketProtocol 
@@ -77,10 +71,16 @@ class ZMQSocketProtocol
 	public var socket : ZMQSocket;
 	public var context : Context; // This is a haxe.remoting.Context object.
                                   // Don't get this mixed up with a ZMQContext!
+	public var codec : ZMQRemotingCodec;	// Codec used to encode requests and answers
+
+	// Built-in codecs, for decoding messages not in codec's format
+	var textCodec : ZMQRemotingCodec;
+	var binaryCodec : ZMQRemotingCodec;
 
-	public function new( sock, ctx ) {
+	public function new( sock, ctx, ?codec : ZMQRemotingCodec ) {
 		this.socket = sock;
 		this.context = ctx;
+		this.codec = { if( codec == null ) new ZMQTextCodec() else codec; };
 	}
 
 	function decodeChar(c) : Null<Int> {
@@ -124,21 +124,11 @@ class ZMQSocketProtocol
 	}
 
 	public function sendRequest( path : Array<String>, params : Array<Dynamic> ) {
-		var s = new haxe.Serializer();
-		s.serialize(true);
-		s.serialize(path);
-		s.serialize(params);
-		sendMessage(s.toString());
+		socket.sendMsg(codec.encodeRequest(path, params));
 	}
 
 	public function sendAnswer( answer : Dynamic, ?isException : Bool ) {
-		var s = new haxe.Serializer();
-		s.serialize(false);
-		if( isException )
-			s.serializeException(answer);
-		else
-			s.serialize(answer);
-		sendMessage(s.toString());
+		socket.sendMsg(codec.encodeAnswer(answer, isException == true));
 	}
 
 	public function sendMessage( msg : String ) {
@@ -151,22 +141,50 @@ class ZMQSocketProtocol
 		return data;
 	}
 
+	/**
+	 * Returns the codec to decode a received message with: this protocol's codec if the
+	 * message is in its format, else the built-in codec for the message's format.
+	 */
+	public function decoderFor( data : Bytes ) : ZMQRemotingCodec {
+		if( codec.accepts(data) )
+			return codec;
+		if( binaryCodec == null )
+			binaryCodec = new ZMQBinaryCodec();
+		if( binaryCodec.accepts(data) )
+			return binaryCodec;
+		if( textCodec == null )
+			textCodec = new ZMQTextCodec();
+		return textCodec;
+	}
+
 	public function isRequest( data : String ) {
-		return switch( haxe.Unserializer.run(data) ) {
-		case true: true;
-		case false: false;
-		default: throw "Invalid data";
-		}
+		return isRequestBytes(Bytes.ofString(data));
+	}
+
+	public function isRequestBytes( data : Bytes ) : Bool {
+		return decoderFor(data).isRequest(data);
 	}
 
 	public function processRequest( data : String, ?onError : Array<String> -> Array<Dynamic> -> Dynamic -> Void ) {
-		var s = new haxe.Unserializer(data);
+		processRequestBytes(Bytes.ofString(data), onError);
+	}
+
+	public function processRequestBytes( data : Bytes, ?onError : Array<String> -> Array<Dynamic> -> Dynamic -> Void ) {
+		var s = socket;
+		answerRequest(data, function(answer) s.sendMsg(answer), onError);
+	}
+
+	/**
+	 * Makes the call held in a request, and passes the encoded answer (in the format of the
+	 * request) to reply, rather than sending it on the socket.
+	 */
+	public function answerRequest( data : Bytes, reply : Bytes -> Void, ?onError : Array<String> -> Array<Dynamic> -> Dynamic -> Void ) {
+		var c = decoderFor(data);
+		var request = c.decodeRequest(data);
+		var path = request.path;
+		var args = request.params;
 		var result : Dynamic;
 		var isException = false;
-		if( s.unserialize() != true )
-			throw "Not a request";
-		var path : Array<String> = s.unserialize();
-		var args : Array<Dynamic> = s.unserialize();
 		try {
 			if ( context == null ) throw "No context is shared";
 			result = context.call(path,args);
@@ -174,18 +192,19 @@ class ZMQSocketProtocol
 			result = e;
 			isException = true;
 		}
-		// send back result/exception over network
-		sendAnswer(result,isException);
+		// send back result/exception, in the format of the request
+		reply(c.encodeAnswer(result, isException));
 		// send the error event
 		if( isException && onError != null )
 			onError(path,args,result);
 	}
 
 	public function processAnswer( data : String ) : Dynamic {
-		var s = new haxe.Unserializer(data);
-		if( s.unserialize() != false )
-			throw "Not an answer";
-		return s.unserialize();
+		return processAnswerBytes(Bytes.ofString(data));
+	}
+
+	public function processAnswerBytes( data : Bytes ) : Dynamic {
+		return decoderFor(data).decodeAnswer(data);
 	}
 
 
@@ -194,5 +213,12 @@ class ZMQSocketProtocol
 		return decodeData(b.toString());
 	}
 
+	/**
+	 * Receives the next message, without converting it to a String. Blocking call.
+	 */
+	public function readBytes() : Bytes {
+		return socket.recvMsg();
+	}
+
 
-}
+}
\ No newline at end of file
@@ -0,0 +1,119 @@
+/**
+ * (c) 2011 Richard J Smith
+ *
+ * This file is part of hxzmq
+ *
+ * hxzmq is free software; you can redistribute it and/or modify it under
+ * the terms of the Lesser GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hxzmq is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * Lesser GNU General Public License for more details.
+ *
+ * You should have received a copy of the Lesser GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * Sections of this class code were copied from the haxe.remoting.SocketProtocol class in the standard haXe distribution
+ * Copyright (c) 2005-2007, The haXe Project Contributors
+ * All rights reserved.
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   - Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   - Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE HAXE PROJECT CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE HAXE PROJECT CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+package org.zeromq.remoting;
+
+import haxe.io.Bytes;
+import org.zeromq.remoting.ZMQRemotingCodec;
+
+/**
+ * The original haXe remoting message format: values serialized with haxe.Serializer into a string.
+ * <p>
+ * A request is composed of the following serialized values :<br />
+ *	- the boolean true for a request<br />
+ *	- an array of strings representing the object+method path<br />
+ *	- an array of parameters<br />
+ * </p>
+ * <p>
+ * An answer is composed of the following serialized values :<br />
+ *	- the boolean false for an answer<br />
+ *	- a serialized value representing the result<br />
+ * </p>
+ * <p>
+ * Exceptions are serialized with [serializeException] so they will be thrown immediately
+ * when they are unserialized.
+ * </p>
+ */
+class ZMQTextCodec implements ZMQRemotingCodec
+{
+
+	public function new() {
+	}
+	
+	public function accepts(data:Bytes):Bool {
+		// Every message starts with a serialized boolean, "t" or "f"
+		return data != null && data.length > 0 && (data.get(0) == 116 || data.get(0) == 102);
+	}
+	
+	public function encodeRequest(path:Array<String>, params:Array<Dynamic>):Bytes {
+		var s = new haxe.Serializer();
+		s.serialize(true);
+		s.serialize(path);
+		s.serialize(params);
+		return Bytes.ofString(s.toString());
+	}
+	
+	public function encodeAnswer(answer:Dynamic, isException:Bool):Bytes {
+		var s = new haxe.Serializer();
+		s.serialize(false);
+		if( isException )
+			s.serializeException(answer);
+		else
+			s.serialize(answer);
+		return Bytes.ofString(s.toString());
+	}
+	
+	public function isRequest(data:Bytes):Bool {
+		return switch( haxe.Unserializer.run(data.toString()) ) {
+		case true: true;
+		case false: false;
+		default: throw "Invalid data";
+		}
+	}
+	
+	public function decodeRequest(data:Bytes):ZMQRemotingRequest {
+		var s = new haxe.Unserializer(data.toString());
+		if( s.unserialize() != true )
+			throw "Not a request";
+		var path : Array<String> = s.unserialize();
+		var params : Array<Dynamic> = s.unserialize();
+		return { path:path, params:params };
+	}
+	
+	public function decodeAnswer(data:Bytes):Dynamic {
+		var s = new haxe.Unserializer(data.toString());
+		if( s.unserialize() != false )
+			throw "Not an answer";
+		return s.unserialize();
+	}
+}
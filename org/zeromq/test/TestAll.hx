@@ -41,6 +41,7 @@ class TestAll
 		runner.add(new TestMultiPartMessage());
 		runner.add(new TestReqRep());
 		runner.add(new TestPoller());
+		runner.add(new TestDevice());
        
 		// org.zeromq.remoting package tests
         runner.add(new TestZMQRemoting());
@@ -50,6 +51,7 @@ class TestAll
         runner.add(new TestZSocket());
         runner.add(new TestZFrame());
         runner.add(new TestZMsg());
+        runner.add(new TestZJournal());
         runner.add(new TestZLoop());
 		runner.add(new TestZThread());
         
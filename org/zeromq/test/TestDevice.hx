@@ -0,0 +1,204 @@
+/**
+ * (c) $(CopyrightDate) Richard J Smith
+ *
+ * This file is part of hxzmq
+ *
+ * hxzmq is free software; you can redistribute it and/or modify it under
+ * the terms of the Lesser GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hxzmq is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * Lesser GNU General Public License for more details.
+ *
+ * You should have received a copy of the Lesser GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+package org.zeromq.test;
+import haxe.io.Bytes;
+import neko.Sys;
+import org.zeromq.ZContext;
+import org.zeromq.ZMQ;
+import org.zeromq.ZMQDevice;
+import org.zeromq.ZMQException;
+import org.zeromq.ZMQSocket;
+import org.zeromq.ZMsg;
+import org.zeromq.ZSubscriptionCache;
+import org.zeromq.ZThread;
+
+/**
+ * Haxe test class focussing on ZMQDevice class
+ */
+class TestDevice extends BaseTest
+{
+
+	private function proxyThread(ctx:ZContext, pipe:ZMQSocket, args:Dynamic) {
+		var frontend = ctx.createSocket(ZMQ_PULL);
+		frontend.bind("inproc://proxy.frontend");
+		var backend = ctx.createSocket(ZMQ_PUSH);
+		backend.bind("inproc://proxy.backend");
+		var capture = ctx.createSocket(ZMQ_PUSH);
+		capture.connect("inproc://proxy.capture");
+		pipe.sendMsg(Bytes.ofString("READY"));
+		
+		// Runs until the context is terminated
+		ZMQDevice.proxy(frontend, backend, capture);
+		
+		frontend.close();
+		backend.close();
+		capture.close();
+		pipe.close();
+	}
+	
+	public function testProxy() {
+		var ctx = new ZContext();
+		var capture = ctx.createSocket(ZMQ_PULL);
+		capture.bind("inproc://proxy.capture");
+		
+		var pipe:ZMQSocket = ZThread.attach(ctx, proxyThread, null);
+		assertEquals("READY", pipe.recvMsg().toString());
+		
+		var input = ctx.createSocket(ZMQ_PUSH);
+		input.connect("inproc://proxy.frontend");
+		var output = ctx.createSocket(ZMQ_PULL);
+		output.connect("inproc://proxy.backend");
+		
+		input.sendMsg(Bytes.ofString("part1"), SNDMORE);
+		input.sendMsg(Bytes.ofString("part2"));
+		assertEquals("part1", output.recvMsg().toString());
+		assertTrue(output.hasReceiveMore());
+		assertEquals("part2", output.recvMsg().toString());
+		assertEquals("part1", capture.recvMsg().toString());
+		assertEquals("part2", capture.recvMsg().toString());
+		
+		try {
+			ctx.destroy();
+		} catch (e:ZMQException) {
+			if (!ZMQ.isInterrupted())
+				assertTrue(false);
+		}
+	}
+	
+#if !php
+	private function cachingProxyThread(ctx:ZContext, pipe:ZMQSocket, args:Dynamic) {
+		var frontend = ctx.createSocket(ZMQ_XSUB);
+		frontend.connect("inproc://lvc.publisher");
+		var backend = ctx.createSocket(ZMQ_XPUB);
+		backend.bind("inproc://lvc.subscribers");
+		pipe.sendMsg(Bytes.ofString("READY"));
+		
+		// Runs until the context is terminated
+		ZMQDevice.proxy(frontend, backend, null, args.cache);
+		
+		frontend.close();
+		backend.close();
+		pipe.close();
+	}
+	
+	public function testCachingProxy() {
+		var ctx = new ZContext();
+		var publisher = ctx.createSocket(ZMQ_PUB);
+		publisher.bind("inproc://lvc.publisher");
+		var cache = new ZSubscriptionCache();
+		var pipe:ZMQSocket = ZThread.attach(ctx, cachingProxyThread, { cache:cache } );
+		assertEquals("READY", pipe.recvMsg().toString());
+		
+		var early = ctx.createSocket(ZMQ_SUB);
+		early.connect("inproc://lvc.subscribers");
+		early.setsockopt(ZMQ_SUBSCRIBE, Bytes.ofString("A"));
+		Sys.sleep(0.1);		// Give time for the subscription to reach the publisher
+		assertEquals(1, cache.prefixes());
+		assertTrue(cache.matches(Bytes.ofString("A1")));
+		assertFalse(cache.matches(Bytes.ofString("B1")));
+		
+		var msg = new ZMsg();
+		msg.addString("A1");
+		msg.addString("value");
+		msg.send(publisher);
+		msg = ZMsg.recvMsg(early);
+		assertEquals("A1", msg.popString());
+		assertEquals("value", msg.popString());
+		assertEquals(1, cache.topics());
+		
+		// A late joiner is sent the cached value straight away
+		var late = ctx.createSocket(ZMQ_SUB);
+		late.setsockopt(ZMQ_RCVTIMEO, 1000);
+		late.connect("inproc://lvc.subscribers");
+		late.setsockopt(ZMQ_SUBSCRIBE, Bytes.ofString("A"));
+		msg = ZMsg.recvMsg(late);
+		assertTrue(msg != null);
+		assertEquals("A1", msg.popString());
+		assertEquals("value", msg.popString());
+		assertEquals(2, cache.subscribers(Bytes.ofString("A")));
+		
+		var last = cache.lastValue(Bytes.ofString("A1"));
+		assertEquals(2, last.size());
+		assertTrue(last.last().streq("value"));
+		assertTrue(cache.lastValue(Bytes.ofString("A")) == null);
+		cache.clear();
+		assertEquals(0, cache.topics());
+		assertEquals(1, cache.prefixes());
+		
+		try {
+			ctx.destroy();
+		} catch (e:ZMQException) {
+			if (!ZMQ.isInterrupted())
+				assertTrue(false);
+		}
+	}
+	
+	public function testCachingProxyCacheAll() {
+		var ctx = new ZContext();
+		var publisher = ctx.createSocket(ZMQ_PUB);
+		publisher.bind("inproc://lvc.publisher");
+		var cache = new ZSubscriptionCache(true);
+		var pipe:ZMQSocket = ZThread.attach(ctx, cachingProxyThread, { cache:cache } );
+		assertEquals("READY", pipe.recvMsg().toString());
+		Sys.sleep(0.1);		// Give time for the proxy's own subscription to reach the publisher
+		
+		// Topics are cached with no subscribers
+		var msg = new ZMsg();
+		msg.addString("B1");
+		msg.addString("value");
+		msg.send(publisher);
+		Sys.sleep(0.1);
+		assertEquals(1, cache.topics());
+		assertEquals(0, cache.prefixes());
+		
+		// A subscriber to everything coming and going leaves the proxy subscribed
+		var sub = ctx.createSocket(ZMQ_SUB);
+		sub.connect("inproc://lvc.subscribers");
+		sub.setsockopt(ZMQ_SUBSCRIBE, Bytes.ofString(""));
+		Sys.sleep(0.1);
+		assertEquals(1, cache.prefixes());
+		sub.setsockopt(ZMQ_UNSUBSCRIBE, Bytes.ofString(""));
+		Sys.sleep(0.1);
+		assertEquals(0, cache.prefixes());
+		msg = new ZMsg();
+		msg.addString("C1");
+		msg.addString("value");
+		msg.send(publisher);
+		Sys.sleep(0.1);
+		assertEquals(2, cache.topics());
+		
+		try {
+			ctx.destroy();
+		} catch (e:ZMQException) {
+			if (!ZMQ.isInterrupted())
+				assertTrue(false);
+		}
+	}
+#end
+	
+	public override function setup():Void {
+		// Do nothing
+	}
+	
+	public override function tearDown():Void {
+		// Do nothing
+	}
+	
+}
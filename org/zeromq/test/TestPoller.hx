@@ -96,6 +96,106 @@ class TestPoller extends BaseTest
 		}
 	}
 	
+	public function testPollsetReuse() {
+		
+		var pair1:SocketPair = createBoundPair(ZMQ_PAIR, ZMQ_PAIR);
+		var pair2:SocketPair = createBoundPair(ZMQ_PAIR, ZMQ_PAIR);
+		try {
+			var poller:ZMQPoller = new ZMQPoller();
+			poller.registerSocket(pair1.s2, ZMQ.ZMQ_POLLIN());
+			poller.registerSocket(pair2.s1, ZMQ.ZMQ_POLLIN());
+			poller.registerSocket(pair2.s2, ZMQ.ZMQ_POLLIN());
+			
+			pair2.s1.sendMsg(Bytes.ofString("msg"));
+			Sys.sleep(0.1);
+			assertEquals(1, poller.poll(0));
+			assertTrue(poller.noevents(1));
+			assertTrue(poller.noevents(2));
+			assertTrue(poller.pollin(3));
+			
+			// Removing an item moves later items down, and the pollset keeps polling them
+			assertTrue(poller.unregisterSocket(pair1.s2));
+			assertEquals(1, poller.poll(0));
+			assertEquals(2, poller.revents.length);
+			assertTrue(poller.pollin(2));
+			pair2.s2.recvMsg();
+			assertEquals(0, poller.poll(0));
+			
+			poller.unregisterAllSockets();
+			
+		} catch (e:ZMQException) {
+			trace("ZMQException #:" + e.errNo + ", str:" + e.str());
+			trace (Stack.toString(Stack.exceptionStack()));
+			assertTrue(false);
+		}
+	}
+	
+	public function testReadyList() {
+		
+		var pairs = new Array<SocketPair>();
+		try {
+			var poller:ZMQPoller = new ZMQPoller();
+			for (i in 0...10) {
+				var pair = createBoundPair(ZMQ_PAIR, ZMQ_PAIR);
+				pairs.push(pair);
+				poller.registerSocket(pair.s2, ZMQ.ZMQ_POLLIN());
+			}
+			
+			pairs[3].s1.sendMsg(Bytes.ofString("msg3"));
+			pairs[7].s1.sendMsg(Bytes.ofString("msg7"));
+			Sys.sleep(0.1);
+			
+			// Only the two signalled sockets are in the ready list
+			assertEquals(2, poller.poll(0));
+			assertEquals(2, poller.readyCount());
+			assertEquals(4, poller.readyIndex(0));
+			assertEquals(8, poller.readyIndex(1));
+			assertEquals(ZMQ.ZMQ_POLLIN(), poller.readyEvents(1));
+			assertTrue(poller.pollin(8));
+			assertTrue(poller.noevents(1));
+			assertEquals(10, poller.revents.length);
+			assertEquals(ZMQ.ZMQ_POLLIN(), poller.revents[3]);
+			
+			poller.unregisterAllSockets();
+			
+		} catch (e:ZMQException) {
+			trace("ZMQException #:" + e.errNo + ", str:" + e.str());
+			trace (Stack.toString(Stack.exceptionStack()));
+			assertTrue(false);
+		}
+	}
+	
+	public function testRegisterFd() {
+		
+		try {
+			var pair:SocketPair = createBoundPair(ZMQ_PAIR, ZMQ_PAIR);
+			var poller:ZMQPoller = new ZMQPoller();
+			var other = createBoundPair(ZMQ_PAIR, ZMQ_PAIR);
+			poller.registerSocket(other.s2, ZMQ.ZMQ_POLLIN());
+			
+			// The signalling fd of a 0MQ socket is a native descriptor that becomes readable
+			// when the socket has events pending
+			var fd:Int = pair.s2.getsockopt(ZMQ_FD);
+			poller.registerFd(fd, ZMQ.ZMQ_POLLIN());
+			assertEquals(2, poller.getSize());
+			
+			pair.s1.sendMsg(Bytes.ofString("wake"));
+			assertEquals(1, poller.poll(1000 * ZMQ.ZMQ_POLL_MSEC()));
+			assertEquals(2, poller.readyIndex(0));
+			assertTrue(poller.pollin(2));
+			
+			assertTrue(poller.unregisterFd(fd));
+			assertFalse(poller.unregisterFd(fd));
+			assertEquals(1, poller.getSize());
+			assertRaisesZMQException(function() { poller.registerFd(-1, ZMQ.ZMQ_POLLIN()); }, EINVAL);
+			
+		} catch (e:ZMQException) {
+			trace("ZMQException #:" + e.errNo + ", str:" + e.str());
+			trace (Stack.toString(Stack.exceptionStack()));
+			assertTrue(false);
+		}
+	}
+	
 	public function testPollingReqRepZMQ3() {
 		var pollinout:Int = ZMQ.ZMQ_POLLIN() | ZMQ.ZMQ_POLLOUT();
 		var ctx:ZContext;
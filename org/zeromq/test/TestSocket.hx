@@ -25,6 +25,7 @@ import haxe.io.Bytes;
 import org.zeromq.ZMQ;
 import org.zeromq.ZMQContext;
 import org.zeromq.ZMQSocket;
+import org.zeromq.ZMQStats;
 import org.zeromq.ZMQException;
 import org.zeromq.test.BaseTest;
 
@@ -181,6 +182,142 @@ class TestSocket extends BaseTest
 			assertTrue(false);
 		}
 	}
+	public function testSendZeroCopy() {
+		
+		try {
+			var pair:SocketPair = createBoundPair(ZMQ_PAIR, ZMQ_PAIR);
+			var a:Bytes = Bytes.ofString("foo");
+			pair.s1.sendMsgZeroCopy(a);
+			var msg:Bytes = pair.s2.recvMsg();
+			assertEquals("foo", msg.toString());
+			
+			for (i in 0...10) {
+				a = Bytes.alloc(1);
+				a.set(0, i);
+				pair.s1.sendMsgZeroCopy(a);
+				msg = pair.s2.recvMsg();
+				assertTrue(msg.length == 1);
+				assertTrue(msg.get(0) == i);
+			}
+			// All sent messages have been received, so 0MQ should not be holding any buffers
+			assertEquals(0, ZMQSocket.releaseZeroCopyBuffers());
+			
+		} catch (e:ZMQException) {
+			trace("ZMQException #:" + e.errNo + ", str:" + e.str());
+			trace (Stack.toString(Stack.exceptionStack()));
+			assertTrue(false);
+		}
+	}
+	
+	public function testRecvInto() {
+		
+		try {
+			var pair:SocketPair = createBoundPair(ZMQ_PAIR, ZMQ_PAIR);
+			var buf:Bytes = Bytes.alloc(8);
+			
+			pair.s1.sendMsg(Bytes.ofString("foo"));
+			assertEquals(3, pair.s2.recvInto(buf, 2));
+			assertEquals("foo", buf.sub(2, 3).toString());
+			
+			// Message larger than available space is truncated, full size is returned
+			pair.s1.sendMsg(Bytes.ofString("truncated"));
+			assertEquals(9, pair.s2.recvInto(buf, 4));
+			assertEquals("trun", buf.sub(4, 4).toString());
+			
+			assertEquals(-1, pair.s2.recvInto(buf, 0, DONTWAIT));
+			assertRaisesZMQException(function() { pair.s2.recvInto(buf, 9); }, EINVAL);
+			
+		} catch (e:ZMQException) {
+			trace("ZMQException #:" + e.errNo + ", str:" + e.str());
+			trace (Stack.toString(Stack.exceptionStack()));
+			assertTrue(false);
+		}
+	}
+	
+	public function testBatch() {
+		
+		try {
+			var pair:SocketPair = createBoundPair(ZMQ_PAIR, ZMQ_PAIR);
+			var msgs = new Array<Bytes>();
+			for (i in 0...5) {
+				msgs.push(Bytes.ofString("msg" + i));
+			}
+			assertEquals(5, pair.s1.sendBatch(msgs));
+			
+			// Drains only up to max, then whatever is left
+			var r:Array<Bytes> = pair.s2.recvBatch(3);
+			assertEquals(3, r.length);
+			assertEquals("msg0", r[0].toString());
+			r = pair.s2.recvBatch(10, DONTWAIT);
+			assertEquals(2, r.length);
+			assertEquals("msg4", r[1].toString());
+			
+			assertEquals(null, pair.s2.recvBatch(10, DONTWAIT));
+			
+			// Multipart messages are kept whole, and their ends are flagged
+			pair.s1.sendMsg(Bytes.ofString("a1"), SNDMORE);
+			pair.s1.sendMsg(Bytes.ofString("a2"));
+			pair.s1.sendMsg(Bytes.ofString("b1"));
+			var more = new Array<Bool>();
+			r = pair.s2.recvBatch(1, null, more);
+			assertEquals(2, r.length);
+			assertEquals("a2", r[1].toString());
+			assertTrue(more[0]);
+			assertFalse(more[1]);
+			r = pair.s2.recvBatch(10, null, more);
+			assertEquals(1, r.length);
+			assertEquals(1, more.length);
+			assertFalse(more[0]);
+			assertRaisesZMQException(function() { pair.s2.recvBatch(0); }, EINVAL);
+			
+		} catch (e:ZMQException) {
+			trace("ZMQException #:" + e.errNo + ", str:" + e.str());
+			trace (Stack.toString(Stack.exceptionStack()));
+			assertTrue(false);
+		}
+	}
+	
+	public function testStats() {
+		
+		try {
+			var pair:SocketPair = createBoundPair(ZMQ_PAIR, ZMQ_PAIR);
+			if (!ZMQStats.isEnabled()) {
+				// hxzmq.ndll built without HXZMQ_STATS
+				assertEquals(null, pair.s1.stats());
+				return;
+			}
+			pair.s1.sendMsg(Bytes.ofString("hello"));
+			pair.s1.sendMsg(Bytes.ofString("world"));
+			pair.s2.recvMsg();
+			pair.s2.recvMsg();
+			assertEquals(null, pair.s2.recvMsg(DONTWAIT));
+			
+			var sent:ZMQStats = pair.s1.stats();
+			assertEquals(2.0, sent.messagesSent);
+			assertEquals(10.0, sent.bytesSent);
+			assertEquals(0.0, sent.messagesReceived);
+			var received:ZMQStats = pair.s2.stats();
+			assertEquals(2.0, received.messagesReceived);
+			assertEquals(1.0, received.receivesEmpty);
+			assertEquals(3.0, received.calls);
+			
+			// Every timed call lands in one histogram bucket
+			var total = 0.0;
+			for (n in received.histogram) total += n;
+			assertEquals(received.calls, total);
+			assertTrue(received.percentile(50) <= received.percentile(99));
+			
+			assertTrue(ZMQStats.process().messagesSent >= 2);
+			pair.s1.close();
+			assertEquals(null, pair.s1.stats());
+			
+		} catch (e:ZMQException) {
+			trace("ZMQException #:" + e.errNo + ", str:" + e.str());
+			trace (Stack.toString(Stack.exceptionStack()));
+			assertTrue(false);
+		}
+	}
+	
 	public function testSendBasic() {
 		
 		try {
@@ -55,6 +55,34 @@ class TestZContext extends BaseTest
         assertFalse(ctx1.context.closed);
     }
     
+#if (neko || cpp)
+    public function testContextOptions() {
+        var ctx:ZContext = new ZContext();
+        ctx.ioThreads = 2;
+        ctx.maxSockets = 100;
+        ctx.setSocketAffinity(ZMQ_PUB, 2);
+        
+        // Affinity comes from the socket type, unless given
+        var s:ZMQSocket = ctx.createSocket(ZMQ_PUB);
+        var r:ZMQInt64Type = s.getsockopt(ZMQ_AFFINITY);
+        assertEquals(2, r.lo);
+        var s1:ZMQSocket = ctx.createSocket(ZMQ_PUB, 1);
+        r = s1.getsockopt(ZMQ_AFFINITY);
+        assertEquals(1, r.lo);
+        var s2:ZMQSocket = ctx.createSocket(ZMQ_SUB);
+        r = s2.getsockopt(ZMQ_AFFINITY);
+        assertEquals(0, r.lo);
+        
+        if (ZMQ.version_full() >= ZMQ.makeVersion(3, 2, 0)) {
+            assertEquals(2, ctx.context.getOption(ZMQ_IO_THREADS));
+            assertEquals(100, ctx.context.getOption(ZMQ_MAX_SOCKETS));
+        } else {
+            assertRaisesZMQException(function() { ctx.context.getOption(ZMQ_MAX_SOCKETS); }, ENOTSUP);
+        }
+        ctx.destroy();
+    }
+#end
+    
     public function testAddingSockets() {
         // tests "internal" newSocket method, should not be used outside hxzmq itself
         var ctx:ZContext = new ZContext();
@@ -91,4 +91,45 @@ class TestZFrame extends BaseTest
         
         ctx.destroy();
     }
+    
+    public function testForwarding() {
+        var ctx:ZContext = new ZContext();
+        var output:ZMQSocket = ctx.createSocket(ZMQ_PAIR);
+        output.bindEndpoint("inproc", "zframe.forward.in");
+        var input:ZMQSocket = ctx.createSocket(ZMQ_PAIR);
+        input.connectEndpoint("inproc", "zframe.forward.in");
+        var forwardOut:ZMQSocket = ctx.createSocket(ZMQ_PAIR);
+        forwardOut.bindEndpoint("inproc", "zframe.forward.out");
+        var forwardIn:ZMQSocket = ctx.createSocket(ZMQ_PAIR);
+        forwardIn.connectEndpoint("inproc", "zframe.forward.out");
+        
+        new ZFrame(Bytes.ofString("Hello")).send(output, ZFrame.ZFRAME_MORE);
+        new ZFrame(Bytes.ofString("World")).send(output);
+        
+        // Forward received frames on without reading their content
+        var f:ZFrame = ZFrame.recvFrame(input);
+        assertTrue(f.more);
+        assertEquals(5, f.size());
+        assertEquals("e".charCodeAt(0), f.getByte(1));
+        assertEquals("ell", f.sub(1, 3).toString());
+        var copy:ZFrame = f.duplicate();
+        f.send(forwardOut, ZFrame.ZFRAME_MORE + ZFrame.ZFRAME_REUSE);
+        assertEquals(5, f.size());
+        f.send(forwardOut, ZFrame.ZFRAME_MORE);
+        assertFalse(f.hasData());
+        f = ZFrame.recvFrame(input);
+        assertFalse(f.more);
+        f.send(forwardOut);
+        
+        f = ZFrame.recvFrame(forwardIn);
+        assertTrue(f.streq("Hello"));
+        assertTrue(f.equals(copy));
+        f = ZFrame.recvFrame(forwardIn);
+        assertTrue(f.streq("Hello"));
+        f = ZFrame.recvFrame(forwardIn);
+        assertTrue(f.streq("World"));
+        assertFalse(f.more);
+        
+        ctx.destroy();
+    }
 }
\ No newline at end of file
@@ -0,0 +1,193 @@
+/**
+ * (c) 2011 Richard J Smith
+ *
+ * This file is part of hxzmq
+ *
+ * hxzmq is free software; you can redistribute it and/or modify it under
+ * the terms of the Lesser GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hxzmq is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * Lesser GNU General Public License for more details.
+ *
+ * You should have received a copy of the Lesser GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+package org.zeromq.test;
+import haxe.io.Bytes;
+import neko.FileSystem;
+import neko.io.File;
+import org.zeromq.ZContext;
+import org.zeromq.ZFrame;
+import org.zeromq.ZJournal;
+import org.zeromq.ZMsg;
+import org.zeromq.ZMQ;
+
+class TestZJournal extends BaseTest
+{
+    private static inline var DIR = "zjournal.test";
+
+#if !php
+    public function testAppendRead() {
+        // Small segments, so that appends roll over into new segment files
+        var journal = new ZJournal(DIR, 4096);
+        assertEquals(0.0, journal.next());
+        assertEquals(0.0, journal.appendBatch(newBatch(100)));
+        var msg = new ZMsg();
+        msg.addString("Last");
+        assertEquals(100.0, journal.append(msg));
+        assertEquals("Last", msg.popString());
+        assertEquals(101.0, journal.next());
+
+        var read = journal.read(98, 10);
+        assertEquals(3, read.length);
+        assertEquals("Key98", read[0].popString());
+        assertEquals(100, read[0].first().size());
+        assertEquals("Last", read[2].popString());
+        assertEquals(0, journal.read(101, 10).length);
+        journal.close();
+    }
+
+    public function testReopen() {
+        var journal = new ZJournal(DIR, 4096);
+        journal.appendBatch(newBatch(100));
+        journal.setSyncPolicy(10, 100);
+        journal.close();
+
+        // Reopening rebuilds the index from the segment files
+        journal = new ZJournal(DIR, 4096);
+        assertEquals(0.0, journal.first());
+        assertEquals(100.0, journal.next());
+        var read = journal.read(0, 200);
+        assertEquals(100, read.length);
+        for (i in 0 ... 100) {
+            assertEquals("Key" + i, read[i].popString());
+        }
+        journal.close();
+    }
+
+    public function testSyncAfterRollover() {
+        // With no group commit policy, segments are rolled over without syncing,
+        // so sync() must write out every segment appended to since the last one
+        var journal = new ZJournal(DIR, 4096);
+        journal.appendBatch(newBatch(50));
+        journal.sync();
+        journal.appendBatch(newBatch(100));
+        journal.sync();
+        assertEquals(150.0, journal.next());
+        journal.close();
+        journal = new ZJournal(DIR, 4096);
+        assertEquals(150.0, journal.next());
+        assertEquals(150, journal.read(0, 200).length);
+        journal.close();
+    }
+
+    public function testReplay() {
+        var journal = new ZJournal(DIR, 4096);
+        journal.appendBatch(newBatch(10));
+
+        // Replayed frames can be sent on, and outlive the journal
+        var ctx:ZContext = new ZContext();
+        var output:ZMQSocket = ctx.createSocket(ZMQ_PAIR);
+        ZSocket.bindEndpoint(output, "inproc", "zjournal.test");
+        var input:ZMQSocket = ctx.createSocket(ZMQ_PAIR);
+        ZSocket.connectEndpoint(input, "inproc", "zjournal.test");
+        var read = journal.read(5, 1);
+        journal.close();
+        read[0].send(output);
+        var received = ZMsg.recvMsg(input);
+        assertEquals("Key5", received.popString());
+        assertEquals(100, received.contentSize());
+        received.destroy();
+        ctx.destroy();
+    }
+
+    public function testDamagedRecord() {
+        var journal = new ZJournal(DIR, 4096);
+        journal.appendBatch(newBatch(100));
+        journal.close();
+
+        // A damaged message ends its segment when the journal is reopened
+        damage("Key40");
+        journal = new ZJournal(DIR, 4096);
+        assertEquals(100.0, journal.next());
+        assertEquals(38.0, journal.readable(38));
+        var read = journal.read(38, 10);
+        assertEquals(2, read.length);
+        assertEquals("Key39", read[1].popString());
+
+        // Reads inside the gap start after it, so a replayer always moves on
+        var seq = journal.readable(40);
+        assertTrue(seq > 40.0);
+        read = journal.read(40, 1);
+        assertEquals(1, read.length);
+        assertEquals("Key" + Std.int(seq), read[0].popString());
+        var count = 0;
+        seq = 0.0;
+        while (seq < journal.next()) {
+            seq = journal.readable(seq);
+            read = journal.read(seq, 7);
+            seq += read.length;
+            count += read.length;
+        }
+        assertTrue(count < 100 && count > 40);
+        journal.close();
+
+        // A damaged message at the end of the journal is overwritten by the next appended
+        damage("Key99");
+        journal = new ZJournal(DIR, 4096);
+        assertEquals(99.0, journal.next());
+        assertEquals(0, journal.read(99, 10).length);
+        journal.close();
+    }
+
+    private function newBatch(n:Int):Array<ZMsg> {
+        var batch = new Array<ZMsg>();
+        for (i in 0 ... n) {
+            var msg = new ZMsg();
+            msg.addString("Key" + i);
+            msg.add(new ZFrame(Bytes.alloc(100)));
+            batch.push(msg);
+        }
+        return batch;
+    }
+
+    // Changes the first byte of text where it is found in the journal's segment files
+    private function damage(text:String) {
+        for (f in FileSystem.readDirectory(DIR)) {
+            var path = DIR + "/" + f;
+            var data = File.getBytes(path);
+            for (pos in 0 ... data.length - text.length) {
+                if (data.getString(pos, text.length) == text) {
+                    data.set(pos, data.get(pos) ^ 0x20);
+                    var out = File.write(path, true);
+                    out.write(data);
+                    out.close();
+                    return;
+                }
+            }
+        }
+    }
+
+    private function removeJournal() {
+        if (!FileSystem.exists(DIR))
+            return;
+        for (f in FileSystem.readDirectory(DIR)) {
+            FileSystem.deleteFile(DIR + "/" + f);
+        }
+        FileSystem.deleteDirectory(DIR);
+    }
+
+    public override function setup():Void {
+        removeJournal();
+    }
+
+    public override function tearDown():Void {
+        removeJournal();
+    }
+#end
+}
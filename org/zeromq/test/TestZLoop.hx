@@ -19,10 +19,15 @@
 
 package org.zeromq.test;
 
+import haxe.io.Bytes;
 import org.zeromq.ZMQ;
+import org.zeromq.ZMQSocket;
 import org.zeromq.ZLoop;
+import org.zeromq.ZMailbox;
 import org.zeromq.ZContext;
 import org.zeromq.ZMsg;
+import org.zeromq.ZSocket;
+import org.zeromq.ZThread;
 
 class TestZLoop extends BaseTest
 {
@@ -65,4 +70,163 @@ class TestZLoop extends BaseTest
         loop.destroy();
         ctx.destroy();
     }
-}
\ No newline at end of file
+    
+    public function testManyTimers() {
+        var loop:ZLoop = new ZLoop();
+        var fired = new Array<Int>();
+        
+        var timerEventFn = function (loop:ZLoop, args:Dynamic):Int {
+            fired.push(args);
+            return 0;
+        };
+        var stopFn = function (loop:ZLoop, args:Dynamic):Int {
+            return -1;  // End the reactor
+        };
+        
+        // Register in reverse deadline order; cancelled timers never fire
+        for (i in 0...1000) {
+            assertTrue(loop.registerTimer(20 - (i % 20), 1, timerEventFn, 1000 - i));
+        }
+        loop.registerTimer(10, 1, timerEventFn, -1);
+        loop.unregisterTimer(-1);
+        assertTrue(loop.registerTimer(50, 1, stopFn, null));
+        
+        loop.start();
+        
+        assertEquals(1000, fired.length);
+        assertEquals(-1, Lambda.indexOf(fired, -1));
+        loop.destroy();
+    }
+    
+    public function testFdHandler() {
+        var ctx:ZContext = new ZContext();
+        
+        var output:ZMQSocket = ctx.createSocket(ZMQ_PAIR);
+        ZSocket.bindEndpoint(output, "inproc", "zloop.fd");
+        var input:ZMQSocket = ctx.createSocket(ZMQ_PAIR);
+        ZSocket.connectEndpoint(input, "inproc", "zloop.fd");
+        
+        var loop:ZLoop = new ZLoop();
+        var received = null;
+        
+        var timerEventFn = function (loop:ZLoop, args:Dynamic):Int {
+            ZMsg.newStringMsg("PING").send(output);
+            return 0;
+        };
+        
+        // Watch input's signalling descriptor as a plain fd, as a service would a pipe or TCP socket
+        var fd:Int = input.getsockopt(ZMQ_FD);
+        var fdEventFn = function(loop:ZLoop, ready:Int):Int {
+            var msg = input.recvMsg(DONTWAIT);
+            if (msg == null)
+                return 0;   // Woken for some other socket event
+            received = msg.toString();
+            assertEquals(fd, ready);
+            return -1;  // End the reactor
+        };
+        
+        assertTrue(loop.registerTimer(10, 1, timerEventFn));
+        assertTrue(loop.registerFd(fd, ZMQ.ZMQ_POLLIN(), fdEventFn));
+        loop.start();
+        assertEquals("PING", received);
+        
+        loop.unregisterFd(fd);
+        loop.destroy();
+        ctx.destroy();
+    }
+    
+#if !php
+    public function testWriter() {
+        var ctx:ZContext = new ZContext();
+        
+        // Small high water marks, so that most messages have to be queued
+        var output:ZMQSocket = ctx.createSocket(ZMQ_PUSH);
+        output.setsockopt(ZMQ_SNDHWM, 1);
+        ZSocket.bindEndpoint(output, "inproc", "zloop.writer");
+        var input:ZMQSocket = ctx.createSocket(ZMQ_PULL);
+        input.setsockopt(ZMQ_RCVHWM, 1);
+        ZSocket.connectEndpoint(input, "inproc", "zloop.writer");
+        
+        var loop:ZLoop = new ZLoop();
+        var count = 100;
+        var received = 0;
+        var drained = 0;
+        
+        // Queued messages must neither block nor be dropped
+        var queued = 0;
+        for (i in 0 ... count) {
+            queued = loop.send(output, Bytes.ofString(Std.string(i)));
+        }
+        assertTrue(queued > 0);
+        assertEquals(queued, loop.queued(output));
+        
+        var writerEventFn = function(loop:ZLoop, socket:ZMQSocket):Int {
+            assertEquals(0, loop.queued(socket));
+            drained++;
+            return 0;
+        };
+        var socketEventFn = function(loop:ZLoop, socket:ZMQSocket):Int {
+            assertEquals(Std.string(received), socket.recvMsg().toString());
+            received++;
+            return { if (received == count) -1 else 0; };
+        };
+        
+        assertTrue(loop.registerWriter(output, writerEventFn));
+        assertTrue(loop.registerPoller( { socket:input, event:ZMQ.ZMQ_POLLIN() }, socketEventFn));
+        loop.start();
+        assertEquals(count, received);
+        assertEquals(1, drained);
+        assertEquals(0, loop.queued(output));
+        
+        loop.unregisterWriter(output);
+        loop.destroy();
+        ctx.destroy();
+    }
+#end
+    
+#if !php
+    public function testMailbox() {
+        var mailbox:ZMailbox = new ZMailbox();
+        var loop:ZLoop = new ZLoop();
+        var threads = 4;
+        var count = 1000;
+        var received = 0;
+        var last = new Array<Int>();
+        for (t in 0 ... threads)
+            last.push(-1);
+        
+        // Each thread posts its own sequence, as a status update would
+        for (t in 0 ... threads) {
+            ZThread.detach(function(args:Dynamic) {
+                for (i in 0 ... count)
+                    mailbox.post( { thread:args, seq:i } );
+            }, t);
+        }
+        
+        var mailboxEventFn = function(loop:ZLoop, v:Dynamic):Int {
+            // Values from one thread arrive in the order posted
+            assertEquals(last[v.thread] + 1, v.seq);
+            last[v.thread] = v.seq;
+            received++;
+            return { if (received == threads * count) -1 else 0; };
+        };
+        
+        assertTrue(loop.registerMailbox(mailbox, mailboxEventFn));
+        loop.start();
+        assertEquals(threads * count, received);
+        assertEquals(0, mailbox.size());
+        assertEquals(null, mailbox.recv());
+        
+        // Values are not copied
+        var b = Bytes.ofString("status");
+        mailbox.post(b);
+        assertEquals(1, mailbox.size());
+        assertTrue(mailbox.recvBatch(10)[0] == b);
+        
+        loop.unregisterMailbox(mailbox);
+        loop.destroy();
+        mailbox.destroy();
+        assertRaisesZMQException(function() { mailbox.post(1); }, ETERM);
+    }
+#end
+}
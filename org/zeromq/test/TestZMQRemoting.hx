@@ -26,13 +26,17 @@ import haxe.remoting.Proxy;
 import neko.Sys;
 import org.zeromq.ZContext;
 import org.zeromq.ZFrame;
+import org.zeromq.ZLoop;
 import org.zeromq.ZMsg;
 import org.zeromq.ZSocket;
 
 #if !php
 import neko.vm.Thread;
 #end
+import org.zeromq.remoting.ZMQBinaryCodec;
 import org.zeromq.remoting.ZMQConnection;
+import org.zeromq.remoting.ZMQRemotingServer;
+import org.zeromq.remoting.ZMQTextCodec;
 import org.zeromq.ZMQ;
 import org.zeromq.ZMQSocket;
 import org.zeromq.test.helpers.HelloWorldResponderAPI;
@@ -137,6 +141,281 @@ class TestZMQRemoting extends BaseTest
 		var rep:ZFrame = ZFrame.recvFrame(sender);
         cnx.processMessage(rep.toString());       
     }
+    
+    public function testBinaryCodec() {
+        var codec = new ZMQBinaryCodec();
+        var bytes = Bytes.alloc(3);
+        bytes.set(0, 0);
+        bytes.set(1, 255);
+        bytes.set(2, 7);
+        var inner:Array<Dynamic> = [2, "three"];
+        var nested:Array<Dynamic> = [1, inner];
+        var hash = new Hash<Int>();
+        hash.set("a", 1);
+        var params:Array<Dynamic> = [null, true, false, 0, 127, 128, 300000, -1, -70000, 1.5, "Hello", "Grüße", bytes,
+            nested, { name:"Bill", age:42 }, hash];
+        
+        var data = codec.encodeRequest(["HelloWorldResponder", "hello"], params);
+        assertTrue(codec.accepts(data));
+        assertFalse(new ZMQTextCodec().accepts(data));
+        assertTrue(codec.isRequest(data));
+        var request = codec.decodeRequest(data);
+        assertEquals("HelloWorldResponder.hello", request.path.join("."));
+        var p = request.params;
+        assertEquals(params.length, p.length);
+        assertEquals(null, p[0]);
+        assertEquals(true, p[1]);
+        assertEquals(false, p[2]);
+        assertEquals(0, p[3]);
+        assertEquals(127, p[4]);
+        assertEquals(128, p[5]);
+        assertEquals(300000, p[6]);
+        assertEquals(-1, p[7]);
+        assertEquals(-70000, p[8]);
+        assertEquals(1.5, p[9]);
+        assertEquals("Hello", p[10]);
+        assertEquals("Grüße", p[11]);
+        assertEquals(0, bytes.compare(p[12]));
+        assertEquals("three", p[13][1][1]);
+        assertEquals("Bill", p[14].name);
+        assertEquals(42, p[14].age);
+        assertEquals(1, p[15].get("a"));
+        
+        // Repeated paths are interned
+        assertTrue(codec.decodeRequest(data).path == request.path);
+        
+        var answer = codec.encodeAnswer("Result", false);
+        assertFalse(codec.isRequest(answer));
+        assertEquals("Result", codec.decodeAnswer(answer));
+        var thrown:Dynamic = null;
+        try {
+            codec.decodeAnswer(codec.encodeAnswer("Failed", true));
+        } catch (e:Dynamic) {
+            thrown = e;
+        }
+        assertEquals("Failed", thrown);
+        
+        thrown = null;
+        try {
+            codec.decodeRequest(data.sub(0, data.length - 1));
+        } catch (e:Dynamic) {
+            thrown = e;
+        }
+        assertEquals("Truncated data", thrown);
+    }
+    
+    /**
+     * Repeats the synchronous test with a binary format client, then with a binary format server
+     */
+    public function testBinaryRemotingSendResponse() {
+		var ZMQcontext:ZContext = new ZContext();
+		var sender:ZMQSocket = ZMQcontext.createSocket(ZMQ_REQ);
+		var responder:ZMQSocket = ZMQcontext.createSocket(ZMQ_REP);
+		var senderPort = ZSocket.bindEndpoint(sender, "tcp", "127.0.0.1", "*");
+		ZSocket.connectEndpoint(responder, "tcp", "127.0.0.1", Std.string(senderPort));
+
+        var remotingContext:Context = new Context();
+        remotingContext.addObject("HelloWorldResponder", new HelloWorldResponderAPI());
+		var conn:ZMQConnection = ZMQConnection.create(responder, remotingContext);
+        var cnx:ZMQConnection = ZMQConnection.create(sender, null, new ZMQBinaryCodec());
+        cnx.setErrorHandler( function(err) trace("Error : "+Std.string(err)) );
+        
+        var me = this;
+        var answers = 0;
+        var display = function(s:String) {
+            me.assertEquals("Bill, Hello World", s);
+            answers++;
+        };
+        var binary = new ZMQBinaryCodec();
+        
+        // Text format server answers a binary request in binary
+        cnx.HelloWorldResponder.hello.call(["Bill"], display);
+        var request = conn.getProtocol().readBytes();
+        assertTrue(binary.accepts(request));
+        conn.processBytes(request);
+        var answer = cnx.getProtocol().readBytes();
+        assertTrue(binary.accepts(answer));
+        cnx.processBytes(answer);
+        assertEquals(1, answers);
+        
+        // Binary format server answers a text request in text
+        conn.getProtocol().codec = new ZMQBinaryCodec();
+        cnx.getProtocol().codec = new ZMQTextCodec();
+        cnx.HelloWorldResponder.hello.call(["Bill"], display);
+        request = conn.getProtocol().readBytes();
+        assertFalse(binary.accepts(request));
+        conn.processBytes(request);
+        answer = cnx.getProtocol().readBytes();
+        assertFalse(binary.accepts(answer));
+        cnx.processMessage(answer.toString());
+        assertEquals(2, answers);
+        
+        ZMQcontext.destroy();
+    }
+    /**
+     * Pipelines many calls over one DEALER socket to a ROUTER socket, both attached to a ZLoop,
+     * then checks that answers arriving out of order reach the right callbacks
+     */
+    public function testAsyncRemoting() {
+		var ZMQcontext:ZContext = new ZContext();
+		var server:ZMQSocket = ZMQcontext.createSocket(ZMQ_ROUTER);
+		var serverPort = ZSocket.bindEndpoint(server, "tcp", "127.0.0.1", "*");
+		var client:ZMQSocket = ZMQcontext.createSocket(ZMQ_DEALER);
+		ZSocket.connectEndpoint(client, "tcp", "127.0.0.1", Std.string(serverPort));
+
+        var remotingContext:Context = new Context();
+        remotingContext.addObject("HelloWorldResponder", new HelloWorldResponderAPI());
+		var conn:ZMQConnection = ZMQConnection.createAsync(server, remotingContext, new ZMQBinaryCodec());
+        var cnx:ZMQConnection = ZMQConnection.createAsync(client, null, new ZMQBinaryCodec());
+        cnx.setErrorHandler( function(err) trace("Error : "+Std.string(err)) );
+        
+        var loop:ZLoop = new ZLoop();
+        assertTrue(conn.attach(loop));
+        assertTrue(cnx.attach(loop));
+        
+        var results = new Hash<String>();
+        for (i in 0 ... 100) {
+            cnx.HelloWorldResponder.hello.call(["Bill" + i], storeResult(results, "Bill" + i));
+        }
+        assertEquals(100, cnx.pendingCalls());
+        loop.registerTimer(10, 0, function(loop:ZLoop, args:Dynamic):Int {
+            return { if (cnx.pendingCalls() == 0) -1 else 0; };
+        });
+        loop.registerTimer(5000, 1, function(loop:ZLoop, args:Dynamic):Int { return -1; } );
+        loop.start();
+        cnx.detach();
+        conn.detach();
+        loop.destroy();
+        assertEquals(0, cnx.pendingCalls());
+        for (i in 0 ... 100) {
+            assertEquals("Bill" + i + ", Hello World", results.get("Bill" + i));
+        }
+        
+        // Answer three calls in reverse order, by hand
+        results = new Hash<String>();
+        for (name in ["Ann", "Bob", "Cy"]) {
+            cnx.HelloWorldResponder.hello.call([name], storeResult(results, name));
+        }
+        var requests = new Array<ZMsg>();
+        for (i in 0 ... 3) {
+            requests.push(ZMsg.recvMsg(server));
+        }
+        var codec = new ZMQBinaryCodec();
+        requests.reverse();
+        for (request in requests) {
+            var params = codec.decodeRequest(request.last().data).params;
+            request.last().reset(codec.encodeAnswer("Hi " + params[0], false));
+            request.send(server);
+        }
+        var handled = 0;
+        while (handled < 3) {
+            handled += cnx.dispatch();
+        }
+        assertEquals(0, cnx.pendingCalls());
+        assertEquals("Hi Ann", results.get("Ann"));
+        assertEquals("Hi Bob", results.get("Bob"));
+        assertEquals("Hi Cy", results.get("Cy"));
+        
+        // An answer that matches no call reaches the error handler, but does not stop dispatch
+        var errors = 0;
+        cnx.setErrorHandler(function(err) { errors++; throw err; } );
+        cnx.HelloWorldResponder.hello.call(["Di"], storeResult(results, "Di"));
+        var request = ZMsg.recvMsg(server);
+        var answer = new ZMsg();
+        answer.add(request.pop());
+        answer.add(request.pop());
+        request.pop().destroy();
+        var badId = Bytes.alloc(4);
+        for (i in 0 ... 4) badId.set(i, 0xFF);
+        answer.add(new ZFrame(badId));
+        answer.add(new ZFrame(codec.encodeAnswer("Hi Di", false)));
+        request.destroy();
+        answer.send(server);
+        handled = 0;
+        while (handled < 1) {
+            handled += cnx.dispatch();
+        }
+        assertEquals(1, errors);
+        assertEquals(1, cnx.pendingCalls());
+        
+        ZMQcontext.destroy();
+    }
+    
+#if !php
+    /**
+     * Serves pipelined calls, and one sync call, from a multi-threaded server
+     */
+    public function testRemotingServer() {
+		var ZMQcontext:ZContext = new ZContext();
+        var server = new ZMQRemotingServer(ZMQcontext, "tcp://127.0.0.1:5596", 4, function() {
+            var ctx = new Context();
+            ctx.addObject("HelloWorldResponder", new HelloWorldResponderAPI());
+            return ctx;
+        });
+        var loop:ZLoop = new ZLoop();
+        assertTrue(server.attach(loop));
+        
+		var client:ZMQSocket = ZMQcontext.createSocket(ZMQ_DEALER);
+        client.connect("tcp://127.0.0.1:5596");
+        var cnx:ZMQConnection = ZMQConnection.createAsync(client, null, new ZMQBinaryCodec());
+        var errors = 0;
+        cnx.setErrorHandler( function(err) { errors++; } );
+        assertTrue(cnx.attach(loop));
+        
+        var results = new Hash<String>();
+        for (i in 0 ... 50) {
+            cnx.HelloWorldResponder.hello.call(["Bill" + i], storeResult(results, "Bill" + i));
+        }
+        cnx.HelloWorldResponder.missing.call([]);
+        // Method paths come from the client, so may hold anything
+        cnx.resolve("Hello\tWorld").resolve("x").call([]);
+        var timers = { };
+        loop.registerTimer(10, 0, function(loop:ZLoop, args:Dynamic):Int {
+            return { if (cnx.pendingCalls() == 0) -1 else 0; };
+        }, timers);
+        loop.registerTimer(5000, 1, function(loop:ZLoop, args:Dynamic):Int { return -1; }, timers);
+        loop.start();
+        loop.unregisterTimer(timers);
+        cnx.detach();
+        
+        assertEquals(0, cnx.pendingCalls());
+        assertEquals(2, errors);
+        for (i in 0 ... 50) {
+            assertEquals("Bill" + i + ", Hello World", results.get("Bill" + i));
+        }
+        assertEquals(52, server.answered);
+        assertEquals(0, server.queueDepth());
+        assertEquals(0, server.busyWorkers());
+        var hello = server.methodStats().get("HelloWorldResponder.hello");
+        assertEquals(50, hello.calls);
+        assertEquals(0, hello.errors);
+        assertTrue(hello.maxLatency >= hello.totalServiceTime / hello.calls);
+        assertEquals(1, server.methodStats().get("HelloWorldResponder.missing").errors);
+        assertEquals(1, server.methodStats().get("Hello\tWorld.x").errors);
+        
+        // A sync client, in the original text format
+		var requester:ZMQSocket = ZMQcontext.createSocket(ZMQ_REQ);
+        requester.connect("tcp://127.0.0.1:5596");
+        var sync:ZMQConnection = ZMQConnection.create(requester);
+        var answer:String = null;
+        sync.HelloWorldResponder.hello.call(["Ann"], function(s:String) { answer = s; } );
+        loop.registerPoller( { socket:requester, event:ZMQ.ZMQ_POLLIN() }, function(loop:ZLoop, socket:ZMQSocket):Int {
+            sync.processBytes(socket.recvMsg());
+            return -1;
+        });
+        loop.start();
+        assertEquals("Ann, Hello World", answer);
+        
+        server.destroy();
+        loop.destroy();
+        ZMQcontext.destroy();
+    }
+#end
+    
+    static function storeResult(results:Hash<String>, name:String):Dynamic->Void {
+        return function(r:Dynamic) { results.set(name, r); };
+    }
+    
 #if (neko || cpp)    
     static function helloWorldSender() {
 		var context:ZMQContext = ZMQContext.instance();
@@ -87,6 +87,37 @@ class TestZMsg extends BaseTest
         ctx.destroy();
     }
     
+    public function testForwardEnvelope() {
+        var ctx:ZContext = new ZContext();
+        
+        var output:ZMQSocket = ctx.createSocket(ZMQ_PAIR);
+        ZSocket.bindEndpoint(output, "inproc", "zmsg.test3");
+        var input:ZMQSocket = ctx.createSocket(ZMQ_PAIR);
+        ZSocket.connectEndpoint(input, "inproc", "zmsg.test3");
+        
+        // Byte-level multipart send, received as a ZMsg
+        var parts = [Bytes.ofString("Address1"), Bytes.ofString("Address2"), Bytes.ofString(""), Bytes.ofString("Body")];
+        assertTrue(output.sendMultipart(parts));
+        var msg:ZMsg = ZMsg.recvMsg(input);
+        assertTrue(msg != null);
+        assertEquals(4, msg.size());
+        assertEquals("Address1", msg.first().data.toString());
+        
+        // Forward received frames untouched, received back as raw parts
+        msg.send(input);
+        var received:Array<Bytes> = output.recvMultipart();
+        assertEquals(4, received.length);
+        assertEquals("Address2", received[1].toString());
+        assertEquals(0, received[2].length);
+        assertEquals("Body", received[3].toString());
+        
+        // Nothing waiting
+        assertEquals(null, output.recvMultipart(DONTWAIT));
+        assertEquals(null, ZFrame.recvFrames(input, DONTWAIT));
+        
+        ctx.destroy();
+    }
+    
     public function testMessageFrameManipulation() {
         var msg:ZMsg = new ZMsg();
         for (i in 0 ... 10) {
@@ -119,7 +150,9 @@ class TestZMsg extends BaseTest
             function(f:ZFrame):Bool {
             return (StringTools.startsWith(f.data.toString(), "Frame")); } );
         assertEquals(2, filteredMsg.size());  
+        assertTrue(filteredMsg.first() != msg.first());
         filteredMsg.destroy();
+        assertEquals("Frame0", msg.first().data.toString());
         
         msg.destroy();
 		
@@ -146,6 +179,89 @@ class TestZMsg extends BaseTest
         msg.destroy();
     }
     
+    public function testPushPopReusesSlots() {
+        var msg:ZMsg = new ZMsg();
+        msg.addString("Address");
+        msg.addString("");
+        msg.addString("Body");
+        
+        // Unwrap then wrap a reply envelope, as a ROUTER broker does
+        var address = msg.unwrap();
+        assertEquals(1, msg.size());
+        assertEquals("Body", msg.first().data.toString());
+        msg.wrap(address);
+        assertEquals(3, msg.size());
+        assertEquals("Address", msg.popString());
+        assertEquals(0, msg.pop().size());
+        msg.pushString("Header");
+        msg.addString("Trailer");
+        var names = new Array<String>();
+        for (f in msg) {
+            names.push(f.data.toString());
+        }
+        assertEquals("Header,Body,Trailer", names.join(","));
+        assertEquals("Trailer", msg.last().data.toString());
+        msg.destroy();
+    }
+    
+    public function testDuplicateSharesData() {
+        var msg:ZMsg = new ZMsg();
+        msg.addString("Hello");
+        msg.addString("World");
+        var copy:ZMsg = msg.duplicate();
+        assertEquals(2, copy.size());
+        assertTrue(copy.first() != msg.first());
+        assertTrue(copy.first().data == msg.first().data);
+        assertTrue(copy.last().equals(msg.last()));
+        
+        // Resetting a copied frame leaves the original alone
+        copy.first().reset(Bytes.ofString("Bye"));
+        assertEquals("Hello", msg.first().data.toString());
+        copy.destroy();
+        msg.destroy();
+    }
+    
+    public function testPooling() {
+        var ctx:ZContext = new ZContext();
+        var output:ZMQSocket = ctx.createSocket(ZMQ_PAIR);
+        ZSocket.bindEndpoint(output, "inproc", "zmsg.pool");
+        var input:ZMQSocket = ctx.createSocket(ZMQ_PAIR);
+        ZSocket.connectEndpoint(input, "inproc", "zmsg.pool");
+        
+        ZMsg.setPoolSize(4);
+        ZFrame.setPoolSize(16);
+        
+        var msg:ZMsg = ZMsg.newMsg();
+        msg.addString("Address");
+        msg.addString("Body");
+        var frame = msg.first();
+        msg.send(output);
+        
+        // Sent message and frames are reused by the receive
+        var received = ZMsg.recvMsg(input);
+        assertTrue(received == msg);
+        assertEquals(2, received.size());
+        assertTrue(received.first() == frame || received.last() == frame);
+        assertEquals("Address", received.popString());
+        assertEquals("Body", received.popString());
+        received.destroy();
+        received.destroy();
+        
+        // Destroying twice pools the message once
+        var a = ZMsg.newMsg();
+        var b = ZMsg.newMsg();
+        assertTrue(a == msg);
+        assertTrue(b != msg);
+        assertTrue(a.isEmpty());
+        a.destroy();
+        b.destroy();
+        
+        ZMsg.setPoolSize(0);
+        ZFrame.setPoolSize(0);
+        assertTrue(ZMsg.newMsg() != msg);
+        ctx.destroy();
+    }
+    
     public function testReadWriteFile() {
         var msg:ZMsg = new ZMsg();
         for (i in 0 ... 10) {
@@ -22,10 +22,12 @@ import haxe.Stack;
 import haxe.io.Bytes;
 import neko.Sys;
 import org.zeromq.ZContext;
+import org.zeromq.ZLoop;
 import org.zeromq.ZMQ;
 import org.zeromq.ZMQException;
 import org.zeromq.ZMQSocket;
 import org.zeromq.ZThread;
+import org.zeromq.ZThreadPool;
 
 /**
  * Haxe test class focussing on ZThread class
@@ -88,7 +90,86 @@ class TestZThread extends BaseTest
 		
 	}
 	
+	
+	private static function squareTask(ctx:ZContext, task:Bytes):Bytes {
+		var n = Std.parseInt(task.toString());
+		return Bytes.ofString(Std.string(n * n));
+	}
+	
+	public function testZThreadPool() {
+		var ctx = new ZContext();
+		var pool = new ZThreadPool(ctx, 3, squareTask);
+		assertEquals(3, pool.size);
+		
+		// Without a reactor, submit blocks until a worker takes the task
+		var sum = 0;
+		for (i in 0 ... 20)
+			pool.submit(Bytes.ofString(Std.string(i)));
+		for (i in 0 ... 20)
+			sum += Std.parseInt(pool.recvResult().toString());
+		assertEquals(2470, sum);
+		assertEquals(0, pool.pending);
+		
+		pool.destroy();
+		ctx.destroy();
+	}
+	
+	private static function slowTask(ctx:ZContext, task:Bytes):Bytes {
+		if (task.toString() == "slow")
+			Sys.sleep(0.5);
+		return task;
+	}
+	
+	public function testZThreadPoolIdleWorkers() {
+		var ctx = new ZContext();
+		var pool = new ZThreadPool(ctx, 2, slowTask);
 		
+		// Tasks queued behind a slow one go to the idle worker
+		pool.submit(Bytes.ofString("slow"));
+		for (i in 0 ... 5)
+			pool.submit(Bytes.ofString("fast"));
+		for (i in 0 ... 5)
+			assertEquals("fast", pool.recvResult().toString());
+		assertEquals("slow", pool.recvResult().toString());
+		
+		pool.destroy();
+		ctx.destroy();
+	}
+	
+#if !php
+	public function testZThreadPoolLoop() {
+		var ctx = new ZContext();
+		var loop = new ZLoop();
+		var pool = new ZThreadPool(ctx, 4, squareTask);
+		var count = 200;
+		var sum = 0;
+		var received = 0;
+		
+		assertTrue(pool.attach(loop, function(loop:ZLoop, results:Array<Bytes>):Int {
+			for (r in results)
+				sum += Std.parseInt(r.toString());
+			received += results.length;
+			return { if (received == count) -1 else 0; };
+		}));
+		
+		// Tasks the workers cannot take yet are queued, not blocked on
+		var queued = 0;
+		for (i in 0 ... count)
+			queued = pool.submit(Bytes.ofString(Std.string(i)));
+		assertTrue(queued > 0);
+		assertEquals(count, pool.pending);
+		
+		loop.start();
+		assertEquals(count, received);
+		assertEquals(0, pool.pending);
+		assertEquals(2646700, sum);
+		
+		pool.destroy();
+		loop.destroy();
+		ctx.destroy();
+	}
+#end
+	
 	public override function setup():Void {
 		// Do nothing
 	}
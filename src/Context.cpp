@@ -24,10 +24,19 @@
 // Define a Kind type name for ZMQ context handles, which are opaque to the Haxe layer
 DEFINE_KIND(k_zmq_context_handle);
 
+// zmq_ctx_new and zmq_ctx_set replace zmq_init from 0MQ 3.2
+#if ZMQ_VERSION >= ZMQ_MAKE_VERSION(3,2,0)
+#define HXZMQ_CTX_OPTIONS
+#endif
+
 // Finalizer for context
 void finalize_context( value v) {
 	gc_enter_blocking();
+#ifdef HXZMQ_CTX_OPTIONS
+	int ret = zmq_ctx_destroy( val_data(v));
+#else
 	int ret = zmq_term( val_data(v));
+#endif
 	gc_exit_blocking();
 	if (ret != 0) {
 		int err = zmq_errno();
@@ -46,8 +55,18 @@ value hx_zmq_construct (value io_threads)
 		return alloc_null();
 	}
 	
+#ifdef HXZMQ_CTX_OPTIONS
+	void *c = zmq_ctx_new ();
+	int err = zmq_errno();
+	if (c != NULL && zmq_ctx_set (c, ZMQ_IO_THREADS, _io_threads) != 0) {
+		err = zmq_errno();
+		zmq_ctx_destroy (c);
+		c = NULL;
+	}
+#else
 	void *c = zmq_init (_io_threads);
 	int err = zmq_errno();
+#endif
 	
 	if (c == NULL) {
 		val_throw (alloc_int(err));
@@ -72,5 +91,55 @@ value hx_zmq_term(value v)
 	return alloc_null();
 }
 
+/**
+ * Sets a context option, e.g. ZMQ_MAX_SOCKETS or ZMQ_THREAD_AFFINITY_CPU_ADD.
+ * Options that configure the I/O threads only take effect if set before the first socket is created.
+ * Throws ENOTSUP if the option is not supported by the 0MQ library built against.
+ */
+value hx_zmq_ctx_set(value context_handle_, value option_, value optval_)
+{
+	val_check_kind(context_handle_, k_zmq_context_handle);
+	if (!val_is_int(option_) || !val_is_int(optval_)) {
+		val_throw(alloc_int(EINVAL));
+		return alloc_null();
+	}
+#ifdef HXZMQ_CTX_OPTIONS
+	if (val_int(option_) >= 0) {
+		if (zmq_ctx_set (val_data(context_handle_), val_int(option_), val_int(optval_)) != 0)
+			val_throw(alloc_int(zmq_errno()));
+		return alloc_null();
+	}
+#endif
+	val_throw(alloc_int(ENOTSUP));
+	return alloc_null();
+}
+
+/**
+ * Returns the value of a context option.
+ * Throws ENOTSUP if the option is not supported by the 0MQ library built against.
+ */
+value hx_zmq_ctx_get(value context_handle_, value option_)
+{
+	val_check_kind(context_handle_, k_zmq_context_handle);
+	if (!val_is_int(option_)) {
+		val_throw(alloc_int(EINVAL));
+		return alloc_null();
+	}
+#ifdef HXZMQ_CTX_OPTIONS
+	if (val_int(option_) >= 0) {
+		int rc = zmq_ctx_get (val_data(context_handle_), val_int(option_));
+		if (rc == -1) {
+			val_throw(alloc_int(zmq_errno()));
+			return alloc_null();
+		}
+		return alloc_int(rc);
+	}
+#endif
+	val_throw(alloc_int(ENOTSUP));
+	return alloc_null();
+}
+
 DEFINE_PRIM( hx_zmq_construct, 1);
-DEFINE_PRIM( hx_zmq_term, 1);
\ No newline at end of file
+DEFINE_PRIM( hx_zmq_term, 1);
+DEFINE_PRIM( hx_zmq_ctx_set, 3);
+DEFINE_PRIM( hx_zmq_ctx_get, 2);
\ No newline at end of file
@@ -24,6 +24,8 @@
 
 
 #include "socket.h"
+#include "message.h"
+#include "subscriptions.h"
 
 value hx_zmq_device (value type_, value frontend_, value backend_) {
 	
@@ -49,3 +51,106 @@ value hx_zmq_device (value type_, value frontend_, value backend_) {
 	return alloc_int(rc);
 }
 DEFINE_PRIM( hx_zmq_device, 3);
+
+#if ZMQ_VERSION < ZMQ_MAKE_VERSION(3,2,0)
+// Moves one whole multipart message from one socket to another, copying each part to capture if set.
+// Returns -1 on error (with errno set), else 0
+static int hx_zmq_proxy_forward (void *from, void *to, void *capture) {
+	zmq_msg_t msg;
+	while (true) {
+		zmq_msg_init (&msg);
+#if ZMQ_VERSION >= ZMQ_MAKE_VERSION(3,0,0)
+		int rc = zmq_recvmsg (from, &msg, 0);
+#else
+		int rc = zmq_recv (from, &msg, 0);
+#endif
+		if (rc == -1) {
+			zmq_msg_close (&msg);
+			return -1;
+		}
+		bool more = hx_zmq_rcvmore (from);
+		int flags = more ? ZMQ_SNDMORE : 0;
+		
+		if (capture != NULL) {
+			zmq_msg_t copy;
+			zmq_msg_init (&copy);
+			rc = zmq_msg_copy (&copy, &msg);
+#if ZMQ_VERSION >= ZMQ_MAKE_VERSION(3,0,0)
+			if (rc == 0) rc = zmq_sendmsg (capture, &copy, flags);
+#else
+			if (rc == 0) rc = zmq_send (capture, &copy, flags);
+#endif
+			zmq_msg_close (&copy);
+			if (rc == -1) {
+				zmq_msg_close (&msg);
+				return -1;
+			}
+		}
+		
+#if ZMQ_VERSION >= ZMQ_MAKE_VERSION(3,0,0)
+		rc = zmq_sendmsg (to, &msg, flags);
+#else
+		rc = zmq_send (to, &msg, flags);
+#endif
+		zmq_msg_close (&msg);
+		if (rc == -1)
+			return -1;
+		if (!more)
+			return 0;
+	}
+}
+#endif
+
+/**
+ * Runs a proxy between frontend and backend sockets in the current thread, forwarding
+ * messages in both directions entirely in native code, with the GC released for the whole run.
+ * If capture is not null, every message part forwarded is also copied to the capture socket.
+ * If cache is not null, frontend and backend must be XSUB and XPUB sockets, and subscriptions
+ * and the last message on each topic are tracked in the cache (see Subscriptions.cpp).
+ * 
+ * Returns when the 0MQ context is terminated; throws any other error, including EINTR.
+ */
+value hx_zmq_proxy (value frontend_, value backend_, value capture_, value cache_) {
+	
+	val_check_kind(frontend_, k_zmq_socket_handle);
+	val_check_kind(backend_, k_zmq_socket_handle);
+	if (!val_is_null(capture_))
+		val_check_kind(capture_, k_zmq_socket_handle);
+	if (!val_is_null(cache_))
+		val_check_kind(cache_, k_zmq_subs_handle);
+	
+	void *frontend = val_data(frontend_);
+	void *backend = val_data(backend_);
+	void *capture = val_is_null(capture_) ? NULL : val_data(capture_);
+	hx_zmq_subs *cache = val_is_null(cache_) ? NULL : (hx_zmq_subs *)val_data(cache_);
+	
+	gc_enter_blocking();
+	if (cache != NULL) {
+		hx_zmq_subs_proxy (cache, frontend, backend, capture);
+	} else {
+#if ZMQ_VERSION >= ZMQ_MAKE_VERSION(3,2,0)
+		zmq_proxy (frontend, backend, capture);
+#else
+		zmq_pollitem_t items [] = {
+			{ frontend, 0, ZMQ_POLLIN, 0 },
+			{ backend, 0, ZMQ_POLLIN, 0 }
+		};
+		while (true) {
+			if (zmq_poll (items, 2, -1) == -1)
+				break;
+			if ((items [0].revents & ZMQ_POLLIN) && hx_zmq_proxy_forward (frontend, backend, capture) == -1)
+				break;
+			if ((items [1].revents & ZMQ_POLLIN) && hx_zmq_proxy_forward (backend, frontend, capture) == -1)
+				break;
+		}
+#endif
+	}
+	int err = zmq_errno();
+	gc_exit_blocking();
+	
+	if (err != ETERM) {
+		val_throw(alloc_int(err));
+	}
+	return alloc_null();
+}
+DEFINE_PRIM( hx_zmq_proxy, 4);
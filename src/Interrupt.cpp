@@ -20,6 +20,8 @@
 #include <signal.h>
 #include <hx/CFFI.h>
 
+#include "interrupt.h"
+
 
 // Add in functions for handling system interrupts
 // See: http://zguide.zeromq.org/page:all#Handling-Interrupt-Signals
@@ -49,6 +51,11 @@ value hx_zmq_catch_signals ()
 }
 DEFINE_PRIM( hx_zmq_catch_signals, 0);
 
+int hx_zmq_is_interrupted ()
+{
+	return s_interrupted;
+}
+
 // Returns 1 if interrupted, else 0
 value hx_zmq_interrupted ()
 {
@@ -0,0 +1,799 @@
+/**
+ * (c) 2011 Richard J Smith
+ *
+ * This file is part of hxzmq
+ *
+ * hxzmq is free software; you can redistribute it and/or modify it under
+ * the terms of the Lesser GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hxzmq is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * Lesser GNU General Public License for more details.
+ *
+ * You should have received a copy of the Lesser GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef _MSC_VER
+// Add stdint.hpp header file from zeromq distro to pick up integer types definitions
+#include <stdint.hpp>
+#else
+#include <stdint.h>
+#endif
+
+#include <algorithm>
+#include <cstring>
+#include <errno.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <zmq.h>
+#include <hx/CFFI.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#endif
+
+#include "socket.h"
+#include "message.h"
+#include "timer.h"
+
+/*
+ * Append-only message journal.
+ *
+ * Messages are stored in a directory of segment files, each named after the sequence number
+ * of its first message, preallocated to the segment size and memory-mapped. A segment is:
+ *
+ *   16 byte header: "HXZJ", uint32 version, int64 first sequence number
+ *   records, one per multipart message: uint32 length of the rest of the record,
+ *     uint32 CRC-32 of the rest of the record after it, uint32 frame count,
+ *     then for each frame its uint32 size and data
+ *   zeroes, to the end of the file
+ *
+ * Integers are in host byte order. A record's length is written last, so a record torn by
+ * a crash reads as the end of the segment. The kernel may write a record's pages back in any
+ * order though, so its checksum is checked too when the segment is opened; the first record
+ * that fails the check ends the segment. Appending copies each message straight into the
+ * mapping, a whole batch of messages per call; the kernel writes the pages back. msync is
+ * called according to the group commit policy: after some number of messages, or once some
+ * time has passed since the last sync, whichever comes first. The policy is checked on every
+ * call into the journal, so an idle journal is synced the next time it is read or closed.
+ *
+ * An index of record offsets is built for each segment as it is opened, so messages are read
+ * by sequence number without scanning. Frames read back refer to the mapped data rather than
+ * copies of it (small frames excepted), and keep their segment mapped until 0MQ releases them.
+ *
+ * Sequence numbers are 64 bit, and are passed to and from haXe as Floats, exact up to 2^53.
+ *
+ * A journal must only be used by one thread at a time.
+ */
+
+#define JOURNAL_MAGIC "HXZJ"
+#define JOURNAL_VERSION 2
+#define JOURNAL_HEADER 16
+// Record length, checksum and frame count
+#define RECORD_HEADER 12
+
+// Frames up to this size are copied when read, as 0MQ stores them inline anyway
+#define JOURNAL_COPY_MAX 32
+
+struct journal_segment {
+	std::string path;
+	int64_t first;					// Sequence number of first message
+	char *base;
+	size_t size;
+	std::vector<uint32_t> offsets;	// Record offset of each message
+	size_t dirty_from;				// Offset of first byte not yet synced
+	volatile long refs;				// One for the journal, plus one per frame read back
+#if defined(_WIN32)
+	HANDLE file, mapping;
+#else
+	int fd;
+#endif
+};
+
+struct hx_zmq_journal {
+	std::string dir;
+	size_t segment_size;
+	std::vector<journal_segment *> segments;
+	size_t write_pos;				// End of the last record in the last segment
+	int64_t next;					// Sequence number of the next message appended
+	// Group commit policy, 0 to disable each trigger
+	int sync_every;
+	int sync_interval;				// msecs
+	int unsynced;					// Messages appended since last sync
+	size_t dirty_seg;				// Index of first segment that may hold unsynced data
+	double last_sync;
+	bool closed;
+};
+
+DEFINE_KIND( k_zmq_journal_handle );
+
+static inline long atomic_add(volatile long *p, long v) {
+#ifdef _MSC_VER
+	return InterlockedExchangeAdd(p, v) + v;
+#else
+	return __sync_add_and_fetch(p, v);
+#endif
+}
+
+static inline void get_u32(const char *p, uint32_t *v) { memcpy(v, p, 4); }
+static inline void put_u32(char *p, uint32_t v) { memcpy(p, &v, 4); }
+
+static uint32_t crc_table[256];
+
+static void init_crc_table() {
+	if (crc_table[1] != 0)
+		return;
+	for (uint32_t i = 0; i < 256; i++) {
+		uint32_t c = i;
+		for (int k = 0; k < 8; k++)
+			c = (c & 1) ? 0xedb88320 ^ (c >> 1) : c >> 1;
+		crc_table[i] = c;
+	}
+}
+
+// CRC-32 (as used by zlib) of size bytes at p
+static uint32_t journal_crc(const char *p, size_t size) {
+	uint32_t c = 0xffffffff;
+	for (size_t i = 0; i < size; i++)
+		c = crc_table[(c ^ (uint8_t)p[i]) & 0xff] ^ (c >> 8);
+	return c ^ 0xffffffff;
+}
+
+static int last_error() {
+#if defined(_WIN32)
+	return GetLastError() == ERROR_FILE_NOT_FOUND ? ENOENT : EIO;
+#else
+	return errno;
+#endif
+}
+
+static void unmap_segment(journal_segment *s) {
+#if defined(_WIN32)
+	if (s->base) UnmapViewOfFile(s->base);
+	if (s->mapping) CloseHandle(s->mapping);
+	if (s->file != INVALID_HANDLE_VALUE) CloseHandle(s->file);
+#else
+	if (s->base) munmap(s->base, s->size);
+	if (s->fd >= 0) close(s->fd);
+#endif
+	delete s;
+}
+
+static void release_segment(journal_segment *s) {
+	if (atomic_add(&s->refs, -1) == 0)
+		unmap_segment(s);
+}
+
+// Called by 0MQ, possibly from an I/O thread, when it has finished with a frame read back
+static void release_frame(void *data, void *hint) {
+	release_segment((journal_segment *)hint);
+}
+
+/**
+ * Opens and maps a segment file. If size is not 0, the file is created with that size.
+ * Returns NULL and sets *err on failure.
+ */
+static journal_segment *map_segment(const std::string &path, size_t size, int *err) {
+	journal_segment *s = new journal_segment;
+	s->path = path;
+	s->first = 0;
+	s->base = NULL;
+	s->dirty_from = 0;
+	s->refs = 1;
+	bool create = size != 0;
+#if defined(_WIN32)
+	s->mapping = NULL;
+	s->file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL,
+		create ? CREATE_ALWAYS : OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (s->file == INVALID_HANDLE_VALUE) {
+		*err = last_error();
+		unmap_segment(s);
+		return NULL;
+	}
+	if (!create) {
+		LARGE_INTEGER li;
+		GetFileSizeEx(s->file, &li);
+		size = (size_t)li.QuadPart;
+	}
+	s->size = size;
+	s->mapping = CreateFileMappingA(s->file, NULL, PAGE_READWRITE, (DWORD)((uint64_t)size >> 32), (DWORD)size, NULL);
+	if (s->mapping != NULL)
+		s->base = (char *)MapViewOfFile(s->mapping, FILE_MAP_WRITE, 0, 0, size);
+	if (s->base == NULL) {
+		*err = EIO;
+		unmap_segment(s);
+		return NULL;
+	}
+#else
+	s->fd = open(path.c_str(), create ? (O_RDWR | O_CREAT | O_TRUNC) : O_RDWR, 0644);
+	if (s->fd < 0) {
+		*err = errno;
+		unmap_segment(s);
+		return NULL;
+	}
+	if (create) {
+		if (ftruncate(s->fd, (off_t)size) != 0) {
+			*err = errno;
+			unmap_segment(s);
+			return NULL;
+		}
+	} else {
+		struct stat st;
+		if (fstat(s->fd, &st) != 0) {
+			*err = errno;
+			unmap_segment(s);
+			return NULL;
+		}
+		size = (size_t)st.st_size;
+	}
+	s->size = size;
+	void *p = size < JOURNAL_HEADER ? MAP_FAILED : mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, s->fd, 0);
+	if (p == MAP_FAILED) {
+		*err = size < JOURNAL_HEADER ? EINVAL : errno;
+		unmap_segment(s);
+		return NULL;
+	}
+	s->base = (char *)p;
+#endif
+	return s;
+}
+
+static std::string segment_path(const std::string &dir, int64_t first) {
+	char name[32];
+	sprintf(name, "%020lld.log", (long long)first);
+	return dir + "/" + name;
+}
+
+static journal_segment *create_segment(hx_zmq_journal *j, int64_t first, size_t size, int *err) {
+	journal_segment *s = map_segment(segment_path(j->dir, first), size, err);
+	if (s == NULL)
+		return NULL;
+	s->first = first;
+	uint32_t version = JOURNAL_VERSION;
+	memcpy(s->base, JOURNAL_MAGIC, 4);
+	memcpy(s->base + 4, &version, 4);
+	memcpy(s->base + 8, &first, 8);
+	return s;
+}
+
+/**
+ * Maps an existing segment and indexes its records. Returns NULL and sets *err on failure.
+ */
+static journal_segment *open_segment(const std::string &path, int *err) {
+	journal_segment *s = map_segment(path, 0, err);
+	if (s == NULL)
+		return NULL;
+	uint32_t version;
+	get_u32(s->base + 4, &version);
+	if (memcmp(s->base, JOURNAL_MAGIC, 4) != 0 || version != JOURNAL_VERSION) {
+		*err = EINVAL;
+		unmap_segment(s);
+		return NULL;
+	}
+	memcpy(&s->first, s->base + 8, 8);
+	size_t pos = JOURNAL_HEADER;
+	while (pos + RECORD_HEADER <= s->size) {
+		const char *rec = s->base + pos;
+		uint32_t len, crc, nframes;
+		get_u32(rec, &len);
+		// A zero length is the end of the records; one running past the file was torn
+		if (len < RECORD_HEADER - 4 || len > s->size - pos - 4)
+			break;
+		get_u32(rec + 4, &crc);
+		if (journal_crc(rec + 8, len - 4) != crc)
+			break;
+		// The frames must exactly fill the record, as reads trust their sizes
+		get_u32(rec + 8, &nframes);
+		const char *p = rec + RECORD_HEADER, *end = rec + 4 + len;
+		for (uint32_t k = 0; k < nframes && p != NULL; k++) {
+			uint32_t size;
+			if (end - p < 4)
+				p = NULL;
+			else {
+				get_u32(p, &size);
+				p = size > (size_t)(end - p - 4) ? NULL : p + 4 + size;
+			}
+		}
+		if (p != end)
+			break;
+		s->offsets.push_back((uint32_t)pos);
+		pos += 4 + len;
+	}
+	s->dirty_from = pos;
+	return s;
+}
+
+static size_t segment_end(journal_segment *s) {
+	if (s->offsets.empty())
+		return JOURNAL_HEADER;
+	uint32_t len;
+	get_u32(s->base + s->offsets.back(), &len);
+	return s->offsets.back() + 4 + len;
+}
+
+// Lists the names of segment files in dir
+static bool list_segments(const std::string &dir, std::vector<std::string> *names) {
+#if defined(_WIN32)
+	WIN32_FIND_DATAA fd;
+	HANDLE h = FindFirstFileA((dir + "/*.log").c_str(), &fd);
+	if (h == INVALID_HANDLE_VALUE)
+		return GetLastError() == ERROR_FILE_NOT_FOUND;
+	do {
+		names->push_back(fd.cFileName);
+	} while (FindNextFileA(h, &fd));
+	FindClose(h);
+#else
+	DIR *d = opendir(dir.c_str());
+	if (d == NULL)
+		return false;
+	struct dirent *e;
+	while ((e = readdir(d)) != NULL) {
+		std::string name = e->d_name;
+		if (name.size() == 24 && name.compare(20, 4, ".log") == 0)
+			names->push_back(name);
+	}
+	closedir(d);
+#endif
+	// Names are zero-padded sequence numbers, so sort in sequence order
+	std::sort(names->begin(), names->end());
+	return true;
+}
+
+static void close_journal(hx_zmq_journal *j) {
+	if (j->closed)
+		return;
+	j->closed = true;
+	for (size_t i = 0; i < j->segments.size(); i++)
+		release_segment(j->segments[i]);
+	j->segments.clear();
+}
+
+// Finalizer for journals
+void finalize_journal( value v) {
+	hx_zmq_journal *j = (hx_zmq_journal *)val_data(v);
+	close_journal(j);
+	delete j;
+}
+
+static hx_zmq_journal *journal_from_handle(value journal_handle_) {
+	if (!val_is_kind(journal_handle_, k_zmq_journal_handle))
+		return NULL;
+	hx_zmq_journal *j = (hx_zmq_journal *)val_data(journal_handle_);
+	return j->closed ? NULL : j;
+}
+
+/**
+ * Writes a segment's unsynced bytes (its header too, if it is new) to disk
+ */
+static int sync_segment(journal_segment *s) {
+	size_t end = segment_end(s);
+	if (end <= s->dirty_from)
+		return 0;
+#if defined(_WIN32)
+	if (!FlushViewOfFile(s->base + s->dirty_from, end - s->dirty_from) || !FlushFileBuffers(s->file))
+		return EIO;
+#else
+	// msync needs a page-aligned start
+	size_t page = (size_t)sysconf(_SC_PAGESIZE);
+	size_t from = s->dirty_from - (s->dirty_from % page);
+	if (msync(s->base + from, end - from, MS_SYNC) != 0)
+		return errno;
+#endif
+	s->dirty_from = end;
+	return 0;
+}
+
+/**
+ * Writes unsynced records to disk, including those in segments rolled over from since
+ * the last sync
+ */
+static int sync_journal(hx_zmq_journal *j) {
+	for (; j->dirty_seg < j->segments.size(); j->dirty_seg++) {
+		int rc = sync_segment(j->segments[j->dirty_seg]);
+		if (rc != 0)
+			return rc;
+	}
+	j->dirty_seg = j->segments.size() - 1;
+	j->unsynced = 0;
+	j->last_sync = hx_zmq_clock_ms();
+	return 0;
+}
+
+static bool sync_due(hx_zmq_journal *j) {
+	if (j->unsynced == 0)
+		return false;
+	return (j->sync_every > 0 && j->unsynced >= j->sync_every) ||
+		(j->sync_interval > 0 && hx_zmq_clock_ms() - j->last_sync >= j->sync_interval);
+}
+
+/**
+ * Syncs the journal if the group commit policy says so.
+ * Called on every journal call, so the interval also holds while nothing is being appended.
+ */
+static int sync_if_due(hx_zmq_journal *j) {
+	return sync_due(j) ? sync_journal(j) : 0;
+}
+
+/**
+ * Reads a sequence number passed as a Float (or Int). Returns false if it is not a whole,
+ * non-negative number.
+ */
+static bool val_seq(value seq_, int64_t *seq) {
+	if (!val_is_number(seq_))
+		return false;
+	double d = val_number(seq_);
+	if (d < 0 || d > 9007199254740992.0 || d != (double)(int64_t)d)
+		return false;
+	*seq = (int64_t)d;
+	return true;
+}
+
+/**
+ * Opens the journal in directory path, creating the directory if need be.
+ * New segment files are created with segment_size bytes.
+ */
+value hx_zmq_journal_open(value path_, value segment_size_) {
+	if (!val_is_string(path_) || !val_is_int(segment_size_) || val_int(segment_size_) < 4096) {
+		val_throw(alloc_int(EINVAL));
+		return alloc_null();
+	}
+	std::string dir = val_string(path_);
+	init_crc_table();
+#if defined(_WIN32)
+	CreateDirectoryA(dir.c_str(), NULL);
+#else
+	mkdir(dir.c_str(), 0755);
+#endif
+	std::vector<std::string> names;
+	if (!list_segments(dir, &names)) {
+		val_throw(alloc_int(last_error()));
+		return alloc_null();
+	}
+
+	hx_zmq_journal *j = new hx_zmq_journal;
+	j->dir = dir;
+	j->segment_size = (size_t)val_int(segment_size_);
+	j->sync_every = 0;
+	j->sync_interval = 0;
+	j->unsynced = 0;
+	j->last_sync = hx_zmq_clock_ms();
+	j->closed = false;
+
+	int err = 0;
+	for (size_t i = 0; i < names.size() && err == 0; i++) {
+		journal_segment *s = open_segment(dir + "/" + names[i], &err);
+		if (s != NULL)
+			j->segments.push_back(s);
+	}
+	if (err == 0 && j->segments.empty()) {
+		journal_segment *s = create_segment(j, 0, j->segment_size, &err);
+		if (s != NULL)
+			j->segments.push_back(s);
+	}
+	if (err != 0) {
+		close_journal(j);
+		delete j;
+		val_throw(alloc_int(err));
+		return alloc_null();
+	}
+	journal_segment *last = j->segments.back();
+	j->write_pos = segment_end(last);
+	j->dirty_seg = j->segments.size() - 1;
+	j->next = last->first + (int64_t)last->offsets.size();
+
+	value v = alloc_abstract(k_zmq_journal_handle, j);
+	val_gc(v, finalize_journal);		// finalize_journal is called when the abstract value is garbage collected
+	return v;
+}
+
+/**
+ * Appends a batch of messages, each an array of frames (Bytes or native message handles).
+ * Frames are copied; message handles are left open.
+ * Returns the sequence number of the first message appended, as a Float.
+ */
+value hx_zmq_journal_append(value journal_handle_, value messages_) {
+	hx_zmq_journal *j = journal_from_handle(journal_handle_);
+	if (j == NULL || !val_is_array(messages_)) {
+		val_throw(alloc_int(EINVAL));
+		return alloc_null();
+	}
+	int n = val_array_size(messages_);
+
+	// Check the whole batch before writing any of it
+	std::vector<size_t> sizes(n);
+	for (int i = 0; i < n; i++) {
+		value frames = val_array_i(messages_, i);
+		if (!val_is_array(frames)) {
+			val_throw(alloc_int(EINVAL));
+			return alloc_null();
+		}
+		size_t need = RECORD_HEADER;
+		int nframes = val_array_size(frames);
+		for (int k = 0; k < nframes; k++) {
+			value frame = val_array_i(frames, k);
+			uint8_t *data = 0;
+			size_t size = 0;
+			if (val_is_kind(frame, k_zmq_msg_handle) && ((hx_zmq_msg *)val_data(frame))->open) {
+				size = zmq_msg_size(&((hx_zmq_msg *)val_data(frame))->msg);
+			} else if (!hx_zmq_bytes_data(frame, &data, &size)) {
+				val_throw(alloc_int(EINVAL));
+				return alloc_null();
+			}
+			need += 4 + size;
+		}
+		if (need > 0x7fffffff) {
+			val_throw(alloc_int(EMSGSIZE));
+			return alloc_null();
+		}
+		sizes[i] = need;
+	}
+
+	int64_t first = j->next;
+	for (int i = 0; i < n; i++) {
+		journal_segment *s = j->segments.back();
+		if (j->write_pos + sizes[i] > s->size) {
+			// Roll over to a new segment, big enough for this message. The segment left
+			// keeps its own dirty range, for the next sync to flush
+			int err = 0;
+			size_t size = std::max(j->segment_size, sizes[i] + JOURNAL_HEADER);
+			s = create_segment(j, j->next, size, &err);
+			if (s == NULL) {
+				val_throw(alloc_int(err));
+				return alloc_null();
+			}
+			j->segments.push_back(s);
+			j->write_pos = JOURNAL_HEADER;
+		}
+		char *rec = s->base + j->write_pos;
+		value frames = val_array_i(messages_, i);
+		int nframes = val_array_size(frames);
+		char *p = rec + RECORD_HEADER;
+		for (int k = 0; k < nframes; k++) {
+			value frame = val_array_i(frames, k);
+			uint8_t *data = 0;
+			size_t size = 0;
+			if (val_is_kind(frame, k_zmq_msg_handle)) {
+				zmq_msg_t *msg = &((hx_zmq_msg *)val_data(frame))->msg;
+				data = (uint8_t *)zmq_msg_data(msg);
+				size = zmq_msg_size(msg);
+			} else {
+				hx_zmq_bytes_data(frame, &data, &size);
+			}
+			put_u32(p, (uint32_t)size);
+			memcpy(p + 4, data, size);
+			p += 4 + size;
+		}
+		put_u32(rec + 8, (uint32_t)nframes);
+		put_u32(rec + 4, journal_crc(rec + 8, sizes[i] - 8));
+		// The length goes in last, so a partly written record is never read
+#ifndef _MSC_VER
+		__sync_synchronize();
+#else
+		MemoryBarrier();
+#endif
+		put_u32(rec, (uint32_t)(sizes[i] - 4));
+		s->offsets.push_back((uint32_t)j->write_pos);
+		j->write_pos += sizes[i];
+		j->next++;
+		j->unsynced++;
+	}
+
+	int err = sync_if_due(j);
+	if (err != 0) {
+		val_throw(alloc_int(err));
+		return alloc_null();
+	}
+	return alloc_float((double)first);
+}
+
+/**
+ * Returns the sequence number of the first message held at or after seq, and the index of
+ * its segment. A damaged record dropped when its segment was opened leaves a gap up to the
+ * next segment, which this skips.
+ */
+static int64_t readable_from(hx_zmq_journal *j, int64_t seq, size_t *index) {
+	int64_t first = j->segments.front()->first;
+	if (seq < first)
+		seq = first;
+	// Find the segment holding seq: the last one starting at or before it
+	size_t si = j->segments.size() - 1;
+	while (si > 0 && j->segments[si]->first > seq)
+		si--;
+	while (si + 1 < j->segments.size() && seq >= j->segments[si]->first + (int64_t)j->segments[si]->offsets.size()) {
+		si++;
+		seq = std::max(seq, j->segments[si]->first);
+	}
+	*index = si;
+	return seq;
+}
+
+/**
+ * Reads up to max messages, starting with sequence number seq.
+ * Returns an array of messages, each an array of native message handles,
+ * empty if seq is past the last message. If seq falls in a gap left by a damaged record,
+ * reading starts after the gap (see hx_zmq_journal_readable); it stops short at the next gap.
+ */
+value hx_zmq_journal_read(value journal_handle_, value seq_, value max_) {
+	hx_zmq_journal *j = journal_from_handle(journal_handle_);
+	int64_t seq;
+	if (j == NULL || !val_seq(seq_, &seq) || !val_is_int(max_) || val_int(max_) < 0) {
+		val_throw(alloc_int(EINVAL));
+		return alloc_null();
+	}
+	int err = sync_if_due(j);
+	if (err != 0) {
+		val_throw(alloc_int(err));
+		return alloc_null();
+	}
+	size_t from;
+	seq = readable_from(j, seq, &from);
+	int64_t end = std::min(j->next, seq + (int64_t)val_int(max_));
+	if (seq >= end)
+		return alloc_array(0);
+
+	// Count the messages to read, so the result can be allocated before any frames are
+	int64_t last = seq;
+	for (size_t si = from; last < end && si < j->segments.size(); si++) {
+		journal_segment *s = j->segments[si];
+		int64_t held = s->first + (int64_t)s->offsets.size();
+		if (last < s->first || held <= last)
+			break;
+		last = std::min(end, held);
+	}
+
+	// Each frame is wrapped as soon as it is initialised, straight into an array the
+	// result holds, so the collector sees all of them if it runs part way through
+	value ret = alloc_array((int)(last - seq));
+	int n = 0;
+	for (size_t si = from; seq < last; si++) {
+		journal_segment *s = j->segments[si];
+		for (; seq < last && seq - s->first < (int64_t)s->offsets.size(); seq++) {
+			const char *rec = s->base + s->offsets[(size_t)(seq - s->first)];
+			uint32_t nframes;
+			get_u32(rec + 8, &nframes);
+			const char *p = rec + RECORD_HEADER;
+			value frames = alloc_array((int)nframes);
+			val_array_set_i(ret, n++, frames);
+			for (uint32_t k = 0; k < nframes; k++) {
+				uint32_t size;
+				get_u32(p, &size);
+				zmq_msg_t msg;
+				int rc;
+				if (size <= JOURNAL_COPY_MAX) {
+					rc = zmq_msg_init_size(&msg, size);
+					if (rc == 0) memcpy(zmq_msg_data(&msg), p + 4, size);
+				} else {
+					atomic_add(&s->refs, 1);
+					rc = zmq_msg_init_data(&msg, (void *)(p + 4), size, release_frame, s);
+					if (rc != 0) release_segment(s);
+				}
+				if (rc != 0) {
+					val_throw(alloc_int(zmq_errno()));
+					return alloc_null();
+				}
+				val_array_set_i(frames, (int)k, hx_zmq_alloc_msg_handle(&msg, k + 1 < nframes));
+				p += 4 + size;
+			}
+		}
+	}
+	return ret;
+}
+
+/**
+ * Returns the sequence number of the first message that can be read at or after seq,
+ * as a Float: seq itself, unless it is before the first message held or in a gap left by
+ * a damaged record
+ */
+value hx_zmq_journal_readable(value journal_handle_, value seq_) {
+	hx_zmq_journal *j = journal_from_handle(journal_handle_);
+	int64_t seq;
+	if (j == NULL || !val_seq(seq_, &seq)) {
+		val_throw(alloc_int(EINVAL));
+		return alloc_null();
+	}
+	size_t si;
+	return alloc_float((double)readable_from(j, seq, &si));
+}
+
+/**
+ * Returns the sequence number the next message appended will have, as a Float
+ */
+value hx_zmq_journal_next(value journal_handle_) {
+	val_check_kind(journal_handle_, k_zmq_journal_handle);
+	hx_zmq_journal *j = journal_from_handle(journal_handle_);
+	int err = j == NULL ? EINVAL : sync_if_due(j);
+	if (err != 0) {
+		val_throw(alloc_int(err));
+		return alloc_null();
+	}
+	return alloc_float((double)j->next);
+}
+
+/**
+ * Returns the sequence number of the first message held, as a Float
+ */
+value hx_zmq_journal_first(value journal_handle_) {
+	val_check_kind(journal_handle_, k_zmq_journal_handle);
+	hx_zmq_journal *j = journal_from_handle(journal_handle_);
+	int err = j == NULL ? EINVAL : sync_if_due(j);
+	if (err != 0) {
+		val_throw(alloc_int(err));
+		return alloc_null();
+	}
+	return alloc_float((double)j->segments.front()->first);
+}
+
+/**
+ * Sets the group commit policy: sync after every messages appended, or once interval msecs
+ * have passed since the last sync. 0 disables either trigger; with both 0 (the default),
+ * only the kernel's own writeback and explicit syncs are used.
+ */
+value hx_zmq_journal_set_sync(value journal_handle_, value every_, value interval_) {
+	hx_zmq_journal *j = journal_from_handle(journal_handle_);
+	if (j == NULL || !val_is_int(every_) || !val_is_int(interval_) || val_int(every_) < 0 || val_int(interval_) < 0) {
+		val_throw(alloc_int(EINVAL));
+		return alloc_null();
+	}
+	j->sync_every = val_int(every_);
+	j->sync_interval = val_int(interval_);
+	int err = sync_if_due(j);
+	if (err != 0) {
+		val_throw(alloc_int(err));
+		return alloc_null();
+	}
+	return alloc_null();
+}
+
+/**
+ * Writes all appended messages to disk, returning once they are durable
+ */
+value hx_zmq_journal_sync(value journal_handle_) {
+	hx_zmq_journal *j = journal_from_handle(journal_handle_);
+	if (j == NULL) {
+		val_throw(alloc_int(EINVAL));
+		return alloc_null();
+	}
+	gc_enter_blocking();
+	int err = sync_journal(j);
+	gc_exit_blocking();
+	if (err != 0) {
+		val_throw(alloc_int(err));
+		return alloc_null();
+	}
+	return alloc_null();
+}
+
+/**
+ * Closes the journal, syncing it first if a group commit policy is set.
+ * Segments stay mapped while frames read from them are still in use.
+ */
+value hx_zmq_journal_close(value journal_handle_) {
+	val_check_kind(journal_handle_, k_zmq_journal_handle);
+	hx_zmq_journal *j = (hx_zmq_journal *)val_data(journal_handle_);
+	if (!j->closed && (j->sync_every > 0 || j->sync_interval > 0))
+		sync_journal(j);
+	close_journal(j);
+	return alloc_null();
+}
+
+DEFINE_PRIM( hx_zmq_journal_open, 2);
+DEFINE_PRIM( hx_zmq_journal_append, 2);
+DEFINE_PRIM( hx_zmq_journal_read, 3);
+DEFINE_PRIM( hx_zmq_journal_readable, 2);
+DEFINE_PRIM( hx_zmq_journal_next, 1);
+DEFINE_PRIM( hx_zmq_journal_first, 1);
+DEFINE_PRIM( hx_zmq_journal_set_sync, 3);
+DEFINE_PRIM( hx_zmq_journal_sync, 1);
+DEFINE_PRIM( hx_zmq_journal_close, 1);
@@ -0,0 +1,427 @@
+/**
+ * (c) 2011 Richard J Smith
+ *
+ * This file is part of hxzmq
+ *
+ * hxzmq is free software; you can redistribute it and/or modify it under
+ * the terms of the Lesser GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hxzmq is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * Lesser GNU General Public License for more details.
+ *
+ * You should have received a copy of the Lesser GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstring>
+#include <errno.h>
+#include <stdlib.h>
+#include <vector>
+#include <zmq.h>
+#include <hx/CFFI.h>
+
+#if defined(_WIN32)
+#include <winsock2.h>
+#include <windows.h>
+#elif defined(__linux__)
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#endif
+
+/*
+ * Mailbox for passing haXe values from any number of threads to one consumer, usually a ZLoop.
+ *
+ * Values are held in an intrusive lock-free multi-producer single-consumer queue
+ * (after Dmitry Vyukov's design), each kept alive by a GC root until it is received.
+ * A wakeup descriptor, readable while the mailbox holds values, lets the consumer wait for
+ * mail in the same poll as its 0MQ sockets: an eventfd on Linux, a pipe on other POSIX
+ * systems, and a loopback TCP connection on Windows, where zmq_poll only takes SOCKETs.
+ *
+ * Only the transition from empty to non-empty writes to the descriptor, so a burst of posts
+ * costs one wakeup, and nothing passes through a 0MQ socket.
+ */
+
+struct mailbox_node {
+	mailbox_node * volatile next;
+	value *root;
+};
+
+struct hx_zmq_mailbox {
+	mailbox_node * volatile head;	// Last node pushed; swapped by producers
+	mailbox_node *tail;				// Next node to pop; consumer only
+	mailbox_node stub;
+	volatile long pending;			// Values posted and not yet received
+	volatile long closed;
+	volatile long popping;			// Set while a thread pops values, as the queue has one consumer
+	volatile long redrain;			// Set by posts that find the mailbox closed
+#if defined(_WIN32)
+	SOCKET rfd, wfd;
+#else
+	int rfd, wfd;					// The same eventfd on Linux
+#endif
+};
+
+DEFINE_KIND( k_zmq_mailbox_handle );
+
+static inline mailbox_node *atomic_swap(mailbox_node * volatile *p, mailbox_node *v) {
+#ifdef _MSC_VER
+	return (mailbox_node *)InterlockedExchangePointer((PVOID volatile *)p, v);
+#else
+	mailbox_node *prev = __sync_lock_test_and_set(p, v);
+	__sync_synchronize();
+	return prev;
+#endif
+}
+
+static inline long atomic_add(volatile long *p, long v) {
+#ifdef _MSC_VER
+	return InterlockedExchangeAdd(p, v);
+#else
+	return __sync_fetch_and_add(p, v);
+#endif
+}
+
+static inline bool atomic_cas(volatile long *p, long old, long v) {
+#ifdef _MSC_VER
+	return InterlockedCompareExchange(p, v, old) == old;
+#else
+	return __sync_bool_compare_and_swap(p, old, v);
+#endif
+}
+
+static void mailbox_push(hx_zmq_mailbox *mb, mailbox_node *n) {
+	n->next = NULL;
+	mailbox_node *prev = atomic_swap(&mb->head, n);
+	prev->next = n;
+}
+
+// Returns NULL if empty, or if a producer is part way through a push
+static mailbox_node *mailbox_pop(hx_zmq_mailbox *mb) {
+	mailbox_node *tail = mb->tail;
+	mailbox_node *next = tail->next;
+	if (tail == &mb->stub) {
+		if (next == NULL)
+			return NULL;
+		mb->tail = next;
+		tail = next;
+		next = next->next;
+	}
+	if (next != NULL) {
+		mb->tail = next;
+		return tail;
+	}
+	if (tail != mb->head)
+		return NULL;
+	mailbox_push(mb, &mb->stub);
+	next = tail->next;
+	if (next != NULL) {
+		mb->tail = next;
+		return tail;
+	}
+	return NULL;
+}
+
+static void mailbox_signal(hx_zmq_mailbox *mb) {
+	// A full pipe is already readable, so write errors are ignored
+#if defined(_WIN32)
+	char c = 0;
+	send(mb->wfd, &c, 1, 0);
+#elif defined(__linux__)
+	uint64_t one = 1;
+	ssize_t rc = write(mb->wfd, &one, sizeof(one));
+	(void)rc;
+#else
+	char c = 0;
+	ssize_t rc = write(mb->wfd, &c, 1);
+	(void)rc;
+#endif
+}
+
+static void mailbox_unsignal(hx_zmq_mailbox *mb) {
+	char buf [64];
+#if defined(_WIN32)
+	while (recv(mb->rfd, buf, sizeof(buf), 0) > 0)
+		;
+#else
+	while (read(mb->rfd, buf, sizeof(buf)) > 0)
+		;
+#endif
+}
+
+// Accounts for n values received, clearing the wakeup descriptor once the mailbox is empty
+static void mailbox_received(hx_zmq_mailbox *mb, long n) {
+	if (n == 0 || atomic_add(&mb->pending, -n) != n)
+		return;
+	mailbox_unsignal(mb);
+	// A producer may have posted, and signalled, before the descriptor was cleared
+	if (mb->pending > 0)
+		mailbox_signal(mb);
+}
+
+static value mailbox_take(mailbox_node *n) {
+	value v = *n->root;
+	free_root(n->root);
+	free(n);
+	return v;
+}
+
+static void mailbox_discard(hx_zmq_mailbox *mb) {
+	long n = 0;
+	mailbox_node *node;
+	while ((node = mailbox_pop(mb)) != NULL) {
+		mailbox_take(node);
+		n++;
+	}
+	mailbox_received(mb, n);
+}
+
+// Discards the values of a closed mailbox and clears its wakeup descriptor.
+// Called by close, and by receives and posts once the mailbox is closed, so that a post
+// racing with close cannot leave its value rooted and the descriptor readable.
+// A caller that finds another thread popping asks it to drain again.
+static void mailbox_drain(hx_zmq_mailbox *mb) {
+	atomic_add(&mb->redrain, 1);
+	while (mb->redrain != 0 && atomic_cas(&mb->popping, 0, 1)) {
+		atomic_add(&mb->redrain, -mb->redrain);
+		mailbox_discard(mb);
+		mailbox_unsignal(mb);
+		atomic_add(&mb->popping, -1);
+	}
+}
+
+#if defined(_WIN32)
+// Connects a pair of loopback TCP sockets, as zmq_poll can only poll SOCKETs on Windows
+static int mailbox_socketpair(SOCKET *rfd, SOCKET *wfd) {
+	SOCKET listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (listener == INVALID_SOCKET)
+		return -1;
+	struct sockaddr_in addr;
+	int addrlen = sizeof(addr);
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = 0;
+	*rfd = *wfd = INVALID_SOCKET;
+	if (bind(listener, (struct sockaddr *)&addr, sizeof(addr)) == 0 &&
+			getsockname(listener, (struct sockaddr *)&addr, &addrlen) == 0 &&
+			listen(listener, 1) == 0 &&
+			(*wfd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP)) != INVALID_SOCKET &&
+			connect(*wfd, (struct sockaddr *)&addr, sizeof(addr)) == 0 &&
+			(*rfd = accept(listener, NULL, NULL)) != INVALID_SOCKET) {
+		u_long nonblocking = 1;
+		ioctlsocket(*rfd, FIONBIO, &nonblocking);
+		ioctlsocket(*wfd, FIONBIO, &nonblocking);
+		BOOL nodelay = TRUE;
+		setsockopt(*wfd, IPPROTO_TCP, TCP_NODELAY, (char *)&nodelay, sizeof(nodelay));
+		closesocket(listener);
+		return 0;
+	}
+	if (*wfd != INVALID_SOCKET)
+		closesocket(*wfd);
+	closesocket(listener);
+	return -1;
+}
+#endif
+
+// Finalizer for mailboxes. Values not yet received are released
+void finalize_mailbox( value v) {
+	hx_zmq_mailbox *mb = (hx_zmq_mailbox *)val_data(v);
+	mailbox_discard(mb);
+#if defined(_WIN32)
+	closesocket(mb->rfd);
+	closesocket(mb->wfd);
+	WSACleanup();
+#else
+	close(mb->rfd);
+	if (mb->wfd != mb->rfd)
+		close(mb->wfd);
+#endif
+	delete mb;
+}
+
+/**
+ * Creates a new, empty mailbox
+ */
+value hx_zmq_mailbox_construct() {
+	hx_zmq_mailbox *mb = new hx_zmq_mailbox;
+	mb->stub.next = NULL;
+	mb->stub.root = NULL;
+	mb->head = &mb->stub;
+	mb->tail = &mb->stub;
+	mb->pending = 0;
+	mb->closed = 0;
+	mb->popping = 0;
+	mb->redrain = 0;
+
+#if defined(_WIN32)
+	WSADATA wsa;
+	WSAStartup(MAKEWORD(2, 2), &wsa);
+	if (mailbox_socketpair(&mb->rfd, &mb->wfd) != 0) {
+		int err = WSAGetLastError();
+		WSACleanup();
+#elif defined(__linux__)
+	mb->rfd = mb->wfd = eventfd(0, EFD_NONBLOCK);
+	if (mb->rfd == -1) {
+		int err = errno;
+#else
+	int fds [2];
+	if (pipe(fds) == 0) {
+		mb->rfd = fds[0];
+		mb->wfd = fds[1];
+		fcntl(mb->rfd, F_SETFL, O_NONBLOCK);
+		fcntl(mb->wfd, F_SETFL, O_NONBLOCK);
+	} else {
+		int err = errno;
+#endif
+		delete mb;
+		val_throw(alloc_int(err));
+		return alloc_null();
+	}
+
+	value v = alloc_abstract(k_zmq_mailbox_handle, mb);
+	val_gc(v, finalize_mailbox);		// finalize_mailbox is called when the abstract value is garbage collected
+	return v;
+}
+
+/**
+ * Posts a value to the mailbox. May be called from any thread.
+ * Throws ETERM once the mailbox has been closed.
+ */
+value hx_zmq_mailbox_post(value mailbox_handle_, value v) {
+
+	val_check_kind(mailbox_handle_, k_zmq_mailbox_handle);
+	hx_zmq_mailbox *mb = (hx_zmq_mailbox *)val_data(mailbox_handle_);
+	if (val_is_null(v)) {
+		val_throw(alloc_int(EINVAL));
+		return alloc_null();
+	}
+	if (mb->closed) {
+		val_throw(alloc_int(ETERM));
+		return alloc_null();
+	}
+
+	mailbox_node *n = (mailbox_node *)malloc(sizeof(mailbox_node));
+	if (n == NULL) {
+		val_throw(alloc_int(ENOMEM));
+		return alloc_null();
+	}
+	n->root = alloc_root();
+	*n->root = v;
+
+	// Count before pushing, so the consumer never sees more values than pending
+	bool wasEmpty = (atomic_add(&mb->pending, 1) == 0);
+	mailbox_push(mb, n);
+	if (wasEmpty)
+		mailbox_signal(mb);
+	// The mailbox may have been closed, and drained, since it was checked
+	if (mb->closed)
+		mailbox_drain(mb);
+	return alloc_null();
+}
+
+/**
+ * Receives the oldest value from the mailbox, without waiting.
+ * Returns null if the mailbox is empty. Only one thread may receive from a mailbox.
+ */
+value hx_zmq_mailbox_recv(value mailbox_handle_) {
+
+	val_check_kind(mailbox_handle_, k_zmq_mailbox_handle);
+	hx_zmq_mailbox *mb = (hx_zmq_mailbox *)val_data(mailbox_handle_);
+
+	if (mb->closed) {
+		mailbox_drain(mb);
+		return alloc_null();
+	}
+	// Only fails while the mailbox is being closed
+	if (!atomic_cas(&mb->popping, 0, 1))
+		return alloc_null();
+	mailbox_node *n = mailbox_pop(mb);
+	atomic_add(&mb->popping, -1);
+	if (n == NULL)
+		return alloc_null();
+	value v = mailbox_take(n);
+	mailbox_received(mb, 1);
+	return v;
+}
+
+/**
+ * Receives up to max values from the mailbox, oldest first, without waiting.
+ * Returns an array, empty if the mailbox is empty.
+ */
+value hx_zmq_mailbox_recv_batch(value mailbox_handle_, value max_) {
+
+	val_check_kind(mailbox_handle_, k_zmq_mailbox_handle);
+	hx_zmq_mailbox *mb = (hx_zmq_mailbox *)val_data(mailbox_handle_);
+	if (!val_is_int(max_) || val_int(max_) < 0) {
+		val_throw(alloc_int(EINVAL));
+		return alloc_null();
+	}
+
+	if (mb->closed) {
+		mailbox_drain(mb);
+		return alloc_array(0);
+	}
+	if (!atomic_cas(&mb->popping, 0, 1))
+		return alloc_array(0);
+
+	// Values stay rooted until they are in the returned array
+	int max = val_int(max_);
+	std::vector<mailbox_node *> nodes;
+	mailbox_node *node;
+	while ((int)nodes.size() < max && (node = mailbox_pop(mb)) != NULL)
+		nodes.push_back(node);
+	atomic_add(&mb->popping, -1);
+
+	value ret = alloc_array(nodes.size());
+	for (size_t i = 0; i < nodes.size(); i++)
+		val_array_set_i(ret, i, mailbox_take(nodes[i]));
+	mailbox_received(mb, nodes.size());
+	return ret;
+}
+
+/**
+ * Returns the descriptor to poll for POLLIN, readable while the mailbox holds values
+ */
+value hx_zmq_mailbox_fd(value mailbox_handle_) {
+	val_check_kind(mailbox_handle_, k_zmq_mailbox_handle);
+	hx_zmq_mailbox *mb = (hx_zmq_mailbox *)val_data(mailbox_handle_);
+	return alloc_int((int)mb->rfd);
+}
+
+/**
+ * Returns the number of values posted and not yet received
+ */
+value hx_zmq_mailbox_size(value mailbox_handle_) {
+	val_check_kind(mailbox_handle_, k_zmq_mailbox_handle);
+	hx_zmq_mailbox *mb = (hx_zmq_mailbox *)val_data(mailbox_handle_);
+	return alloc_int((int)mb->pending);
+}
+
+/**
+ * Closes the mailbox to further posts, and releases any values not yet received.
+ * The wakeup descriptor stays open until the mailbox is garbage collected,
+ * as other threads may still hold it.
+ */
+value hx_zmq_mailbox_close(value mailbox_handle_) {
+	val_check_kind(mailbox_handle_, k_zmq_mailbox_handle);
+	hx_zmq_mailbox *mb = (hx_zmq_mailbox *)val_data(mailbox_handle_);
+	atomic_cas(&mb->closed, 0, 1);
+	mailbox_drain(mb);
+	return alloc_null();
+}
+
+DEFINE_PRIM( hx_zmq_mailbox_construct, 0);
+DEFINE_PRIM( hx_zmq_mailbox_post, 2);
+DEFINE_PRIM( hx_zmq_mailbox_recv, 1);
+DEFINE_PRIM( hx_zmq_mailbox_recv_batch, 2);
+DEFINE_PRIM( hx_zmq_mailbox_fd, 1);
+DEFINE_PRIM( hx_zmq_mailbox_size, 1);
+DEFINE_PRIM( hx_zmq_mailbox_close, 1);
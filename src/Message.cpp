@@ -0,0 +1,457 @@
+/*
+    Copyright (c) Richard Smith 2011
+
+    This file is part of hxzmq.
+
+    0MQ is free software; you can redistribute it and/or modify it under
+    the terms of the Lesser GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    0MQ is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    Lesser GNU General Public License for more details.
+
+    You should have received a copy of the Lesser GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifdef _MSC_VER
+// Add stdint.hpp header file from zeromq distro to pick up integer types definitions
+#include <stdint.hpp>
+#endif
+
+#include <assert.h>
+#include <cstring>
+#include <vector>
+#include <zmq.h>
+#include <hx/CFFI.h>
+
+#include "socket.h"
+#include "message.h"
+#include "stats.h"
+
+/*
+ * Native message handles.
+ *
+ * A k_zmq_msg_handle abstract owns a live zmq_msg_t, so a received frame can stay in
+ * libzmq-owned memory until (and unless) the haXe code needs its bytes.
+ * Sending a handle passes the zmq_msg_t straight back to libzmq, so a frame that is
+ * received and forwarded is never copied through a haXe buffer.
+ */
+
+DEFINE_KIND( k_zmq_msg_handle );
+
+// Finalizer for message handles
+void finalize_msg( value v) {
+	hx_zmq_msg *m = (hx_zmq_msg *)val_data(v);
+	if (m->open)
+		zmq_msg_close(&m->msg);
+	delete m;
+}
+
+value hx_zmq_wrap_msg(hx_zmq_msg *m)
+{
+	value v = alloc_abstract(k_zmq_msg_handle, m);
+	val_gc(v, finalize_msg);		// finalize_msg is called when the abstract value is garbage collected
+	return v;
+}
+
+value hx_zmq_alloc_msg_handle(zmq_msg_t *msg, bool more)
+{
+	hx_zmq_msg *m = new hx_zmq_msg;
+	// A zmq_msg_t may only be moved by libzmq, never copied directly
+	zmq_msg_init(&m->msg);
+	zmq_msg_move(&m->msg, msg);
+	zmq_msg_close(msg);
+	m->open = true;
+	m->more = more;
+	return hx_zmq_wrap_msg(m);
+}
+
+bool hx_zmq_rcvmore(void *socket)
+{
+#if ZMQ_VERSION >= ZMQ_MAKE_VERSION(3,0,0)
+	// In ZMQ 3+, RCVMORE is an int value, not int64
+	int more = 0;
+#else
+	int64_t more = 0;
+#endif
+	size_t morelen = sizeof(more);
+	if (zmq_getsockopt(socket, ZMQ_RCVMORE, &more, &morelen) != 0)
+		return false;
+	return more != 0;
+}
+
+// Returns the open message held by a handle value, or NULL if the value is not an open message handle
+static hx_zmq_msg *msg_from_handle(value msg_handle_) {
+	if (!val_is_kind(msg_handle_, k_zmq_msg_handle))
+		return NULL;
+	hx_zmq_msg *m = (hx_zmq_msg *)val_data(msg_handle_);
+	return m->open ? m : NULL;
+}
+
+/**
+ * Receive a message from a socket, returned as a native message handle.
+ * Returns null if DONTWAIT was specified and no message was available.
+ */
+value hx_zmq_msg_recv(value socket_handle_, value flags) {
+	
+	val_check_kind(socket_handle_, k_zmq_socket_handle);
+	
+	if (!val_is_null(flags) && !val_is_int(flags)) {
+		val_throw(alloc_int(EINVAL));
+		return alloc_null();
+	}
+	
+	zmq_msg_t message;
+	int rc = zmq_msg_init (&message);
+	int err = zmq_errno();
+	if (rc != 0) {
+		val_throw(alloc_int(err));
+		return alloc_null();
+	}
+	
+	gc_enter_blocking();
+	HXZMQ_STATS_START(t);
+#if ZMQ_VERSION >= ZMQ_MAKE_VERSION(3,0,0)	
+	rc = zmq_recvmsg (val_data(socket_handle_), &message, val_int(flags));
+#else
+	rc = zmq_recv (val_data(socket_handle_), &message, val_int(flags));
+#endif
+	err = zmq_errno();
+	HXZMQ_STATS_RECV(val_data(socket_handle_), rc == -1 ? 0 : 1, zmq_msg_size(&message), rc == -1 ? err : 0, t);
+	gc_exit_blocking();
+	
+	if (rc == -1) {
+		zmq_msg_close (&message);
+		if (err == EAGAIN)
+			return alloc_null();
+		val_throw(alloc_int(err));
+		return alloc_null();
+	}
+	
+	return hx_zmq_alloc_msg_handle(&message, hx_zmq_rcvmore(val_data(socket_handle_)));
+}
+
+/**
+ * Send a native message handle to a socket.
+ * On success, the handle is closed as libzmq takes ownership of its content.
+ * Returns true if sent, false if DONTWAIT was specified and the message could not be queued.
+ */
+value hx_zmq_msg_send(value socket_handle_, value msg_handle_, value flags) {
+	
+	val_check_kind(socket_handle_, k_zmq_socket_handle);
+	
+	if (!val_is_null(flags) && !val_is_int(flags)) {
+		val_throw(alloc_int(EINVAL));
+		return alloc_null();
+	}
+	
+	hx_zmq_msg *m = msg_from_handle(msg_handle_);
+	if (m == NULL) {
+		val_throw(alloc_int(EINVAL));
+		return alloc_null();
+	}
+	
+	gc_enter_blocking();
+	HXZMQ_STATS_START(t);
+#ifdef HXZMQ_STATS
+	// Taken before sending, which empties the message
+	size_t size = zmq_msg_size (&m->msg);
+#endif
+#if ZMQ_VERSION >= ZMQ_MAKE_VERSION(3,0,0)	
+	int rc = zmq_sendmsg (val_data(socket_handle_), &m->msg, val_int(flags));
+#else
+	int rc = zmq_send (val_data(socket_handle_), &m->msg, val_int(flags));
+#endif
+	int err = zmq_errno();
+	HXZMQ_STATS_SEND(val_data(socket_handle_), rc == -1 ? 0 : 1, size, rc == -1 ? err : 0, t);
+	gc_exit_blocking();
+	
+	if (rc == -1) {
+		if (err == EAGAIN)
+			return alloc_bool(false);
+		val_throw(alloc_int(err));
+		return alloc_null();
+	}
+	
+	// libzmq leaves an empty message behind after a successful send
+	zmq_msg_close(&m->msg);
+	m->open = false;
+	return alloc_bool(true);
+}
+
+/**
+ * Returns true if more message parts followed the message when it was received
+ */
+value hx_zmq_msg_more(value msg_handle_) {
+	val_check_kind(msg_handle_, k_zmq_msg_handle);
+	hx_zmq_msg *m = (hx_zmq_msg *)val_data(msg_handle_);
+	return alloc_bool(m->more);
+}
+
+/**
+ * Returns the byte size of the message
+ */
+value hx_zmq_msg_size(value msg_handle_) {
+	hx_zmq_msg *m = msg_from_handle(msg_handle_);
+	if (m == NULL) {
+		val_throw(alloc_int(EINVAL));
+		return alloc_null();
+	}
+	return alloc_int(zmq_msg_size(&m->msg));
+}
+
+/**
+ * Returns a single byte from the message, without copying the message data
+ */
+value hx_zmq_msg_get(value msg_handle_, value pos_) {
+	hx_zmq_msg *m = msg_from_handle(msg_handle_);
+	if (m == NULL || !val_is_int(pos_)) {
+		val_throw(alloc_int(EINVAL));
+		return alloc_null();
+	}
+	int pos = val_int(pos_);
+	if (pos < 0 || (size_t)pos >= zmq_msg_size(&m->msg)) {
+		val_throw(alloc_int(EINVAL));
+		return alloc_null();
+	}
+	return alloc_int(((unsigned char *)zmq_msg_data(&m->msg))[pos]);
+}
+
+/**
+ * Copies len bytes of the message, starting at offset pos, into a new buffer
+ */
+value hx_zmq_msg_slice(value msg_handle_, value pos_, value len_) {
+	hx_zmq_msg *m = msg_from_handle(msg_handle_);
+	if (m == NULL || !val_is_int(pos_) || !val_is_int(len_)) {
+		val_throw(alloc_int(EINVAL));
+		return alloc_null();
+	}
+	int pos = val_int(pos_);
+	int len = val_int(len_);
+	if (pos < 0 || len < 0 || (size_t)(pos + len) > zmq_msg_size(&m->msg)) {
+		val_throw(alloc_int(EINVAL));
+		return alloc_null();
+	}
+	buffer b = alloc_buffer(NULL);
+	buffer_append_sub(b, (char *)zmq_msg_data(&m->msg) + pos, len);
+	return buffer_val(b);
+}
+
+/**
+ * Copies the whole message content into a new buffer
+ */
+value hx_zmq_msg_data(value msg_handle_) {
+	hx_zmq_msg *m = msg_from_handle(msg_handle_);
+	if (m == NULL) {
+		val_throw(alloc_int(EINVAL));
+		return alloc_null();
+	}
+	buffer b = alloc_buffer(NULL);
+	buffer_append_sub(b, (char *)zmq_msg_data(&m->msg), zmq_msg_size(&m->msg));
+	return buffer_val(b);
+}
+
+/**
+ * Creates a new message handle sharing the content of an existing one.
+ * libzmq reference-counts large message content, so this does not copy it.
+ */
+value hx_zmq_msg_copy(value msg_handle_) {
+	hx_zmq_msg *m = msg_from_handle(msg_handle_);
+	if (m == NULL) {
+		val_throw(alloc_int(EINVAL));
+		return alloc_null();
+	}
+	zmq_msg_t copy;
+	int rc = zmq_msg_init (&copy);
+	if (rc == 0) rc = zmq_msg_copy (&copy, &m->msg);
+	int err = zmq_errno();
+	if (rc != 0) {
+		zmq_msg_close (&copy);
+		val_throw(alloc_int(err));
+		return alloc_null();
+	}
+	return hx_zmq_alloc_msg_handle(&copy, m->more);
+}
+
+/**
+ * Closes the message, releasing its content back to libzmq.
+ * Closing an already-closed handle does nothing.
+ */
+value hx_zmq_msg_close(value msg_handle_) {
+	val_check_kind(msg_handle_, k_zmq_msg_handle);
+	hx_zmq_msg *m = (hx_zmq_msg *)val_data(msg_handle_);
+	if (m->open) {
+		int rc = zmq_msg_close(&m->msg);
+		m->open = false;
+		if (rc != 0) {
+			val_throw(alloc_int(zmq_errno()));
+			return alloc_null();
+		}
+	}
+	return alloc_null();
+}
+
+/**
+ * Send an array of frames to a socket as one multipart message, in a single native call.
+ * Each frame may be either byte data (copied) or a message handle (moved, without copying).
+ * Frame message handles are left empty, whether or not the message was sent.
+ * Returns the number of frames sent, or 0 if DONTWAIT was specified and the message could not be queued.
+ */
+value hx_zmq_send_multipart(value socket_handle_, value frames_, value flags) {
+	
+	val_check_kind(socket_handle_, k_zmq_socket_handle);
+	
+	if (!val_is_array(frames_) || (!val_is_null(flags) && !val_is_int(flags))) {
+		val_throw(alloc_int(EINVAL));
+		return alloc_null();
+	}
+	
+	int n = val_array_size(frames_);
+	if (n == 0)
+		return alloc_int(0);
+	
+	// Build all 0MQ messages before releasing the GC
+	zmq_msg_t *parts = new zmq_msg_t [n];
+	for (int i = 0; i < n; i++) {
+		value frame = val_array_i(frames_, i);
+		hx_zmq_msg *m = msg_from_handle(frame);
+		size_t size = 0;
+		uint8_t *data = 0;
+		int rc;
+		if (m != NULL) {
+			rc = zmq_msg_init (&parts[i]);
+			if (rc == 0) rc = zmq_msg_move (&parts[i], &m->msg);
+		} else if (hx_zmq_bytes_data(frame, &data, &size)) {
+			rc = zmq_msg_init_size (&parts[i], size);
+			if (rc == 0) memcpy (zmq_msg_data(&parts[i]), data, size);
+		} else {
+			rc = -1;
+			errno = EINVAL;
+		}
+		if (rc != 0) {
+			int err = (m == NULL && data == 0) ? EINVAL : zmq_errno();
+			for (int j = 0; j < i; j++)
+				zmq_msg_close (&parts[j]);
+			delete [] parts;
+			val_throw(alloc_int(err));
+			return alloc_null();
+		}
+	}
+	
+	void *socket = val_data(socket_handle_);
+	int _flags = val_int(flags);
+	int sent = 0;
+	int err = 0;
+	
+	gc_enter_blocking();
+	HXZMQ_STATS_START(t);
+	size_t bytes = 0;
+	for (; sent < n; sent++) {
+		size_t size = zmq_msg_size (&parts[sent]);
+#if ZMQ_VERSION >= ZMQ_MAKE_VERSION(3,0,0)	
+		int rc = zmq_sendmsg (socket, &parts[sent], (sent < n - 1) ? (_flags | ZMQ_SNDMORE) : _flags);
+#else
+		int rc = zmq_send (socket, &parts[sent], (sent < n - 1) ? (_flags | ZMQ_SNDMORE) : _flags);
+#endif
+		if (rc == -1) {
+			err = zmq_errno();
+			break;
+		}
+		bytes += size;
+	}
+	HXZMQ_STATS_SEND(socket, sent, bytes, err, t);
+	gc_exit_blocking();
+	
+	for (int i = 0; i < n; i++)
+		zmq_msg_close (&parts[i]);
+	delete [] parts;
+	
+	if (sent < n) {
+		if (err == EAGAIN && sent == 0)
+			return alloc_int(0);
+		val_throw(alloc_int(err));
+		return alloc_null();
+	}
+	return alloc_int(sent);
+}
+
+/**
+ * Receive all parts of a multipart message from a socket, in a single native call.
+ * Returns an array of message handles, or null if DONTWAIT was specified and no message was available.
+ */
+value hx_zmq_recv_multipart(value socket_handle_, value flags) {
+	
+	val_check_kind(socket_handle_, k_zmq_socket_handle);
+	
+	if (!val_is_null(flags) && !val_is_int(flags)) {
+		val_throw(alloc_int(EINVAL));
+		return alloc_null();
+	}
+	
+	void *socket = val_data(socket_handle_);
+	int _flags = val_int(flags);
+	std::vector<hx_zmq_msg *> parts;
+	int err = 0;
+	size_t bytes = 0;
+	
+	gc_enter_blocking();
+	HXZMQ_STATS_START(t);
+	while (true) {
+		hx_zmq_msg *m = new hx_zmq_msg;
+		zmq_msg_init (&m->msg);
+		// Only the first part can block; 0MQ delivers the remaining parts atomically with it
+#if ZMQ_VERSION >= ZMQ_MAKE_VERSION(3,0,0)	
+		int rc = zmq_recvmsg (socket, &m->msg, parts.empty() ? _flags : 0);
+#else
+		int rc = zmq_recv (socket, &m->msg, parts.empty() ? _flags : 0);
+#endif
+		if (rc == -1) {
+			err = zmq_errno();
+			zmq_msg_close (&m->msg);
+			delete m;
+			break;
+		}
+		m->open = true;
+		m->more = hx_zmq_rcvmore(socket);
+		parts.push_back(m);
+		bytes += zmq_msg_size (&m->msg);
+		if (!m->more)
+			break;
+	}
+	HXZMQ_STATS_RECV(socket, err == 0 ? (int)parts.size() : 0, bytes, err, t);
+	gc_exit_blocking();
+	
+	if (err != 0) {
+		bool empty = parts.empty();
+		for (size_t i = 0; i < parts.size(); i++) {
+			zmq_msg_close (&parts[i]->msg);
+			delete parts[i];
+		}
+		if (err == EAGAIN && empty)
+			return alloc_null();
+		val_throw(alloc_int(err));
+		return alloc_null();
+	}
+	
+	value ret = alloc_array(parts.size());
+	for (size_t i = 0; i < parts.size(); i++) {
+		val_array_set_i(ret, i, hx_zmq_wrap_msg(parts[i]));
+	}
+	return ret;
+}
+
+DEFINE_PRIM( hx_zmq_msg_recv, 2);
+DEFINE_PRIM( hx_zmq_msg_send, 3);
+DEFINE_PRIM( hx_zmq_msg_more, 1);
+DEFINE_PRIM( hx_zmq_msg_size, 1);
+DEFINE_PRIM( hx_zmq_msg_get, 2);
+DEFINE_PRIM( hx_zmq_msg_slice, 3);
+DEFINE_PRIM( hx_zmq_msg_data, 1);
+DEFINE_PRIM( hx_zmq_msg_copy, 1);
+DEFINE_PRIM( hx_zmq_msg_close, 1);
+DEFINE_PRIM( hx_zmq_send_multipart, 3);
+DEFINE_PRIM( hx_zmq_recv_multipart, 2);
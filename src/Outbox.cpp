@@ -0,0 +1,183 @@
+/**
+ * (c) 2011 Richard J Smith
+ *
+ * This file is part of hxzmq
+ *
+ * hxzmq is free software; you can redistribute it and/or modify it under
+ * the terms of the Lesser GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hxzmq is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * Lesser GNU General Public License for more details.
+ *
+ * You should have received a copy of the Lesser GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstring>
+#include <deque>
+#include <zmq.h>
+#include <hx/CFFI.h>
+
+#include "socket.h"
+#include "stats.h"
+
+#ifndef ZMQ_DONTWAIT
+#define ZMQ_DONTWAIT ZMQ_NOBLOCK
+#endif
+
+/*
+ * Outbound message queue for a socket.
+ *
+ * Messages are sent with DONTWAIT while the queue is empty; a message that would block
+ * (e.g. at the socket's high water mark) is kept, along with every later message, until
+ * a flush finds the socket writable again. So nothing is dropped, and order is kept, by socket
+ * types that block at the high water mark; PUB and XPUB drop there without failing the send.
+ * 0MQ only refuses the first part of a multipart message, so queued parts stay together.
+ *
+ * The socket is passed in on each call rather than held, so the outbox never outlives it.
+ */
+struct outbox_item {
+	zmq_msg_t msg;
+	int flags;
+};
+
+// Items are initialised in place; deque never moves elements added or removed at either end
+typedef std::deque<outbox_item> hx_zmq_outbox;
+
+DEFINE_KIND( k_zmq_outbox_handle );
+
+// Finalizer for outboxes. Queued messages are discarded
+void finalize_outbox( value v) {
+	hx_zmq_outbox *q = (hx_zmq_outbox *)val_data(v);
+	for (size_t i = 0; i < q->size(); i++)
+		zmq_msg_close (&(*q)[i].msg);
+	delete q;
+}
+
+static int outbox_sendmsg(void *socket, outbox_item *item) {
+	HXZMQ_STATS_START(t);
+#ifdef HXZMQ_STATS
+	// Taken before sending, which empties the message
+	size_t size = zmq_msg_size (&item->msg);
+#endif
+#if ZMQ_VERSION >= ZMQ_MAKE_VERSION(3,0,0)
+	int rc = zmq_sendmsg (socket, &item->msg, item->flags | ZMQ_DONTWAIT);
+#else
+	int rc = zmq_send (socket, &item->msg, item->flags | ZMQ_DONTWAIT);
+#endif
+	HXZMQ_STATS_SEND(socket, rc == -1 ? 0 : 1, size, rc == -1 ? zmq_errno() : 0, t);
+	// zmq_sendmsg returns the message size in 3.x
+	return rc == -1 ? -1 : 0;
+}
+
+/**
+ * Creates a new, empty outbox
+ */
+value hx_zmq_outbox_construct() {
+	value v = alloc_abstract(k_zmq_outbox_handle, new hx_zmq_outbox);
+	val_gc(v, finalize_outbox);		// finalize_outbox is called when the abstract value is garbage collected
+	return v;
+}
+
+/**
+ * Sends a message on socket, or queues it if it cannot be sent without blocking,
+ * or if earlier messages are still queued.
+ * Returns the number of messages left queued, so 0 if the message was sent.
+ */
+value hx_zmq_outbox_send(value outbox_handle_, value socket_handle_, value msg_data, value more_) {
+
+	val_check_kind(outbox_handle_, k_zmq_outbox_handle);
+	val_check_kind(socket_handle_, k_zmq_socket_handle);
+	hx_zmq_outbox *q = (hx_zmq_outbox *)val_data(outbox_handle_);
+
+	size_t size = 0;
+	uint8_t *data = 0;
+	if (!hx_zmq_bytes_data(msg_data, &data, &size) || !val_is_bool(more_)) {
+		val_throw(alloc_int(EINVAL));
+		return alloc_null();
+	}
+
+	q->push_back(outbox_item());
+	outbox_item *item = &q->back();
+	if (zmq_msg_init_size (&item->msg, size) != 0) {
+		int err = zmq_errno();
+		q->pop_back();
+		val_throw(alloc_int(err));
+		return alloc_null();
+	}
+	memcpy (zmq_msg_data (&item->msg), data, size);
+	item->flags = val_bool(more_) ? ZMQ_SNDMORE : 0;
+
+	if (q->size() == 1) {
+		if (outbox_sendmsg (val_data(socket_handle_), item) == 0) {
+			zmq_msg_close (&item->msg);
+			q->pop_back();
+		} else {
+			int err = zmq_errno();
+			if (err != EAGAIN) {
+				zmq_msg_close (&item->msg);
+				q->pop_back();
+				val_throw(alloc_int(err));
+				return alloc_null();
+			}
+		}
+	}
+	return alloc_int((int)q->size());
+}
+
+/**
+ * Sends as many queued messages as the socket will take without blocking.
+ * Returns the number of messages still queued.
+ */
+value hx_zmq_outbox_flush(value outbox_handle_, value socket_handle_) {
+
+	val_check_kind(outbox_handle_, k_zmq_outbox_handle);
+	val_check_kind(socket_handle_, k_zmq_socket_handle);
+	hx_zmq_outbox *q = (hx_zmq_outbox *)val_data(outbox_handle_);
+	void *socket = val_data(socket_handle_);
+
+	while (!q->empty()) {
+		outbox_item *item = &q->front();
+		if (outbox_sendmsg (socket, item) != 0) {
+			int err = zmq_errno();
+			if (err == EAGAIN)
+				break;
+			val_throw(alloc_int(err));
+			return alloc_null();
+		}
+		zmq_msg_close (&item->msg);
+		q->pop_front();
+	}
+	return alloc_int((int)q->size());
+}
+
+/**
+ * Returns the number of messages queued
+ */
+value hx_zmq_outbox_size(value outbox_handle_) {
+	val_check_kind(outbox_handle_, k_zmq_outbox_handle);
+	hx_zmq_outbox *q = (hx_zmq_outbox *)val_data(outbox_handle_);
+	return alloc_int((int)q->size());
+}
+
+/**
+ * Discards all queued messages
+ */
+value hx_zmq_outbox_clear(value outbox_handle_) {
+	val_check_kind(outbox_handle_, k_zmq_outbox_handle);
+	hx_zmq_outbox *q = (hx_zmq_outbox *)val_data(outbox_handle_);
+	for (size_t i = 0; i < q->size(); i++)
+		zmq_msg_close (&(*q)[i].msg);
+	q->clear();
+	return alloc_null();
+}
+
+DEFINE_PRIM( hx_zmq_outbox_construct, 0);
+DEFINE_PRIM( hx_zmq_outbox_send, 4);
+DEFINE_PRIM( hx_zmq_outbox_flush, 2);
+DEFINE_PRIM( hx_zmq_outbox_size, 1);
+DEFINE_PRIM( hx_zmq_outbox_clear, 1);
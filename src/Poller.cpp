@@ -24,6 +24,9 @@
 
 
 #include "socket.h"
+#include "poller.h"
+#include "prime.h"
+#include "stats.h"
 
 value hx_zmq_poll (value sockets_, value events_, value timeout_) {
 
@@ -50,16 +53,22 @@ value hx_zmq_poll (value sockets_, value events_, value timeout_) {
 		value socket = val_array_i(sockets_, i);
 		value event = val_array_i(events_, i);
 		
-		// Test that array index values are of the expected value type
-		val_check_kind(socket, k_zmq_socket_handle);
 		if (!val_is_int(event)) {
 			val_throw(alloc_int(EINVAL));
 			delete [] pitem;
 			return alloc_null();
 		}
 		
-		pitem [i].socket = val_data (socket);
-		pitem [i].fd = 0;
+		// Each item is either a socket handle, or an int native file descriptor
+		if (val_is_int(socket)) {
+			pitem [i].socket = NULL;
+			pitem [i].fd = val_int (socket);
+		} else {
+			// Test that array index values are of the expected value type
+			val_check_kind(socket, k_zmq_socket_handle);
+			pitem [i].socket = val_data (socket);
+			pitem [i].fd = 0;
+		}
 		pitem [i].events = val_int (event);
 		pitem [i].revents = 0;	
 	}
@@ -70,8 +79,10 @@ value hx_zmq_poll (value sockets_, value events_, value timeout_) {
 	int err = 0;
 	long tout = val_int(timeout_);
 
+	HXZMQ_STATS_START(t);
 	rc = zmq_poll (pitem, ls, tout);
     err = zmq_errno();
+	HXZMQ_STATS_POLL(t);
 	
 	gc_exit_blocking();
 	
@@ -100,6 +111,200 @@ value hx_zmq_poll (value sockets_, value events_, value timeout_) {
 
 DEFINE_PRIM (hx_zmq_poll, 3);
 
+DEFINE_KIND( k_zmq_pollset_handle );
+
+// Finalizer for pollsets
+void finalize_pollset( value v) {
+	hx_zmq_pollset *ps = (hx_zmq_pollset *)val_data(v);
+	delete [] ps->items;
+	delete [] ps->ready;
+	delete ps;
+}
+
+int hx_zmq_pollset_wait(hx_zmq_pollset *ps, long timeout) {
+	ps->nready = 0;
+	HXZMQ_STATS_START(t);
+	int rc = zmq_poll (ps->items, ps->size, timeout);
+	HXZMQ_STATS_POLL(t);
+	if (rc <= 0)
+		return rc;
+	for (int i = 0; i < ps->size && ps->nready < rc; i++) {
+		if (ps->items[i].revents != 0)
+			ps->ready[ps->nready++] = i;
+	}
+	return ps->nready;
+}
+
+HXZMQ_PRIME_API int hx_zmq_prime_poll(hx_zmq_pollset *ps, long timeout) {
+	if (ps == NULL)
+		return -ENOTSUP;
+	gc_enter_blocking();
+	int rc = hx_zmq_pollset_wait(ps, timeout);
+	int err = zmq_errno();
+	gc_exit_blocking();
+	if (rc == -1)
+		return -err;
+	return rc;
+}
+
+HXZMQ_PRIME_API int hx_zmq_prime_ready(hx_zmq_pollset *ps, int k, int *revents) {
+	if (ps == NULL || k < 0 || k >= ps->nready)
+		return -1;
+	int index = ps->ready[k];
+	*revents = ps->items[index].revents;
+	return index;
+}
+
+HXZMQ_PRIME_API hx_zmq_pollset *hx_zmq_prime_pollset(void *handle) {
+	value v = (value)handle;
+	return val_is_kind(v, k_zmq_pollset_handle) ? (hx_zmq_pollset *)val_data(v) : NULL;
+}
+
+/**
+ * Creates a new, empty pollset
+ */
+value hx_zmq_pollset_construct() {
+	hx_zmq_pollset *ps = new hx_zmq_pollset;
+	ps->capacity = 16;
+	ps->size = 0;
+	ps->nready = 0;
+	ps->generation = 0;
+	ps->items = new zmq_pollitem_t [ps->capacity];
+	ps->ready = new int [ps->capacity];
+	
+	value v = alloc_abstract(k_zmq_pollset_handle, ps);
+	val_gc(v, finalize_pollset);		// finalize_pollset is called when the abstract value is garbage collected
+	return v;
+}
+
+// Appends an item for either a 0MQ socket or, if socket is NULL, a native file descriptor.
+// Returns the index of the new item
+static int pollset_append(hx_zmq_pollset *ps, void *socket, int fd, short events) {
+	
+	if (ps->size == ps->capacity) {
+		int capacity = ps->capacity * 2;
+		zmq_pollitem_t *items = new zmq_pollitem_t [capacity];
+		memcpy (items, ps->items, ps->size * sizeof(zmq_pollitem_t));
+		delete [] ps->items;
+		delete [] ps->ready;
+		ps->items = items;
+		ps->ready = new int [capacity];
+		ps->capacity = capacity;
+		ps->nready = 0;
+	}
+	
+	zmq_pollitem_t *item = &ps->items[ps->size];
+	item->socket = socket;
+	item->fd = fd;
+	item->events = events;
+	item->revents = 0;
+	ps->generation++;
+	return ps->size++;
+}
+
+/**
+ * Appends a socket to the pollset.
+ * Returns the index of the new item
+ */
+value hx_zmq_pollset_add(value pollset_handle_, value socket_handle_, value events_) {
+	
+	val_check_kind(pollset_handle_, k_zmq_pollset_handle);
+	hx_zmq_pollset *ps = (hx_zmq_pollset *)val_data(pollset_handle_);
+	val_check_kind(socket_handle_, k_zmq_socket_handle);
+	if (!val_is_int(events_)) {
+		val_throw(alloc_int(EINVAL));
+		return alloc_null();
+	}
+	
+	return alloc_int(pollset_append(ps, val_data(socket_handle_), 0, val_int(events_)));
+}
+
+/**
+ * Appends a native file descriptor (or SOCKET, on Windows) to the pollset,
+ * to be polled alongside its 0MQ sockets.
+ * Returns the index of the new item
+ */
+value hx_zmq_pollset_add_fd(value pollset_handle_, value fd_, value events_) {
+	
+	val_check_kind(pollset_handle_, k_zmq_pollset_handle);
+	hx_zmq_pollset *ps = (hx_zmq_pollset *)val_data(pollset_handle_);
+	if (!val_is_int(fd_) || val_int(fd_) < 0 || !val_is_int(events_)) {
+		val_throw(alloc_int(EINVAL));
+		return alloc_null();
+	}
+	
+	return alloc_int(pollset_append(ps, NULL, val_int(fd_), val_int(events_)));
+}
+
+/**
+ * Removes the item at index from the pollset, moving later items down by one
+ */
+value hx_zmq_pollset_remove(value pollset_handle_, value index_) {
+	
+	val_check_kind(pollset_handle_, k_zmq_pollset_handle);
+	hx_zmq_pollset *ps = (hx_zmq_pollset *)val_data(pollset_handle_);
+	if (!val_is_int(index_) || val_int(index_) < 0 || val_int(index_) >= ps->size) {
+		val_throw(alloc_int(EINVAL));
+		return alloc_null();
+	}
+	
+	int index = val_int(index_);
+	memmove (&ps->items[index], &ps->items[index + 1], (ps->size - index - 1) * sizeof(zmq_pollitem_t));
+	ps->size--;
+	ps->nready = 0;
+	ps->generation++;
+	return alloc_null();
+}
+
+/**
+ * Removes all items from the pollset, keeping its memory for reuse
+ */
+value hx_zmq_pollset_clear(value pollset_handle_) {
+	
+	val_check_kind(pollset_handle_, k_zmq_pollset_handle);
+	hx_zmq_pollset *ps = (hx_zmq_pollset *)val_data(pollset_handle_);
+	ps->size = 0;
+	ps->nready = 0;
+	ps->generation++;
+	return alloc_null();
+}
+
+/**
+ * Polls the pollset.
+ * Returns a flat array of (index, revents) pairs for the items that signalled only,
+ * which is empty if the timeout expired
+ */
+value hx_zmq_pollset_poll(value pollset_handle_, value timeout_) {
+	
+	val_check_kind(pollset_handle_, k_zmq_pollset_handle);
+	hx_zmq_pollset *ps = (hx_zmq_pollset *)val_data(pollset_handle_);
+	if (!val_is_int(timeout_)) {
+		val_throw(alloc_int(EINVAL));
+		return alloc_null();
+	}
+	
+	int rc = hx_zmq_prime_poll(ps, val_int(timeout_));
+	if (rc < 0) {
+		val_throw(alloc_int(-rc));
+		return alloc_null();
+	}
+	
+	value ready = alloc_array(ps->nready * 2);
+	for (int i = 0; i < ps->nready; i++) {
+		int index = ps->ready[i];
+		val_array_set_i (ready, i * 2, alloc_int(index));
+		val_array_set_i (ready, i * 2 + 1, alloc_int(ps->items[index].revents));
+	}
+	return ready;
+}
+
+DEFINE_PRIM (hx_zmq_pollset_construct, 0);
+DEFINE_PRIM (hx_zmq_pollset_add, 3);
+DEFINE_PRIM (hx_zmq_pollset_add_fd, 3);
+DEFINE_PRIM (hx_zmq_pollset_remove, 2);
+DEFINE_PRIM (hx_zmq_pollset_clear, 1);
+DEFINE_PRIM (hx_zmq_pollset_poll, 2);
+
 value hx_zmq_ZMQ_POLL_MSEC()
 {
 #if ZMQ_VERSION >= ZMQ_MAKE_VERSION(3,0,0)
@@ -0,0 +1,117 @@
+/*
+    Copyright (c) Richard Smith 2011
+
+    This file is part of hxzmq.
+
+    0MQ is free software; you can redistribute it and/or modify it under
+    the terms of the Lesser GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    0MQ is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    Lesser GNU General Public License for more details.
+
+    You should have received a copy of the Lesser GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <climits>
+#include <cmath>
+#include <vector>
+#include <zmq.h>
+#include <hx/CFFI.h>
+
+#include "poller.h"
+#include "timer.h"
+#include "interrupt.h"
+
+// Longest time to wait in one poll when no timers are due, in msecs
+#define HX_ZMQ_REACTOR_MAX_WAIT (3600 * 1000)
+
+/**
+ * Runs a reactor over a pollset and a timer queue until a handler returns -1,
+ * or the process is interrupted.
+ * 
+ * The wait loop runs entirely in native code. It calls back into haXe only for
+ * timers that have expired, as timer_fn(id), and then for items that signalled,
+ * as socket_fn(index, revents). If a handler adds or removes pollset items, any
+ * remaining signalled items are left to be reported again by the next poll.
+ * 
+ * Returns 0 if interrupted, -1 if cancelled by a handler.
+ */
+value hx_zmq_reactor_start(value pollset_handle_, value timers_handle_, value socket_fn, value timer_fn) {
+	
+	val_check_kind(pollset_handle_, k_zmq_pollset_handle);
+	val_check_kind(timers_handle_, k_zmq_timers_handle);
+	if (!val_is_function(socket_fn) || !val_is_function(timer_fn)) {
+		val_throw(alloc_int(EINVAL));
+		return alloc_null();
+	}
+	
+	hx_zmq_pollset *ps = (hx_zmq_pollset *)val_data(pollset_handle_);
+	hx_zmq_timers *timers = (hx_zmq_timers *)val_data(timers_handle_);
+	std::vector<int> due_ids;
+	std::vector<double> due_whens;
+	
+	while (true) {
+		// Tickless wait, until the next timer is due
+		double now = hx_zmq_clock_ms ();
+		double next;
+		long timeout = HX_ZMQ_REACTOR_MAX_WAIT;
+		// Rounded up, as waking just before a timer is due would only poll again with a 0 timeout
+		if (timers->next (&next) && next - now < timeout)
+			timeout = next > now ? (long)ceil (next - now) : 0;
+#if ZMQ_VERSION < ZMQ_MAKE_VERSION(3,0,0)
+		// 0MQ 2.x polls in usecs; clamped first, as long may be 32 bits
+		if (timeout > LONG_MAX / 1000)
+			timeout = LONG_MAX / 1000;
+		timeout *= 1000;
+#endif
+		
+		gc_enter_blocking();
+		int rc = hx_zmq_pollset_wait (ps, timeout);
+		int err = zmq_errno();
+		gc_exit_blocking();
+		
+		if (rc == -1 || hx_zmq_is_interrupted ()) {
+			if (rc == -1 && !(err == EINTR && hx_zmq_is_interrupted ())) {
+				val_throw(alloc_int(err));
+				return alloc_null();
+			}
+			return alloc_int(0);
+		}
+		
+		// Take all expired timers off the queue first, so that timers
+		// rescheduled by their handlers wait for the next pass
+		now = hx_zmq_clock_ms ();
+		due_ids.clear ();
+		due_whens.clear ();
+		int id;
+		double when;
+		while (timers->pop_expired (now, &id, &when)) {
+			due_ids.push_back (id);
+			due_whens.push_back (when);
+		}
+		for (size_t i = 0; i < due_ids.size (); i++) {
+			if (val_int (val_call1 (timer_fn, alloc_int (due_ids [i]))) == -1) {
+				// Put back timers not yet handled
+				for (size_t j = i + 1; j < due_ids.size (); j++)
+					timers->add (due_ids [j], due_whens [j]);
+				return alloc_int(-1);
+			}
+		}
+		
+		// Then the signalled pollset items, while the pollset is unchanged
+		unsigned int generation = ps->generation;
+		for (int i = 0; i < ps->nready && ps->generation == generation; i++) {
+			int index = ps->ready [i];
+			if (val_int (val_call2 (socket_fn, alloc_int (index), alloc_int (ps->items [index].revents))) == -1)
+				return alloc_int(-1);
+		}
+	}
+	return alloc_int(0);
+}
+
+DEFINE_PRIM( hx_zmq_reactor_start, 4);
@@ -25,10 +25,17 @@
 
 #include <assert.h>
 #include <cstring>
+#include <cstdlib>
+#include <deque>
+#include <vector>
 #include <zmq.h>
 #include <hx/CFFI.h>
 
 #include "socket.h"
+#include "message.h"
+#include "lock.h"
+#include "prime.h"
+#include "stats.h"
 
 DEFINE_KIND( k_zmq_socket_handle );
 
@@ -36,6 +43,7 @@ DECLARE_KIND( k_zmq_context_handle );
 
 // Finalizer for context
 void finalize_socket( value v) {
+	HXZMQ_STATS_CLOSE(val_data(v));
 	gc_enter_blocking();
 	int ret = zmq_close( val_data(v));
 	gc_exit_blocking();
@@ -61,6 +69,8 @@ value hx_zmq_construct_socket (value context_handle,value type)
 		return alloc_null();
 	}
 	
+	HXZMQ_STATS_OPEN(s);
+	
 	// See: http://nekovm.org/doc/ffi#abstracts_and_kinds
 	value v =  alloc_abstract(k_zmq_socket_handle,s);
 	val_gc(v,finalize_socket);		// finalize_socket is called when the abstract value is garbage collected
@@ -138,21 +148,27 @@ value hx_zmq_setintsockopt(value socket_handle_,value option_, value optval_) {
 		return alloc_null();
 	}
 
-	int rc = 0;
-	int err = 0;
-	int ival = val_int(optval_);
-	int option = val_int(option_);
-	size_t optvallen = sizeof(ival);
-	
-	rc = zmq_setsockopt (val_data(socket_handle_), option, &ival, optvallen);
-    err = zmq_errno();
+	int rc = hx_zmq_prime_setsockopt_int(val_data(socket_handle_), val_int(option_), val_int(optval_));
 	if (rc != 0) {
-		val_throw(alloc_int(err));
+		val_throw(alloc_int(-rc));
 		return alloc_null();
 	}		
 	return alloc_int(rc);
 }
 
+HXZMQ_PRIME_API void *hx_zmq_prime_socket(void *handle) {
+	value v = (value)handle;
+	return val_is_kind(v, k_zmq_socket_handle) ? val_data(v) : NULL;
+}
+
+HXZMQ_PRIME_API int hx_zmq_prime_setsockopt_int(void *socket, int option, int optval) {
+	
+	int rc = zmq_setsockopt (socket, option, &optval, sizeof(optval));
+	if (rc != 0)
+		return -zmq_errno();
+	return 0;
+}
+
 
 value hx_zmq_setint64sockopt(value socket_handle_,value option_, value hi_optval_, value lo_optval_) {
 
@@ -242,19 +258,27 @@ value hx_zmq_getintsockopt(value socket_handle_,value option_) {
 		return alloc_null();
 	}
 
-	int rc = 0;
-	int err = 0;
-	uint64_t optval = 0;
-	size_t optvallen = sizeof(optval);
-	rc = zmq_getsockopt(val_data(socket_handle_),val_int(option_),&optval, &optvallen);
-	err = zmq_errno();
+	int optval = 0;
+	int rc = hx_zmq_prime_getsockopt_int(val_data(socket_handle_), val_int(option_), &optval);
 	if (rc != 0) {
-		val_throw(alloc_int(err));
+		val_throw(alloc_int(-rc));
 		return alloc_int(0);
 	}		
 	return alloc_int(optval);
 }
 
+HXZMQ_PRIME_API int hx_zmq_prime_getsockopt_int(void *socket, int option, int *optval) {
+	
+	// Some "int" options (e.g. ZMQ_RCVMORE in 2.x) are 64 bits wide, so read into a buffer large enough for either
+	uint64_t buf = 0;
+	size_t buflen = sizeof(buf);
+	int rc = zmq_getsockopt(socket, option, &buf, &buflen);
+	if (rc != 0)
+		return -zmq_errno();
+	*optval = (int)buf;
+	return 0;
+}
+
 value hx_zmq_getint64sockopt(value socket_handle_,value option_) {
 
 	val_check_kind(socket_handle_, k_zmq_socket_handle);
@@ -316,6 +340,30 @@ value hx_zmq_getbytessockopt(value socket_handle_,value option_) {
 }
 
 
+/**
+ * Extract byte data from either Neko string or C++ buffer.
+ * Returns false if the value holds neither.
+ * see: http://waxe.googlecode.com/svn-history/r32/trunk/src/waxe/HaxeAPI.cpp "Val2ByteData"
+ */
+bool hx_zmq_bytes_data(value msg_data, uint8_t **data, size_t *size) {
+	if (val_is_string(msg_data))
+	{
+		// Neko
+		*size = val_strlen(msg_data);
+		*data = (uint8_t *)val_string(msg_data);
+		return true;
+	}
+	else if (val_is_buffer(msg_data))
+	{
+		// CPP
+		buffer buf = val_to_buffer(msg_data);
+		*size = buffer_size(buf);
+		*data = (uint8_t *)buffer_data(buf);
+		return true;
+	}
+	return false;
+}
+
 /**
  * Receive data from socket
  * Based on code in  https://github.com/zeromq/jzmq/blob/master/src/Socket.cpp
@@ -332,80 +380,266 @@ value hx_zmq_send(value socket_handle_, value msg_data, value flags) {
 	size_t size = 0;
 	uint8_t *data = 0;
 	
+	if (!hx_zmq_bytes_data(msg_data, &data, &size)) {
+		val_throw(alloc_int(EINVAL));
+		return alloc_null();
+	}
+	
+	int rc = hx_zmq_prime_send(val_data(socket_handle_), data, size, val_int(flags));
+	
+	// If NOBLOCK, but cant send message now, quietly return
+	if (rc < 0 && rc != -EAGAIN) {
+		val_throw(alloc_int(-rc));
+	}
+	return alloc_null();
+}
+
+HXZMQ_PRIME_API int hx_zmq_prime_send(void *socket, const uint8_t *data, size_t size, int flags) {
 	
 	zmq_msg_t message;
+	
+	// Set up send message buffer by copying the provided bytes data
+	int rc = zmq_msg_init_size(&message, size);
+	if (rc != 0)
+		return -zmq_errno();
+	memcpy (zmq_msg_data(&message), data, size);
+	
+	gc_enter_blocking();
+	HXZMQ_STATS_START(t);
+#if ZMQ_VERSION >= ZMQ_MAKE_VERSION(3,0,0)	
+	rc = zmq_sendmsg (socket, &message, flags);
+#else
+	rc = zmq_send (socket, &message, flags);
+#endif
+	int err = zmq_errno();
+	HXZMQ_STATS_SEND(socket, rc == -1 ? 0 : 1, size, rc == -1 ? err : 0, t);
+	gc_exit_blocking();
+	
+	// Close the message whether or not it was sent; the send error takes precedence
+	int rc1 = zmq_msg_close (&message);
+	if (rc == -1)
+		return -err;
+	if (rc1 != 0)
+		return -zmq_errno();
+	return 0;
+}
 
-	// Extract byte data from either Neko string or C++ buffer
-	// see: http://waxe.googlecode.com/svn-history/r32/trunk/src/waxe/HaxeAPI.cpp "Val2ByteData"
-	if (val_is_string(msg_data))
+/*
+ * Zero-copy send support.
+ *
+ * hx_zmq_send_zerocopy hands the haXe byte buffer directly to libzmq via zmq_msg_init_data,
+ * instead of copying it into a new zmq_msg_t.  The buffer value is held in a GC root for as long
+ * as libzmq references it, so the garbage collector cannot reclaim it.
+ *
+ * libzmq calls the free function from one of its own I/O threads, which are not attached
+ * to the haXe GC, so the root cannot be freed there.  Instead the callback moves the pinned
+ * buffer onto a released list, which is drained (and the roots freed) from a haXe thread
+ * on the next zero-copy send, or by an explicit call to hx_zmq_release_zerocopy.
+ */
+struct zerocopy_pin_t {
+	value *root;
+	zerocopy_pin_t *next;
+};
+
+static hx_zmq_mutex zerocopy_mutex;
+static zerocopy_pin_t *zerocopy_released = NULL;
+static int zerocopy_pinned = 0;
+
+// Called by libzmq (possibly on an I/O thread) once it has finished with the message data
+static void zerocopy_free_fn (void *, void *hint) {
+	zerocopy_pin_t *pin = (zerocopy_pin_t *)hint;
+	hx_zmq_scoped_lock lock (zerocopy_mutex);
+	pin->next = zerocopy_released;
+	zerocopy_released = pin;
+}
+
+// Frees GC roots of all buffers released by libzmq. Must be called from a haXe thread.
+static int zerocopy_drain () {
+	zerocopy_pin_t *pin;
 	{
-		// Neko
-		size = val_strlen(msg_data);
-		data = (uint8_t *)val_string(msg_data);
+		hx_zmq_scoped_lock lock (zerocopy_mutex);
+		pin = zerocopy_released;
+		zerocopy_released = NULL;
 	}
-	else if (val_is_buffer(msg_data))
-	{
-		// CPP
-		buffer buf = val_to_buffer(msg_data);
-		size = buffer_size(buf);
-		data = (uint8_t *)buffer_data(buf);
-	} else {
+	int n = 0;
+	while (pin != NULL) {
+		zerocopy_pin_t *next = pin->next;
+		free_root (pin->root);
+		free (pin);
+		pin = next;
+		n++;
+	}
+	if (n > 0) {
+		hx_zmq_scoped_lock lock (zerocopy_mutex);
+		zerocopy_pinned -= n;
+	}
+	return n;
+}
+
+/**
+ * Send data from socket without copying it.
+ * The caller must not modify the sent bytes until libzmq has released them.
+ */
+value hx_zmq_send_zerocopy(value socket_handle_, value msg_data, value flags) {
+	
+	val_check_kind(socket_handle_, k_zmq_socket_handle);
+	
+	if (!val_is_null(flags) && !val_is_int(flags)) {
 		val_throw(alloc_int(EINVAL));
 		return alloc_null();
 	}
-		
 	
-	// Set up send message buffer by referencing the provided bytes data
-    //zero copy version: int rc = zmq_msg_init_data (&message, data, size,NULL,NULL);
-	int rc = zmq_msg_init_size(&message, size);
-	memcpy (zmq_msg_data(&message), data, size);
+	size_t size = 0;
+	uint8_t *data = 0;
+	
+	if (!hx_zmq_bytes_data(msg_data, &data, &size)) {
+		val_throw(alloc_int(EINVAL));
+		return alloc_null();
+	}
+	
+	// Recover roots of any buffers previously released by libzmq
+	zerocopy_drain();
+	
+	// Pin the buffer value for as long as libzmq holds a reference to its data
+	zerocopy_pin_t *pin = (zerocopy_pin_t *)malloc(sizeof(zerocopy_pin_t));
+	if (pin == NULL) {
+		val_throw(alloc_int(ENOMEM));
+		return alloc_null();
+	}
+	pin->root = alloc_root();
+	*(pin->root) = msg_data;
+	pin->next = NULL;
+	{
+		hx_zmq_scoped_lock lock (zerocopy_mutex);
+		zerocopy_pinned++;
+	}
+	
+	zmq_msg_t message;
+	int rc = zmq_msg_init_data (&message, data, size, zerocopy_free_fn, pin);
+	int err = zmq_errno();
+	if (rc != 0) {
+		zerocopy_free_fn (data, pin);
+		zerocopy_drain();
+		val_throw(alloc_int(err));
+		return alloc_null();
+	}
 	
-    int err = zmq_errno();
-    if (rc != 0) {
-        val_throw(alloc_int(err));
-        return alloc_null();
-    }
-
 	gc_enter_blocking();
+	HXZMQ_STATS_START(t);
 	// Send
 #if ZMQ_VERSION >= ZMQ_MAKE_VERSION(3,0,0)	
-    rc = zmq_sendmsg (val_data(socket_handle_), &message, val_int(flags));
+	rc = zmq_sendmsg (val_data(socket_handle_), &message, val_int(flags));
 #else
-    rc = zmq_send (val_data(socket_handle_), &message, val_int(flags));
+	rc = zmq_send (val_data(socket_handle_), &message, val_int(flags));
 #endif
-    err = zmq_errno();
+	err = zmq_errno();
+	HXZMQ_STATS_SEND(val_data(socket_handle_), rc == -1 ? 0 : 1, size, rc == -1 ? err : 0, t);
 	
 	gc_exit_blocking();
 	
-	// If NOBLOCK, but cant send message now, close message first before quitting
-    if (rc == -1 && err == EAGAIN) {
-        rc = zmq_msg_close (&message);
-        err = zmq_errno();
-        if (rc != 0) {
-			val_throw(alloc_int(err));
+	// If the message was not queued, closing it releases the buffer back to us
+	if (rc == -1) {
+		zmq_msg_close (&message);
+		zerocopy_drain();
+		if (err == EAGAIN)
 			return alloc_null();
-        }
-        return alloc_null();
-    }
-    
-    if (rc == -1) {
-        val_throw(alloc_int(err));
-        rc = zmq_msg_close (&message);
-        err = zmq_errno();
-        if (rc != 0) {
-			val_throw(alloc_int(err));
-			return alloc_null();
-        }
-        return alloc_null();
-    }
+		val_throw(alloc_int(err));
+		return alloc_null();
+	}
+	
+	rc = zmq_msg_close (&message);
+	err = zmq_errno();
+	if (rc != 0) {
+		val_throw(alloc_int(err));
+		return alloc_null();
+	}
+	return alloc_null();
+}
 
-    rc = zmq_msg_close (&message);
-    err = zmq_errno();
-    if (rc != 0) {
+/**
+ * Frees GC pins on zero-copy buffers that libzmq has finished with.
+ * Returns the number of buffers still held by libzmq.
+ */
+value hx_zmq_release_zerocopy() {
+	zerocopy_drain();
+	hx_zmq_scoped_lock lock (zerocopy_mutex);
+	return alloc_int(zerocopy_pinned);
+}
+
+/**
+ * Send each element of an array of byte data to socket as a separate message, in a single native call.
+ * Stops at the first message that cannot be queued when DONTWAIT is specified.
+ * Returns the number of messages sent.
+ */
+value hx_zmq_send_batch(value socket_handle_, value msgs_, value flags) {
+	
+	val_check_kind(socket_handle_, k_zmq_socket_handle);
+	
+	if (!val_is_array(msgs_) || (!val_is_null(flags) && !val_is_int(flags))) {
+		val_throw(alloc_int(EINVAL));
+		return alloc_null();
+	}
+	
+	int n = val_array_size(msgs_);
+	if (n == 0)
+		return alloc_int(0);
+	
+	// Copy all message data into 0MQ messages before releasing the GC
+	zmq_msg_t *msgs = new zmq_msg_t [n];
+	for (int i = 0; i < n; i++) {
+		size_t size;
+		uint8_t *data;
+		int err = EINVAL;
+		bool ok = hx_zmq_bytes_data(val_array_i(msgs_, i), &data, &size);
+		if (ok) {
+			ok = (zmq_msg_init_size (&msgs[i], size) == 0);
+			if (ok)
+				memcpy (zmq_msg_data(&msgs[i]), data, size);
+			else
+				err = zmq_errno();
+		}
+		if (!ok) {
+			for (int j = 0; j < i; j++)
+				zmq_msg_close (&msgs[j]);
+			delete [] msgs;
 			val_throw(alloc_int(err));
 			return alloc_null();
-    }
-	return alloc_null();
+		}
+	}
+	
+	void *socket = val_data(socket_handle_);
+	int _flags = val_int(flags);
+	int sent = 0;
+	int err = 0;
+	
+	gc_enter_blocking();
+	HXZMQ_STATS_START(t);
+	size_t bytes = 0;
+	for (; sent < n; sent++) {
+		size_t size = zmq_msg_size (&msgs[sent]);
+#if ZMQ_VERSION >= ZMQ_MAKE_VERSION(3,0,0)	
+		int rc = zmq_sendmsg (socket, &msgs[sent], _flags);
+#else
+		int rc = zmq_send (socket, &msgs[sent], _flags);
+#endif
+		if (rc == -1) {
+			err = zmq_errno();
+			break;
+		}
+		bytes += size;
+	}
+	HXZMQ_STATS_SEND(socket, sent, bytes, err, t);
+	gc_exit_blocking();
+	
+	for (int i = 0; i < n; i++)
+		zmq_msg_close (&msgs[i]);
+	delete [] msgs;
+	
+	if (sent < n && err != EAGAIN) {
+		val_throw(alloc_int(err));
+		return alloc_null();
+	}
+	return alloc_int(sent);
 }
 
 /**
@@ -431,15 +665,17 @@ value hx_zmq_rcv(value socket_handle_, value flags) {
     }
 	
 	gc_enter_blocking();
+	HXZMQ_STATS_START(t);
 	
 #if ZMQ_VERSION >= ZMQ_MAKE_VERSION(3,0,0)	
     rc = zmq_recvmsg (val_data(socket_handle_), &message, val_int(flags));
 #else
     rc = zmq_recv (val_data(socket_handle_), &message, val_int(flags));
 #endif
+    err = zmq_errno();
+	HXZMQ_STATS_RECV(val_data(socket_handle_), rc == -1 ? 0 : 1, zmq_msg_size(&message), rc == -1 ? err : 0, t);
 	gc_exit_blocking();
 
-    err = zmq_errno();
     if (rc == -1 && err == EAGAIN) {
         rc = zmq_msg_close (&message);
         err = zmq_errno();
@@ -477,12 +713,163 @@ value hx_zmq_rcv(value socket_handle_, value flags) {
 	return buffer_val(b);
 }
 
+/**
+ * Receive up to max_ message parts from socket in a single native call.
+ * Only the first receive uses flags (and so may block); further parts are read with
+ * DONTWAIT until the socket has no more waiting, or max_ parts have been read.
+ * A multipart message is never split between batches: once its first part is read, the rest
+ * are read too, even beyond max_ (0MQ delivers all parts of a message together).
+ * Returns an array of (byte data, more flag) pairs, one per part,
+ * or null if DONTWAIT was specified and no message was available.
+ */
+value hx_zmq_recv_batch(value socket_handle_, value max_, value flags) {
+	
+	val_check_kind(socket_handle_, k_zmq_socket_handle);
+	
+	if (!val_is_int(max_) || val_int(max_) <= 0 || (!val_is_null(flags) && !val_is_int(flags))) {
+		val_throw(alloc_int(EINVAL));
+		return alloc_null();
+	}
+	
+	size_t max = val_int(max_);
+	void *socket = val_data(socket_handle_);
+	int _flags = val_int(flags);
+	// Messages are received in place: deque never moves elements added at the end,
+	// and a zmq_msg_t must not be copied
+	std::deque<zmq_msg_t> msgs;
+	std::vector<bool> mores;
+	bool more = false;
+	int err = 0;
+	size_t bytes = 0;
+	
+	gc_enter_blocking();
+	HXZMQ_STATS_START(t);
+	while (msgs.size() < max || more) {
+		msgs.push_back(zmq_msg_t());
+		zmq_msg_t *msg = &msgs.back();
+		zmq_msg_init (msg);
+#if ZMQ_VERSION >= ZMQ_MAKE_VERSION(3,0,0)	
+		int rc = zmq_recvmsg (socket, msg, mores.empty() ? _flags : ZMQ_DONTWAIT);
+#else
+		int rc = zmq_recv (socket, msg, mores.empty() ? _flags : ZMQ_NOBLOCK);
+#endif
+		if (rc == -1) {
+			err = zmq_errno();
+			zmq_msg_close (msg);
+			msgs.pop_back();
+			break;
+		}
+		more = hx_zmq_rcvmore (socket);
+		bytes += zmq_msg_size (msg);
+		mores.push_back(more);
+	}
+	int n = (int)msgs.size();
+	// Running out of messages after the first is how a batch ends, not a failure
+	HXZMQ_STATS_RECV(socket, n, bytes, n == 0 ? err : (err == EAGAIN ? 0 : err), t);
+	gc_exit_blocking();
+	
+	if (n == 0) {
+		if (err == EAGAIN)
+			return alloc_null();
+		val_throw(alloc_int(err));
+		return alloc_null();
+	}
+	
+	// Any error after the first message is left for the next call to report,
+	// so that messages already taken off the socket are not lost
+	value ret = alloc_array(n * 2);
+	for (int i = 0; i < n; i++) {
+		buffer b = alloc_buffer(NULL);
+		buffer_append_sub(b, (char *)zmq_msg_data(&msgs[i]), zmq_msg_size(&msgs[i]));
+		zmq_msg_close (&msgs[i]);
+		val_array_set_i(ret, i * 2, buffer_val(b));
+		val_array_set_i(ret, i * 2 + 1, alloc_bool(mores[i]));
+	}
+	return ret;
+}
+
+/**
+ * Receive data from socket directly into a caller-owned buffer, starting at offset.
+ * Avoids allocating a new buffer per message.
+ * 
+ * As with zmq_recv, returns the full size of the received message, which may be larger
+ * than the space available in the buffer; in that case the message was truncated.
+ * Returns -1 if DONTWAIT was specified and no message was available.
+ */
+value hx_zmq_recv_into(value socket_handle_, value msg_data, value offset_, value flags) {
+	
+	val_check_kind(socket_handle_, k_zmq_socket_handle);
+	
+	if (!val_is_int(offset_) || (!val_is_null(flags) && !val_is_int(flags))) {
+		val_throw(alloc_int(EINVAL));
+		return alloc_null();
+	}
+	
+	size_t size = 0;
+	uint8_t *data = 0;
+	
+	if (!hx_zmq_bytes_data(msg_data, &data, &size)) {
+		val_throw(alloc_int(EINVAL));
+		return alloc_null();
+	}
+	
+	int offset = val_int(offset_);
+	if (offset < 0 || (size_t)offset > size) {
+		val_throw(alloc_int(EINVAL));
+		return alloc_null();
+	}
+	
+	int rc = hx_zmq_prime_recv(val_data(socket_handle_), data + offset, size - offset, val_int(flags));
+	if (rc < 0) {
+		if (rc == -EAGAIN)
+			return alloc_int(-1);
+		val_throw(alloc_int(-rc));
+		return alloc_null();
+	}
+	return alloc_int(rc);
+}
+
+HXZMQ_PRIME_API int hx_zmq_prime_recv(void *socket, uint8_t *data, size_t size, int flags) {
+	
+	gc_enter_blocking();
+	HXZMQ_STATS_START(t);
+#if ZMQ_VERSION >= ZMQ_MAKE_VERSION(3,0,0)	
+	int rc = zmq_recv (socket, data, size, flags);
+	int err = zmq_errno();
+#else
+	// zmq_recv takes a zmq_msg_t in 2.x, so emulate the 3.x buffer semantics
+	zmq_msg_t message;
+	int rc = zmq_msg_init (&message);
+	if (rc == 0) {
+		rc = zmq_recv (socket, &message, flags);
+		if (rc == 0) {
+			size_t sz = zmq_msg_size (&message);
+			memcpy (data, zmq_msg_data (&message), sz < size ? sz : size);
+			rc = (int)sz;
+		}
+	}
+	int err = zmq_errno();
+	zmq_msg_close (&message);
+#endif
+	HXZMQ_STATS_RECV(socket, rc == -1 ? 0 : 1, rc == -1 ? 0 : rc, rc == -1 ? err : 0, t);
+	gc_exit_blocking();
+	
+	if (rc == -1)
+		return -err;
+	return rc;
+}
+
 DEFINE_PRIM( hx_zmq_construct_socket, 2);
 DEFINE_PRIM( hx_zmq_close, 1);
 DEFINE_PRIM( hx_zmq_bind, 2);
 DEFINE_PRIM( hx_zmq_connect, 2);
 DEFINE_PRIM( hx_zmq_send, 3);
+DEFINE_PRIM( hx_zmq_send_zerocopy, 3);
+DEFINE_PRIM( hx_zmq_release_zerocopy, 0);
+DEFINE_PRIM( hx_zmq_send_batch, 3);
 DEFINE_PRIM( hx_zmq_rcv, 2);
+DEFINE_PRIM( hx_zmq_recv_into, 4);
+DEFINE_PRIM( hx_zmq_recv_batch, 3);
 DEFINE_PRIM( hx_zmq_setintsockopt,3);
 DEFINE_PRIM( hx_zmq_setint64sockopt,4);
 DEFINE_PRIM( hx_zmq_setbytessockopt,3);
@@ -0,0 +1,270 @@
+/**
+ * (c) 2011 Richard J Smith
+ *
+ * This file is part of hxzmq
+ *
+ * hxzmq is free software; you can redistribute it and/or modify it under
+ * the terms of the Lesser GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hxzmq is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * Lesser GNU General Public License for more details.
+ *
+ * You should have received a copy of the Lesser GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstring>
+#include <errno.h>
+#include <zmq.h>
+#include <hx/CFFI.h>
+
+#include "socket.h"
+#include "stats.h"
+
+#ifdef HXZMQ_STATS
+
+#if defined(_WIN32)
+#include <windows.h>
+#elif defined(__APPLE__)
+#include <mach/mach_time.h>
+#else
+#include <time.h>
+#endif
+
+/*
+ * Counters are kept in a fixed table of slots, one per open socket, found by hashing the
+ * 0MQ socket pointer. Slots are claimed with compare-and-swap and counters are updated
+ * with atomic adds, so recording never takes a lock. Snapshots read the counters without
+ * synchronisation, so are approximate while other threads are sending or receiving.
+ *
+ * Blocking times go into a log-linear (HDR-style) histogram of nanoseconds: each power of two
+ * is split into 4 linear sub-buckets, so a bucket's bounds are within 25% of any value in it.
+ */
+
+// Number of sockets that can be tracked at once; must be a power of 2.
+// Sockets opened when the table is full are not tracked.
+#define HXZMQ_STATS_SLOTS 256
+
+// Largest power of two given its own buckets (2^40 ns is about 18 minutes)
+#define HXZMQ_STATS_MAX_MAGNITUDE 40
+#define HXZMQ_STATS_BUCKETS ((HXZMQ_STATS_MAX_MAGNITUDE) * 4)
+
+// Counter layout, also the layout of the arrays returned to haXe (followed by the histogram buckets)
+enum {
+	C_MSGS_SENT = 0,
+	C_BYTES_SENT,
+	C_MSGS_RECV,
+	C_BYTES_RECV,
+	C_SEND_AGAIN,
+	C_RECV_AGAIN,
+	C_ERRORS,
+	C_CALLS,
+	C_NSEC,
+	C_COUNT
+};
+
+struct hx_zmq_stats_t {
+	volatile uint64_t counters[C_COUNT];
+	volatile uint64_t buckets[HXZMQ_STATS_BUCKETS];
+};
+
+// Marks a slot whose socket has been closed, so that lookups probe past it
+#define HXZMQ_STATS_TOMBSTONE ((void *)1)
+
+static void * volatile stats_keys[HXZMQ_STATS_SLOTS];
+static hx_zmq_stats_t stats_slots[HXZMQ_STATS_SLOTS];
+
+// Totals folded in from closed sockets
+static hx_zmq_stats_t stats_closed;
+
+// Poll calls; only C_CALLS, C_NSEC and the buckets are used
+static hx_zmq_stats_t stats_polls;
+
+static inline void atomic_add(volatile uint64_t *p, uint64_t v) {
+#ifdef _MSC_VER
+	InterlockedExchangeAdd64((volatile LONGLONG *)p, (LONGLONG)v);
+#else
+	__sync_fetch_and_add(p, v);
+#endif
+}
+
+static inline bool atomic_cas(void * volatile *p, void *expected, void *replacement) {
+#ifdef _MSC_VER
+	return InterlockedCompareExchangePointer((PVOID volatile *)p, replacement, expected) == expected;
+#else
+	return __sync_bool_compare_and_swap(p, expected, replacement);
+#endif
+}
+
+static inline unsigned int stats_hash(void *socket) {
+	return (unsigned int)(((size_t)socket >> 4) * 2654435761u) & (HXZMQ_STATS_SLOTS - 1);
+}
+
+static hx_zmq_stats_t *stats_find(void *socket) {
+	unsigned int h = stats_hash(socket);
+	for (int i = 0; i < HXZMQ_STATS_SLOTS; i++) {
+		unsigned int slot = (h + i) & (HXZMQ_STATS_SLOTS - 1);
+		void *key = stats_keys[slot];
+		if (key == socket)
+			return &stats_slots[slot];
+		if (key == NULL)
+			return NULL;
+	}
+	return NULL;
+}
+
+static int stats_bucket(uint64_t v) {
+	if (v < 4)
+		return (int)v;
+	int m = 2;
+	while (m < HXZMQ_STATS_MAX_MAGNITUDE && (v >> (m + 1)) != 0)
+		m++;
+	if ((v >> (m + 1)) != 0)
+		return HXZMQ_STATS_BUCKETS - 1;
+	return (m - 1) * 4 + (int)((v >> (m - 2)) & 3);
+}
+
+static void stats_add_sample(hx_zmq_stats_t *st, uint64_t elapsed) {
+	atomic_add(&st->counters[C_CALLS], 1);
+	atomic_add(&st->counters[C_NSEC], elapsed);
+	atomic_add(&st->buckets[stats_bucket(elapsed)], 1);
+}
+
+static void stats_fold(hx_zmq_stats_t *into, hx_zmq_stats_t *from) {
+	for (int i = 0; i < C_COUNT; i++)
+		atomic_add(&into->counters[i], from->counters[i]);
+	for (int i = 0; i < HXZMQ_STATS_BUCKETS; i++)
+		atomic_add(&into->buckets[i], from->buckets[i]);
+}
+
+uint64_t hx_zmq_stats_clock() {
+#if defined(_WIN32)
+	static LARGE_INTEGER freq;
+	LARGE_INTEGER now;
+	if (freq.QuadPart == 0)
+		QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&now);
+	return (uint64_t)((double)now.QuadPart * 1000000000.0 / (double)freq.QuadPart);
+#elif defined(__APPLE__)
+	static mach_timebase_info_data_t timebase;
+	if (timebase.denom == 0)
+		mach_timebase_info(&timebase);
+	return mach_absolute_time() * timebase.numer / timebase.denom;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+#endif
+}
+
+void hx_zmq_stats_record(void *socket, int dir, int n, size_t bytes, int err, uint64_t start) {
+	uint64_t elapsed = hx_zmq_stats_clock() - start;
+	hx_zmq_stats_t *st = stats_find(socket);
+	if (st == NULL)
+		return;
+	if (n > 0) {
+		atomic_add(&st->counters[C_MSGS_SENT + dir * 2], n);
+		atomic_add(&st->counters[C_BYTES_SENT + dir * 2], bytes);
+	}
+	if (err == EAGAIN)
+		atomic_add(&st->counters[C_SEND_AGAIN + dir], 1);
+	else if (err != 0)
+		atomic_add(&st->counters[C_ERRORS], 1);
+	stats_add_sample(st, elapsed);
+}
+
+void hx_zmq_stats_poll(uint64_t start) {
+	stats_add_sample(&stats_polls, hx_zmq_stats_clock() - start);
+}
+
+void hx_zmq_stats_open(void *socket) {
+	unsigned int h = stats_hash(socket);
+	for (int i = 0; i < HXZMQ_STATS_SLOTS; i++) {
+		unsigned int slot = (h + i) & (HXZMQ_STATS_SLOTS - 1);
+		void *key = stats_keys[slot];
+		if ((key == NULL || key == HXZMQ_STATS_TOMBSTONE) && atomic_cas(&stats_keys[slot], key, socket)) {
+			// Only the thread that created the socket records against it until it is returned to haXe
+			memset((void *)&stats_slots[slot], 0, sizeof(hx_zmq_stats_t));
+			return;
+		}
+	}
+}
+
+void hx_zmq_stats_close(void *socket) {
+	unsigned int h = stats_hash(socket);
+	for (int i = 0; i < HXZMQ_STATS_SLOTS; i++) {
+		unsigned int slot = (h + i) & (HXZMQ_STATS_SLOTS - 1);
+		void *key = stats_keys[slot];
+		if (key == socket) {
+			stats_fold(&stats_closed, &stats_slots[slot]);
+			stats_keys[slot] = HXZMQ_STATS_TOMBSTONE;
+			return;
+		}
+		if (key == NULL)
+			return;
+	}
+}
+
+static value stats_to_array(hx_zmq_stats_t *st) {
+	value result = alloc_array(C_COUNT + HXZMQ_STATS_BUCKETS);
+	for (int i = 0; i < C_COUNT; i++)
+		val_array_set_i(result, i, alloc_float((double)st->counters[i]));
+	for (int i = 0; i < HXZMQ_STATS_BUCKETS; i++)
+		val_array_set_i(result, C_COUNT + i, alloc_float((double)st->buckets[i]));
+	return result;
+}
+
+#endif
+
+/**
+ * Returns the counters and blocking time histogram for a socket as an array of floats,
+ * or null if stats are not compiled in or the socket is not tracked
+ */
+value hx_zmq_stats_socket(value socket_handle_) {
+	val_check_kind(socket_handle_, k_zmq_socket_handle);
+#ifdef HXZMQ_STATS
+	hx_zmq_stats_t *st = stats_find(val_data(socket_handle_));
+	if (st != NULL)
+		return stats_to_array(st);
+#endif
+	return alloc_null();
+}
+
+/**
+ * Returns the totals across all sockets, open or closed, in the same layout as hx_zmq_stats_socket,
+ * or null if stats are not compiled in
+ */
+value hx_zmq_stats_process() {
+#ifdef HXZMQ_STATS
+	hx_zmq_stats_t total;
+	memcpy(&total, (void *)&stats_closed, sizeof(total));
+	for (int slot = 0; slot < HXZMQ_STATS_SLOTS; slot++) {
+		void *key = stats_keys[slot];
+		if (key != NULL && key != HXZMQ_STATS_TOMBSTONE)
+			stats_fold(&total, &stats_slots[slot]);
+	}
+	return stats_to_array(&total);
+#else
+	return alloc_null();
+#endif
+}
+
+/**
+ * Returns the number of poll calls and their blocking time histogram, in the same layout as
+ * hx_zmq_stats_socket, or null if stats are not compiled in
+ */
+value hx_zmq_stats_polls() {
+#ifdef HXZMQ_STATS
+	return stats_to_array(&stats_polls);
+#else
+	return alloc_null();
+#endif
+}
+
+DEFINE_PRIM( hx_zmq_stats_socket, 1);
+DEFINE_PRIM( hx_zmq_stats_process, 0);
+DEFINE_PRIM( hx_zmq_stats_polls, 0);
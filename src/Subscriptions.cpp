@@ -0,0 +1,486 @@
+/**
+ * (c) 2011 Richard J Smith
+ *
+ * This file is part of hxzmq
+ *
+ * hxzmq is free software; you can redistribute it and/or modify it under
+ * the terms of the Lesser GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hxzmq is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * Lesser GNU General Public License for more details.
+ *
+ * You should have received a copy of the Lesser GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef _MSC_VER
+// Add stdint.hpp header file from zeromq distro to pick up integer types definitions
+#include <stdint.hpp>
+#else
+#include <stdint.h>
+#endif
+
+#include <cstring>
+#include <deque>
+#include <errno.h>
+#include <map>
+#include <string>
+#include <vector>
+#include <zmq.h>
+#include <hx/CFFI.h>
+
+#include "socket.h"
+#include "message.h"
+#include "lock.h"
+#include "subscriptions.h"
+
+/*
+ * Subscription trie and last value cache, for XSUB/XPUB proxies.
+ *
+ * Each node of the trie stands for a byte string, and records the number of subscribe requests
+ * for that string as a prefix, and the last message published with that string as its topic
+ * (first frame). A proxy run with a cache (see hx_zmq_subs_proxy):
+ *
+ *  - forwards a subscription upstream only when the prefix gains its first subscriber, and an
+ *    unsubscription only when it loses its last, so publishers see each prefix once
+ *  - keeps the last message published on each topic, holding copies of the 0MQ messages, which
+ *    share their content with the messages forwarded rather than copying it
+ *  - on every subscribe request, sends the cached messages for all topics under the prefix,
+ *    so a late joiner is brought up to date without waiting for the next publication
+ *
+ * XPUB_VERBOSE is set on the backend where libzmq supports it (3.2 on), so that the proxy sees
+ * every subscribe request rather than just the first for each prefix. XPUB only passes on an
+ * unsubscription once no subscribers remain, so that clears the prefix's count.
+ * The replayed messages go to every subscriber matching the topic, as with any publication.
+ *
+ * A cache made to cache all topics subscribes the frontend to "" when the proxy starts, and
+ * keeps that subscription for the life of the proxy: subscribe and unsubscribe requests for ""
+ * from downstream are counted, but never passed on.
+ *
+ * The cache is locked, so it can be inspected from other threads while the proxy runs.
+ */
+
+struct subs_node {
+	std::map<unsigned char, subs_node *> next;
+	int subs;			// Subscribe requests for this prefix, 0 if not subscribed
+	int nparts;			// Parts of last message with this topic, 0 if none cached
+	zmq_msg_t *last;
+	subs_node() : subs(0), nparts(0), last(NULL) {}
+};
+
+struct hx_zmq_subs {
+	subs_node root;
+	int prefixes;		// Nodes with subscribers
+	int topics;			// Nodes with a cached message
+	bool cache_all;		// Proxy holds its own subscription to ""
+	hx_zmq_mutex mutex;
+};
+
+DEFINE_KIND( k_zmq_subs_handle );
+
+static int recv_part(void *socket, zmq_msg_t *msg) {
+#if ZMQ_VERSION >= ZMQ_MAKE_VERSION(3,0,0)
+	return zmq_recvmsg (socket, msg, 0);
+#else
+	return zmq_recv (socket, msg, 0);
+#endif
+}
+
+// Sends a part, copying it to capture first if set. Returns -1 on error, else 0
+static int send_part(void *socket, zmq_msg_t *msg, int flags, void *capture) {
+	int rc = 0;
+	if (capture != NULL) {
+		zmq_msg_t copy;
+		zmq_msg_init (&copy);
+		rc = zmq_msg_copy (&copy, msg);
+#if ZMQ_VERSION >= ZMQ_MAKE_VERSION(3,0,0)
+		if (rc == 0) rc = zmq_sendmsg (capture, &copy, flags);
+#else
+		if (rc == 0) rc = zmq_send (capture, &copy, flags);
+#endif
+		zmq_msg_close (&copy);
+		if (rc == -1)
+			return -1;
+	}
+#if ZMQ_VERSION >= ZMQ_MAKE_VERSION(3,0,0)
+	rc = zmq_sendmsg (socket, msg, flags);
+#else
+	rc = zmq_send (socket, msg, flags);
+#endif
+	return rc == -1 ? -1 : 0;
+}
+
+static void clear_last(hx_zmq_subs *s, subs_node *node) {
+	if (node->last == NULL)
+		return;
+	for (int i = 0; i < node->nparts; i++)
+		zmq_msg_close (&node->last[i]);
+	delete [] node->last;
+	node->last = NULL;
+	node->nparts = 0;
+	s->topics--;
+}
+
+static void free_nodes(hx_zmq_subs *s, subs_node *node) {
+	std::map<unsigned char, subs_node *>::iterator it;
+	for (it = node->next.begin(); it != node->next.end(); ++it) {
+		free_nodes(s, it->second);
+		delete it->second;
+	}
+	node->next.clear();
+	clear_last(s, node);
+}
+
+// Discards cached messages at and under node, and any nodes left empty.
+// Returns true if node itself is left empty
+static bool clear_cache(hx_zmq_subs *s, subs_node *node) {
+	clear_last(s, node);
+	std::map<unsigned char, subs_node *>::iterator it = node->next.begin();
+	while (it != node->next.end()) {
+		if (clear_cache(s, it->second)) {
+			delete it->second;
+			node->next.erase(it++);
+		} else {
+			++it;
+		}
+	}
+	return node->subs == 0 && node->next.empty();
+}
+
+// Returns the node for a string, creating it and its parents if create is set, else NULL if not found
+static subs_node *find_node(hx_zmq_subs *s, const uint8_t *data, size_t size, bool create) {
+	subs_node *node = &s->root;
+	for (size_t i = 0; i < size; i++) {
+		std::map<unsigned char, subs_node *>::iterator it = node->next.find(data[i]);
+		if (it != node->next.end()) {
+			node = it->second;
+		} else if (create) {
+			subs_node *child = new subs_node;
+			node->next[data[i]] = child;
+			node = child;
+		} else {
+			return NULL;
+		}
+	}
+	return node;
+}
+
+// Removes nodes along the path of a string that no longer hold anything, deepest first
+static void prune(hx_zmq_subs *s, const uint8_t *data, size_t size) {
+	std::vector<subs_node *> path;
+	subs_node *node = &s->root;
+	path.push_back(node);
+	for (size_t i = 0; i < size; i++) {
+		std::map<unsigned char, subs_node *>::iterator it = node->next.find(data[i]);
+		if (it == node->next.end())
+			return;
+		node = it->second;
+		path.push_back(node);
+	}
+	for (size_t i = size; i > 0; i--) {
+		node = path[i];
+		if (node->subs > 0 || node->last != NULL || !node->next.empty())
+			return;
+		path[i - 1]->next.erase(data[i - 1]);
+		delete node;
+	}
+}
+
+// Caches a copy of a published message under its topic
+static int cache_message(hx_zmq_subs *s, std::deque<zmq_msg_t> &parts) {
+	zmq_msg_t *last = new zmq_msg_t [parts.size()];
+	for (size_t i = 0; i < parts.size(); i++) {
+		zmq_msg_init (&last[i]);
+		if (zmq_msg_copy (&last[i], &parts[i]) != 0) {
+			int err = zmq_errno();
+			for (size_t k = 0; k <= i; k++)
+				zmq_msg_close (&last[k]);
+			delete [] last;
+			errno = err;
+			return -1;
+		}
+	}
+	hx_zmq_scoped_lock lock(s->mutex);
+	subs_node *node = find_node(s, (uint8_t *)zmq_msg_data (&parts[0]), zmq_msg_size (&parts[0]), true);
+	clear_last(s, node);
+	node->last = last;
+	node->nparts = (int)parts.size();
+	s->topics++;
+	return 0;
+}
+
+// Sends cached messages for all topics at or under node
+static int replay(subs_node *node, void *socket) {
+	for (int i = 0; i < node->nparts; i++) {
+		zmq_msg_t copy;
+		zmq_msg_init (&copy);
+		int rc = zmq_msg_copy (&copy, &node->last[i]);
+		if (rc == 0) rc = send_part(socket, &copy, i + 1 < node->nparts ? ZMQ_SNDMORE : 0, NULL);
+		zmq_msg_close (&copy);
+		if (rc == -1)
+			return -1;
+	}
+	std::map<unsigned char, subs_node *>::iterator it;
+	for (it = node->next.begin(); it != node->next.end(); ++it) {
+		if (replay(it->second, socket) == -1)
+			return -1;
+	}
+	return 0;
+}
+
+// Moves a published message from the frontend to the backend, caching it on the way
+static int forward_publication(hx_zmq_subs *s, void *from, void *to, void *capture) {
+	// deque never moves elements added at the end, so the messages stay valid
+	std::deque<zmq_msg_t> parts;
+	bool more = true;
+	int rc = 0;
+	while (more && rc != -1) {
+		parts.push_back(zmq_msg_t());
+		zmq_msg_init (&parts.back());
+		rc = recv_part(from, &parts.back());
+		more = rc != -1 && hx_zmq_rcvmore (from);
+	}
+	if (rc != -1)
+		rc = cache_message(s, parts);
+	for (size_t i = 0; i < parts.size(); i++) {
+		if (rc != -1)
+			rc = send_part(to, &parts[i], i + 1 < parts.size() ? ZMQ_SNDMORE : 0, capture);
+		zmq_msg_close (&parts[i]);
+	}
+	return rc == -1 ? -1 : 0;
+}
+
+// Moves a subscription message from the backend to the frontend, updating the trie and
+// replaying cached messages to a new subscriber. Only the first subscription and last
+// unsubscription for each prefix are passed on. The subscription is passed on before the
+// replay, so that a failed replay cannot leave a prefix counted but never subscribed upstream.
+static int forward_subscription(hx_zmq_subs *s, void *from, void *to, void *capture) {
+	zmq_msg_t msg;
+	zmq_msg_init (&msg);
+	if (recv_part(from, &msg) == -1) {
+		zmq_msg_close (&msg);
+		return -1;
+	}
+	bool more = hx_zmq_rcvmore (from);
+	uint8_t *data = (uint8_t *)zmq_msg_data (&msg);
+	size_t size = zmq_msg_size (&msg);
+	bool pass = true;
+	bool subscribe = false;
+	std::string prefix;
+	int rc = 0;
+	if (!more && size > 0 && (data[0] == 0 || data[0] == 1)) {
+		hx_zmq_scoped_lock lock(s->mutex);
+		if (data[0] == 1) {
+			subs_node *node = find_node(s, data + 1, size - 1, true);
+			if (node->subs++ == 0)
+				s->prefixes++;
+			else
+				pass = false;
+			subscribe = true;
+			prefix.assign((const char *)data + 1, size - 1);
+		} else {
+			subs_node *node = find_node(s, data + 1, size - 1, false);
+			pass = node != NULL && node->subs > 0;
+			if (pass) {
+				node->subs = 0;
+				s->prefixes--;
+				prune(s, data + 1, size - 1);
+			}
+		}
+		// The proxy's own subscription to "" must outlive those of its subscribers
+		if (s->cache_all && size == 1)
+			pass = false;
+	}
+	// Anything else sent upstream passes through whole
+	while (true) {
+		if (pass)
+			rc = send_part(to, &msg, more ? ZMQ_SNDMORE : 0, capture);
+		zmq_msg_close (&msg);
+		if (rc == -1 || !more)
+			break;
+		zmq_msg_init (&msg);
+		rc = recv_part(from, &msg);
+		if (rc == -1) {
+			zmq_msg_close (&msg);
+			break;
+		}
+		more = hx_zmq_rcvmore (from);
+	}
+	if (rc != -1 && subscribe) {
+		// Only the proxy thread unsubscribes, so the node is still there
+		hx_zmq_scoped_lock lock(s->mutex);
+		subs_node *node = find_node(s, (const uint8_t *)prefix.data(), prefix.size(), false);
+		if (node != NULL)
+			rc = replay(node, from);
+	}
+	return rc == -1 ? -1 : 0;
+}
+
+int hx_zmq_subs_proxy(hx_zmq_subs *subs, void *frontend, void *backend, void *capture) {
+#ifdef ZMQ_XPUB_VERBOSE
+	int verbose = 1;
+	zmq_setsockopt (backend, ZMQ_XPUB_VERBOSE, &verbose, sizeof (verbose));
+#endif
+	if (subs->cache_all) {
+		zmq_msg_t msg;
+		if (zmq_msg_init_size (&msg, 1) == -1)
+			return -1;
+		*(uint8_t *)zmq_msg_data (&msg) = 1;
+		int rc = send_part(frontend, &msg, 0, NULL);
+		zmq_msg_close (&msg);
+		if (rc == -1)
+			return -1;
+	}
+	zmq_pollitem_t items [] = {
+		{ frontend, 0, ZMQ_POLLIN, 0 },
+		{ backend, 0, ZMQ_POLLIN, 0 }
+	};
+	while (true) {
+		if (zmq_poll (items, 2, -1) == -1)
+			return -1;
+		if ((items [0].revents & ZMQ_POLLIN) && forward_publication (subs, frontend, backend, capture) == -1)
+			return -1;
+		if ((items [1].revents & ZMQ_POLLIN) && forward_subscription (subs, backend, frontend, capture) == -1)
+			return -1;
+	}
+}
+
+// Finalizer for subscription caches. Cached messages are released
+void finalize_subs( value v) {
+	hx_zmq_subs *s = (hx_zmq_subs *)val_data(v);
+	free_nodes(s, &s->root);
+	delete s;
+}
+
+/**
+ * Creates a new, empty subscription cache. If cache_all is true, a proxy run with it
+ * subscribes upstream to every topic, so that all topics are cached.
+ */
+value hx_zmq_subs_construct(value cache_all_) {
+	if (!val_is_bool(cache_all_)) {
+		val_throw(alloc_int(EINVAL));
+		return alloc_null();
+	}
+	hx_zmq_subs *s = new hx_zmq_subs;
+	s->prefixes = 0;
+	s->topics = 0;
+	s->cache_all = val_bool(cache_all_);
+	value v = alloc_abstract(k_zmq_subs_handle, s);
+	val_gc(v, finalize_subs);		// finalize_subs is called when the abstract value is garbage collected
+	return v;
+}
+
+/**
+ * Returns the number of subscribe requests held for a prefix
+ */
+value hx_zmq_subs_count(value subs_handle_, value prefix_) {
+	val_check_kind(subs_handle_, k_zmq_subs_handle);
+	hx_zmq_subs *s = (hx_zmq_subs *)val_data(subs_handle_);
+	uint8_t *data = 0;
+	size_t size = 0;
+	if (!hx_zmq_bytes_data(prefix_, &data, &size)) {
+		val_throw(alloc_int(EINVAL));
+		return alloc_null();
+	}
+	hx_zmq_scoped_lock lock(s->mutex);
+	subs_node *node = find_node(s, data, size, false);
+	return alloc_int(node == NULL ? 0 : node->subs);
+}
+
+/**
+ * Returns true if a message with this topic would reach a subscriber:
+ * that is, if any subscribed prefix is a prefix of topic
+ */
+value hx_zmq_subs_matches(value subs_handle_, value topic_) {
+	val_check_kind(subs_handle_, k_zmq_subs_handle);
+	hx_zmq_subs *s = (hx_zmq_subs *)val_data(subs_handle_);
+	uint8_t *data = 0;
+	size_t size = 0;
+	if (!hx_zmq_bytes_data(topic_, &data, &size)) {
+		val_throw(alloc_int(EINVAL));
+		return alloc_null();
+	}
+	hx_zmq_scoped_lock lock(s->mutex);
+	subs_node *node = &s->root;
+	for (size_t i = 0; node->subs == 0 && i < size; i++) {
+		std::map<unsigned char, subs_node *>::iterator it = node->next.find(data[i]);
+		if (it == node->next.end())
+			return alloc_bool(false);
+		node = it->second;
+	}
+	return alloc_bool(node->subs > 0);
+}
+
+/**
+ * Returns the number of prefixes subscribed to
+ */
+value hx_zmq_subs_prefixes(value subs_handle_) {
+	val_check_kind(subs_handle_, k_zmq_subs_handle);
+	hx_zmq_subs *s = (hx_zmq_subs *)val_data(subs_handle_);
+	hx_zmq_scoped_lock lock(s->mutex);
+	return alloc_int(s->prefixes);
+}
+
+/**
+ * Returns the number of topics with a cached message
+ */
+value hx_zmq_subs_topics(value subs_handle_) {
+	val_check_kind(subs_handle_, k_zmq_subs_handle);
+	hx_zmq_subs *s = (hx_zmq_subs *)val_data(subs_handle_);
+	hx_zmq_scoped_lock lock(s->mutex);
+	return alloc_int(s->topics);
+}
+
+/**
+ * Returns the last message published on a topic, as an array of native message handles,
+ * or null if none is cached
+ */
+value hx_zmq_subs_last(value subs_handle_, value topic_) {
+	val_check_kind(subs_handle_, k_zmq_subs_handle);
+	hx_zmq_subs *s = (hx_zmq_subs *)val_data(subs_handle_);
+	uint8_t *data = 0;
+	size_t size = 0;
+	if (!hx_zmq_bytes_data(topic_, &data, &size)) {
+		val_throw(alloc_int(EINVAL));
+		return alloc_null();
+	}
+	std::vector<zmq_msg_t> copies;
+	{
+		hx_zmq_scoped_lock lock(s->mutex);
+		subs_node *node = find_node(s, data, size, false);
+		if (node == NULL || node->last == NULL)
+			return alloc_null();
+		copies.resize(node->nparts);
+		for (int i = 0; i < node->nparts; i++) {
+			zmq_msg_init (&copies[i]);
+			zmq_msg_copy (&copies[i], &node->last[i]);
+		}
+	}
+	value ret = alloc_array((int)copies.size());
+	for (size_t i = 0; i < copies.size(); i++)
+		val_array_set_i(ret, (int)i, hx_zmq_alloc_msg_handle(&copies[i], i + 1 < copies.size()));
+	return ret;
+}
+
+/**
+ * Discards all cached messages. Subscriptions are kept.
+ */
+value hx_zmq_subs_clear(value subs_handle_) {
+	val_check_kind(subs_handle_, k_zmq_subs_handle);
+	hx_zmq_subs *s = (hx_zmq_subs *)val_data(subs_handle_);
+	hx_zmq_scoped_lock lock(s->mutex);
+	clear_cache(s, &s->root);
+	return alloc_null();
+}
+
+DEFINE_PRIM( hx_zmq_subs_construct, 1);
+DEFINE_PRIM( hx_zmq_subs_count, 2);
+DEFINE_PRIM( hx_zmq_subs_matches, 2);
+DEFINE_PRIM( hx_zmq_subs_prefixes, 1);
+DEFINE_PRIM( hx_zmq_subs_topics, 1);
+DEFINE_PRIM( hx_zmq_subs_last, 2);
+DEFINE_PRIM( hx_zmq_subs_clear, 1);
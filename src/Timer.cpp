@@ -0,0 +1,225 @@
+/*
+    Copyright (c) Richard Smith 2011
+
+    This file is part of hxzmq.
+
+    0MQ is free software; you can redistribute it and/or modify it under
+    the terms of the Lesser GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    0MQ is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    Lesser GNU General Public License for more details.
+
+    You should have received a copy of the Lesser GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#if defined (_WIN32)
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+#include <hx/CFFI.h>
+
+#include "timer.h"
+
+double hx_zmq_clock_ms () {
+	// Monotonic, so that a step in the wall clock neither fires nor stalls timers
+#if defined (_WIN32)
+	return (double)GetTickCount64 ();
+#else
+	struct timespec ts;
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+#endif
+}
+
+void hx_zmq_timers::place (size_t pos, const entry &e) {
+	heap [pos] = e;
+	positions [e.id] = pos;
+}
+
+void hx_zmq_timers::sift_up (size_t pos) {
+	entry e = heap [pos];
+	while (pos > 0) {
+		size_t parent = (pos - 1) / 2;
+		if (!before (e, heap [parent]))
+			break;
+		place (pos, heap [parent]);
+		pos = parent;
+	}
+	place (pos, e);
+}
+
+void hx_zmq_timers::sift_down (size_t pos) {
+	entry e = heap [pos];
+	size_t n = heap.size ();
+	while (true) {
+		size_t child = pos * 2 + 1;
+		if (child >= n)
+			break;
+		if (child + 1 < n && before (heap [child + 1], heap [child]))
+			child++;
+		if (!before (heap [child], e))
+			break;
+		place (pos, heap [child]);
+		pos = child;
+	}
+	place (pos, e);
+}
+
+void hx_zmq_timers::remove_at (size_t pos) {
+	positions.erase (heap [pos].id);
+	entry last = heap.back ();
+	heap.pop_back ();
+	if (pos < heap.size ()) {
+		place (pos, last);
+		sift_up (pos);
+		sift_down (positions [last.id]);
+	}
+}
+
+void hx_zmq_timers::add (int id, double when) {
+	std::map<int, size_t>::iterator it = positions.find (id);
+	if (it != positions.end ())
+		remove_at (it->second);
+	entry e;
+	e.when = when;
+	e.seq = seq++;
+	e.id = id;
+	heap.push_back (e);
+	sift_up (heap.size () - 1);
+}
+
+bool hx_zmq_timers::cancel (int id) {
+	std::map<int, size_t>::iterator it = positions.find (id);
+	if (it == positions.end ())
+		return false;
+	remove_at (it->second);
+	return true;
+}
+
+bool hx_zmq_timers::next (double *when) const {
+	if (heap.empty ())
+		return false;
+	*when = heap [0].when;
+	return true;
+}
+
+bool hx_zmq_timers::pop_expired (double now, int *id, double *when) {
+	if (heap.empty () || heap [0].when > now)
+		return false;
+	*id = heap [0].id;
+	*when = heap [0].when;
+	remove_at (0);
+	return true;
+}
+
+DEFINE_KIND( k_zmq_timers_handle );
+
+// Finalizer for timer queues
+void finalize_timers( value v) {
+	delete (hx_zmq_timers *)val_data(v);
+}
+
+/**
+ * Creates a new, empty timer queue
+ */
+value hx_zmq_timers_construct() {
+	value v = alloc_abstract(k_zmq_timers_handle, new hx_zmq_timers ());
+	val_gc(v, finalize_timers);		// finalize_timers is called when the abstract value is garbage collected
+	return v;
+}
+
+/**
+ * Schedules timer id to expire at when (msecs), replacing any existing deadline for it
+ */
+value hx_zmq_timers_add(value timers_handle_, value id_, value when_) {
+	
+	val_check_kind(timers_handle_, k_zmq_timers_handle);
+	if (!val_is_int(id_) || !val_is_number(when_)) {
+		val_throw(alloc_int(EINVAL));
+		return alloc_null();
+	}
+	((hx_zmq_timers *)val_data(timers_handle_))->add (val_int(id_), val_number(when_));
+	return alloc_null();
+}
+
+/**
+ * Cancels timer id. Returns false if it was not scheduled
+ */
+value hx_zmq_timers_cancel(value timers_handle_, value id_) {
+	
+	val_check_kind(timers_handle_, k_zmq_timers_handle);
+	if (!val_is_int(id_)) {
+		val_throw(alloc_int(EINVAL));
+		return alloc_null();
+	}
+	return alloc_bool(((hx_zmq_timers *)val_data(timers_handle_))->cancel (val_int(id_)));
+}
+
+/**
+ * Returns the earliest scheduled deadline (msecs), or null if no timers are scheduled
+ */
+value hx_zmq_timers_next(value timers_handle_) {
+	
+	val_check_kind(timers_handle_, k_zmq_timers_handle);
+	double when;
+	if (!((hx_zmq_timers *)val_data(timers_handle_))->next (&when))
+		return alloc_null();
+	return alloc_float(when);
+}
+
+/**
+ * Removes all timers due at or before now (msecs).
+ * Returns an array of their ids, in deadline order
+ */
+value hx_zmq_timers_expired(value timers_handle_, value now_) {
+	
+	val_check_kind(timers_handle_, k_zmq_timers_handle);
+	if (!val_is_number(now_)) {
+		val_throw(alloc_int(EINVAL));
+		return alloc_null();
+	}
+	hx_zmq_timers *timers = (hx_zmq_timers *)val_data(timers_handle_);
+	double now = val_number(now_);
+	
+	std::vector<int> ids;
+	int id;
+	double when;
+	while (timers->pop_expired (now, &id, &when))
+		ids.push_back (id);
+	
+	value ret = alloc_array(ids.size());
+	for (size_t i = 0; i < ids.size(); i++) {
+		val_array_set_i(ret, i, alloc_int(ids[i]));
+	}
+	return ret;
+}
+
+/**
+ * Returns the current time, in milliseconds, on the same clock as the native reactor
+ */
+value hx_zmq_timers_now() {
+	return alloc_float(hx_zmq_clock_ms ());
+}
+
+/**
+ * Returns the number of scheduled timers
+ */
+value hx_zmq_timers_size(value timers_handle_) {
+	
+	val_check_kind(timers_handle_, k_zmq_timers_handle);
+	return alloc_int(((hx_zmq_timers *)val_data(timers_handle_))->size ());
+}
+
+DEFINE_PRIM( hx_zmq_timers_construct, 0);
+DEFINE_PRIM( hx_zmq_timers_add, 3);
+DEFINE_PRIM( hx_zmq_timers_cancel, 2);
+DEFINE_PRIM( hx_zmq_timers_next, 1);
+DEFINE_PRIM( hx_zmq_timers_expired, 2);
+DEFINE_PRIM( hx_zmq_timers_size, 1);
+DEFINE_PRIM( hx_zmq_timers_now, 0);
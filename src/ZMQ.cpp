@@ -319,6 +319,69 @@ value hx_zmq_ZMQ_TYPE()
 }
 DEFINE_PRIM( hx_zmq_ZMQ_TYPE,0);
 
+/* ******* CONTEXT OPTIONS **********/
+// Return -1 where the libzmq built against does not support the option
+
+value hx_zmq_ZMQ_IO_THREADS()
+{
+#ifdef ZMQ_IO_THREADS
+	return alloc_int(ZMQ_IO_THREADS);
+#else
+	return alloc_int(-1);
+#endif
+}
+DEFINE_PRIM( hx_zmq_ZMQ_IO_THREADS,0);
+
+value hx_zmq_ZMQ_MAX_SOCKETS()
+{
+#ifdef ZMQ_MAX_SOCKETS
+	return alloc_int(ZMQ_MAX_SOCKETS);
+#else
+	return alloc_int(-1);
+#endif
+}
+DEFINE_PRIM( hx_zmq_ZMQ_MAX_SOCKETS,0);
+
+value hx_zmq_ZMQ_THREAD_PRIORITY()
+{
+#ifdef ZMQ_THREAD_PRIORITY
+	return alloc_int(ZMQ_THREAD_PRIORITY);
+#else
+	return alloc_int(-1);
+#endif
+}
+DEFINE_PRIM( hx_zmq_ZMQ_THREAD_PRIORITY,0);
+
+value hx_zmq_ZMQ_THREAD_SCHED_POLICY()
+{
+#ifdef ZMQ_THREAD_SCHED_POLICY
+	return alloc_int(ZMQ_THREAD_SCHED_POLICY);
+#else
+	return alloc_int(-1);
+#endif
+}
+DEFINE_PRIM( hx_zmq_ZMQ_THREAD_SCHED_POLICY,0);
+
+value hx_zmq_ZMQ_THREAD_AFFINITY_CPU_ADD()
+{
+#ifdef ZMQ_THREAD_AFFINITY_CPU_ADD
+	return alloc_int(ZMQ_THREAD_AFFINITY_CPU_ADD);
+#else
+	return alloc_int(-1);
+#endif
+}
+DEFINE_PRIM( hx_zmq_ZMQ_THREAD_AFFINITY_CPU_ADD,0);
+
+value hx_zmq_ZMQ_THREAD_AFFINITY_CPU_REMOVE()
+{
+#ifdef ZMQ_THREAD_AFFINITY_CPU_REMOVE
+	return alloc_int(ZMQ_THREAD_AFFINITY_CPU_REMOVE);
+#else
+	return alloc_int(-1);
+#endif
+}
+DEFINE_PRIM( hx_zmq_ZMQ_THREAD_AFFINITY_CPU_REMOVE,0);
+
 /* ******* POLLER OPTIONS **********/
 value hx_zmq_ZMQ_POLLIN()
 {
@@ -0,0 +1,63 @@
+/*
+    Copyright (c) Richard Smith 2011
+
+    This file is part of hxzmq.
+
+    0MQ is free software; you can redistribute it and/or modify it under
+    the terms of the Lesser GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    0MQ is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    Lesser GNU General Public License for more details.
+
+    You should have received a copy of the Lesser GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef HXZMQ_LOCK_H
+#define HXZMQ_LOCK_H
+
+// Minimal portable mutex, used to protect native state that is touched
+// from both haXe threads and libzmq's own I/O threads.
+
+#if defined (_WIN32)
+#include <windows.h>
+
+class hx_zmq_mutex {
+public:
+	hx_zmq_mutex () { InitializeCriticalSection (&cs); }
+	~hx_zmq_mutex () { DeleteCriticalSection (&cs); }
+	void lock () { EnterCriticalSection (&cs); }
+	void unlock () { LeaveCriticalSection (&cs); }
+private:
+	CRITICAL_SECTION cs;
+};
+
+#else
+#include <pthread.h>
+
+class hx_zmq_mutex {
+public:
+	hx_zmq_mutex () { pthread_mutex_init (&mutex, NULL); }
+	~hx_zmq_mutex () { pthread_mutex_destroy (&mutex); }
+	void lock () { pthread_mutex_lock (&mutex); }
+	void unlock () { pthread_mutex_unlock (&mutex); }
+private:
+	pthread_mutex_t mutex;
+};
+
+#endif
+
+// Scoped lock helper
+class hx_zmq_scoped_lock {
+public:
+	hx_zmq_scoped_lock (hx_zmq_mutex &m) : m(m) { m.lock (); }
+	~hx_zmq_scoped_lock () { m.unlock (); }
+private:
+	hx_zmq_mutex &m;
+};
+
+#endif
@@ -0,0 +1,48 @@
+/**
+ * (c) 2011 Richard J Smith
+ *
+ * This file is part of hxzmq
+ *
+ * hxzmq is free software; you can redistribute it and/or modify it under
+ * the terms of the Lesser GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hxzmq is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * Lesser GNU General Public License for more details.
+ *
+ * You should have received a copy of the Lesser GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+ 
+#ifndef HXZMQ_MESSAGE_H
+#define HXZMQ_MESSAGE_H
+
+#include <hx/CFFI.h>
+#include <zmq.h>
+
+// Define a Kind type name for ZMQ message handles, which are opaque to the Haxe layer
+DECLARE_KIND(k_zmq_msg_handle);
+
+// Live 0MQ message held by a k_zmq_msg_handle abstract.
+// open is false once the message has been closed or sent.
+// more records the socket's RCVMORE state when the message was received.
+struct hx_zmq_msg {
+	zmq_msg_t msg;
+	bool open;
+	bool more;
+};
+
+// Wraps an initialised 0MQ message in a new k_zmq_msg_handle abstract, moving its content and closing it
+value hx_zmq_alloc_msg_handle(zmq_msg_t *msg, bool more);
+
+// Wraps an open, heap-allocated hx_zmq_msg in a new k_zmq_msg_handle abstract, taking ownership of it
+value hx_zmq_wrap_msg(hx_zmq_msg *m);
+
+// Returns true if more message parts follow the last part received on the socket
+bool hx_zmq_rcvmore(void *socket);
+
+#endif
@@ -0,0 +1,47 @@
+/**
+ * (c) 2011 Richard J Smith
+ *
+ * This file is part of hxzmq
+ *
+ * hxzmq is free software; you can redistribute it and/or modify it under
+ * the terms of the Lesser GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hxzmq is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * Lesser GNU General Public License for more details.
+ *
+ * You should have received a copy of the Lesser GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+ 
+#ifndef HXZMQ_POLLER_H
+#define HXZMQ_POLLER_H
+
+#include <hx/CFFI.h>
+#include <zmq.h>
+
+// Define a Kind type name for native pollsets, which are opaque to the Haxe layer
+DECLARE_KIND(k_zmq_pollset_handle);
+
+// Persistent set of 0MQ poll items held by a k_zmq_pollset_handle abstract.
+// items is grown as needed and reused across polls.
+// ready holds the indices of items signalled by the last poll.
+// generation changes whenever items are added or removed.
+struct hx_zmq_pollset {
+	zmq_pollitem_t *items;
+	int *ready;
+	int size;
+	int capacity;
+	int nready;
+	unsigned int generation;
+};
+
+// Polls all items in the pollset, filling its ready list. Must be called with the GC released.
+// Returns the number of ready items, or -1 on error (with errno set)
+int hx_zmq_pollset_wait(hx_zmq_pollset *ps, long timeout);
+
+#endif
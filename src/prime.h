@@ -0,0 +1,74 @@
+/**
+ * (c) 2011 Richard J Smith
+ *
+ * This file is part of hxzmq
+ *
+ * hxzmq is free software; you can redistribute it and/or modify it under
+ * the terms of the Lesser GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hxzmq is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * Lesser GNU General Public License for more details.
+ *
+ * You should have received a copy of the Lesser GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef HXZMQ_PRIME_H
+#define HXZMQ_PRIME_H
+
+#include <stddef.h>
+
+#ifdef _MSC_VER
+#include <stdint.hpp>
+#else
+#include <stdint.h>
+#endif
+
+struct hx_zmq_pollset;
+
+// Typed entry points for the hot primitives, taking native ints and raw byte pointers
+// rather than boxed values. The DEFINE_PRIM functions unbox their arguments and call these,
+// and hxcpp applications linking the hxzmq-static library (see build.xml) and compiled with
+// -D hxzmq_static call them directly from ZMQSocket and ZMQPoller.
+// Each releases the GC around any libzmq call that may block.
+// All return a negative errno on failure.
+#ifdef _WIN32
+#define HXZMQ_PRIME_API extern "C" __declspec(dllexport)
+#else
+#define HXZMQ_PRIME_API extern "C" __attribute__((visibility("default")))
+#endif
+
+// Sends size bytes from data as one message. Returns 0 when sent, or -EAGAIN if DONTWAIT was specified
+// and the message could not be queued
+HXZMQ_PRIME_API int hx_zmq_prime_send(void *socket, const uint8_t *data, size_t size, int flags);
+
+// Receives one message into data, truncating it to size bytes. Returns the full message size,
+// or -EAGAIN if DONTWAIT was specified and no message was available
+HXZMQ_PRIME_API int hx_zmq_prime_recv(void *socket, uint8_t *data, size_t size, int flags);
+
+// Polls the pollset, filling its ready list. Returns the number of ready items,
+// or -errno on error (-ENOTSUP if ps is NULL)
+HXZMQ_PRIME_API int hx_zmq_prime_poll(hx_zmq_pollset *ps, long timeout);
+
+// Returns the k'th ready item's index from the last poll, and stores its events in *revents.
+// Returns -1 if ps is NULL or k is not below the last poll's ready count
+HXZMQ_PRIME_API int hx_zmq_prime_ready(hx_zmq_pollset *ps, int k, int *revents);
+
+// Return the native socket or pollset held by a handle (the hxcpp object, Dynamic.mPtr, of a
+// haXe handle field), or NULL if handle is not one. Handles are resolved on each call, so the
+// GC remains free to move them
+HXZMQ_PRIME_API void *hx_zmq_prime_socket(void *handle);
+HXZMQ_PRIME_API hx_zmq_pollset *hx_zmq_prime_pollset(void *handle);
+
+// Sets an int socket option
+HXZMQ_PRIME_API int hx_zmq_prime_setsockopt_int(void *socket, int option, int optval);
+
+// Reads an int socket option into optval
+HXZMQ_PRIME_API int hx_zmq_prime_getsockopt_int(void *socket, int option, int *optval);
+
+#endif
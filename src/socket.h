@@ -22,3 +22,6 @@
 
 // Define a Kind type name for ZMQ socket handles, which are opaque to the Haxe layer
 DECLARE_KIND(k_zmq_socket_handle);
+
+// Extracts byte data from either a Neko string or C++ buffer value. Returns false if the value holds neither.
+bool hx_zmq_bytes_data(value msg_data, uint8_t **data, size_t *size);
@@ -0,0 +1,76 @@
+/**
+ * (c) 2011 Richard J Smith
+ *
+ * This file is part of hxzmq
+ *
+ * hxzmq is free software; you can redistribute it and/or modify it under
+ * the terms of the Lesser GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hxzmq is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * Lesser GNU General Public License for more details.
+ *
+ * You should have received a copy of the Lesser GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef HXZMQ_STATS_H
+#define HXZMQ_STATS_H
+
+// Optional traffic counters and blocking-time histograms, kept per socket and process-wide.
+// Compiled in only when HXZMQ_STATS is defined (see build.xml); otherwise the macros below expand to nothing.
+
+#ifdef HXZMQ_STATS
+
+#ifdef _MSC_VER
+#include <stdint.hpp>
+#else
+#include <stdint.h>
+#endif
+#include <stddef.h>
+
+enum {
+	HXZMQ_STATS_TX = 0,
+	HXZMQ_STATS_RX = 1
+};
+
+// Starts timing a blocking section
+#define HXZMQ_STATS_START(t) uint64_t t = hx_zmq_stats_clock()
+
+// Records n messages of bytes total sent on socket, a failure with errno err if non-zero, and the time since t
+#define HXZMQ_STATS_SEND(socket, n, bytes, err, t) hx_zmq_stats_record(socket, HXZMQ_STATS_TX, n, bytes, err, t)
+
+// As HXZMQ_STATS_SEND, for messages received
+#define HXZMQ_STATS_RECV(socket, n, bytes, err, t) hx_zmq_stats_record(socket, HXZMQ_STATS_RX, n, bytes, err, t)
+
+// Records a poll call started at t
+#define HXZMQ_STATS_POLL(t) hx_zmq_stats_poll(t)
+
+// Starts and stops tracking a socket
+#define HXZMQ_STATS_OPEN(socket) hx_zmq_stats_open(socket)
+#define HXZMQ_STATS_CLOSE(socket) hx_zmq_stats_close(socket)
+
+// Monotonic clock, in nanoseconds
+uint64_t hx_zmq_stats_clock();
+
+void hx_zmq_stats_record(void *socket, int dir, int n, size_t bytes, int err, uint64_t start);
+void hx_zmq_stats_poll(uint64_t start);
+void hx_zmq_stats_open(void *socket);
+void hx_zmq_stats_close(void *socket);
+
+#else
+
+#define HXZMQ_STATS_START(t)
+#define HXZMQ_STATS_SEND(socket, n, bytes, err, t) ((void)0)
+#define HXZMQ_STATS_RECV(socket, n, bytes, err, t) ((void)0)
+#define HXZMQ_STATS_POLL(t) ((void)0)
+#define HXZMQ_STATS_OPEN(socket) ((void)0)
+#define HXZMQ_STATS_CLOSE(socket) ((void)0)
+
+#endif
+
+#endif
@@ -0,0 +1,34 @@
+/*
+    Copyright (c) Richard Smith 2011
+
+    This file is part of hxzmq.
+
+    0MQ is free software; you can redistribute it and/or modify it under
+    the terms of the Lesser GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    0MQ is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    Lesser GNU General Public License for more details.
+
+    You should have received a copy of the Lesser GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+ 
+#ifndef HXZMQ_SUBSCRIPTIONS_H
+#define HXZMQ_SUBSCRIPTIONS_H
+
+#include <hx/CFFI.h>
+
+// Define a Kind type name for subscription caches, which are opaque to the Haxe layer
+DECLARE_KIND(k_zmq_subs_handle);
+
+struct hx_zmq_subs;
+
+// Runs a caching proxy between an XSUB frontend and an XPUB backend until an error occurs.
+// Returns -1, with errno set (ETERM when the context is terminated)
+int hx_zmq_subs_proxy(hx_zmq_subs *subs, void *frontend, void *backend, void *capture);
+
+#endif
@@ -0,0 +1,72 @@
+/**
+ * (c) 2011 Richard J Smith
+ *
+ * This file is part of hxzmq
+ *
+ * hxzmq is free software; you can redistribute it and/or modify it under
+ * the terms of the Lesser GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hxzmq is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * Lesser GNU General Public License for more details.
+ *
+ * You should have received a copy of the Lesser GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+ 
+#ifndef HXZMQ_TIMER_H
+#define HXZMQ_TIMER_H
+
+#include <cstddef>
+#include <map>
+#include <vector>
+#include <hx/CFFI.h>
+
+// Define a Kind type name for native timer queues, which are opaque to the Haxe layer
+DECLARE_KIND(k_zmq_timers_handle);
+
+// Binary min-heap of timer deadlines, keyed by caller-assigned timer id.
+// Timers with equal deadlines expire in the order they were added.
+class hx_zmq_timers {
+public:
+	hx_zmq_timers () : seq (0) {}
+	
+	// Adds (or reschedules) timer id to expire at when (msecs)
+	void add (int id, double when);
+	// Removes timer id. Returns false if it was not scheduled
+	bool cancel (int id);
+	// Returns true and sets when to the earliest deadline, if any timer is scheduled
+	bool next (double *when) const;
+	// Removes the earliest timer if it expires at or before now, returning its id and deadline
+	bool pop_expired (double now, int *id, double *when);
+	size_t size () const { return heap.size (); }
+	
+private:
+	struct entry {
+		double when;
+		unsigned int seq;
+		int id;
+	};
+	
+	bool before (const entry &a, const entry &b) const {
+		return a.when < b.when || (a.when == b.when && a.seq < b.seq);
+	}
+	void place (size_t pos, const entry &e);
+	void sift_up (size_t pos);
+	void sift_down (size_t pos);
+	void remove_at (size_t pos);
+	
+	std::vector<entry> heap;
+	std::map<int, size_t> positions;
+	unsigned int seq;
+};
+
+// Returns the current time, in milliseconds on a monotonic clock with an arbitrary origin,
+// as used for timer deadlines
+double hx_zmq_clock_ms ();
+
+#endif